@@ -0,0 +1,59 @@
+#include <libfilezilla/binary_log.hpp>
+#include <libfilezilla/format.hpp>
+
+#include <iostream>
+
+namespace {
+std::string type_name(fz::logmsg::type t)
+{
+	switch (t) {
+	case fz::logmsg::status:
+		return "status";
+	case fz::logmsg::error:
+		return "error";
+	case fz::logmsg::command:
+		return "command";
+	case fz::logmsg::reply:
+		return "reply";
+	case fz::logmsg::debug_warning:
+		return "warning";
+	case fz::logmsg::debug_info:
+		return "info";
+	case fz::logmsg::debug_verbose:
+		return "verbose";
+	case fz::logmsg::debug_debug:
+		return "debug";
+	default:
+		return fz::sprintf("0x%x", static_cast<uint64_t>(t));
+	}
+}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2 || !argv[1] || !*argv[1]) {
+		std::cerr << "Usage: " << (argc ? argv[0] : "decode_log") << " <file>" << std::endl;
+		return 1;
+	}
+
+	fz::binary_log_reader reader(fz::to_native(std::string(argv[1])));
+	if (!reader.opened()) {
+		std::cerr << "Cannot open " << argv[1] << " or it is not a binary log file" << std::endl;
+		return 1;
+	}
+
+	fz::timestamp_formatter formatter;
+	fz::logmsg::type t;
+	fz::datetime time;
+	std::wstring msg;
+	while (reader.read(t, time, msg)) {
+		std::cout << formatter.iso8601(time, fz::datetime::utc) << ' ' << type_name(t) << ' ' << fz::to_utf8(msg) << '\n';
+	}
+
+	if (reader.error()) {
+		std::cerr << "Malformed data in " << argv[1] << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
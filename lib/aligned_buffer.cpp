@@ -0,0 +1,81 @@
+#include "libfilezilla/aligned_buffer.hpp"
+
+#include <new>
+#include <utility>
+
+#include <stdlib.h>
+#ifdef FZ_WINDOWS
+#include <malloc.h>
+#endif
+
+namespace fz {
+
+aligned_buffer::aligned_buffer(size_t capacity, size_t alignment)
+{
+	if (alignment < sizeof(void*)) {
+		alignment = sizeof(void*);
+	}
+	if (alignment & (alignment - 1)) {
+		throw std::bad_alloc();
+	}
+	if (!capacity) {
+		return;
+	}
+	if (capacity > static_cast<size_t>(-1) - alignment) {
+		throw std::bad_alloc();
+	}
+	capacity = (capacity + alignment - 1) & ~(alignment - 1);
+
+#ifdef FZ_WINDOWS
+	void* p = _aligned_malloc(capacity, alignment);
+#else
+	void* p{};
+	if (posix_memalign(&p, alignment, capacity) != 0) {
+		p = nullptr;
+	}
+#endif
+	if (!p) {
+		throw std::bad_alloc();
+	}
+
+	data_ = static_cast<unsigned char*>(p);
+	capacity_ = capacity;
+	alignment_ = alignment;
+}
+
+aligned_buffer::~aligned_buffer()
+{
+	reset();
+}
+
+aligned_buffer::aligned_buffer(aligned_buffer && op) noexcept
+{
+	*this = std::move(op);
+}
+
+aligned_buffer& aligned_buffer::operator=(aligned_buffer && op) noexcept
+{
+	if (this != &op) {
+		reset();
+		std::swap(data_, op.data_);
+		std::swap(capacity_, op.capacity_);
+		std::swap(alignment_, op.alignment_);
+	}
+	return *this;
+}
+
+void aligned_buffer::reset()
+{
+	if (data_) {
+#ifdef FZ_WINDOWS
+		_aligned_free(data_);
+#else
+		free(data_);
+#endif
+		data_ = nullptr;
+	}
+	capacity_ = 0;
+	alignment_ = 0;
+}
+
+}
@@ -0,0 +1,822 @@
+#include "libfilezilla/async_file.hpp"
+#include "libfilezilla/event_loop.hpp"
+
+#include <algorithm>
+
+#ifdef FZ_WINDOWS
+#include "libfilezilla/glue/windows.hpp"
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#if defined(FZ_UNIX) && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// IORING_OP_READ, IORING_OP_WRITE and opcode probing need Linux 5.6 headers
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define FZ_IO_URING 1
+#include <string.h>
+#endif
+#endif
+
+namespace fz {
+
+struct async_file::request final
+{
+	enum class op {
+		read,
+		write,
+		sync
+	};
+
+	op op_{};
+	int64_t offset_{};
+
+	buffer buf_;
+	unsigned char* data_{};
+
+	// Octets to transfer and octets transferred so far
+	size_t size_{};
+	size_t done_{};
+
+	int error_{};
+	bool completed_{};
+
+	// Read-ahead that became useless due to seeking
+	bool discard_{};
+};
+
+namespace {
+size_t const max_workers = 8;
+
+// Does one transfer of the remaining part of the request, returns the number of
+// octets transferred or -1 on error.
+int64_t transfer(file & f, async_file::request & r, int & error)
+{
+	int64_t const remaining = static_cast<int64_t>(std::min(r.size_ - r.done_, size_t(1) << 30));
+	int64_t const offset = r.offset_ + static_cast<int64_t>(r.done_);
+	unsigned char* const p = r.data_ + r.done_;
+
+	int64_t res;
+	if (r.op_ == async_file::request::op::read) {
+		res = f.read_at(offset, p, remaining);
+	}
+	else {
+		res = f.write_at(offset, p, remaining);
+	}
+	if (res < 0) {
+#ifdef FZ_WINDOWS
+		error = static_cast<int>(GetLastError());
+#else
+		error = errno;
+#endif
+	}
+	return res;
+}
+
+int do_sync(file::file_t fd)
+{
+#ifdef FZ_WINDOWS
+	return FlushFileBuffers(fd) ? 0 : static_cast<int>(GetLastError());
+#elif defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+	return fdatasync(fd) ? errno : 0;
+#else
+	return ::fsync(fd) ? errno : 0;
+#endif
+}
+
+// Accounts for the outcome of a transfer, returns true if the request is finished.
+bool update(async_file::request & r, int64_t transferred, int error)
+{
+	if (transferred < 0) {
+		r.error_ = error;
+		return true;
+	}
+	if (r.op_ == async_file::request::op::sync) {
+		return true;
+	}
+
+	r.done_ += static_cast<size_t>(transferred);
+	if (r.done_ >= r.size_) {
+		return true;
+	}
+	if (!transferred) {
+		if (r.op_ == async_file::request::op::write) {
+#ifdef FZ_WINDOWS
+			r.error_ = ERROR_WRITE_FAULT;
+#else
+			r.error_ = EIO;
+#endif
+		}
+		// Short read: End of file
+		return true;
+	}
+	return false;
+}
+}
+
+class async_file::engine
+{
+public:
+	virtual ~engine() = default;
+
+	// Must be called locked
+	virtual void submit(request & r, scoped_lock & l) = 0;
+
+	// Must be called locked once there are no more pending requests
+	virtual void stop(scoped_lock & l) = 0;
+
+	bool uring_{};
+};
+
+/*
+ * Executes the requests in up to max_workers threads taken from the thread pool.
+ * The workers share the mutex of the async_file.
+ */
+class async_file::pool_engine final : public async_file::engine
+{
+public:
+	explicit pool_engine(async_file & owner)
+		: owner_(owner)
+		, max_workers_(std::min(owner.opts_.queue_depth, max_workers))
+	{}
+
+	virtual void submit(request & r, scoped_lock & l) override
+	{
+		queue_.push_back(&r);
+		if (!idle_ && workers_.size() < max_workers_) {
+			async_task task = owner_.pool_.spawn([this]() { entry(); });
+			if (task) {
+				workers_.emplace_back(std::move(task));
+				return;
+			}
+			if (workers_.empty()) {
+				queue_.pop_back();
+#ifdef FZ_WINDOWS
+				r.error_ = ERROR_NOT_ENOUGH_MEMORY;
+#else
+				r.error_ = EAGAIN;
+#endif
+				owner_.complete(r, l);
+				return;
+			}
+		}
+		cond_.signal(l);
+	}
+
+	virtual void stop(scoped_lock & l) override
+	{
+		quit_ = true;
+		cond_.signal(l);
+
+		l.unlock();
+		workers_.clear();
+		l.lock();
+	}
+
+private:
+	void entry()
+	{
+		scoped_lock l(owner_.mtx_);
+		while (!quit_) {
+			if (queue_.empty()) {
+				++idle_;
+				cond_.wait(l);
+				--idle_;
+				continue;
+			}
+
+			request & r = *queue_.front();
+			queue_.pop_front();
+			if (!queue_.empty()) {
+				// Let another idle worker pick up the next request
+				cond_.signal(l);
+			}
+
+			l.unlock();
+			if (r.op_ == request::op::sync) {
+				r.error_ = do_sync(owner_.file_.fd());
+			}
+			else {
+				int error{};
+				while (!update(r, transfer(owner_.file_, r, error), error)) {
+				}
+			}
+			l.lock();
+
+			owner_.complete(r, l);
+		}
+
+		// Wake up the next worker so that it can quit as well
+		cond_.signal(l);
+	}
+
+	async_file & owner_;
+	size_t const max_workers_;
+
+	std::deque<request*> queue_;
+	std::vector<async_task> workers_;
+	condition cond_;
+	size_t idle_{};
+	bool quit_{};
+};
+
+#if FZ_IO_URING
+/*
+ * Submits requests to an io_uring instance. A single reaper thread waits for
+ * completions. Both submission and completion are done holding the mutex of
+ * the async_file, so the rings have only a single producer and consumer each.
+ *
+ * The reaper is stopped by signalling an eventfd, which is polled through a
+ * request submitted right away by init().
+ */
+class async_file::uring_engine final : public async_file::engine
+{
+public:
+	explicit uring_engine(async_file & owner)
+		: owner_(owner)
+	{
+		uring_ = true;
+	}
+
+	virtual ~uring_engine()
+	{
+		if (sqes_) {
+			munmap(sqes_, sqes_size_);
+		}
+		if (cq_ring_ && cq_ring_ != sq_ring_) {
+			munmap(cq_ring_, cq_ring_size_);
+		}
+		if (sq_ring_) {
+			munmap(sq_ring_, sq_ring_size_);
+		}
+		if (fd_ != -1) {
+			::close(fd_);
+		}
+		if (quit_fd_ != -1) {
+			::close(quit_fd_);
+		}
+	}
+
+	bool init()
+	{
+		// One additional entry for the poll request waking up the reaper
+		unsigned const entries = static_cast<unsigned>(owner_.opts_.queue_depth + 1);
+
+		io_uring_params p{};
+		fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+		if (fd_ == -1) {
+			return false;
+		}
+
+		if (!supported(IORING_OP_READ) || !supported(IORING_OP_WRITE) || !supported(IORING_OP_FSYNC) || !supported(IORING_OP_POLL_ADD)) {
+			return false;
+		}
+
+		sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		bool const single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single) {
+			sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+		}
+
+		sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+		if (!sq_ring_) {
+			return false;
+		}
+		if (single) {
+			cq_ring_ = sq_ring_;
+		}
+		else {
+			cq_ring_ = map(cq_ring_size_, IORING_OFF_CQ_RING);
+			if (!cq_ring_) {
+				return false;
+			}
+		}
+		sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+		sqes_ = reinterpret_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+		if (!sqes_) {
+			return false;
+		}
+
+		sq_tail_ = reinterpret_cast<unsigned*>(sq_ring_ + p.sq_off.tail);
+		sq_mask_ = *reinterpret_cast<unsigned*>(sq_ring_ + p.sq_off.ring_mask);
+		sq_array_ = reinterpret_cast<unsigned*>(sq_ring_ + p.sq_off.array);
+
+		cq_head_ = reinterpret_cast<unsigned*>(cq_ring_ + p.cq_off.head);
+		cq_tail_ = reinterpret_cast<unsigned*>(cq_ring_ + p.cq_off.tail);
+		cq_mask_ = *reinterpret_cast<unsigned*>(cq_ring_ + p.cq_off.ring_mask);
+		cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring_ + p.cq_off.cqes);
+
+		quit_fd_ = eventfd(0, EFD_CLOEXEC);
+		if (quit_fd_ == -1) {
+			return false;
+		}
+
+		// A completion without user data tells the reaper to quit
+		io_uring_sqe & sqe = next_sqe();
+		sqe.opcode = IORING_OP_POLL_ADD;
+		sqe.fd = quit_fd_;
+		sqe.poll_events = POLLIN;
+		if (submit_sqe()) {
+			return false;
+		}
+
+		reaper_ = owner_.pool_.spawn([this]() { entry(); });
+		return reaper_.operator bool();
+	}
+
+	virtual void submit(request & r, scoped_lock & l) override
+	{
+		io_uring_sqe & sqe = next_sqe();
+		sqe.fd = owner_.file_.fd();
+		sqe.user_data = reinterpret_cast<uintptr_t>(&r);
+		if (r.op_ == request::op::sync) {
+			sqe.opcode = IORING_OP_FSYNC;
+			sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+		}
+		else {
+			sqe.opcode = (r.op_ == request::op::read) ? IORING_OP_READ : IORING_OP_WRITE;
+			sqe.off = static_cast<uint64_t>(r.offset_) + r.done_;
+			sqe.addr = reinterpret_cast<uintptr_t>(r.data_ + r.done_);
+			sqe.len = static_cast<unsigned>(std::min(r.size_ - r.done_, size_t(1) << 30));
+		}
+		int const error = submit_sqe();
+		if (error) {
+			// Not submitted, there will be no completion for it
+			r.error_ = error;
+			owner_.complete(r, l);
+		}
+	}
+
+	virtual void stop(scoped_lock & l) override
+	{
+		if (reaper_) {
+			// Completes the poll request submitted by init()
+			uint64_t const v = 1;
+			while (::write(quit_fd_, &v, sizeof(v)) == -1 && errno == EINTR) {
+			}
+
+			l.unlock();
+			reaper_.join();
+			l.lock();
+		}
+	}
+
+private:
+	unsigned char* map(size_t size, off_t offset)
+	{
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+		return (p == MAP_FAILED) ? nullptr : static_cast<unsigned char*>(p);
+	}
+
+	bool supported(unsigned op)
+	{
+		size_t const ops = 256;
+		std::vector<unsigned char> mem(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op));
+		auto* probe = reinterpret_cast<io_uring_probe*>(mem.data());
+		if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, ops) < 0) {
+			return false;
+		}
+		return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	// The number of requests in flight is bounded by the queue depth, so the
+	// submission queue cannot be full.
+	io_uring_sqe & next_sqe()
+	{
+		unsigned const tail = *sq_tail_;
+		unsigned const index = tail & sq_mask_;
+		io_uring_sqe & sqe = sqes_[index];
+		memset(&sqe, 0, sizeof(sqe));
+		sq_array_[index] = index;
+		__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+		return sqe;
+	}
+
+	// Submits the entry obtained from next_sqe(), returns an error code on failure.
+	// A failed entry is taken back, so it does not get submitted along with the next one.
+	int submit_sqe()
+	{
+		int const res = enter(1, 0, 0);
+		if (res == 1) {
+			return 0;
+		}
+		int const error = (res == -1) ? errno : EAGAIN;
+		__atomic_store_n(sq_tail_, *sq_tail_ - 1, __ATOMIC_RELEASE);
+		return error;
+	}
+
+	// EAGAIN and EBUSY are only retried a few times. Submission happens holding
+	// the mutex the reaper needs to empty the completion queue, waiting for
+	// it to drain could never succeed.
+	int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+	{
+		int res;
+		int busy{};
+		do {
+			res = static_cast<int>(syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0));
+		} while (res == -1 && (errno == EINTR || ((errno == EAGAIN || errno == EBUSY) && ++busy < 3)));
+		return res;
+	}
+
+	void entry()
+	{
+		bool quit{};
+		while (!quit) {
+			enter(0, 1, IORING_ENTER_GETEVENTS);
+
+			scoped_lock l(owner_.mtx_);
+			unsigned head = *cq_head_;
+			unsigned const tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+			for (; head != tail; ++head) {
+				io_uring_cqe const& cqe = cqes_[head & cq_mask_];
+				auto* r = reinterpret_cast<request*>(static_cast<uintptr_t>(cqe.user_data));
+				int const res = cqe.res;
+				__atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+
+				if (!r) {
+					quit = true;
+				}
+				else if (update(*r, res < 0 ? -1 : res, -res)) {
+					owner_.complete(*r, l);
+				}
+				else {
+					submit(*r, l);
+				}
+			}
+		}
+	}
+
+	async_file & owner_;
+
+	int fd_{-1};
+
+	unsigned char* sq_ring_{};
+	unsigned char* cq_ring_{};
+	io_uring_sqe* sqes_{};
+	size_t sq_ring_size_{};
+	size_t cq_ring_size_{};
+	size_t sqes_size_{};
+
+	unsigned* sq_tail_{};
+	unsigned* sq_array_{};
+	unsigned sq_mask_{};
+
+	unsigned* cq_head_{};
+	unsigned* cq_tail_{};
+	unsigned cq_mask_{};
+	io_uring_cqe* cqes_{};
+
+	int quit_fd_{-1};
+	async_task reaper_;
+};
+#endif
+
+namespace {
+async_file::options sanitize(async_file::options opts)
+{
+	opts.queue_depth = std::clamp(opts.queue_depth, size_t(1), size_t(256));
+	opts.block_size = std::clamp(opts.block_size, size_t(1), size_t(64) * 1024 * 1024);
+	return opts;
+}
+}
+
+async_file::async_file(thread_pool & pool, event_handler & handler)
+	: async_file(pool, handler, options())
+{
+}
+
+async_file::async_file(thread_pool & pool, event_handler & handler, options const& opts)
+	: pool_(pool)
+	, handler_(handler)
+	, opts_(sanitize(opts))
+{
+}
+
+async_file::~async_file()
+{
+	close();
+}
+
+result async_file::open(native_string const& name, file::mode m, file::creation_flags d)
+{
+	close();
+
+	result const res = file_.open(name, m, d);
+	if (!res) {
+		return res;
+	}
+	mode_ = m;
+
+	scoped_lock l(mtx_);
+#if FZ_IO_URING
+	if (opts_.use_io_uring) {
+		auto e = std::make_unique<uring_engine>(*this);
+		if (e->init()) {
+			engine_ = std::move(e);
+		}
+	}
+#endif
+	if (!engine_) {
+		engine_ = std::make_unique<pool_engine>(*this);
+	}
+
+	return res;
+}
+
+void async_file::close()
+{
+	scoped_lock l(mtx_);
+	if (engine_) {
+		while (pending_) {
+			idle_waiting_ = true;
+			idle_cond_.wait(l);
+		}
+		engine_->stop(l);
+		engine_.reset();
+	}
+
+	requests_.clear();
+	stage_.clear();
+	offset_ = 0;
+	error_ = 0;
+	eof_ = false;
+	synced_ = false;
+	waiting_ = false;
+	flushing_ = false;
+	l.unlock();
+
+	auto filter = [&](event_loop::Events::value_type const& ev) -> bool {
+		if (ev.first != &handler_) {
+			return false;
+		}
+		else if (ev.second->derived_type() != async_file_event::type()) {
+			return false;
+		}
+		return std::get<0>(static_cast<async_file_event const&>(*ev.second).v_) == this;
+	};
+	handler_.event_loop_.filter_events(filter);
+
+	file_.close();
+}
+
+bool async_file::uses_io_uring() const
+{
+	scoped_lock l(mtx_);
+	return engine_ && engine_->uring_;
+}
+
+int async_file::error() const
+{
+	scoped_lock l(mtx_);
+	return error_;
+}
+
+bool async_file::seek(int64_t offset)
+{
+	if (!opened() || offset < 0) {
+		return false;
+	}
+
+	scoped_lock l(mtx_);
+	if (mode_ == file::reading) {
+		requests_.erase(std::remove_if(requests_.begin(), requests_.end(), [](std::unique_ptr<request> const& r) { return r->completed_; }), requests_.end());
+		for (auto & r : requests_) {
+			r->discard_ = true;
+		}
+		eof_ = false;
+	}
+	else if (!stage_.empty()) {
+		// May exceed the queue depth by one
+		submit_stage(l);
+	}
+	offset_ = offset;
+
+	return true;
+}
+
+async_file::status async_file::read(buffer & out)
+{
+	if (!opened() || mode_ != file::reading) {
+		return status::error;
+	}
+
+	scoped_lock l(mtx_);
+	if (error_) {
+		return status::error;
+	}
+
+	requests_.erase(std::remove_if(requests_.begin(), requests_.end(), [](std::unique_ptr<request> const& r) { return r->discard_ && r->completed_; }), requests_.end());
+	fill_read_ahead(l);
+
+	auto it = std::find_if(requests_.begin(), requests_.end(), [](std::unique_ptr<request> const& r) { return !r->discard_; });
+	if (it == requests_.end()) {
+		if (eof_) {
+			return status::eof;
+		}
+		// Discarded requests are occupying the queue
+		waiting_ = true;
+		return status::wait;
+	}
+	if (!(*it)->completed_) {
+		waiting_ = true;
+		return status::wait;
+	}
+
+	std::unique_ptr<request> r = std::move(*it);
+	requests_.erase(it);
+
+	if (r->error_) {
+		error_ = r->error_;
+		return status::error;
+	}
+
+	if (r->done_ < r->size_) {
+		// Short read, subsequent blocks are past the end of the file
+		eof_ = true;
+		for (auto & other : requests_) {
+			other->discard_ = true;
+		}
+	}
+	if (!r->done_) {
+		return status::eof;
+	}
+
+	if (out.empty()) {
+		std::swap(out, r->buf_);
+	}
+	else {
+		out.append(r->buf_);
+	}
+
+	fill_read_ahead(l);
+
+	return status::ok;
+}
+
+void async_file::fill_read_ahead(scoped_lock & l)
+{
+	while (!eof_ && requests_.size() < opts_.queue_depth) {
+		auto r = std::make_unique<request>();
+		r->op_ = request::op::read;
+		r->offset_ = offset_;
+		r->size_ = opts_.block_size;
+		r->data_ = r->buf_.get(r->size_);
+		offset_ += static_cast<int64_t>(r->size_);
+		submit(std::move(r), l);
+	}
+}
+
+async_file::status async_file::write(buffer & data)
+{
+	if (!opened() || mode_ != file::writing) {
+		return status::error;
+	}
+
+	scoped_lock l(mtx_);
+	if (error_) {
+		return status::error;
+	}
+
+	if (!data.empty()) {
+		synced_ = false;
+	}
+	while (!data.empty()) {
+		if (stage_.size() >= opts_.block_size) {
+			if (pending_ >= opts_.queue_depth) {
+				waiting_ = true;
+				flushing_ = false;
+				return status::wait;
+			}
+			submit_stage(l);
+		}
+
+		if (stage_.empty() && data.size() <= opts_.block_size) {
+			// Avoid copying
+			std::swap(stage_, data);
+		}
+		else {
+			size_t const n = std::min(opts_.block_size - stage_.size(), data.size());
+			stage_.append(data.get(), n);
+			data.consume(n);
+		}
+	}
+
+	if (stage_.size() >= opts_.block_size && pending_ < opts_.queue_depth) {
+		submit_stage(l);
+	}
+
+	return status::ok;
+}
+
+async_file::status async_file::finalize(bool sync)
+{
+	if (!opened() || mode_ != file::writing) {
+		return status::error;
+	}
+
+	scoped_lock l(mtx_);
+	if (error_) {
+		return status::error;
+	}
+
+	if (!stage_.empty()) {
+		if (pending_ >= opts_.queue_depth) {
+			waiting_ = true;
+			flushing_ = false;
+			return status::wait;
+		}
+		submit_stage(l);
+	}
+
+	if (!pending_ && sync && !synced_) {
+		auto r = std::make_unique<request>();
+		r->op_ = request::op::sync;
+		submit(std::move(r), l);
+	}
+
+	if (pending_) {
+		waiting_ = true;
+		flushing_ = true;
+		return status::wait;
+	}
+
+	return error_ ? status::error : status::ok;
+}
+
+void async_file::submit_stage(scoped_lock & l)
+{
+	auto r = std::make_unique<request>();
+	r->op_ = request::op::write;
+	r->offset_ = offset_;
+	std::swap(r->buf_, stage_);
+	r->data_ = r->buf_.get();
+	r->size_ = r->buf_.size();
+	offset_ += static_cast<int64_t>(r->size_);
+	submit(std::move(r), l);
+}
+
+void async_file::submit(std::unique_ptr<request> && r, scoped_lock & l)
+{
+	request & ref = *r;
+	requests_.push_back(std::move(r));
+	++pending_;
+	engine_->submit(ref, l);
+}
+
+void async_file::complete(request & r, scoped_lock & l)
+{
+	r.completed_ = true;
+	--pending_;
+
+	if (r.op_ == request::op::read) {
+		r.buf_.add(r.done_);
+	}
+	else {
+		if (r.error_) {
+			if (!error_) {
+				error_ = r.error_;
+			}
+		}
+		else if (r.op_ == request::op::sync) {
+			synced_ = true;
+		}
+		requests_.erase(std::find_if(requests_.begin(), requests_.end(), [&r](std::unique_ptr<request> const& v) { return v.get() == &r; }));
+	}
+
+	if (waiting_ && ready()) {
+		waiting_ = false;
+		handler_.send_event<async_file_event>(this);
+	}
+
+	if (!pending_ && idle_waiting_) {
+		idle_waiting_ = false;
+		idle_cond_.signal(l);
+	}
+}
+
+bool async_file::ready() const
+{
+	if (mode_ == file::reading) {
+		bool stale_pending{};
+		for (auto const& r : requests_) {
+			if (!r->discard_) {
+				return r->completed_;
+			}
+			stale_pending |= !r->completed_;
+		}
+		return !stale_pending;
+	}
+
+	if (error_) {
+		return true;
+	}
+	return flushing_ ? !pending_ : pending_ < opts_.queue_depth;
+}
+
+}
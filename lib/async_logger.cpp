@@ -0,0 +1,401 @@
+#include "libfilezilla/async_logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+/*
+  Each logging thread owns one single-producer/single-consumer ring buffer per
+  logger. The thread keeps a reference to its queues in thread-local storage,
+  so pushing a message is lock-free. The writer thread is only woken up through
+  the mutex if it is idle.
+*/
+namespace fz {
+
+namespace {
+std::atomic<uint64_t> next_logger_id{1};
+
+// How long the writer waits for further messages after having written some
+auto const batch_delay = duration::from_milliseconds(10);
+
+size_t round_up_to_power_of_two(size_t v)
+{
+	size_t ret = 1;
+	while (ret < v) {
+		ret <<= 1;
+	}
+	return ret;
+}
+
+// The queues of the current thread, by logger id
+thread_local std::vector<std::pair<uint64_t, std::shared_ptr<async_logger::queue>>> local_queues;
+}
+
+struct async_logger::entry final
+{
+	logmsg::type type_{};
+	datetime time_;
+	std::wstring msg_;
+
+	// If set, msg_ is empty and the message gets formatted by the sink
+	deferred_message deferred_;
+};
+
+class async_logger::queue final
+{
+public:
+	explicit queue(size_t capacity)
+		: slots_(round_up_to_power_of_two(std::max(capacity, size_t(2))))
+		, mask_(slots_.size() - 1)
+	{}
+
+	// Only called by the producer. Does not touch e if the queue is full.
+	// Returns the number of queued entries, or 0 if the queue is full.
+	size_t push(entry && e)
+	{
+		size_t const tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_cache_ >= slots_.size()) {
+			head_cache_ = head_.load(std::memory_order_acquire);
+			if (tail - head_cache_ >= slots_.size()) {
+				return 0;
+			}
+		}
+		slots_[tail & mask_] = std::move(e);
+		tail_.store(tail + 1, std::memory_order_release);
+		return tail + 1 - head_cache_;
+	}
+
+	// Only called by the producer with the result of a successful push. Returns true
+	// once the queue has become at least half full, and again only after it has been
+	// found less than half full in between.
+	bool filling_up(size_t queued)
+	{
+		size_t const half = slots_.size() / 2;
+		if (queued >= half) {
+			// Based on a stale head, the actual number may be smaller
+			head_cache_ = head_.load(std::memory_order_acquire);
+			queued = tail_.load(std::memory_order_relaxed) - head_cache_;
+		}
+		if (queued < half) {
+			signalled_ = false;
+			return false;
+		}
+		if (signalled_) {
+			return false;
+		}
+		signalled_ = true;
+		return true;
+	}
+
+	// Only called by the consumer
+	size_t drain(std::vector<entry> & out)
+	{
+		size_t head = head_.load(std::memory_order_relaxed);
+		size_t const tail = tail_.load(std::memory_order_acquire);
+		size_t const n = tail - head;
+		for (; head != tail; ++head) {
+			out.emplace_back(std::move(slots_[head & mask_]));
+		}
+		head_.store(tail, std::memory_order_release);
+		return n;
+	}
+
+	bool empty() const
+	{
+		return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+	}
+
+	std::atomic<uint64_t> dropped_{};
+
+	// Protected by the logger's mutex
+	uint64_t reported_dropped_{};
+	bool waiting_{};
+	condition space_;
+
+	// Set once the logger is gone
+	std::atomic<bool> closed_{};
+
+private:
+	std::vector<entry> slots_;
+	size_t const mask_;
+
+	alignas(64) std::atomic<size_t> head_{};
+	alignas(64) std::atomic<size_t> tail_{};
+	size_t head_cache_{};
+	bool signalled_{};
+};
+
+async_logger::async_logger(log_sink & sink)
+	: async_logger(sink, options())
+{
+}
+
+async_logger::async_logger(log_sink & sink, options const& opts)
+	: sink_(sink)
+	, options_(opts)
+	, id_(next_logger_id++)
+{
+	defer_formatting_ = opts.defer_formatting;
+	thread_.run([this] { run(); });
+}
+
+async_logger::~async_logger()
+{
+	{
+		scoped_lock l(mtx_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	thread_.join();
+
+	scoped_lock l(mtx_);
+	for (auto & q : queues_) {
+		q->closed_ = true;
+	}
+}
+
+async_logger::queue& async_logger::local_queue()
+{
+	for (auto const& q : local_queues) {
+		if (q.first == id_) {
+			return *q.second;
+		}
+	}
+
+	// Forget about queues of loggers that no longer exist
+	local_queues.erase(std::remove_if(local_queues.begin(), local_queues.end(), [](auto const& q) { return q.second->closed_.load(); }), local_queues.end());
+
+	auto q = std::make_shared<queue>(options_.queue_capacity);
+	{
+		scoped_lock l(mtx_);
+		queues_.push_back(q);
+	}
+	local_queues.emplace_back(id_, q);
+	return *q;
+}
+
+void async_logger::wakeup_writer(bool force)
+{
+	// Pairs with the fence in the writer thread between setting idle_ and checking the queues
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (idle_.load(std::memory_order_relaxed)) {
+		force |= idle_.exchange(false);
+	}
+	if (force) {
+		scoped_lock l(mtx_);
+		cond_.signal(l);
+	}
+}
+
+void async_logger::do_log(logmsg::type t, std::wstring && msg)
+{
+	push(entry{t, datetime::now(), std::move(msg), deferred_message()});
+}
+
+void async_logger::do_log_deferred(logmsg::type t, deferred_message && msg)
+{
+	push(entry{t, datetime::now(), std::wstring(), std::move(msg)});
+}
+
+void async_logger::push(entry && e)
+{
+	auto & q = local_queue();
+
+	size_t queued{};
+	while (!(queued = q.push(std::move(e)))) {
+		if (options_.overflow == overflow_policy::drop) {
+			++q.dropped_;
+			return;
+		}
+
+		scoped_lock l(mtx_);
+		q.waiting_ = true;
+		cond_.signal(l);
+		// The timeout guards against the writer having drained the queue before waiting_ was set.
+		q.space_.wait(l, duration::from_milliseconds(50));
+		q.waiting_ = false;
+	}
+
+	// While the writer is busy, only wake it up early if the queue is filling up
+	wakeup_writer(q.filling_up(queued));
+}
+
+void async_logger::flush()
+{
+	scoped_lock l(mtx_);
+	uint64_t const target = ++flush_requested_;
+	cond_.signal(l);
+	while (flushed_ < target && !quit_) {
+		flushed_cond_.wait(l, duration::from_milliseconds(50));
+	}
+}
+
+uint64_t async_logger::dropped() const
+{
+	scoped_lock l(mtx_);
+	uint64_t ret = dropped_;
+	for (auto const& q : queues_) {
+		ret += q->dropped_;
+	}
+	return ret;
+}
+
+void async_logger::run()
+{
+	std::vector<std::shared_ptr<queue>> queues;
+	std::vector<entry> batch;
+
+	bool dirty{};
+	// Flushing does not need to be precise
+	auto const clock = monotonic_clock::source::coarse;
+	auto last_flush = monotonic_clock::now(clock);
+
+	scoped_lock l(mtx_);
+	while (true) {
+		queues = queues_;
+		uint64_t const flush_requested = flush_requested_;
+		bool const flush_pending = flush_requested > flushed_;
+		bool const quit = quit_;
+		l.unlock();
+
+		uint64_t dropped{};
+		for (auto & q : queues) {
+			q->drain(batch);
+		}
+
+		l.lock();
+		for (auto & q : queues) {
+			uint64_t const d = q->dropped_;
+			dropped += d - q->reported_dropped_;
+			q->reported_dropped_ = d;
+			if (q->waiting_) {
+				q->space_.signal(l);
+			}
+		}
+
+		// Release the snapshot, otherwise no queue would ever be referenced only by the registry.
+		queues.clear();
+
+		// Discard queues of threads that have exited and whose messages have all been written.
+		for (size_t i = 0; i < queues_.size(); ) {
+			auto & q = queues_[i];
+			if (q.use_count() == 1 && q->empty()) {
+				dropped_ += q->dropped_;
+				q = std::move(queues_.back());
+				queues_.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+		l.unlock();
+
+		bool const written = !batch.empty() || dropped;
+		if (written) {
+			// Messages of each queue are already in order, interleave the queues by time
+			std::stable_sort(batch.begin(), batch.end(), [](entry const& a, entry const& b) { return a.time_ < b.time_; });
+			for (auto const& e : batch) {
+				if (e.deferred_) {
+					sink_.write_deferred(e.type_, e.time_, e.deferred_);
+				}
+				else {
+					sink_.write(e.type_, e.time_, e.msg_);
+				}
+			}
+			batch.clear();
+
+			if (dropped) {
+				sink_.write(logmsg::debug_warning, datetime::now(), fz::sprintf(L"%d log messages have been dropped", dropped));
+			}
+			dirty = true;
+		}
+
+		auto const now = monotonic_clock::now(clock);
+		if (dirty && (quit || flush_pending || now - last_flush >= options_.flush_interval)) {
+			sink_.flush();
+			dirty = false;
+			last_flush = now;
+		}
+
+		l.lock();
+		if (flush_pending) {
+			flushed_ = flush_requested;
+			flushed_cond_.signal(l);
+		}
+		if (quit) {
+			break;
+		}
+		if (flush_requested_ > flushed_ || quit_) {
+			continue;
+		}
+
+		if (written) {
+			// Let more messages accumulate before looking again, rather than
+			// having the logging threads wake us up for every single message.
+			cond_.wait(l, batch_delay);
+			continue;
+		}
+
+		idle_ = true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool pending{};
+		for (auto const& q : queues_) {
+			if (!q->empty()) {
+				pending = true;
+				break;
+			}
+		}
+		if (!pending) {
+			if (dirty) {
+				auto const since = monotonic_clock::now(clock) - last_flush;
+				if (since < options_.flush_interval) {
+					cond_.wait(l, options_.flush_interval - since);
+				}
+			}
+			else {
+				cond_.wait(l);
+			}
+		}
+		idle_ = false;
+	}
+}
+
+file_log_sink::file_log_sink(native_string const& path, size_t batch_size)
+	: batch_size_(batch_size)
+{
+	if (file_.open(path, file::writing, file::existing)) {
+		file_.seek(0, file::end);
+	}
+}
+
+file_log_sink::~file_log_sink()
+{
+	flush();
+}
+
+void file_log_sink::write(logmsg::type, datetime const& time, std::wstring_view const& msg)
+{
+	char* p = reinterpret_cast<char*>(buffer_.get(timestamp_formatter::max_size + 1));
+	size_t const len = formatter_.iso8601(p, time, datetime::utc);
+	p[len] = ' ';
+	buffer_.add(len + 1);
+	buffer_.append(to_utf8(msg));
+	buffer_.append('\n');
+
+	if (buffer_.size() >= batch_size_) {
+		flush();
+	}
+}
+
+void file_log_sink::flush()
+{
+	while (!buffer_.empty() && file_.opened()) {
+		int64_t written = file_.write(buffer_.get(), static_cast<int64_t>(buffer_.size()));
+		if (written <= 0) {
+			break;
+		}
+		buffer_.consume(static_cast<size_t>(written));
+	}
+	buffer_.clear();
+}
+
+}
@@ -0,0 +1,529 @@
+#include "libfilezilla/binary_log.hpp"
+
+#include <cstring>
+#include <variant>
+
+/*
+  File layout: The magic string followed by a version octet, then a sequence of records.
+  Each sink appends a new such header, so a file can hold several sessions. Format ids and
+  time deltas start over after each header. Each record starts with its type octet:
+
+  - format:  varint id, octet kind (0: narrow, 1: wide as UTF-8), string
+  - message: varint zigzag time delta in ms, varint type, varint format id,
+             varint argument count, arguments
+  - text:    varint zigzag time delta in ms, varint type, string (UTF-8)
+
+  Strings are prefixed by their length as varint. Each argument starts with a tag
+  octet. For integers, the lower four bits of the tag hold the size of the original type.
+*/
+namespace fz {
+
+namespace {
+char const magic[] = "FZBINLOG";
+size_t const magic_size = sizeof(magic) - 1;
+unsigned char const version = 1;
+
+enum record_type : unsigned char {
+	format_record = 1,
+	message_record = 2,
+	text_record = 3
+};
+
+enum arg_tag : unsigned char {
+	tag_signed = 0x10,
+	tag_unsigned = 0x20,
+	tag_floating = 0x30,
+	tag_pointer = 0x31,
+	tag_string = 0x40,
+	tag_string_utf8 = 0x41,
+	tag_wstring = 0x42
+};
+
+// Limits memory usage if non-literal format strings are used
+size_t const max_copied_formats = 4096;
+
+uint64_t zigzag(int64_t v)
+{
+	return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v)
+{
+	return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+void put_varint(buffer & b, uint64_t v)
+{
+	unsigned char* p = b.get(10);
+	size_t n{};
+	while (v >= 0x80) {
+		p[n++] = static_cast<unsigned char>(v) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = static_cast<unsigned char>(v);
+	b.add(n);
+}
+
+void put_string(buffer & b, std::string_view const& s)
+{
+	put_varint(b, s.size());
+	b.append(s);
+}
+
+int64_t to_milliseconds(datetime const& t)
+{
+	return static_cast<int64_t>(t.get_time_t()) * 1000 + t.get_milliseconds();
+}
+
+datetime from_milliseconds(int64_t ms)
+{
+	datetime ret(static_cast<time_t>(ms / 1000), datetime::milliseconds);
+	ret += duration::from_milliseconds(ms % 1000);
+	return ret;
+}
+
+struct cursor final
+{
+	unsigned char const* p_;
+	unsigned char const* const end_;
+	bool ok_{true};
+
+	unsigned char octet()
+	{
+		if (p_ == end_) {
+			ok_ = false;
+			return 0;
+		}
+		return *p_++;
+	}
+
+	uint64_t varint()
+	{
+		uint64_t v{};
+		for (unsigned int shift = 0; shift < 64; shift += 7) {
+			unsigned char const c = octet();
+			v |= static_cast<uint64_t>(c & 0x7f) << shift;
+			if (!(c & 0x80)) {
+				return v;
+			}
+		}
+		ok_ = false;
+		return 0;
+	}
+
+	std::string_view string()
+	{
+		uint64_t const size = varint();
+		if (!ok_ || static_cast<uint64_t>(end_ - p_) < size) {
+			ok_ = false;
+			return {};
+		}
+		std::string_view ret(reinterpret_cast<char const*>(p_), static_cast<size_t>(size));
+		p_ += size;
+		return ret;
+	}
+};
+
+using arg_value = std::variant<int8_t, int16_t, int32_t, int64_t, uint8_t, uint16_t, uint32_t, uint64_t, double, void const*, std::wstring>;
+
+template<typename Signed, typename Unsigned>
+bool make_integral(arg_value & out, uint64_t v, bool is_signed)
+{
+	if (is_signed) {
+		out = static_cast<Signed>(unzigzag(v));
+	}
+	else {
+		out = static_cast<Unsigned>(v);
+	}
+	return true;
+}
+
+// Returns false on unknown tags. Truncation is signalled through the cursor.
+bool read_arg(cursor & c, arg_value & out)
+{
+	unsigned char const tag = c.octet();
+	if ((tag & 0xf0) == tag_signed || (tag & 0xf0) == tag_unsigned) {
+		bool const is_signed = (tag & 0xf0) == tag_signed;
+		uint64_t const v = c.varint();
+		switch (tag & 0x0f) {
+		case 1:
+			return make_integral<int8_t, uint8_t>(out, v, is_signed);
+		case 2:
+			return make_integral<int16_t, uint16_t>(out, v, is_signed);
+		case 4:
+			return make_integral<int32_t, uint32_t>(out, v, is_signed);
+		case 8:
+			return make_integral<int64_t, uint64_t>(out, v, is_signed);
+		default:
+			return !c.ok_;
+		}
+	}
+	switch (tag) {
+	case tag_floating: {
+		uint64_t bits{};
+		for (unsigned int i = 0; i < 8; ++i) {
+			bits |= static_cast<uint64_t>(c.octet()) << (i * 8);
+		}
+		double v;
+		memcpy(&v, &bits, sizeof(v));
+		out = v;
+		return true;
+	}
+	case tag_pointer:
+		out = reinterpret_cast<void const*>(static_cast<uintptr_t>(c.varint()));
+		return true;
+	case tag_string:
+		out = to_wstring(c.string());
+		return true;
+	case tag_string_utf8:
+	case tag_wstring:
+		out = to_wstring_from_utf8(c.string());
+		return true;
+	default:
+		return !c.ok_;
+	}
+}
+
+// Same as fz::sprintf, but with the argument types only known at runtime
+std::wstring render(std::wstring_view const& fmt, std::vector<arg_value> const& args)
+{
+	std::wstring ret;
+
+	size_t start = 0, pos;
+	size_t arg_n{};
+	while ((pos = fmt.find('%', start)) != std::wstring_view::npos) {
+		ret.append(fmt.substr(start, pos - start));
+
+		detail::field f = detail::parse_field(fmt, pos, arg_n);
+		if (f.type == '%') {
+			ret += '%';
+		}
+		else if (f) {
+			if (arg_n < args.size()) {
+				std::visit([&](auto const& arg) { detail::format_arg(ret, f, arg); }, args[arg_n]);
+			}
+			++arg_n;
+		}
+		start = pos;
+	}
+	ret.append(fmt.substr(start));
+
+	return ret;
+}
+}
+
+class binary_log_sink::encoder final : public deferred_visitor
+{
+public:
+	void reset()
+	{
+		args_.clear();
+		arg_count_ = 0;
+	}
+
+	virtual void format(std::string_view const& fmt, bool literal) override
+	{
+		narrow_ = fmt;
+		wide_ = std::wstring_view();
+		is_wide_ = false;
+		literal_ = literal;
+	}
+
+	virtual void format(std::wstring_view const& fmt, bool literal) override
+	{
+		narrow_ = std::string_view();
+		wide_ = fmt;
+		is_wide_ = true;
+		literal_ = literal;
+	}
+
+	virtual void signed_arg(int64_t v, size_t size) override
+	{
+		args_.append(static_cast<unsigned char>(tag_signed | size));
+		put_varint(args_, zigzag(v));
+		++arg_count_;
+	}
+
+	virtual void unsigned_arg(uint64_t v, size_t size) override
+	{
+		args_.append(static_cast<unsigned char>(tag_unsigned | size));
+		put_varint(args_, v);
+		++arg_count_;
+	}
+
+	virtual void floating_arg(double v) override
+	{
+		uint64_t bits;
+		memcpy(&bits, &v, sizeof(v));
+		args_.append(tag_floating);
+		unsigned char* p = args_.get(8);
+		for (unsigned int i = 0; i < 8; ++i) {
+			p[i] = static_cast<unsigned char>(bits >> (i * 8));
+		}
+		args_.add(8);
+		++arg_count_;
+	}
+
+	virtual void pointer_arg(void const* v) override
+	{
+		args_.append(tag_pointer);
+		put_varint(args_, reinterpret_cast<uintptr_t>(v));
+		++arg_count_;
+	}
+
+	virtual void string_arg(std::string_view const& v, bool utf8) override
+	{
+		args_.append(utf8 ? tag_string_utf8 : tag_string);
+		put_string(args_, v);
+		++arg_count_;
+	}
+
+	virtual void string_arg(std::wstring_view const& v) override
+	{
+		args_.append(tag_wstring);
+		put_string(args_, to_utf8(v));
+		++arg_count_;
+	}
+
+	buffer args_;
+	uint64_t arg_count_{};
+
+	std::string_view narrow_;
+	std::wstring_view wide_;
+	bool is_wide_{};
+	bool literal_{};
+};
+
+binary_log_sink::binary_log_sink(native_string const& path, size_t batch_size)
+	: batch_size_(batch_size)
+	, encoder_(std::make_unique<encoder>())
+{
+	if (file_.open(path, file::writing, file::existing) && file_.seek(0, file::end) >= 0) {
+		buffer_.append(std::string_view(magic, magic_size));
+		buffer_.append(version);
+	}
+}
+
+binary_log_sink::~binary_log_sink()
+{
+	flush();
+}
+
+void binary_log_sink::write_header(logmsg::type t, datetime const& time)
+{
+	int64_t const ms = to_milliseconds(time);
+	put_varint(buffer_, zigzag(ms - last_time_));
+	put_varint(buffer_, t);
+	last_time_ = ms;
+}
+
+uint64_t binary_log_sink::format_id(encoder const& e)
+{
+	if (e.literal_) {
+		// Literals are created by fzF and live as long as the program, their address identifies them.
+		// Their number is bounded by the program.
+		auto const ptr = e.is_wide_ ? static_cast<void const*>(e.wide_.data()) : static_cast<void const*>(e.narrow_.data());
+		auto const size = e.is_wide_ ? e.wide_.size() : e.narrow_.size();
+		auto const it = literal_formats_.find({ptr, size});
+		if (it != literal_formats_.end()) {
+			return it->second;
+		}
+		literal_formats_.emplace(std::make_pair(ptr, size), next_format_id_);
+	}
+	else {
+		std::string key;
+		key += e.is_wide_ ? 'w' : 'n';
+		if (e.is_wide_) {
+			key += to_utf8(e.wide_);
+		}
+		else {
+			key += e.narrow_;
+		}
+		auto const it = copied_formats_.find(key);
+		if (it != copied_formats_.end()) {
+			return it->second;
+		}
+		if (copied_formats_.size() >= max_copied_formats) {
+			return uint64_t(-1);
+		}
+		copied_formats_.emplace(key, next_format_id_);
+	}
+
+	buffer_.append(format_record);
+	put_varint(buffer_, next_format_id_);
+	buffer_.append(static_cast<unsigned char>(e.is_wide_ ? 1 : 0));
+	put_string(buffer_, e.is_wide_ ? std::string_view(to_utf8(e.wide_)) : e.narrow_);
+	return next_format_id_++;
+}
+
+void binary_log_sink::write(logmsg::type t, datetime const& time, std::wstring_view const& msg)
+{
+	buffer_.append(text_record);
+	write_header(t, time);
+	put_string(buffer_, to_utf8(msg));
+
+	if (buffer_.size() >= batch_size_) {
+		flush();
+	}
+}
+
+void binary_log_sink::write_deferred(logmsg::type t, datetime const& time, deferred_message const& msg)
+{
+	encoder_->reset();
+	if (msg.visit(*encoder_)) {
+		uint64_t const id = format_id(*encoder_);
+		if (id != uint64_t(-1)) {
+			buffer_.append(message_record);
+			write_header(t, time);
+			put_varint(buffer_, id);
+			put_varint(buffer_, encoder_->arg_count_);
+			buffer_.append(encoder_->args_);
+
+			if (buffer_.size() >= batch_size_) {
+				flush();
+			}
+			return;
+		}
+	}
+
+	write(t, time, msg.format());
+}
+
+void binary_log_sink::flush()
+{
+	while (!buffer_.empty() && file_.opened()) {
+		int64_t written = file_.write(buffer_.get(), static_cast<int64_t>(buffer_.size()));
+		if (written <= 0) {
+			break;
+		}
+		buffer_.consume(static_cast<size_t>(written));
+	}
+	buffer_.clear();
+}
+
+binary_log_reader::binary_log_reader(native_string const& path)
+{
+	if (file_.open(path, file::reading)) {
+		while (buffer_.size() < magic_size + 1 && fill()) {
+		}
+		if (buffer_.size() < magic_size + 1 || memcmp(buffer_.get(), magic, magic_size) || buffer_[magic_size] != version) {
+			error_ = true;
+		}
+		else {
+			buffer_.consume(magic_size + 1);
+		}
+	}
+}
+
+bool binary_log_reader::fill()
+{
+	if (eof_ || !file_.opened()) {
+		return false;
+	}
+
+	size_t const chunk = 64 * 1024;
+	int64_t const read = file_.read(buffer_.get(chunk), chunk);
+	if (read <= 0) {
+		eof_ = true;
+		if (read < 0) {
+			error_ = true;
+		}
+		return false;
+	}
+	buffer_.add(static_cast<size_t>(read));
+	return true;
+}
+
+bool binary_log_reader::read(logmsg::type & t, datetime & time, std::wstring & msg)
+{
+	if (error_) {
+		return false;
+	}
+
+	std::vector<arg_value> args;
+	while (true) {
+		if (buffer_.empty()) {
+			if (!fill()) {
+				return false;
+			}
+			continue;
+		}
+
+		cursor c{buffer_.get(), buffer_.get() + buffer_.size()};
+		unsigned char const type = c.octet();
+		if (type == static_cast<unsigned char>(magic[0])) {
+			// Header of a session appended to the file
+			if (buffer_.size() >= magic_size + 1) {
+				if (memcmp(buffer_.get(), magic, magic_size) || buffer_[magic_size] != version) {
+					error_ = true;
+					return false;
+				}
+				buffer_.consume(magic_size + 1);
+				formats_.clear();
+				last_time_ = 0;
+				continue;
+			}
+		}
+		else if (type == format_record) {
+			uint64_t const id = c.varint();
+			unsigned char const kind = c.octet();
+			std::string_view const fmt = c.string();
+			if (c.ok_) {
+				if (id != formats_.size() || kind > 1) {
+					error_ = true;
+					return false;
+				}
+				formats_.push_back(kind ? to_wstring_from_utf8(fmt) : to_wstring(fmt));
+				buffer_.consume(static_cast<size_t>(c.p_ - buffer_.get()));
+				continue;
+			}
+		}
+		else if (type == message_record || type == text_record) {
+			int64_t const delta = unzigzag(c.varint());
+			uint64_t const msg_type = c.varint();
+			if (type == message_record) {
+				uint64_t const id = c.varint();
+				uint64_t const count = c.varint();
+				args.clear();
+				for (uint64_t i = 0; i < count && c.ok_; ++i) {
+					args.emplace_back();
+					if (!read_arg(c, args.back())) {
+						error_ = true;
+						return false;
+					}
+				}
+				if (c.ok_) {
+					if (id >= formats_.size()) {
+						error_ = true;
+						return false;
+					}
+					msg = render(formats_[id], args);
+				}
+			}
+			else {
+				std::string_view const text = c.string();
+				if (c.ok_) {
+					msg = to_wstring_from_utf8(text);
+				}
+			}
+			if (c.ok_) {
+				last_time_ += delta;
+				time = from_milliseconds(last_time_);
+				t = static_cast<logmsg::type>(msg_type);
+				buffer_.consume(static_cast<size_t>(c.p_ - buffer_.get()));
+				return true;
+			}
+		}
+		else {
+			error_ = true;
+			return false;
+		}
+
+		// Incomplete record, a truncated record at the end of the file is treated as end of file
+		if (!fill()) {
+			return false;
+		}
+	}
+}
+
+}
@@ -0,0 +1,428 @@
+#include "libfilezilla/directory_cache.hpp"
+#include "libfilezilla/mutex.hpp"
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<sys/inotify.h>)
+#define FZ_USE_INOTIFY 1
+#include <sys/inotify.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+namespace fz {
+
+namespace {
+native_string normalize(native_string path)
+{
+	while (path.size() > 1 && local_filesys::is_separator(path.back())) {
+		path.pop_back();
+	}
+	return path;
+}
+
+#if FZ_USE_INOTIFY
+// Empty if the path has no parent
+native_string parent_path(native_string const& path)
+{
+	size_t pos = path.size();
+	while (pos && !local_filesys::is_separator(path[pos - 1])) {
+		--pos;
+	}
+	if (!pos) {
+		return native_string();
+	}
+	if (pos == 1) {
+		return path.substr(0, 1);
+	}
+	return path.substr(0, pos - 1);
+}
+#endif
+
+size_t memory_usage(native_string const& path, local_filesys::entries const& entries)
+{
+	// The path is stored twice, as key and in the cached directory
+	size_t ret = 256 + 2 * path.size() * sizeof(native_string::value_type);
+	for (size_t i = 0; i < entries.size(); ++i) {
+		ret += sizeof(local_filesys::entry) + (entries[i].name_length + 1) * sizeof(native_string::value_type);
+	}
+	return ret;
+}
+}
+
+class directory_cache::impl final
+{
+public:
+	explicit impl(options const& opts)
+		: opts_(opts)
+	{
+#if FZ_USE_INOTIFY
+		fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	~impl()
+	{
+#if FZ_USE_INOTIFY
+		if (fd_ != -1) {
+			close(fd_);
+		}
+#endif
+	}
+
+	result get(native_string const& path, listing & out);
+	void invalidate(native_string const& path);
+	void clear();
+	stats get_stats();
+
+	bool monitors_changes() const
+	{
+#if FZ_USE_INOTIFY
+		return fd_ != -1;
+#else
+		return false;
+#endif
+	}
+
+private:
+	struct cached_dir final
+	{
+		native_string path_;
+		listing listing_;
+		size_t memory_{};
+		int wd_{-1};
+		monotonic_clock time_;
+	};
+
+	// Most recently used first
+	typedef std::list<cached_dir> lru_list;
+
+	result list(native_string const& path, local_filesys::entries & out);
+	void remove(lru_list::iterator it);
+	void evict();
+
+	mutex mtx_{false};
+	options const opts_;
+	stats stats_;
+
+	lru_list lru_;
+	std::unordered_map<native_string, lru_list::iterator> by_path_;
+	size_t memory_{};
+
+#if FZ_USE_INOTIFY
+	struct watch final
+	{
+		// Incremented on every change, so that listings made while a change
+		// happened do not get cached
+		uint64_t changes_{};
+
+		// Cached directories and listings in progress using the watch
+		size_t refs_{};
+		std::vector<lru_list::iterator> dirs_;
+	};
+
+	int add_watch(native_string const& path, uint64_t & changes);
+	void release_watch(int wd);
+	void drain();
+	void changed(int wd, bool contents);
+
+	int fd_{-1};
+	std::unordered_map<int, watch> watches_;
+	alignas(inotify_event) unsigned char buffer_[16 * 1024];
+#endif
+};
+
+result directory_cache::impl::get(native_string const& path, listing & out)
+{
+	native_string const p = normalize(path);
+	if (p.empty()) {
+		return {result::invalid};
+	}
+
+	scoped_lock l(mtx_);
+#if FZ_USE_INOTIFY
+	drain();
+#endif
+
+	auto const now = monotonic_clock::now();
+	auto it = by_path_.find(p);
+	if (it != by_path_.end()) {
+		auto & d = *it->second;
+		if (d.wd_ != -1 || (now - d.time_) < opts_.max_age) {
+			lru_.splice(lru_.begin(), lru_, it->second);
+			++stats_.hits;
+			out = d.listing_;
+			return {result::ok};
+		}
+		remove(it->second);
+	}
+	++stats_.misses;
+
+	int wd = -1;
+#if FZ_USE_INOTIFY
+	// Watch before listing, so that no change can go unnoticed
+	uint64_t changes{};
+	wd = add_watch(p, changes);
+#endif
+
+	l.unlock();
+	auto entries = std::make_shared<local_filesys::entries>();
+	result const res = list(p, *entries);
+	l.lock();
+
+	bool cache = res && opts_.max_directories;
+	size_t const memory = memory_usage(p, *entries);
+	cache &= memory <= opts_.max_memory;
+#if FZ_USE_INOTIFY
+	if (wd != -1) {
+		drain();
+		cache &= watches_[wd].changes_ == changes;
+	}
+#endif
+	if (!cache) {
+#if FZ_USE_INOTIFY
+		release_watch(wd);
+#endif
+		if (res) {
+			out = std::move(entries);
+		}
+		return res;
+	}
+
+	// Another thread may have listed the same directory in the meantime
+	it = by_path_.find(p);
+	if (it != by_path_.end()) {
+		remove(it->second);
+	}
+
+	lru_.push_front(cached_dir{p, entries, memory, wd, now});
+	by_path_[p] = lru_.begin();
+	memory_ += memory;
+#if FZ_USE_INOTIFY
+	if (wd != -1) {
+		// Takes over the reference obtained by add_watch
+		watches_[wd].dirs_.push_back(lru_.begin());
+	}
+#endif
+	evict();
+
+	out = std::move(entries);
+	return res;
+}
+
+result directory_cache::impl::list(native_string const& path, local_filesys::entries & out)
+{
+	local_filesys fs;
+	result res = fs.begin_find_files(path, false, opts_.query_symlink_targets);
+	if (res) {
+		local_filesys::entries batch;
+		while (fs.get_next_files(batch)) {
+			out.append(batch);
+		}
+	}
+	return res;
+}
+
+void directory_cache::impl::invalidate(native_string const& path)
+{
+	scoped_lock l(mtx_);
+	auto const it = by_path_.find(normalize(path));
+	if (it != by_path_.end()) {
+		remove(it->second);
+		++stats_.invalidations;
+	}
+}
+
+void directory_cache::impl::clear()
+{
+	scoped_lock l(mtx_);
+	while (!lru_.empty()) {
+		remove(lru_.begin());
+	}
+}
+
+directory_cache::stats directory_cache::impl::get_stats()
+{
+	scoped_lock l(mtx_);
+#if FZ_USE_INOTIFY
+	drain();
+#endif
+	stats ret = stats_;
+	ret.directories = lru_.size();
+	ret.memory = memory_;
+	return ret;
+}
+
+void directory_cache::impl::remove(lru_list::iterator it)
+{
+	memory_ -= it->memory_;
+	by_path_.erase(it->path_);
+#if FZ_USE_INOTIFY
+	if (it->wd_ != -1) {
+		auto & dirs = watches_[it->wd_].dirs_;
+		for (auto & d : dirs) {
+			if (d == it) {
+				d = dirs.back();
+				dirs.pop_back();
+				break;
+			}
+		}
+		release_watch(it->wd_);
+	}
+#endif
+	lru_.erase(it);
+}
+
+void directory_cache::impl::evict()
+{
+	while (!lru_.empty() && (lru_.size() > opts_.max_directories || memory_ > opts_.max_memory)) {
+		remove(std::prev(lru_.end()));
+		++stats_.evictions;
+	}
+}
+
+#if FZ_USE_INOTIFY
+int directory_cache::impl::add_watch(native_string const& path, uint64_t & changes)
+{
+	if (fd_ == -1) {
+		return -1;
+	}
+
+	// IN_ATTRIB and IN_MODIFY are also reported for the entries of the directory
+	uint32_t const mask = IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+	int const wd = inotify_add_watch(fd_, path.c_str(), mask);
+	if (wd == -1) {
+		return -1;
+	}
+
+	// Different paths of the same directory share the watch
+	auto & w = watches_[wd];
+	++w.refs_;
+	changes = w.changes_;
+	return wd;
+}
+
+void directory_cache::impl::release_watch(int wd)
+{
+	if (wd == -1) {
+		return;
+	}
+	auto const it = watches_.find(wd);
+	if (it != watches_.end() && !--it->second.refs_) {
+		// Fails harmlessly if the kernel has already removed the watch
+		inotify_rm_watch(fd_, wd);
+		watches_.erase(it);
+	}
+}
+
+void directory_cache::impl::drain()
+{
+	if (fd_ == -1) {
+		return;
+	}
+
+	while (true) {
+		ssize_t const r = read(fd_, buffer_, sizeof(buffer_));
+		if (r <= 0) {
+			if (r == -1 && errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for (ssize_t pos = 0; pos < r; ) {
+			auto const& ev = *reinterpret_cast<inotify_event const*>(buffer_ + pos);
+			pos += sizeof(inotify_event) + ev.len;
+
+			if (ev.mask & IN_Q_OVERFLOW) {
+				// Events got lost, anything could have changed
+				for (auto & w : watches_) {
+					++w.second.changes_;
+				}
+				for (auto it = lru_.begin(); it != lru_.end(); ) {
+					auto const cur = it++;
+					if (cur->wd_ != -1) {
+						remove(cur);
+						++stats_.invalidations;
+					}
+				}
+				continue;
+			}
+
+			// A change to the contents of a directory changes its own modification time
+			changed(ev.wd, (ev.mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) != 0);
+		}
+	}
+}
+
+void directory_cache::impl::changed(int wd, bool contents)
+{
+	auto const w = watches_.find(wd);
+	if (w == watches_.end()) {
+		return;
+	}
+	++w->second.changes_;
+
+	// Removing the directories may release the watch
+	auto const dirs = w->second.dirs_;
+	std::vector<native_string> parents;
+	for (auto const& d : dirs) {
+		if (contents) {
+			parents.push_back(parent_path(d->path_));
+		}
+		remove(d);
+		++stats_.invalidations;
+	}
+
+	for (auto const& parent : parents) {
+		auto const it = by_path_.find(parent);
+		if (it != by_path_.end()) {
+			remove(it->second);
+			++stats_.invalidations;
+		}
+	}
+}
+#endif
+
+directory_cache::directory_cache()
+	: impl_(std::make_unique<impl>(options()))
+{
+}
+
+directory_cache::directory_cache(options const& opts)
+	: impl_(std::make_unique<impl>(opts))
+{
+}
+
+directory_cache::~directory_cache()
+{
+}
+
+result directory_cache::get(native_string const& path, listing & out)
+{
+	return impl_->get(path, out);
+}
+
+void directory_cache::invalidate(native_string const& path)
+{
+	impl_->invalidate(path);
+}
+
+void directory_cache::clear()
+{
+	impl_->clear();
+}
+
+directory_cache::stats directory_cache::get_stats() const
+{
+	return impl_->get_stats();
+}
+
+bool directory_cache::monitors_changes() const
+{
+	return impl_->monitors_changes();
+}
+
+}
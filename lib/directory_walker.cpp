@@ -0,0 +1,284 @@
+#include "libfilezilla/directory_walker.hpp"
+#include "work_stack.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#ifndef FZ_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fz {
+
+struct directory_walker::node final
+{
+	~node()
+	{
+#ifndef FZ_WINDOWS
+		if (fd_ != -1) {
+			close(fd_);
+		}
+#endif
+	}
+
+	std::shared_ptr<node const> parent_;
+	native_string name_;
+
+	// Depth of the entries of this directory
+	size_t depth_{};
+
+#ifdef FZ_WINDOWS
+	native_string path_;
+#else
+	int fd_{-1};
+	dev_t dev_{};
+	ino_t ino_{};
+#endif
+};
+
+native_string directory_walker::entry::path() const
+{
+	size_t len = name.size();
+	for (node const* n = parent_; n && n->parent_; n = n->parent_.get()) {
+		len += n->name_.size() + 1;
+	}
+
+	native_string ret(len, 0);
+	size_t pos = len - name.size();
+	ret.replace(pos, name.size(), name);
+	for (node const* n = parent_; n && n->parent_; n = n->parent_.get()) {
+		ret[--pos] = local_filesys::path_separator;
+		pos -= n->name_.size();
+		ret.replace(pos, n->name_.size(), n->name_);
+	}
+	return ret;
+}
+
+namespace {
+result make_error(int err)
+{
+#ifdef FZ_WINDOWS
+	return {result::other, static_cast<result::raw_t>(err)};
+#else
+	switch (err) {
+	case EACCES:
+	case EPERM:
+		return {result::noperm, err};
+	case ENOENT:
+	case ENOTDIR:
+		return {result::nodir, err};
+	default:
+		return {result::other, err};
+	}
+#endif
+}
+
+// A directory waiting to be enumerated
+struct pending_dir final
+{
+	std::shared_ptr<directory_walker::node const> parent_;
+	native_string name_;
+	bool via_link_{};
+};
+}
+
+class directory_walker::state final
+{
+public:
+	state(thread_pool & pool, directory_walker::options const& opts, directory_walker::callback const& filter, directory_walker::callback const& on_entry)
+		: opts_(opts)
+		, filter_(filter)
+		, on_entry_(on_entry)
+		, stack_(pool, opts.threads, [this](pending_dir & p, std::vector<pending_dir> & subdirs) { process(p, subdirs); })
+	{}
+
+	result run(native_string const& root)
+	{
+		stack_.run({nullptr, root, false});
+		return error_;
+	}
+
+private:
+	void process(pending_dir & p, std::vector<pending_dir> & subdirs)
+	{
+		result const res = enumerate(p, subdirs);
+		if (!res) {
+			scoped_lock l(callback_mtx_);
+			if (error_) {
+				error_ = res;
+			}
+		}
+
+		// Keep the order of the listing, the last subdirectory gets enumerated first otherwise.
+		// Pending directories are a stack so that only few directories need to be kept open.
+		std::reverse(subdirs.begin(), subdirs.end());
+	}
+
+	result open(pending_dir const& p, directory_walker::node & n)
+	{
+#ifdef FZ_WINDOWS
+		if (p.parent_) {
+			n.path_ = p.parent_->path_ + local_filesys::path_separator + p.name_;
+		}
+		else {
+			n.path_ = p.name_;
+		}
+		return {result::ok};
+#else
+		int fd;
+		if (p.parent_) {
+			fd = openat(p.parent_->fd_, p.name_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (p.via_link_ ? 0 : O_NOFOLLOW));
+		}
+		else {
+			fd = ::open(p.name_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		}
+		if (fd == -1) {
+			return make_error(errno);
+		}
+		n.fd_ = fd;
+
+		if (opts_.symlinks == directory_walker::symlink_policy::follow) {
+			struct stat buf;
+			if (fstat(fd, &buf) != 0) {
+				return make_error(errno);
+			}
+			n.dev_ = buf.st_dev;
+			n.ino_ = buf.st_ino;
+
+			if (p.via_link_) {
+				for (auto const* a = p.parent_.get(); a; a = a->parent_.get()) {
+					if (a->dev_ == n.dev_ && a->ino_ == n.ino_) {
+						// Loop, not an error
+						close(n.fd_);
+						n.fd_ = -1;
+						return {result::ok};
+					}
+				}
+			}
+		}
+		return {result::ok};
+#endif
+	}
+
+	result enumerate(pending_dir & p, std::vector<pending_dir> & subdirs)
+	{
+		auto n = std::make_shared<directory_walker::node>();
+		n->depth_ = p.parent_ ? p.parent_->depth_ + 1 : 0;
+
+		result res = open(p, *n);
+		if (!res) {
+			return res;
+		}
+
+		local_filesys fs;
+		bool const follow = opts_.symlinks == directory_walker::symlink_policy::follow;
+#ifdef FZ_WINDOWS
+		res = fs.begin_find_files(n->path_, false, follow);
+#else
+		if (n->fd_ == -1) {
+			return res;
+		}
+		int const fd = fcntl(n->fd_, F_DUPFD_CLOEXEC, 0);
+		if (fd == -1) {
+			return make_error(errno);
+		}
+		res = fs.begin_find_files(fd, false, follow);
+#endif
+		if (!res) {
+			return res;
+		}
+
+		n->parent_ = std::move(p.parent_);
+		n->name_ = std::move(p.name_);
+
+		bool const descend = n->depth_ < opts_.max_depth;
+
+		local_filesys::entries entries;
+		while (fs.get_next_files(entries, opts_.metadata)) {
+			scoped_lock l(callback_mtx_);
+			for (size_t i = 0; i < entries.size(); ++i) {
+				if (stack_.stopped()) {
+					return res;
+				}
+
+				auto const& in = entries[i];
+				if (in.is_link && opts_.symlinks == directory_walker::symlink_policy::skip) {
+					continue;
+				}
+
+				directory_walker::entry e;
+				e.name = entries.name(i);
+				e.depth = n->depth_;
+				e.t = in.t;
+				e.is_link = in.is_link;
+				e.size = in.size;
+				e.modification_time = in.modification_time;
+				e.mode = in.mode;
+				e.parent_ = n.get();
+
+				if (filter_ && !filter_(e)) {
+					continue;
+				}
+				if (!on_entry_(e)) {
+					stack_.stop();
+					error_ = {result::other};
+					return res;
+				}
+
+#ifdef FZ_WINDOWS
+				bool const descend_link = false;
+#else
+				bool const descend_link = follow;
+#endif
+				if (descend && e.t == local_filesys::dir && (!e.is_link || descend_link)) {
+					subdirs.push_back({n, native_string(e.name), e.is_link});
+				}
+			}
+		}
+
+		return res;
+	}
+
+	directory_walker::options const& opts_;
+	directory_walker::callback const& filter_;
+	directory_walker::callback const& on_entry_;
+
+	// Also protects error_
+	mutex callback_mtx_{false};
+	result error_{};
+
+	work_stack<pending_dir> stack_;
+};
+
+directory_walker::directory_walker(thread_pool & pool)
+	: pool_(pool)
+	, opts_()
+{
+}
+
+directory_walker::directory_walker(thread_pool & pool, options const& opts)
+	: pool_(pool)
+	, opts_(opts)
+{
+}
+
+result directory_walker::walk(native_string const& root, callback const& on_entry)
+{
+	if (root.empty() || !on_entry) {
+		return {result::invalid};
+	}
+
+	native_string path = root;
+	if (path.size() > 1 && local_filesys::is_separator(path.back())) {
+		path.pop_back();
+	}
+
+	state s(pool_, opts_, filter_, on_entry);
+	return s.run(path);
+}
+
+}
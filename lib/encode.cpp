@@ -1,56 +1,448 @@
 #include "libfilezilla/buffer.hpp"
 #include "libfilezilla/encode.hpp"
 
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define FZ_ENCODE_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define FZ_ENCODE_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace fz {
 
 namespace {
-template<typename DataContainer>
-void base64_encode_impl(std::string & out, DataContainer const& in, base64_type type, bool pad)
+char const base64_standard_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+char const base64_url_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Values 0x00-0x3f are regular characters, 0x40 is padding, 0x80 whitespace and 0xff invalid.
+// Both alphabets are accepted.
+unsigned char const base64_decode_chars[256] =
 {
-	static_assert(sizeof(typename DataContainer::value_type) == 1, "Bad container type");
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x80, 0x80, 0xff, 0x80, 0x80, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0x80, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0x3e, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0x40, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+// The SIMD kernels below work on blocks of input. Each returns the amount of input
+// it has consumed, the remainder is left to the scalar code.
+//
+// The base64 decoding kernels only accept blocks consisting entirely of alphabet characters,
+// at the first whitespace or padding character the scalar code takes over for a group.
+// They write up to 4 octets past the decoded data, callers need to reserve that much slack.
+size_t const simd_slack = 16;
+
+#if FZ_ENCODE_X86
+#define FZ_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define FZ_TARGET_AVX2 __attribute__((target("avx2")))
+
+FZ_TARGET_SSSE3 inline __m128i base64_encode_lookup_ssse3(__m128i const& indices, bool url)
+{
+	// Maps ranges 0-25, 26-51, 52-61, 62 and 63 to the offset that needs to be added to the index
+	__m128i const offsets = url
+		? _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0)
+		: _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	__m128i r = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	__m128i const upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+	r = _mm_or_si128(r, _mm_and_si128(upper, _mm_set1_epi8(13)));
+	return _mm_add_epi8(_mm_shuffle_epi8(offsets, r), indices);
+}
 
-	std::string::value_type const* const base64_chars =
-		 (type == base64_type::standard)
-			? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
-			: "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+FZ_TARGET_SSSE3 size_t base64_encode_ssse3(char* out, unsigned char const* in, size_t len, bool url)
+{
+	size_t i{};
+	// Loads 16 octets, only uses 12 of them
+	for (; i + 16 <= len; i += 12, out += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+		v = _mm_shuffle_epi8(v, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		__m128i const hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+		__m128i const lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), base64_encode_lookup_ssse3(_mm_or_si128(hi, lo), url));
+	}
+	return i;
+}
 
-	size_t len = in.size();
-	size_t pos{};
+FZ_TARGET_AVX2 inline __m256i base64_encode_lookup_avx2(__m256i const& indices, bool url)
+{
+	__m256i const offsets = url
+		? _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0,
+		                   'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0)
+		: _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+		                   'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	__m256i r = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+	__m256i const upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+	r = _mm256_or_si256(r, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+	return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, r), indices);
+}
 
-	size_t const newcap = out.size() + ((len + 2) / 3) * 4;
-	if (out.capacity() < newcap) {
-		out.reserve(newcap);
+FZ_TARGET_AVX2 size_t base64_encode_avx2(char* out, unsigned char const* in, size_t len, bool url)
+{
+	size_t i{};
+	// Each 128-bit lane gets 12 octets
+	for (; i + 28 <= len; i += 24, out += 32) {
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i))),
+			_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i + 12)), 1);
+		v = _mm256_shuffle_epi8(v, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		                                           10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		__m256i const hi = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		__m256i const lo = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), base64_encode_lookup_avx2(_mm256_or_si256(hi, lo), url));
 	}
+	return i + base64_encode_ssse3(out, in + i, len - i, url);
+}
 
-	while (len >= 3) {
-		len -= 3;
-		auto const c1 = static_cast<unsigned char>(in[pos++]);
-		auto const c2 = static_cast<unsigned char>(in[pos++]);
-		auto const c3 = static_cast<unsigned char>(in[pos++]);
+FZ_TARGET_SSSE3 inline __m128i in_range_ssse3(__m128i const& c, char lower, char upper)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lower - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(upper + 1), c));
+}
 
-		out += base64_chars[(c1 >> 2) & 0x3fu];
-		out += base64_chars[((c1 & 0x3u) << 4) | ((c2 >> 4) & 0xfu)];
-		out += base64_chars[((c2 & 0xfu) << 2) | ((c3 >> 6) & 0x3u)];
-		out += base64_chars[(c3 & 0x3fu)];
+// Translates characters of both alphabets into their 6-bit values. Returns false if anything else is encountered.
+FZ_TARGET_SSSE3 inline bool base64_translate_ssse3(__m128i const& c, __m128i& values)
+{
+	__m128i const upper = in_range_ssse3(c, 'A', 'Z');
+	__m128i const lower = in_range_ssse3(c, 'a', 'z');
+	__m128i const digit = in_range_ssse3(c, '0', '9');
+	__m128i const v62 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')), _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+	__m128i const v63 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+	__m128i const alnum = _mm_or_si128(_mm_or_si128(upper, lower), digit);
+	if (_mm_movemask_epi8(_mm_or_si128(alnum, _mm_or_si128(v62, v63))) != 0xffff) {
+		return false;
 	}
+	__m128i const shift = _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+		_mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+		_mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+	values = _mm_or_si128(_mm_and_si128(alnum, _mm_add_epi8(c, shift)),
+		_mm_or_si128(_mm_and_si128(v62, _mm_set1_epi8(62)), _mm_and_si128(v63, _mm_set1_epi8(63))));
+	return true;
+}
+
+// Packs 16 6-bit values into 12 octets, placed in the low 12 bytes.
+FZ_TARGET_SSSE3 inline __m128i base64_pack_ssse3(__m128i const& values)
+{
+	__m128i const merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+	__m128i const packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+FZ_TARGET_SSSE3 size_t base64_decode_ssse3(unsigned char* out, unsigned char const* in, size_t len)
+{
+	size_t i{};
+	for (; i + 16 <= len; i += 16, out += 12) {
+		__m128i values;
+		if (!base64_translate_ssse3(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)), values)) {
+			break;
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), base64_pack_ssse3(values));
+	}
+	return i;
+}
+
+FZ_TARGET_AVX2 inline __m256i in_range_avx2(__m256i const& c, char lower, char upper)
+{
+	return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(lower - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(upper + 1), c));
+}
+
+FZ_TARGET_AVX2 size_t base64_decode_avx2(unsigned char* out, unsigned char const* in, size_t len)
+{
+	size_t i{};
+	for (; i + 32 <= len; i += 32, out += 24) {
+		__m256i const c = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in + i));
+		__m256i const upper = in_range_avx2(c, 'A', 'Z');
+		__m256i const lower = in_range_avx2(c, 'a', 'z');
+		__m256i const digit = in_range_avx2(c, '0', '9');
+		__m256i const v62 = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('+')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')));
+		__m256i const v63 = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('/')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+		__m256i const alnum = _mm256_or_si256(_mm256_or_si256(upper, lower), digit);
+		if (_mm256_movemask_epi8(_mm256_or_si256(alnum, _mm256_or_si256(v62, v63))) != -1) {
+			break;
+		}
+		__m256i const shift = _mm256_or_si256(_mm256_or_si256(
+			_mm256_and_si256(upper, _mm256_set1_epi8(-'A')),
+			_mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+			_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+		__m256i const values = _mm256_or_si256(_mm256_and_si256(alnum, _mm256_add_epi8(c, shift)),
+			_mm256_or_si256(_mm256_and_si256(v62, _mm256_set1_epi8(62)), _mm256_and_si256(v63, _mm256_set1_epi8(63))));
+
+		__m256i const merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		__m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		                                                      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm256_extracti128_si256(packed, 1));
+	}
+	return i + base64_decode_ssse3(out, in + i, len - i);
+}
+
+FZ_TARGET_SSSE3 size_t hex_encode_ssse3(char* out, unsigned char const* in, size_t len, bool lowercase)
+{
+	__m128i const digits = lowercase
+		? _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f')
+		: _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+	__m128i const nibble = _mm_set1_epi8(0x0f);
+	size_t i{};
+	for (; i + 16 <= len; i += 16, out += 32) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+		__m128i const hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		__m128i const lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, nibble));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	return i;
+}
+
+FZ_TARGET_SSSE3 inline bool hex_translate_ssse3(__m128i const& c, __m128i& values)
+{
+	__m128i const digit = in_range_ssse3(c, '0', '9');
+	__m128i const folded = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	__m128i const alpha = in_range_ssse3(folded, 'a', 'f');
+	if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff) {
+		return false;
+	}
+	values = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+		_mm_and_si128(alpha, _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10))));
+	return true;
+}
+
+FZ_TARGET_SSSE3 size_t hex_decode_ssse3(unsigned char* out, char const* in, size_t len)
+{
+	size_t i{};
+	for (; i + 32 <= len; i += 32, out += 16) {
+		__m128i a, b;
+		if (!hex_translate_ssse3(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)), a) ||
+			!hex_translate_ssse3(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i + 16)), b))
+		{
+			break;
+		}
+		// high * 16 + low for each pair of digits
+		__m128i const weights = _mm_set1_epi16(0x0110);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights)));
+	}
+	return i;
+}
+#elif FZ_ENCODE_NEON
+size_t base64_encode_neon(char* out, unsigned char const* in, size_t len, bool url)
+{
+	uint8x16x4_t const table = vld1q_u8_x4(reinterpret_cast<uint8_t const*>(url ? base64_url_chars : base64_standard_chars));
+	uint8x16_t const mask = vdupq_n_u8(0x3f);
+	size_t i{};
+	for (; i + 48 <= len; i += 48, out += 64) {
+		uint8x16x3_t const v = vld3q_u8(in + i);
+		uint8x16x4_t r;
+		r.val[0] = vqtbl4q_u8(table, vshrq_n_u8(v.val[0], 2));
+		r.val[1] = vqtbl4q_u8(table, vandq_u8(vorrq_u8(vshlq_n_u8(v.val[0], 4), vshrq_n_u8(v.val[1], 4)), mask));
+		r.val[2] = vqtbl4q_u8(table, vandq_u8(vorrq_u8(vshlq_n_u8(v.val[1], 2), vshrq_n_u8(v.val[2], 6)), mask));
+		r.val[3] = vqtbl4q_u8(table, vandq_u8(v.val[2], mask));
+		vst4q_u8(reinterpret_cast<uint8_t*>(out), r);
+	}
+	return i;
+}
+
+inline uint8x16_t in_range_neon(uint8x16_t c, uint8_t lower, uint8_t upper)
+{
+	return vandq_u8(vcgeq_u8(c, vdupq_n_u8(lower)), vcleq_u8(c, vdupq_n_u8(upper)));
+}
+
+inline bool base64_translate_neon(uint8x16_t c, uint8x16_t& values)
+{
+	uint8x16_t const upper = in_range_neon(c, 'A', 'Z');
+	uint8x16_t const lower = in_range_neon(c, 'a', 'z');
+	uint8x16_t const digit = in_range_neon(c, '0', '9');
+	uint8x16_t const v62 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('+')), vceqq_u8(c, vdupq_n_u8('-')));
+	uint8x16_t const v63 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('/')), vceqq_u8(c, vdupq_n_u8('_')));
+	if (vminvq_u8(vorrq_u8(vorrq_u8(vorrq_u8(upper, lower), digit), vorrq_u8(v62, v63))) != 0xff) {
+		return false;
+	}
+	values = vorrq_u8(vorrq_u8(
+		vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A'))),
+		vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26)))),
+		vorrq_u8(vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))),
+		vorrq_u8(vandq_u8(v62, vdupq_n_u8(62)), vandq_u8(v63, vdupq_n_u8(63)))));
+	return true;
+}
+
+size_t base64_decode_neon(unsigned char* out, unsigned char const* in, size_t len)
+{
+	size_t i{};
+	for (; i + 64 <= len; i += 64, out += 48) {
+		uint8x16x4_t const c = vld4q_u8(in + i);
+		uint8x16_t v0, v1, v2, v3;
+		if (!base64_translate_neon(c.val[0], v0) || !base64_translate_neon(c.val[1], v1) ||
+			!base64_translate_neon(c.val[2], v2) || !base64_translate_neon(c.val[3], v3))
+		{
+			break;
+		}
+		uint8x16x3_t r;
+		r.val[0] = vorrq_u8(vshlq_n_u8(v0, 2), vshrq_n_u8(v1, 4));
+		r.val[1] = vorrq_u8(vshlq_n_u8(v1, 4), vshrq_n_u8(v2, 2));
+		r.val[2] = vorrq_u8(vshlq_n_u8(v2, 6), v3);
+		vst3q_u8(out, r);
+	}
+	return i;
+}
+
+size_t hex_encode_neon(char* out, unsigned char const* in, size_t len, bool lowercase)
+{
+	uint8x16_t const digits = vld1q_u8(reinterpret_cast<uint8_t const*>(lowercase ? "0123456789abcdef" : "0123456789ABCDEF"));
+	size_t i{};
+	for (; i + 16 <= len; i += 16, out += 32) {
+		uint8x16_t const v = vld1q_u8(in + i);
+		uint8x16x2_t r;
+		r.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(v, 4));
+		r.val[1] = vqtbl1q_u8(digits, vandq_u8(v, vdupq_n_u8(0x0f)));
+		vst2q_u8(reinterpret_cast<uint8_t*>(out), r);
+	}
+	return i;
+}
+
+inline bool hex_translate_neon(uint8x16_t c, uint8x16_t& values)
+{
+	uint8x16_t const digit = in_range_neon(c, '0', '9');
+	uint8x16_t const folded = vorrq_u8(c, vdupq_n_u8(0x20));
+	uint8x16_t const alpha = in_range_neon(folded, 'a', 'f');
+	if (vminvq_u8(vorrq_u8(digit, alpha)) != 0xff) {
+		return false;
+	}
+	values = vorrq_u8(vandq_u8(digit, vsubq_u8(c, vdupq_n_u8('0'))), vandq_u8(alpha, vsubq_u8(folded, vdupq_n_u8('a' - 10))));
+	return true;
+}
+
+size_t hex_decode_neon(unsigned char* out, char const* in, size_t len)
+{
+	size_t i{};
+	for (; i + 32 <= len; i += 32, out += 16) {
+		uint8x16x2_t const c = vld2q_u8(reinterpret_cast<uint8_t const*>(in + i));
+		uint8x16_t hi, lo;
+		if (!hex_translate_neon(c.val[0], hi) || !hex_translate_neon(c.val[1], lo)) {
+			break;
+		}
+		vst1q_u8(out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+	}
+	return i;
+}
+#endif
+
+struct codec_kernels final
+{
+	size_t (*base64_encode)(char* out, unsigned char const* in, size_t len, bool url){};
+	size_t (*base64_decode)(unsigned char* out, unsigned char const* in, size_t len){};
+	size_t (*hex_encode)(char* out, unsigned char const* in, size_t len, bool lowercase){};
+	size_t (*hex_decode)(unsigned char* out, char const* in, size_t len){};
+};
+
+codec_kernels select_kernels()
+{
+	codec_kernels k;
+#if FZ_ENCODE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		k.base64_encode = &base64_encode_ssse3;
+		k.base64_decode = &base64_decode_ssse3;
+		k.hex_encode = &hex_encode_ssse3;
+		k.hex_decode = &hex_decode_ssse3;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		k.base64_encode = &base64_encode_avx2;
+		k.base64_decode = &base64_decode_avx2;
+	}
+#elif FZ_ENCODE_NEON
+	k.base64_encode = &base64_encode_neon;
+	k.base64_decode = &base64_decode_neon;
+	k.hex_encode = &hex_encode_neon;
+	k.hex_decode = &hex_decode_neon;
+#endif
+	return k;
+}
+
+codec_kernels const& kernels()
+{
+	static codec_kernels const k = select_kernels();
+	return k;
+}
+
+// Encodes all complete groups of 3 octets, returns the number of octets consumed.
+size_t base64_encode_groups(char* out, unsigned char const* in, size_t len, base64_type type)
+{
+	char const* const chars = (type == base64_type::standard) ? base64_standard_chars : base64_url_chars;
+
+	size_t pos{};
+	if (auto const kernel = kernels().base64_encode) {
+		pos = kernel(out, in, len, type == base64_type::url);
+		out += (pos / 3) * 4;
+	}
+
+	for (; len - pos >= 3; pos += 3) {
+		auto const c1 = in[pos];
+		auto const c2 = in[pos + 1];
+		auto const c3 = in[pos + 2];
+
+		*out++ = chars[(c1 >> 2) & 0x3fu];
+		*out++ = chars[((c1 & 0x3u) << 4) | ((c2 >> 4) & 0xfu)];
+		*out++ = chars[((c2 & 0xfu) << 2) | ((c3 >> 6) & 0x3u)];
+		*out++ = chars[(c3 & 0x3fu)];
+	}
+	return pos;
+}
+
+// Encodes the final 1 or 2 octets, returns the number of characters written.
+size_t base64_encode_tail(char* out, unsigned char const* in, size_t len, base64_type type, bool pad)
+{
+	char const* const chars = (type == base64_type::standard) ? base64_standard_chars : base64_url_chars;
+
+	char* const start = out;
 	if (len) {
-		auto const c1 = static_cast<unsigned char>(in[pos++]);
-		out += base64_chars[(c1 >> 2) & 0x3fu];
+		auto const c1 = in[0];
+		*out++ = chars[(c1 >> 2) & 0x3fu];
 		if (len == 2) {
-			auto const c2 = static_cast<unsigned char>(in[pos++]);
-			out += base64_chars[((c1 & 0x3u) << 4) | ((c2 >> 4) & 0xfu)];
-			out += base64_chars[(c2 & 0xfu) << 2];
+			auto const c2 = in[1];
+			*out++ = chars[((c1 & 0x3u) << 4) | ((c2 >> 4) & 0xfu)];
+			*out++ = chars[(c2 & 0xfu) << 2];
 		}
 		else {
-			out += base64_chars[(c1 & 0x3u) << 4];
+			*out++ = chars[(c1 & 0x3u) << 4];
 			if (pad) {
-				out += '=';
+				*out++ = '=';
 			}
 		}
 		if (pad) {
-			out += '=';
+			*out++ = '=';
 		}
 	}
+	return out - start;
+}
+
+template<typename DataContainer>
+void base64_encode_impl(std::string & out, DataContainer const& in, base64_type type, bool pad)
+{
+	static_assert(sizeof(typename DataContainer::value_type) == 1, "Bad container type");
+
+	auto const* data = reinterpret_cast<unsigned char const*>(in.data());
+	size_t const len = in.size();
+
+	size_t const old = out.size();
+	out.resize(old + ((len + 2) / 3) * 4);
+	char* p = out.data() + old;
+
+	size_t const pos = base64_encode_groups(p, data, len, type);
+	p += (pos / 3) * 4;
+	p += base64_encode_tail(p, data + pos, len - pos, type, pad);
+
+	out.resize(p - out.data());
 }
 }
 
@@ -81,91 +473,107 @@ void base64_encode_append(std::string& result, std::string_view const& in, base6
 }
 
 namespace {
-template<typename Ret, typename View>
-Ret base64_decode_impl(View const& in)
+// Emits the octets of a complete group of 4 characters. Padding is only allowed in the last two positions.
+bool base64_decode_quantum(unsigned char const* q, unsigned char*& out, bool& done)
 {
-	using Unsigned = std::make_unsigned_t<typename View::value_type>;
-
-	unsigned char const chars[256] =
-	{
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x80, 0x80, 0xff, 0x80, 0x80, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0x80, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0x3e, 0xff, 0x3f,
-	    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0x40, 0xff, 0xff,
-	    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
-	    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
-	    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
-	    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-	    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
-	};
+	if (q[0] == 0x40 || q[1] == 0x40) {
+		return false;
+	}
 
-	Ret ret;
-	ret.reserve((in.size() / 4) * 3);
+	*out++ = static_cast<unsigned char>((q[0] << 2) | ((q[1] >> 4) & 0x3));
+	if (q[3] == 0x40) {
+		done = true;
+		if (q[2] != 0x40) {
+			*out++ = static_cast<unsigned char>(((q[1] & 0xf) << 4) | ((q[2] >> 2) & 0xf));
+		}
+	}
+	else {
+		if (q[2] == 0x40) {
+			return false;
+		}
+		*out++ = static_cast<unsigned char>(((q[1] & 0xf) << 4) | ((q[2] >> 2) & 0xf));
+		*out++ = static_cast<unsigned char>(((q[2] & 0x3) << 6) | q[3]);
+	}
+	return true;
+}
 
-	size_t pos{};
-	size_t len = in.size();
+// Decodes all complete groups of 4 non-whitespace characters, the characters of
+// an incomplete trailing group are left in quantum. Padding ends the input, only
+// whitespace may follow.
+template<typename View>
+bool base64_decode_chunk(unsigned char* quantum, size_t& quantum_size, bool& done, unsigned char*& out, View const& in)
+{
+	using Unsigned = std::make_unsigned_t<typename View::value_type>;
 
-	// Trim trailing whitespace
-	while (len && static_cast<Unsigned>(in[len - 1]) <= 255 && chars[static_cast<unsigned char>(in[len - 1])] == 0x80) {
-		--len;
-	}
+	auto const kernel = (sizeof(typename View::value_type) == 1) ? kernels().base64_decode : nullptr;
 
-	auto next = [&]() {
-		while (pos < len) {
-			auto const u = static_cast<Unsigned>(in[pos++]);
-			unsigned char c = (u <= 255) ? chars[u] : 0xffu;
-			if (c != 0x80u) {
-				return c;
+	size_t pos{};
+	size_t const len = in.size();
+	while (pos < len) {
+		if (kernel && !quantum_size && !done) {
+			size_t const n = kernel(out, reinterpret_cast<unsigned char const*>(in.data() + pos), len - pos);
+			pos += n;
+			out += (n / 4) * 3;
+			if (pos == len) {
+				break;
 			}
 		}
-		return static_cast<unsigned char>(0x40u);
-	};
 
-	while (pos < len) {
-		auto c1 = next();
-		auto c2 = next();
-		auto c3 = next();
-		auto c4 = next();
-
-		if (c1 == 0xff || c1 == 0x40 ||
-		    c2 == 0xff || c2 == 0x40 ||
-		    c3 == 0xff || c4 == 0xff)
-		{
-			// Bad input
-			return Ret();
+		auto const u = static_cast<Unsigned>(in[pos++]);
+		unsigned char const c = (u <= 255) ? base64_decode_chars[u] : 0xffu;
+		if (c == 0x80u) {
+			continue;
+		}
+		if (c == 0xffu || done) {
+			return false;
 		}
 
-		if (c4 == 0x40) {
-			// Pad
-			if (pos < len) {
-				// Not at end of string
-				return Ret();
-			}
-			ret.push_back((c1 << 2) | ((c2 >> 4) & 0x3));
-
-			if (c3 != 0x40) {
-				ret.push_back(((c2 & 0xf) << 4) | ((c3 >> 2) & 0xf));
+		quantum[quantum_size++] = c;
+		if (quantum_size == 4) {
+			quantum_size = 0;
+			if (!base64_decode_quantum(quantum, out, done)) {
+				return false;
 			}
 		}
-		else {
-			if (c3 == 0x40) {
-				// Bad input
-				return Ret();
-			}
+	}
+
+	return true;
+}
 
-			ret.push_back((c1 << 2) | ((c2 >> 4) & 0x3));
-			ret.push_back(((c2 & 0xf) << 4) | ((c3 >> 2) & 0xf));
-			ret.push_back(((c3 & 0x3) << 6) | c4);
+// Treats an incomplete trailing group as if it was padded.
+bool base64_decode_finish(unsigned char* quantum, size_t quantum_size, unsigned char*& out)
+{
+	if (quantum_size) {
+		if (quantum_size == 1) {
+			return false;
+		}
+		for (size_t i = quantum_size; i < 4; ++i) {
+			quantum[i] = 0x40;
 		}
+		bool done{};
+		return base64_decode_quantum(quantum, out, done);
 	}
+	return true;
+}
 
+template<typename Ret, typename View>
+Ret base64_decode_impl(View const& in)
+{
+	Ret ret;
+	ret.resize((in.size() / 4) * 3 + 2 + simd_slack);
+	auto* const start = reinterpret_cast<unsigned char*>(ret.data());
+	auto* out = start;
+
+	unsigned char quantum[4];
+	size_t quantum_size{};
+	bool done{};
+	if (!base64_decode_chunk(quantum, quantum_size, done, out, in) ||
+		!base64_decode_finish(quantum, quantum_size, out))
+	{
+		return Ret();
+	}
+
+	ret.resize(out - start);
 	return ret;
 }
 }
@@ -201,6 +609,104 @@ std::string base64_decode_s(fz::buffer const& in)
 }
 
 
+base64_encoder::base64_encoder(base64_type type, bool pad)
+	: type_(type)
+	, pad_(pad)
+{
+}
+
+void base64_encoder::encode(unsigned char const* data, size_t len, fz::buffer& out)
+{
+	if (pending_size_ + len < 3) {
+		memcpy(pending_ + pending_size_, data, len);
+		pending_size_ += len;
+		return;
+	}
+
+	char* p = reinterpret_cast<char*>(out.get(((pending_size_ + len) / 3) * 4));
+	char* const start = p;
+
+	if (pending_size_) {
+		unsigned char group[3];
+		memcpy(group, pending_, pending_size_);
+		size_t const fill = 3 - pending_size_;
+		memcpy(group + pending_size_, data, fill);
+		data += fill;
+		len -= fill;
+		pending_size_ = 0;
+		p += (base64_encode_groups(p, group, 3, type_) / 3) * 4;
+	}
+
+	size_t const pos = base64_encode_groups(p, data, len, type_);
+	p += (pos / 3) * 4;
+
+	pending_size_ = len - pos;
+	memcpy(pending_, data + pos, pending_size_);
+
+	out.add(static_cast<size_t>(p - start));
+}
+
+void base64_encoder::encode(std::string_view const& data, fz::buffer& out)
+{
+	encode(reinterpret_cast<unsigned char const*>(data.data()), data.size(), out);
+}
+
+void base64_encoder::encode(fz::buffer const& data, fz::buffer& out)
+{
+	encode(data.get(), data.size(), out);
+}
+
+void base64_encoder::finalize(fz::buffer& out)
+{
+	if (pending_size_) {
+		char* p = reinterpret_cast<char*>(out.get(4));
+		out.add(base64_encode_tail(p, pending_, pending_size_, type_, pad_));
+		pending_size_ = 0;
+	}
+}
+
+bool base64_decoder::decode(std::string_view const& data, fz::buffer& out)
+{
+	if (failed_) {
+		return false;
+	}
+
+	unsigned char* const start = out.get(((quantum_size_ + data.size()) / 4) * 3 + simd_slack);
+	unsigned char* p = start;
+	if (!base64_decode_chunk(quantum_, quantum_size_, done_, p, data)) {
+		failed_ = true;
+	}
+	out.add(static_cast<size_t>(p - start));
+
+	return !failed_;
+}
+
+bool base64_decoder::decode(fz::buffer const& data, fz::buffer& out)
+{
+	return decode(data.to_view(), out);
+}
+
+bool base64_decoder::finalize(fz::buffer& out)
+{
+	bool ret = !failed_;
+	if (ret) {
+		unsigned char* const start = out.get(3);
+		unsigned char* p = start;
+		ret = base64_decode_finish(quantum_, quantum_size_, p);
+		out.add(static_cast<size_t>(p - start));
+	}
+	reset();
+	return ret;
+}
+
+void base64_decoder::reset()
+{
+	quantum_size_ = 0;
+	done_ = false;
+	failed_ = false;
+}
+
+
 namespace {
 template<typename DataContainer>
 std::string base32_encode_impl(DataContainer const& in, base32_type type, bool pad)
@@ -217,68 +723,68 @@ std::string base32_encode_impl(DataContainer const& in, base32_type type, bool p
 	std::string ret;
 
 	size_t len = in.size();
-	size_t pos{};
-
-	ret.reserve(((len + 4) / 5) * 8);
-
-	while (len >= 5) {
-		len -= 5;
-		auto const c1 = static_cast<unsigned char>(in[pos++]);
-		auto const c2 = static_cast<unsigned char>(in[pos++]);
-		auto const c3 = static_cast<unsigned char>(in[pos++]);
-		auto const c4 = static_cast<unsigned char>(in[pos++]);
-		auto const c5 = static_cast<unsigned char>(in[pos++]);
-
-		ret += base32_chars[(c1 >> 3) & 0x1fu];
-		ret += base32_chars[((c1 & 0x7u) << 2) | ((c2 >> 6) & 0x3u)];
-		ret += base32_chars[(c2 >> 1) & 0x1fu];
-		ret += base32_chars[((c2 & 0x1u) << 4) | ((c3 >> 4) & 0xfu)];
-		ret += base32_chars[((c3 & 0xfu) << 1) | ((c4 >> 7) & 0x1u)];
-		ret += base32_chars[(c4 >> 2) & 0x1fu];
-		ret += base32_chars[((c4 & 0x3u) << 3) | ((c5 >> 5) & 0x7u)];
-		ret += base32_chars[c5 & 0x1fu];
+	auto const* p = reinterpret_cast<unsigned char const*>(in.data());
+
+	ret.resize(((len + 4) / 5) * 8);
+	char* out = ret.data();
+
+	// Each group of 5 octets is handled as one 40-bit word
+	for (; len >= 5; len -= 5, p += 5, out += 8) {
+		uint64_t const v = (uint64_t(p[0]) << 32) | (uint64_t(p[1]) << 24) | (uint64_t(p[2]) << 16) | (uint64_t(p[3]) << 8) | uint64_t(p[4]);
+		out[0] = base32_chars[(v >> 35) & 0x1fu];
+		out[1] = base32_chars[(v >> 30) & 0x1fu];
+		out[2] = base32_chars[(v >> 25) & 0x1fu];
+		out[3] = base32_chars[(v >> 20) & 0x1fu];
+		out[4] = base32_chars[(v >> 15) & 0x1fu];
+		out[5] = base32_chars[(v >> 10) & 0x1fu];
+		out[6] = base32_chars[(v >> 5) & 0x1fu];
+		out[7] = base32_chars[v & 0x1fu];
 	}
 	if (len) {
-		auto const c1 = static_cast<unsigned char>(in[pos++]);
-		ret += base32_chars[(c1 >> 3) & 0x1fu];
+		auto const c1 = p[0];
+		*out++ = base32_chars[(c1 >> 3) & 0x1fu];
 		if (len >= 2) {
-			auto const c2 = static_cast<unsigned char>(in[pos++]);
-			ret += base32_chars[((c1 & 0x7u) << 2) | ((c2 >> 6) & 0x3u)];
-			ret += base32_chars[(c2 >> 1) & 0x1fu];
+			auto const c2 = p[1];
+			*out++ = base32_chars[((c1 & 0x7u) << 2) | ((c2 >> 6) & 0x3u)];
+			*out++ = base32_chars[(c2 >> 1) & 0x1fu];
 			if (len >= 3) {
-				auto const c3 = static_cast<unsigned char>(in[pos++]);
-				ret += base32_chars[((c2 & 0x1u) << 4) | ((c3 >> 4) & 0xfu)];
+				auto const c3 = p[2];
+				*out++ = base32_chars[((c2 & 0x1u) << 4) | ((c3 >> 4) & 0xfu)];
 				if (len >= 4) {
-					auto const c4 = static_cast<unsigned char>(in[pos++]);
-					ret += base32_chars[((c3 & 0xfu) << 1) | ((c4 >> 7) & 0x1u)];
-					ret += base32_chars[(c4 >> 2) & 0x1fu];
-					ret += base32_chars[((c4 & 0x3u) << 3)];
+					auto const c4 = p[3];
+					*out++ = base32_chars[((c3 & 0xfu) << 1) | ((c4 >> 7) & 0x1u)];
+					*out++ = base32_chars[(c4 >> 2) & 0x1fu];
+					*out++ = base32_chars[((c4 & 0x3u) << 3)];
 					if (pad) {
-						ret += '=';
+						*out++ = '=';
 					}
 				}
 				else {
-					ret += base32_chars[((c3 & 0xfu) << 1)];
+					*out++ = base32_chars[((c3 & 0xfu) << 1)];
 					if (pad) {
-						ret += "===";
+						memcpy(out, "===", 3);
+						out += 3;
 					}
 				}
 			}
 			else {
-				ret += base32_chars[((c2 & 0x1u) << 4)];
+				*out++ = base32_chars[((c2 & 0x1u) << 4)];
 				if (pad) {
-					ret += "====";
+					memcpy(out, "====", 4);
+					out += 4;
 				}
 			}
 		}
 		else {
-			ret += base32_chars[((c1 & 0x7u) << 2)];
+			*out++ = base32_chars[((c1 & 0x7u) << 2)];
 			if (pad) {
-				ret += "======";
+				memcpy(out, "======", 6);
+				out += 6;
 			}
 		}
 	}
 
+	ret.resize(out - ret.data());
 	return ret;
 }
 }
@@ -367,7 +873,9 @@ Ret base32_decode_impl(View const& in, base32_type type)
 	auto const chars = (type == base32_type::standard) ? chars_s : (type == base32_type::base32hex) ? chars_h : chars_l;
 
 	Ret ret;
-	ret.reserve((in.size() / 8) * 5);
+	ret.resize((in.size() / 8) * 5 + 5);
+	auto* const start = reinterpret_cast<unsigned char*>(ret.data());
+	auto* out = start;
 
 	size_t pos{};
 	size_t len = in.size();
@@ -402,6 +910,30 @@ Ret base32_decode_impl(View const& in, base32_type type)
 	};
 
 	while (pos < len) {
+		// Fast path for groups of 8 regular characters, decoded as one 40-bit word
+		if (!end && len - pos >= 8) {
+			uint64_t v{};
+			size_t i = 0;
+			for (; i < 8; ++i) {
+				auto const u = static_cast<Unsigned>(in[pos + i]);
+				unsigned char const c = (u <= 255) ? chars[u] : 0xffu;
+				if (c >= 32) {
+					break;
+				}
+				v = (v << 5) | c;
+			}
+			if (i == 8) {
+				pos += 8;
+				out[0] = static_cast<unsigned char>(v >> 32);
+				out[1] = static_cast<unsigned char>(v >> 24);
+				out[2] = static_cast<unsigned char>(v >> 16);
+				out[3] = static_cast<unsigned char>(v >> 8);
+				out[4] = static_cast<unsigned char>(v);
+				out += 5;
+				continue;
+			}
+		}
+
 		auto const c1 = next();
 		auto const c2 = next();
 		auto const c3 = next();
@@ -416,33 +948,34 @@ Ret base32_decode_impl(View const& in, base32_type type)
 			return Ret();
 		}
 
-		ret.push_back((c1 << 3) | ((c2 >> 2) & 0x7));
+		*out++ = (c1 << 3) | ((c2 >> 2) & 0x7);
 
 		if (c3 != 0x40) {
 			if (c4 == 0x40) {
 				// Bad input
 				return Ret();
 			}
-			ret.push_back(((c2 & 0x3) << 6) | (c3 << 1) | ((c4 >> 4) & 0x1));
+			*out++ = ((c2 & 0x3) << 6) | (c3 << 1) | ((c4 >> 4) & 0x1);
 
 			if (c5 != 0x40) {
-				ret.push_back(((c4 & 0xf) << 4) | (c5 >> 1));
+				*out++ = ((c4 & 0xf) << 4) | (c5 >> 1);
 
 				if (c6 != 0x40) {
 					if (c7 == 0x40) {
 						// Bad input
 						return Ret();
 					}
-					ret.push_back(((c5 & 0x1) << 7) | (c6 << 2) | ((c7 >> 3) & 0x3));
+					*out++ = ((c5 & 0x1) << 7) | (c6 << 2) | ((c7 >> 3) & 0x3);
 
 					if (c8 != 0x40) {
-						ret.push_back(((c7 & 0x7) << 5) | c8);
+						*out++ = ((c7 & 0x7) << 5) | c8;
 					}
 				}
 			}
 		}
 	}
 
+	ret.resize(out - start);
 	return ret;
 }
 }
@@ -478,6 +1011,41 @@ std::string base32_decode_s(fz::buffer const& in, base32_type type)
 }
 
 
+void hex_encode_raw(char* out, unsigned char const* in, size_t len, bool lowercase)
+{
+	size_t pos{};
+	if (auto const kernel = kernels().hex_encode) {
+		pos = kernel(out, in, len, lowercase);
+		out += pos * 2;
+	}
+
+	char const* const digits = lowercase ? "0123456789abcdef" : "0123456789ABCDEF";
+	for (; pos < len; ++pos) {
+		*out++ = digits[in[pos] >> 4];
+		*out++ = digits[in[pos] & 0xf];
+	}
+}
+
+bool hex_decode_raw(unsigned char* out, char const* in, size_t len)
+{
+	size_t pos{};
+	if (auto const kernel = kernels().hex_decode) {
+		pos = kernel(out, in, len);
+		out += pos / 2;
+	}
+
+	for (; pos + 1 < len; pos += 2) {
+		int const high = hex_char_to_int(in[pos]);
+		int const low = hex_char_to_int(in[pos + 1]);
+		if (high == -1 || low == -1) {
+			return false;
+		}
+		*out++ = static_cast<unsigned char>((high << 4) + low);
+	}
+	return true;
+}
+
+
 std::string percent_encode(std::string_view const& s, bool keep_slashes)
 {
 	std::string ret;
@@ -5,6 +5,14 @@
 
 #include <algorithm>
 
+#if defined(FZ_UNIX) && defined(__linux__)
+#define FZ_HIRES_TIMERS 1
+#include "unix/poller.hpp"
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
 #ifdef LFZ_EVENT_DEBUG
 #include <assert.h>
 #define event_assert(pred) assert((pred))
@@ -14,6 +22,98 @@
 
 namespace fz {
 
+namespace {
+// Empty if there is no coarse clock
+duration const& coarse_resolution()
+{
+	static duration const res = monotonic_clock::available(monotonic_clock::source::coarse) ? monotonic_clock::resolution(monotonic_clock::source::coarse) : duration();
+	return res;
+}
+}
+
+#if FZ_HIRES_TIMERS
+class event_loop::hires_timer final
+{
+public:
+	~hires_timer()
+	{
+		if (fd_ != -1) {
+			::close(fd_);
+		}
+	}
+
+	bool init()
+	{
+		fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		return fd_ != -1 && poller_.init() == 0;
+	}
+
+	// Applies or restores the timer slack of the calling thread
+	void update_slack()
+	{
+		if (enabled_) {
+			if (applied_slack_ != slack_) {
+				if (original_slack_ < 0) {
+					original_slack_ = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+				}
+				prctl(PR_SET_TIMERSLACK, slack_, 0, 0, 0);
+				applied_slack_ = slack_;
+			}
+		}
+		else if (original_slack_ >= 0) {
+			prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(original_slack_), 0, 0, 0);
+			original_slack_ = -1;
+			applied_slack_ = 0;
+		}
+	}
+
+	// Must be called locked, waits until the deadline or until interrupted
+	void wait(scoped_lock & l, monotonic_clock const& deadline)
+	{
+		itimerspec its{};
+		if (deadline) {
+			int64_t const us = (deadline - monotonic_clock::now()).get_microseconds();
+			if (us <= 0) {
+				return;
+			}
+			// Round up, waking up early would only cause another wait
+			its.it_value.tv_sec = us / 1000000;
+			its.it_value.tv_nsec = (us % 1000000) * 1000 + 999;
+		}
+		// Disarms the timer if there is no deadline
+		timerfd_settime(fd_, 0, &its, nullptr);
+
+		pollfd fds[2]{};
+		fds[0].fd = fd_;
+		fds[0].events = POLLIN;
+
+		polling_ = true;
+		poller_.wait(fds, 1, l);
+		polling_ = false;
+
+		if (fds[0].revents & POLLIN) {
+			uint64_t expirations;
+			int damn_spurious_warning = read(fd_, &expirations, sizeof(expirations));
+			(void)damn_spurious_warning;
+		}
+	}
+
+	poller poller_;
+	int fd_{-1};
+
+	bool enabled_{};
+	bool polling_{};
+
+	unsigned long slack_{};
+	unsigned long applied_slack_{};
+	long original_slack_{-1};
+};
+#else
+class event_loop::hires_timer final
+{
+};
+#endif
+
 event_loop::event_loop()
 	: sync_(false)
 	, thread_(std::make_unique<thread>())
@@ -46,7 +146,7 @@ void event_loop::send_event(event_handler* handler, event_base* evt)
 		scoped_lock lock(sync_);
 		if (!handler->removing_) {
 			if (pending_events_.empty()) {
-				cond_.signal(lock);
+				wakeup(lock);
 			}
 			pending_events_.emplace_back(handler, evt);
 			return;
@@ -132,7 +232,7 @@ timer_id event_loop::add_timer(event_handler* handler, duration const& interval,
 		if (!deadline_ || d.deadline_ < deadline_) {
 			// Our new time is the next timer to trigger
 			deadline_ = d.deadline_;
-			cond_.signal(lock);
+			wakeup(lock);
 		}
 	}
 	return d.id_;
@@ -197,10 +297,9 @@ void event_loop::entry()
 {
 	thread_id_ = thread::own_id();
 
-	monotonic_clock now;
-
 	scoped_lock l(sync_);
 	while (!quit_) {
+		monotonic_clock now;
 		if (process_timers(l, now)) {
 			continue;
 		}
@@ -208,7 +307,25 @@ void event_loop::entry()
 			continue;
 		}
 
+		if (deadline_ && !now) {
+			// Timers have only been checked against the coarse clock, which can lag
+			// behind further than expected.
+			now = monotonic_clock::now();
+			if (process_timers(l, now)) {
+				continue;
+			}
+		}
+
 		// Nothing to do, now we wait
+#if FZ_HIRES_TIMERS
+		if (hires_) {
+			hires_->update_slack();
+			if (hires_->enabled_) {
+				hires_->wait(l, deadline_);
+				continue;
+			}
+		}
+#endif
 		if (deadline_) {
 			cond_.wait(l, deadline_ - now);
 		}
@@ -216,6 +333,53 @@ void event_loop::entry()
 			cond_.wait(l);
 		}
 	}
+
+#if FZ_HIRES_TIMERS
+	if (hires_ && hires_->enabled_) {
+		hires_->enabled_ = false;
+		hires_->update_slack();
+		hires_->enabled_ = true;
+	}
+#endif
+}
+
+void event_loop::wakeup(scoped_lock & l)
+{
+#if FZ_HIRES_TIMERS
+	if (hires_ && hires_->polling_) {
+		hires_->poller_.interrupt(l);
+		return;
+	}
+#endif
+	cond_.signal(l);
+}
+
+bool event_loop::set_high_resolution_timers(bool enable, duration const& slack)
+{
+#if FZ_HIRES_TIMERS
+	scoped_lock l(sync_);
+	if (!hires_) {
+		if (!enable) {
+			return true;
+		}
+		auto t = std::make_unique<hires_timer>();
+		if (!t->init()) {
+			return false;
+		}
+		hires_ = std::move(t);
+	}
+
+	hires_->enabled_ = enable;
+	// A slack of zero would select the thread's default slack
+	int64_t const ns = slack.get_microseconds() * 1000;
+	hires_->slack_ = ns > 0 ? static_cast<unsigned long>(ns) : 1;
+
+	wakeup(l);
+	return true;
+#else
+	(void)slack;
+	return !enable;
+#endif
 }
 
 bool event_loop::process_timers(scoped_lock & l, monotonic_clock & now)
@@ -225,7 +389,18 @@ bool event_loop::process_timers(scoped_lock & l, monotonic_clock & now)
 		return false;
 	}
 
-	now = monotonic_clock::now();
+	if (!now) {
+		// Most passes happen long before the next deadline, rule those out using the
+		// cheap coarse clock. It is never ahead of the precise clock. If it turns out
+		// to lag behind by more than its resolution, the caller retries with the
+		// precise time before waiting.
+		duration const& coarse = coarse_resolution();
+		if (coarse && monotonic_clock::now(monotonic_clock::source::coarse) + coarse < deadline_) {
+			return false;
+		}
+
+		now = monotonic_clock::now();
+	}
 	if (now < deadline_) {
 		// Deadline has not yet expired
 		return false;
@@ -265,7 +440,11 @@ bool event_loop::process_timers(scoped_lock & l, monotonic_clock & now)
 			timers_.pop_back();
 		}
 		else {
-			it->deadline_ = now + it->interval_;
+			// Keep the period, unless having fallen behind by more than an interval
+			it->deadline_ += it->interval_;
+			if (it->deadline_ <= now) {
+				it->deadline_ = now + it->interval_;
+			}
 			if (!deadline_ || it->deadline_ < deadline_) {
 				deadline_ = it->deadline_;
 			}
@@ -293,7 +472,7 @@ void event_loop::stop(bool join)
 	{
 		scoped_lock l(sync_);
 		quit_ = true;
-		cond_.signal(l);
+		wakeup(l);
 	}
 
 	if (join) {
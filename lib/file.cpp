@@ -1,18 +1,140 @@
 #include "libfilezilla/libfilezilla.hpp"
 #include "libfilezilla/file.hpp"
 
+#include <algorithm>
+#include <memory>
+
 #ifdef FZ_WINDOWS
 #include "windows/security_descriptor_builder.hpp"
+#include <winioctl.h>
 #else
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define FZ_HAVE_PREADV 1
+#endif
+
 namespace fz {
 
+namespace {
+#if defined(FZ_WINDOWS) || !FZ_HAVE_PREADV
+// Emulates vectored I/O with one call per segment
+template<typename Segment, typename F>
+int64_t transfer_segments(int64_t offset, Segment const* segments, size_t count, F const& transfer)
+{
+	int64_t ret = 0;
+	for (size_t i = 0; i < count; ++i) {
+		int64_t const size = static_cast<int64_t>(segments[i].size);
+		int64_t const res = transfer(offset + ret, segments[i].data, size);
+		if (res < 0) {
+			return ret ? ret : -1;
+		}
+		ret += res;
+		if (res < size) {
+			break;
+		}
+	}
+	return ret;
+}
+#else
+// Enough for the common cases without allocating
+size_t const iov_stack_count = 16;
+
+template<typename Segment, typename F>
+int64_t transfer_segments(Segment const* segments, size_t count, F const& transfer)
+{
+	if (count > IOV_MAX) {
+		// Report a short transfer instead of failing
+		count = IOV_MAX;
+	}
+
+	iovec stack_iov[iov_stack_count];
+	std::unique_ptr<iovec[]> heap_iov;
+	iovec* iov = stack_iov;
+	if (count > iov_stack_count) {
+		heap_iov = std::make_unique<iovec[]>(count);
+		iov = heap_iov.get();
+	}
+	for (size_t i = 0; i < count; ++i) {
+		iov[i].iov_base = const_cast<void*>(segments[i].data);
+		iov[i].iov_len = segments[i].size;
+	}
+
+	int64_t ret;
+	do {
+		ret = transfer(iov, static_cast<int>(count));
+	} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+
+	return ret;
+}
+#endif
+
+#ifndef FZ_WINDOWS
+// Transfers at the current position of fd through the other descriptor buffered_fd,
+// which does not share the position. Advances the position of fd.
+template<typename F>
+int64_t at_position(int fd, int buffered_fd, F const& transfer)
+{
+	off_t const pos = lseek(fd, 0, SEEK_CUR);
+	if (pos == static_cast<off_t>(-1)) {
+		return -1;
+	}
+	int64_t ret;
+	do {
+		ret = transfer(buffered_fd, pos);
+	} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+	if (ret > 0) {
+		lseek(fd, pos + ret, SEEK_SET);
+	}
+	return ret;
+}
+
+#if defined(__linux__) && defined(O_DIRECT)
+// Transfers the aligned part of the request directly using fd, the remainder through the
+// page cache using buffered_fd, a descriptor for the same file opened without O_DIRECT.
+// op gets passed the descriptor, the memory, its length and the offset relative to the
+// start of the request.
+template<typename Buf, typename Op>
+int64_t direct_transfer(int fd, int buffered_fd, size_t alignment, Buf* buf, int64_t count, Op const& op)
+{
+	int64_t done{};
+	if (!(reinterpret_cast<uintptr_t>(buf) % alignment)) {
+		int64_t const aligned = count - count % static_cast<int64_t>(alignment);
+		if (aligned) {
+			done = op(fd, buf, aligned, 0);
+			if (done == -1 && errno == EINVAL) {
+				// The offset in the file isn't aligned
+				done = 0;
+			}
+			else if (done != aligned || aligned == count) {
+				return done;
+			}
+		}
+	}
+
+	int64_t const res = op(buffered_fd, buf + done, count - done, done);
+	if (res < 0) {
+		return done ? done : -1;
+	}
+	return done + res;
+}
+#else
+template<typename Buf, typename Op>
+int64_t direct_transfer(int fd, int, size_t, Buf* buf, int64_t count, Op const& op)
+{
+	return op(fd, buf, count, 0);
+}
+#endif
+#endif
+}
+
 file::file(native_string const& f, mode m, creation_flags d)
 {
 	open(f, m, d);
@@ -31,8 +153,12 @@ file::~file()
 #ifdef FZ_WINDOWS
 file::file(file && op) noexcept
 	: fd_{op.fd_}
+	, drop_behind_{op.drop_behind_}
+	, alignment_{op.alignment_}
 {
 	op.fd_ = INVALID_HANDLE_VALUE;
+	op.drop_behind_ = -1;
+	op.alignment_ = 0;
 }
 
 file& file::operator=(file && op) noexcept
@@ -40,7 +166,11 @@ file& file::operator=(file && op) noexcept
 	if (this != &op) {
 		close();
 		fd_ = op.fd_;
+		drop_behind_ = op.drop_behind_;
+		alignment_ = op.alignment_;
 		op.fd_ = INVALID_HANDLE_VALUE;
+		op.drop_behind_ = -1;
+		op.alignment_ = 0;
 	}
 	return *this;
 }
@@ -96,6 +226,10 @@ result file::open(native_string const& f, mode m, creation_flags d)
 			return {result::noperm, err};
 		case ERROR_DISK_FULL:
 			return {result::nospace, err};
+		case ERROR_FILE_NOT_FOUND:
+			return {result::nofile, err};
+		case ERROR_PATH_NOT_FOUND:
+			return {result::nodir, err};
 		default:
 			return {result::other, err};
 		}
@@ -110,12 +244,16 @@ void file::close()
 		CloseHandle(fd_);
 		fd_ = INVALID_HANDLE_VALUE;
 	}
+	drop_behind_ = -1;
+	alignment_ = 0;
 }
 
 file::file_t file::detach()
 {
 	file_t fd = fd_;
 	fd_ = INVALID_HANDLE_VALUE;
+	drop_behind_ = -1;
+	alignment_ = 0;
 	return fd;
 }
 
@@ -181,6 +319,56 @@ int64_t file::write(void const* buf, int64_t count)
 	return ret;
 }
 
+int64_t file::read_at(int64_t offset, void *buf, int64_t count)
+{
+	int64_t ret = -1;
+
+	OVERLAPPED ov{};
+	ov.Offset = static_cast<DWORD>(offset);
+	ov.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32);
+
+	DWORD read = 0;
+	if (ReadFile(fd_, buf, static_cast<DWORD>(count), &read, &ov)) {
+		ret = static_cast<int64_t>(read);
+	}
+	else if (GetLastError() == ERROR_HANDLE_EOF) {
+		ret = 0;
+	}
+
+	return ret;
+}
+
+int64_t file::write_at(int64_t offset, void const* buf, int64_t count)
+{
+	int64_t ret = -1;
+
+	OVERLAPPED ov{};
+	ov.Offset = static_cast<DWORD>(offset);
+	ov.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32);
+
+	DWORD written = 0;
+	if (WriteFile(fd_, buf, static_cast<DWORD>(count), &written, &ov)) {
+		ret = static_cast<int64_t>(written);
+	}
+
+	return ret;
+}
+
+int64_t file::read_at(int64_t offset, segment const* segments, size_t count)
+{
+	// ReadFileScatter requires unbuffered access with page-sized segments
+	return transfer_segments(offset, segments, count, [this](int64_t o, void* buf, int64_t size) {
+		return read_at(o, buf, size);
+	});
+}
+
+int64_t file::write_at(int64_t offset, const_segment const* segments, size_t count)
+{
+	return transfer_segments(offset, segments, count, [this](int64_t o, void const* buf, int64_t size) {
+		return write_at(o, buf, size);
+	});
+}
+
 bool file::opened() const
 {
 	return fd_ != INVALID_HANDLE_VALUE;
@@ -201,12 +389,101 @@ bool file::fsync()
 	return FlushFileBuffers(fd_) != 0;
 }
 
+bool file::allocate(int64_t size, bool extend)
+{
+	int64_t const current = this->size();
+	if (current < 0) {
+		return false;
+	}
+	if (size <= current) {
+		// Reducing the allocation size would truncate the file
+		return true;
+	}
+
+	FILE_ALLOCATION_INFO info{};
+	info.AllocationSize.QuadPart = size;
+	if (!SetFileInformationByHandle(fd_, FileAllocationInfo, &info, sizeof(info))) {
+		return false;
+	}
+
+	if (extend) {
+		FILE_END_OF_FILE_INFO eof{};
+		eof.EndOfFile.QuadPart = size;
+		return SetFileInformationByHandle(fd_, FileEndOfFileInfo, &eof, sizeof(eof)) != 0;
+	}
+	return true;
+}
+
+bool file::punch_hole(int64_t offset, int64_t length)
+{
+	DWORD bytes{};
+	if (!DeviceIoControl(fd_, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &bytes, nullptr)) {
+		return false;
+	}
+
+	FILE_ZERO_DATA_INFORMATION zero{};
+	zero.FileOffset.QuadPart = offset;
+	zero.BeyondFinalZero.QuadPart = offset + length;
+	return DeviceIoControl(fd_, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), nullptr, 0, &bytes, nullptr) != 0;
+}
+
+std::vector<std::pair<int64_t, int64_t>> file::data_ranges()
+{
+	std::vector<std::pair<int64_t, int64_t>> ret;
+
+	int64_t const size = this->size();
+	if (size <= 0) {
+		return ret;
+	}
+
+	FILE_ALLOCATED_RANGE_BUFFER query{};
+	query.Length.QuadPart = size;
+	FILE_ALLOCATED_RANGE_BUFFER ranges[64];
+	while (true) {
+		DWORD bytes{};
+		BOOL const res = DeviceIoControl(fd_, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), ranges, sizeof(ranges), &bytes, nullptr);
+		if (!res && GetLastError() != ERROR_MORE_DATA) {
+			// Treat the remainder as data
+			ret.emplace_back(query.FileOffset.QuadPart, size - query.FileOffset.QuadPart);
+			break;
+		}
+
+		size_t const n = bytes / sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+		for (size_t i = 0; i < n; ++i) {
+			ret.emplace_back(ranges[i].FileOffset.QuadPart, ranges[i].Length.QuadPart);
+		}
+		if (res || !n) {
+			break;
+		}
+		query.FileOffset.QuadPart = ranges[n - 1].FileOffset.QuadPart + ranges[n - 1].Length.QuadPart;
+		query.Length.QuadPart = size - query.FileOffset.QuadPart;
+	}
+
+	return ret;
+}
+
+bool file::advise(int64_t, int64_t, advice a)
+{
+	return a == advice::normal;
+}
+
+bool file::set_drop_behind(bool enable)
+{
+	return !enable;
+}
+
 #else
 
 file::file(file && op) noexcept
 	: fd_{op.fd_}
+	, drop_behind_{op.drop_behind_}
+	, alignment_{op.alignment_}
+	, buffered_fd_{op.buffered_fd_}
 {
 	op.fd_ = -1;
+	op.drop_behind_ = -1;
+	op.alignment_ = 0;
+	op.buffered_fd_ = -1;
 }
 
 file& file::operator=(file && op) noexcept
@@ -214,7 +491,13 @@ file& file::operator=(file && op) noexcept
 	if (this != &op) {
 		close();
 		fd_ = op.fd_;
+		drop_behind_ = op.drop_behind_;
+		alignment_ = op.alignment_;
+		buffered_fd_ = op.buffered_fd_;
 		op.fd_ = -1;
+		op.drop_behind_ = -1;
+		op.alignment_ = 0;
+		op.buffered_fd_ = -1;
 	}
 	return *this;
 }
@@ -250,14 +533,23 @@ result file::open(native_string const& f, mode m, creation_flags d)
 		case EDQUOT:
 		case ENOSPC:
 			return {result::nospace, err};
+		case ENOENT:
+			// When writing, files get created
+			return {(m == reading) ? result::nofile : result::nodir, err};
+		case ENOTDIR:
+			return {result::nodir, err};
 		default:
 			return {result::other, err};
 		}
 	}
 
-#if HAVE_POSIX_FADVISE
-	(void)posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL | POSIX_FADV_NOREUSE);
-#endif
+	if (d & direct) {
+		enable_direct(f, m);
+	}
+	else {
+		// Advice values are not flags and cannot be combined
+		advise(0, 0, advice::sequential);
+	}
 
 	return {result::ok};
 }
@@ -268,12 +560,19 @@ void file::close()
 		::close(fd_);
 		fd_ = -1;
 	}
+	if (buffered_fd_ != -1) {
+		::close(buffered_fd_);
+		buffered_fd_ = -1;
+	}
+	drop_behind_ = -1;
+	alignment_ = 0;
 }
 
 file::file_t file::detach()
 {
 	file_t fd = fd_;
 	fd_ = -1;
+	close();
 	return fd;
 }
 
@@ -325,23 +624,129 @@ bool file::truncate()
 
 int64_t file::read(void *buf, int64_t count)
 {
-	int64_t ret;
-	do {
-		ret = ::read(fd_, buf, count);
-	} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+	auto const op = [this](int fd, unsigned char* b, int64_t c, int64_t) {
+		if (fd != fd_) {
+			return at_position(fd_, fd, [&](int bfd, off_t pos) { return ::pread(bfd, b, c, pos); });
+		}
+		int64_t ret;
+		do {
+			ret = ::read(fd, b, c);
+		} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+		return ret;
+	};
 
-	return ret;
+	if (alignment_ > 1) {
+		return direct_transfer(fd_, buffered_fd_, alignment_, static_cast<unsigned char*>(buf), count, op);
+	}
+	return op(fd_, static_cast<unsigned char*>(buf), count, 0);
 }
 
 int64_t file::write(void const* buf, int64_t count)
 {
+	auto const op = [this](int fd, unsigned char const* b, int64_t c, int64_t) {
+		if (fd != fd_) {
+			return at_position(fd_, fd, [&](int bfd, off_t pos) { return ::pwrite(bfd, b, c, pos); });
+		}
+		int64_t ret;
+		do {
+			ret = ::write(fd, b, c);
+		} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+		return ret;
+	};
+
 	int64_t ret;
-	do {
-		ret = ::write(fd_, buf, count);
-	} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+	if (alignment_ > 1) {
+		ret = direct_transfer(fd_, buffered_fd_, alignment_, static_cast<unsigned char const*>(buf), count, op);
+	}
+	else {
+		ret = op(fd_, static_cast<unsigned char const*>(buf), count, 0);
+	}
+
+	if (ret > 0 && drop_behind_ != -1) {
+		drop_behind();
+	}
+
+	return ret;
+}
+
+int64_t file::read_at(int64_t offset, void *buf, int64_t count)
+{
+	auto const op = [offset](int fd, unsigned char* b, int64_t c, int64_t done) {
+		int64_t ret;
+		do {
+			ret = ::pread(fd, b, c, offset + done);
+		} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+		return ret;
+	};
+
+	if (alignment_ > 1) {
+		return direct_transfer(fd_, buffered_fd_, alignment_, static_cast<unsigned char*>(buf), count, op);
+	}
+	return op(fd_, static_cast<unsigned char*>(buf), count, 0);
+}
+
+int64_t file::write_at(int64_t offset, void const* buf, int64_t count)
+{
+	auto const op = [offset](int fd, unsigned char const* b, int64_t c, int64_t done) {
+		int64_t ret;
+		do {
+			ret = ::pwrite(fd, b, c, offset + done);
+		} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+		return ret;
+	};
+
+	if (alignment_ > 1) {
+		return direct_transfer(fd_, buffered_fd_, alignment_, static_cast<unsigned char const*>(buf), count, op);
+	}
+	return op(fd_, static_cast<unsigned char const*>(buf), count, 0);
+}
+
+#if FZ_HAVE_PREADV
+int64_t file::read_at(int64_t offset, segment const* segments, size_t count)
+{
+	auto const op = [&](int fd) {
+		return transfer_segments(segments, count, [&](iovec const* iov, int n) {
+			return ::preadv(fd, iov, n, offset);
+		});
+	};
+
+	int64_t const ret = op(fd_);
+	if (ret == -1 && errno == EINVAL && buffered_fd_ != -1) {
+		// Some segment is not aligned
+		return op(buffered_fd_);
+	}
+	return ret;
+}
 
+int64_t file::write_at(int64_t offset, const_segment const* segments, size_t count)
+{
+	auto const op = [&](int fd) {
+		return transfer_segments(segments, count, [&](iovec const* iov, int n) {
+			return ::pwritev(fd, iov, n, offset);
+		});
+	};
+
+	int64_t const ret = op(fd_);
+	if (ret == -1 && errno == EINVAL && buffered_fd_ != -1) {
+		return op(buffered_fd_);
+	}
 	return ret;
 }
+#else
+int64_t file::read_at(int64_t offset, segment const* segments, size_t count)
+{
+	return transfer_segments(offset, segments, count, [this](int64_t o, void* buf, int64_t size) {
+		return read_at(o, buf, size);
+	});
+}
+
+int64_t file::write_at(int64_t offset, const_segment const* segments, size_t count)
+{
+	return transfer_segments(offset, segments, count, [this](int64_t o, void const* buf, int64_t size) {
+		return write_at(o, buf, size);
+	});
+}
+#endif
 
 bool file::opened() const
 {
@@ -366,6 +771,259 @@ bool file::fsync()
 #endif
 }
 
+bool file::allocate(int64_t size, bool extend)
+{
+	if (size <= 0) {
+		return size == 0;
+	}
+
+#if defined(__linux__)
+	// Not using posix_fallocate, glibc emulates it by writing to every block
+	int res;
+	do {
+		res = fallocate(fd_, extend ? 0 : FALLOC_FL_KEEP_SIZE, 0, size);
+	} while (res == -1 && errno == EINTR);
+	return res == 0;
+#elif defined(FZ_MAC)
+	int64_t const current = this->size();
+	if (current < 0) {
+		return false;
+	}
+	if (size > current) {
+		// Allocates relative to the physical end of the file
+		fstore_t store{F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, size - current, 0};
+		if (fcntl(fd_, F_PREALLOCATE, &store) == -1) {
+			store.fst_flags = F_ALLOCATEALL;
+			if (fcntl(fd_, F_PREALLOCATE, &store) == -1) {
+				return false;
+			}
+		}
+		if (extend) {
+			return ftruncate(fd_, size) == 0;
+		}
+	}
+	return true;
+#elif defined(__FreeBSD__)
+	if (!extend && size > this->size()) {
+		// posix_fallocate always extends the file
+		return false;
+	}
+	return posix_fallocate(fd_, 0, size) == 0;
+#else
+	(void)extend;
+	return false;
+#endif
+}
+
+bool file::punch_hole(int64_t offset, int64_t length)
+{
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+	int res;
+	do {
+		res = fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length);
+	} while (res == -1 && errno == EINTR);
+	return res == 0;
+#elif defined(F_PUNCHHOLE)
+	fpunchhole_t hole{};
+	hole.fp_offset = offset;
+	hole.fp_length = length;
+	return fcntl(fd_, F_PUNCHHOLE, &hole) == 0;
+#else
+	(void)offset;
+	(void)length;
+	return false;
+#endif
+}
+
+std::vector<std::pair<int64_t, int64_t>> file::data_ranges()
+{
+	std::vector<std::pair<int64_t, int64_t>> ret;
+
+	int64_t const size = this->size();
+	if (size <= 0) {
+		return ret;
+	}
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	auto const pos = lseek(fd_, 0, SEEK_CUR);
+	if (pos == static_cast<off_t>(-1)) {
+		return ret;
+	}
+
+	int64_t offset{};
+	while (offset < size) {
+		auto const data = lseek(fd_, offset, SEEK_DATA);
+		if (data == static_cast<off_t>(-1)) {
+			if (errno != ENXIO) {
+				// Not supported, treat the remainder as data
+				ret.emplace_back(offset, size - offset);
+			}
+			// Otherwise there is no more data
+			break;
+		}
+		auto hole = lseek(fd_, data, SEEK_HOLE);
+		if (hole == static_cast<off_t>(-1) || hole > size) {
+			hole = size;
+		}
+		if (hole <= data) {
+			break;
+		}
+		ret.emplace_back(data, hole - data);
+		offset = hole;
+	}
+
+	lseek(fd_, pos, SEEK_SET);
+#else
+	ret.emplace_back(0, size);
+#endif
+
+	return ret;
+}
+
+bool file::advise(int64_t offset, int64_t length, advice a)
+{
+#if HAVE_POSIX_FADVISE
+	int flag;
+	switch (a) {
+	case advice::normal:
+		flag = POSIX_FADV_NORMAL;
+		break;
+	case advice::sequential:
+		flag = POSIX_FADV_SEQUENTIAL;
+		break;
+	case advice::random:
+		flag = POSIX_FADV_RANDOM;
+		break;
+	case advice::willneed:
+		flag = POSIX_FADV_WILLNEED;
+		break;
+	case advice::dontneed:
+		flag = POSIX_FADV_DONTNEED;
+		break;
+	case advice::noreuse:
+		flag = POSIX_FADV_NOREUSE;
+		break;
+	default:
+		return false;
+	}
+	return posix_fadvise(fd_, offset, length, flag) == 0;
+#else
+	(void)offset;
+	(void)length;
+	return a == advice::normal;
+#endif
+}
+
+bool file::set_drop_behind(bool enable)
+{
+#if HAVE_POSIX_FADVISE
+	if (!enable) {
+		drop_behind_ = -1;
+		return true;
+	}
+
+	auto const pos = lseek(fd_, 0, SEEK_CUR);
+	if (pos == static_cast<off_t>(-1)) {
+		return false;
+	}
+	drop_behind_ = pos;
+	return true;
+#else
+	return !enable;
+#endif
+}
+
+void file::drop_behind()
+{
+#if HAVE_POSIX_FADVISE
+	// Keeps up to two chunks worth of written data in the cache
+	int64_t const chunk = 8 * 1024 * 1024;
+
+	auto const pos = lseek(fd_, 0, SEEK_CUR);
+	if (pos == static_cast<off_t>(-1)) {
+		return;
+	}
+	if (pos < drop_behind_) {
+		// Seeked backwards
+		drop_behind_ = pos;
+		return;
+	}
+
+	while (pos - drop_behind_ >= 2 * chunk) {
+#ifdef SYNC_FILE_RANGE_WRITE
+		// Dirty pages cannot be dropped, wait for the oldest chunk to be written.
+		// Start writing the next one so that it is done by the time we get to it.
+		sync_file_range(fd_, drop_behind_, chunk, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		sync_file_range(fd_, drop_behind_ + chunk, chunk, SYNC_FILE_RANGE_WRITE);
+#endif
+		posix_fadvise(fd_, drop_behind_, chunk, POSIX_FADV_DONTNEED);
+		drop_behind_ += chunk;
+	}
+#endif
+}
+
+void file::enable_direct(native_string const& f, mode m)
+{
+#if defined(__linux__) && defined(O_DIRECT)
+	// A second description of the same file without O_DIRECT for the unaligned parts
+	// of transfers. Toggling O_DIRECT on the shared description instead would affect
+	// concurrent transfers of other threads.
+	buffered_fd_ = ::open(f.c_str(), ((m == reading) ? O_RDONLY : O_WRONLY) | O_CLOEXEC);
+	struct stat st, buffered_st;
+	if (buffered_fd_ == -1 || fstat(fd_, &st) || fstat(buffered_fd_, &buffered_st) ||
+		st.st_dev != buffered_st.st_dev || st.st_ino != buffered_st.st_ino)
+	{
+		// The file has been replaced in the meantime
+		if (buffered_fd_ != -1) {
+			::close(buffered_fd_);
+			buffered_fd_ = -1;
+		}
+		return;
+	}
+
+	int const flags = fcntl(fd_, F_GETFL);
+	if (flags == -1 || fcntl(fd_, F_SETFL, flags | O_DIRECT) == -1) {
+		// Not supported by the filesystem
+		::close(buffered_fd_);
+		buffered_fd_ = -1;
+		return;
+	}
+
+	// The logical block size of practically all devices divides this
+	size_t alignment = 4096;
+#ifdef STATX_DIOALIGN
+	struct statx stx{};
+	if (statx(fd_, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN)) {
+		if (!stx.stx_dio_mem_align || !stx.stx_dio_offset_align) {
+			// Filesystem accepts the flag, but falls back to buffered I/O anyway
+			fcntl(fd_, F_SETFL, flags);
+			::close(buffered_fd_);
+			buffered_fd_ = -1;
+			return;
+		}
+		alignment = std::max(stx.stx_dio_mem_align, stx.stx_dio_offset_align);
+	}
+#endif
+	alignment_ = alignment;
+#elif defined(O_DIRECT)
+	(void)f;
+	(void)m;
+
+	// Unaligned requests are served through the buffer cache by the system itself
+	int const flags = fcntl(fd_, F_GETFL);
+	if (flags != -1 && fcntl(fd_, F_SETFL, flags | O_DIRECT) != -1) {
+		alignment_ = 1;
+	}
+#elif defined(F_NOCACHE)
+	(void)f;
+	(void)m;
+
+	if (fcntl(fd_, F_NOCACHE, 1) != -1) {
+		alignment_ = 1;
+	}
+#endif
+}
+
 #endif
 
 }
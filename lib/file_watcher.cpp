@@ -0,0 +1,580 @@
+#include "libfilezilla/file_watcher.hpp"
+#include "libfilezilla/event_handler.hpp"
+#include "libfilezilla/event_loop.hpp"
+#include "libfilezilla/local_filesys.hpp"
+#include "libfilezilla/mutex.hpp"
+#include "libfilezilla/thread_pool.hpp"
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<sys/inotify.h>)
+#define FZ_USE_INOTIFY 1
+#include "unix/poller.hpp"
+#include <sys/inotify.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+namespace fz {
+
+namespace {
+native_string normalize(native_string path)
+{
+	while (path.size() > 1 && local_filesys::is_separator(path.back())) {
+		path.pop_back();
+	}
+	return path;
+}
+
+native_string join(native_string const& path, native_string_view name)
+{
+	native_string ret = path;
+	if (ret.empty() || !local_filesys::is_separator(ret.back())) {
+		ret += local_filesys::path_separator;
+	}
+	ret.append(name);
+	return ret;
+}
+
+// State of a path as seen by the periodic scan
+struct scanned final
+{
+	local_filesys::type t{};
+	int64_t size{};
+	datetime mtime;
+	int mode{};
+};
+
+typedef std::map<native_string, scanned> snapshot;
+
+void scan_entries(native_string const& path, bool recursive, snapshot & out)
+{
+	local_filesys fs;
+	if (!fs.begin_find_files(path, false, false)) {
+		return;
+	}
+
+	std::vector<native_string> subdirs;
+	local_filesys::entries entries;
+	while (fs.get_next_files(entries)) {
+		for (size_t i = 0; i < entries.size(); ++i) {
+			auto const& e = entries[i];
+			native_string name = join(path, entries.name(i));
+			if (recursive && e.t == local_filesys::dir) {
+				subdirs.push_back(name);
+			}
+			out[std::move(name)] = scanned{e.t, e.size, e.modification_time, e.mode};
+		}
+	}
+	fs.end_find_files();
+
+	for (auto const& subdir : subdirs) {
+		scan_entries(subdir, true, out);
+	}
+}
+
+void scan(native_string const& path, bool recursive, snapshot & out)
+{
+	scanned s;
+	bool is_link{};
+	s.t = local_filesys::get_file_info(path, is_link, &s.size, &s.mtime, &s.mode);
+	if (s.t == local_filesys::unknown) {
+		return;
+	}
+	out[path] = s;
+	if (s.t == local_filesys::dir) {
+		scan_entries(path, recursive, out);
+	}
+}
+
+#if FZ_USE_INOTIFY
+result make_error(int err)
+{
+	switch (err) {
+	case EACCES:
+	case EPERM:
+		return {result::noperm, err};
+	case ENOENT:
+	case ENOTDIR:
+		return {result::nofile, err};
+	case ENOSPC:
+		return {result::nospace, err};
+	default:
+		return {result::other, err};
+	}
+}
+
+bool is_below(native_string const& path, native_string const& dir)
+{
+	return path.size() >= dir.size() && !path.compare(0, dir.size(), dir) &&
+		(path.size() == dir.size() || local_filesys::is_separator(path[dir.size()]));
+}
+#endif
+}
+
+class file_watcher::impl final
+{
+public:
+	impl(file_watcher & watcher, thread_pool & pool, event_handler & handler, options const& opts)
+		: watcher_(watcher)
+		, handler_(handler)
+		, opts_(opts)
+	{
+#if FZ_USE_INOTIFY
+		if (opts_.use_inotify) {
+			fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (fd_ != -1 && poller_.init() != 0) {
+				close(fd_);
+				fd_ = -1;
+			}
+		}
+#endif
+		task_ = pool.spawn([this]() { thread_entry(); });
+	}
+
+	~impl()
+	{
+		{
+			scoped_lock l(mtx_);
+			quit_ = true;
+			interrupt(l);
+		}
+		task_.join();
+
+#if FZ_USE_INOTIFY
+		if (fd_ != -1) {
+			close(fd_);
+		}
+#endif
+
+		auto filter = [&](event_loop::Events::value_type const& ev) -> bool {
+			if (ev.first != &handler_) {
+				return false;
+			}
+			else if (ev.second->derived_type() != file_watcher_event::type()) {
+				return false;
+			}
+			return std::get<0>(static_cast<file_watcher_event const&>(*ev.second).v_) == &watcher_;
+		};
+		handler_.event_loop_.filter_events(filter);
+	}
+
+	result add(native_string const& path, bool recursive);
+	void remove(native_string const& path);
+
+	bool uses_inotify() const
+	{
+#if FZ_USE_INOTIFY
+		return fd_ != -1;
+#else
+		return false;
+#endif
+	}
+
+private:
+	void thread_entry();
+	void interrupt(scoped_lock & l);
+
+	// Records a change, to be sent once the coalescing delay has passed
+	void change(native_string const& path, file_change c);
+	void flush();
+
+	void rescan(scoped_lock & l);
+	void compare(snapshot const& before, snapshot const& after);
+
+	file_watcher & watcher_;
+	event_handler & handler_;
+	options const opts_;
+
+	mutex mtx_{false};
+	condition cond_;
+	async_task task_;
+	bool quit_{};
+
+	std::vector<std::pair<native_string, file_change>> pending_;
+	std::unordered_map<native_string, size_t> pending_index_;
+	monotonic_clock deadline_;
+
+	struct root final
+	{
+		bool recursive_{};
+
+		// Only used when scanning
+		snapshot snapshot_;
+	};
+	std::map<native_string, root> roots_;
+
+#if FZ_USE_INOTIFY
+	struct watch final
+	{
+		native_string path_;
+		native_string root_;
+	};
+
+	result add_watches(native_string const& path, native_string const& root, bool recursive, bool report);
+	void remove_watches(native_string const& path);
+	void process_events();
+
+	int fd_{-1};
+	poller poller_;
+	std::unordered_map<int, watch> watches_;
+	alignas(inotify_event) unsigned char buffer_[16 * 1024];
+#endif
+};
+
+void file_watcher::impl::interrupt(scoped_lock & l)
+{
+#if FZ_USE_INOTIFY
+	if (fd_ != -1) {
+		poller_.interrupt(l);
+		return;
+	}
+#endif
+	cond_.signal(l);
+}
+
+void file_watcher::impl::thread_entry()
+{
+	scoped_lock l(mtx_);
+	while (!quit_) {
+#if FZ_USE_INOTIFY
+		if (fd_ != -1) {
+			int timeout = -1;
+			if (!pending_.empty()) {
+				auto const remaining = deadline_ - monotonic_clock::now();
+				timeout = remaining > duration() ? static_cast<int>(remaining.get_milliseconds()) + 1 : 0;
+			}
+
+			struct pollfd fds[2]{};
+			fds[0].fd = fd_;
+			fds[0].events = POLLIN;
+			if (!poller_.wait(fds, 1, l, timeout)) {
+				break;
+			}
+			if (quit_) {
+				break;
+			}
+
+			if (fds[0].revents) {
+				process_events();
+			}
+			if (!pending_.empty() && monotonic_clock::now() >= deadline_) {
+				flush();
+			}
+			continue;
+		}
+#endif
+		cond_.wait(l, opts_.poll_interval);
+		if (!quit_) {
+			rescan(l);
+		}
+	}
+}
+
+void file_watcher::impl::change(native_string const& path, file_change c)
+{
+	if (pending_.empty()) {
+		deadline_ = monotonic_clock::now() + opts_.coalesce;
+	}
+
+	auto const it = pending_index_.emplace(path, pending_.size());
+	if (it.second) {
+		pending_.emplace_back(path, c);
+	}
+	else {
+		pending_[it.first->second].second |= c;
+	}
+}
+
+void file_watcher::impl::flush()
+{
+	for (auto & p : pending_) {
+		handler_.send_event<file_watcher_event>(&watcher_, std::move(p.first), p.second);
+	}
+	pending_.clear();
+	pending_index_.clear();
+}
+
+result file_watcher::impl::add(native_string const& path, bool recursive)
+{
+	native_string const p = normalize(path);
+	if (p.empty()) {
+		return {result::invalid};
+	}
+	if (!task_) {
+		return {result::other};
+	}
+
+#if FZ_USE_INOTIFY
+	if (uses_inotify()) {
+		scoped_lock l(mtx_);
+		remove_watches(p);
+		roots_[p].recursive_ = recursive;
+		result const res = add_watches(p, p, recursive, false);
+		if (!res) {
+			remove_watches(p);
+			roots_.erase(p);
+		}
+		return res;
+	}
+#endif
+
+	if (local_filesys::get_file_type(p) == local_filesys::unknown) {
+		return {result::nofile};
+	}
+
+	snapshot s;
+	scan(p, recursive, s);
+
+	scoped_lock l(mtx_);
+	auto & r = roots_[p];
+	r.recursive_ = recursive;
+	r.snapshot_ = std::move(s);
+	return {result::ok};
+}
+
+void file_watcher::impl::remove(native_string const& path)
+{
+	native_string const p = normalize(path);
+
+	scoped_lock l(mtx_);
+	roots_.erase(p);
+#if FZ_USE_INOTIFY
+	for (auto it = watches_.begin(); it != watches_.end(); ) {
+		if (it->second.root_ == p) {
+			inotify_rm_watch(fd_, it->first);
+			it = watches_.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+#endif
+}
+
+void file_watcher::impl::rescan(scoped_lock & l)
+{
+	// Scan without holding the lock, the tree may be large
+	std::vector<std::pair<native_string, bool>> roots;
+	for (auto const& r : roots_) {
+		roots.emplace_back(r.first, r.second.recursive_);
+	}
+
+	l.unlock();
+	std::vector<snapshot> snapshots(roots.size());
+	for (size_t i = 0; i < roots.size(); ++i) {
+		scan(roots[i].first, roots[i].second, snapshots[i]);
+	}
+	l.lock();
+
+	for (size_t i = 0; i < roots.size(); ++i) {
+		auto const it = roots_.find(roots[i].first);
+		if (it == roots_.end() || it->second.recursive_ != roots[i].second) {
+			// Removed or re-added in the meantime
+			continue;
+		}
+		compare(it->second.snapshot_, snapshots[i]);
+		it->second.snapshot_ = std::move(snapshots[i]);
+	}
+
+	// A scan already coalesces all changes since the previous one
+	flush();
+}
+
+void file_watcher::impl::compare(snapshot const& before, snapshot const& after)
+{
+	auto b = before.cbegin();
+	auto a = after.cbegin();
+	while (b != before.cend() || a != after.cend()) {
+		if (a == after.cend() || (b != before.cend() && b->first < a->first)) {
+			change(b->first, file_change::deleted);
+			++b;
+		}
+		else if (b == before.cend() || a->first < b->first) {
+			change(a->first, file_change::created);
+			++a;
+		}
+		else {
+			auto const& x = b->second;
+			auto const& y = a->second;
+
+			// The modification time of directories changes along with their entries, which get reported themselves
+			bool const modified = x.t != y.t || x.mode != y.mode ||
+				(y.t != local_filesys::dir && (x.size != y.size || x.mtime != y.mtime));
+			if (modified) {
+				change(a->first, file_change::modified);
+			}
+			++a;
+			++b;
+		}
+	}
+}
+
+#if FZ_USE_INOTIFY
+result file_watcher::impl::add_watches(native_string const& path, native_string const& root, bool recursive, bool report)
+{
+	// IN_ATTRIB and IN_MODIFY are also reported for the entries of the directory
+	uint32_t mask = IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO;
+	if (path != root) {
+		// Only the watched path itself may be a link
+		mask |= IN_DONT_FOLLOW | IN_ONLYDIR;
+	}
+
+	int const wd = inotify_add_watch(fd_, path.c_str(), mask);
+	if (wd == -1) {
+		return make_error(errno);
+	}
+	watches_[wd] = watch{path, root};
+
+	if (!recursive || local_filesys::get_file_type(path) != local_filesys::dir) {
+		return {result::ok};
+	}
+
+	// Entries may have been created before the watch got added
+	local_filesys fs;
+	result res = fs.begin_find_files(path, false, false);
+	if (!res) {
+		return res;
+	}
+
+	std::vector<native_string> subdirs;
+	local_filesys::entries entries;
+	while (fs.get_next_files(entries, false)) {
+		for (size_t i = 0; i < entries.size(); ++i) {
+			native_string name = join(path, entries.name(i));
+			if (report) {
+				change(name, file_change::created);
+			}
+			if (entries[i].t == local_filesys::dir) {
+				subdirs.push_back(std::move(name));
+			}
+		}
+	}
+	fs.end_find_files();
+
+	for (auto const& subdir : subdirs) {
+		result const r = add_watches(subdir, root, true, report);
+		if (!r && res) {
+			res = r;
+		}
+	}
+	return res;
+}
+
+void file_watcher::impl::remove_watches(native_string const& path)
+{
+	for (auto it = watches_.begin(); it != watches_.end(); ) {
+		if (is_below(it->second.path_, path)) {
+			inotify_rm_watch(fd_, it->first);
+			it = watches_.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void file_watcher::impl::process_events()
+{
+	while (true) {
+		ssize_t const r = read(fd_, buffer_, sizeof(buffer_));
+		if (r <= 0) {
+			if (r == -1 && errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for (ssize_t pos = 0; pos < r; ) {
+			auto const& ev = *reinterpret_cast<inotify_event const*>(buffer_ + pos);
+			pos += sizeof(inotify_event) + ev.len;
+
+			if (ev.mask & IN_Q_OVERFLOW) {
+				for (auto const& root : roots_) {
+					change(root.first, file_change::overflow);
+				}
+				continue;
+			}
+
+			auto const it = watches_.find(ev.wd);
+			if (it == watches_.end()) {
+				continue;
+			}
+			if (ev.mask & IN_IGNORED) {
+				watches_.erase(it);
+				continue;
+			}
+
+			watch const w = it->second;
+			if (!ev.len && w.path_ != w.root_) {
+				// Changes to subdirectories themselves are also reported through the watch of their parent
+				continue;
+			}
+			native_string const path = ev.len ? join(w.path_, native_string_view(ev.name)) : w.path_;
+
+			file_change c{};
+			if (ev.mask & IN_CREATE) {
+				c |= file_change::created;
+			}
+			if (ev.mask & (IN_ATTRIB | IN_MODIFY)) {
+				c |= file_change::modified;
+			}
+			if (ev.mask & (IN_DELETE | IN_DELETE_SELF)) {
+				c |= file_change::deleted;
+			}
+			if (ev.mask & (IN_MOVED_FROM | IN_MOVE_SELF)) {
+				c |= file_change::moved_from;
+			}
+			if (ev.mask & IN_MOVED_TO) {
+				c |= file_change::moved_to;
+			}
+			if (c != file_change{}) {
+				change(path, c);
+			}
+
+			if (ev.len && (ev.mask & IN_ISDIR)) {
+				if (ev.mask & IN_MOVED_FROM) {
+					remove_watches(path);
+				}
+				auto const root = roots_.find(w.root_);
+				if (root != roots_.end() && root->second.recursive_ && (ev.mask & (IN_CREATE | IN_MOVED_TO))) {
+					add_watches(path, w.root_, true, true);
+				}
+			}
+		}
+	}
+}
+#endif
+
+file_watcher::file_watcher(thread_pool & pool, event_handler & handler)
+	: impl_(std::make_unique<impl>(*this, pool, handler, options()))
+{
+}
+
+file_watcher::file_watcher(thread_pool & pool, event_handler & handler, options const& opts)
+	: impl_(std::make_unique<impl>(*this, pool, handler, opts))
+{
+}
+
+file_watcher::~file_watcher()
+{
+}
+
+result file_watcher::add(native_string const& path, bool recursive)
+{
+	return impl_->add(path, recursive);
+}
+
+void file_watcher::remove(native_string const& path)
+{
+	impl_->remove(path);
+}
+
+bool file_watcher::uses_inotify() const
+{
+	return impl_->uses_inotify();
+}
+
+}
@@ -290,6 +290,19 @@ bool set_process_impersonation(impersonation_token const& token)
 	return true;
 }
 
+bool get_impersonation_ids(impersonation_token const& token, uid_t & uid, gid_t & gid, std::vector<gid_t> & sup_groups)
+{
+	auto impl = impersonation_token_impl::get(token);
+	if (!impl) {
+		return false;
+	}
+
+	uid = impl->uid_;
+	gid = impl->gid_;
+	sup_groups = impl->sup_groups_;
+	return true;
+}
+
 bool impersonation_token::operator==(impersonation_token const& op) const
 {
 	if (!impl_) {
@@ -0,0 +1,60 @@
+#ifndef LIBFILEZILLA_ALIGNED_BUFFER_HEADER
+#define LIBFILEZILLA_ALIGNED_BUFFER_HEADER
+
+#include "libfilezilla.hpp"
+
+/** \file
+ * \brief Declares fz::aligned_buffer
+ */
+
+namespace fz {
+
+/**
+ * \brief A fixed-size block of memory with a guaranteed alignment.
+ *
+ * Direct I/O requires the memory passed to the system to be aligned to the
+ * logical block size of the underlying device, something \ref buffer and
+ * the standard containers cannot guarantee. See \ref file::alignment.
+ *
+ * Throws std::bad_alloc if the memory cannot be allocated.
+ */
+class FZ_PUBLIC_SYMBOL aligned_buffer final
+{
+public:
+	aligned_buffer() noexcept = default;
+
+	/** \brief Allocates the passed amount of memory.
+	 *
+	 * \param capacity Rounded up to a multiple of the alignment.
+	 * \param alignment Must be a power of two, at least the size of a pointer is used.
+	 */
+	explicit aligned_buffer(size_t capacity, size_t alignment = 4096);
+
+	~aligned_buffer();
+
+	aligned_buffer(aligned_buffer const&) = delete;
+	aligned_buffer& operator=(aligned_buffer const&) = delete;
+
+	aligned_buffer(aligned_buffer && op) noexcept;
+	aligned_buffer& operator=(aligned_buffer && op) noexcept;
+
+	unsigned char* data() { return data_; }
+	unsigned char const* data() const { return data_; }
+
+	size_t capacity() const { return capacity_; }
+	size_t alignment() const { return alignment_; }
+
+	explicit operator bool() const { return data_ != nullptr; }
+
+	/// Frees the memory
+	void reset();
+
+private:
+	unsigned char* data_{};
+	size_t capacity_{};
+	size_t alignment_{};
+};
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef LIBFILEZILLA_ASYNC_FILE_HEADER
+#define LIBFILEZILLA_ASYNC_FILE_HEADER
+
+/** \file
+ * \brief Declares \ref fz::async_file "async_file" for file I/O that does not block the event loop
+ */
+
+#include "buffer.hpp"
+#include "event_handler.hpp"
+#include "file.hpp"
+#include "mutex.hpp"
+#include "thread_pool.hpp"
+
+#include <deque>
+#include <memory>
+
+namespace fz {
+
+/**
+ * \brief Reads or writes a file sequentially without blocking the calling thread.
+ *
+ * Transfers are split into blocks which are submitted as positional reads and
+ * writes. Up to \ref options::queue_depth blocks are in flight at any time:
+ * When reading, the blocks following the current position are read ahead, when
+ * writing, written data gets queued and is flushed behind the caller's back.
+ *
+ * On Linux the requests are submitted through io_uring if the kernel supports it,
+ * otherwise they are executed by workers obtained from the passed \ref thread_pool.
+ *
+ * Like with non-blocking sockets, \ref read, \ref write and \ref finalize return
+ * \ref status::wait if they cannot make progress right now. An \ref async_file_event
+ * is then sent to the event handler once the operation should be retried.
+ *
+ * All member functions must be called from the same thread, usually the thread
+ * of the handler's event loop.
+ */
+class FZ_PUBLIC_SYMBOL async_file final
+{
+public:
+	struct options final {
+		/// Maximum number of blocks in flight
+		size_t queue_depth{4};
+
+		/// Size of the individual read and write requests
+		size_t block_size{256 * 1024};
+
+		/// If false, the thread pool is used even where io_uring is available
+		bool use_io_uring{true};
+	};
+
+	enum class status {
+		/// The operation has completed
+		ok,
+
+		/// Retry once the \ref async_file_event has been received
+		wait,
+
+		/// Reading has reached the end of the file
+		eof,
+
+		/// An I/O error has occurred, see \ref error
+		error
+	};
+
+	async_file(thread_pool & pool, event_handler & handler);
+	async_file(thread_pool & pool, event_handler & handler, options const& opts);
+
+	/// Waits for outstanding requests, discarding any data that has not been flushed using \ref finalize.
+	~async_file();
+
+	async_file(async_file const&) = delete;
+	async_file& operator=(async_file const&) = delete;
+
+	/** \brief Opens the file
+	 *
+	 * Same semantics as \ref file::open. When reading, read-ahead starts with the
+	 * first call to \ref read.
+	 */
+	result open(native_string const& name, file::mode m, file::creation_flags d = file::existing);
+
+	/** \brief Closes the file.
+	 *
+	 * Blocks until all requests in flight have completed. Data written but not
+	 * yet flushed using \ref finalize may be lost.
+	 */
+	void close();
+
+	bool opened() const { return file_.opened(); }
+
+	/// Whether requests are submitted through io_uring
+	bool uses_io_uring() const;
+
+	/// \see file::size
+	int64_t size() const { return file_.size(); }
+
+	/** \brief Sets the position of the next read or write.
+	 *
+	 * Read-ahead data is discarded. Data already passed to \ref write is still
+	 * written to its original position.
+	 */
+	bool seek(int64_t offset);
+
+	/** \brief Returns the next block of data read from the file.
+	 *
+	 * If \c out is empty, the block is swapped into it, otherwise it is appended.
+	 * Each call keeps up to \ref options::queue_depth blocks being read ahead.
+	 *
+	 * \return status::ok if data has been added to \c out
+	 * \return status::eof at the end of the file
+	 */
+	status read(buffer & out);
+
+	/** \brief Queues data to be written to the file.
+	 *
+	 * Consumes the data that could be queued from \c data. If \c status::wait is
+	 * returned, some data remains unconsumed and the call needs to be repeated
+	 * after the next \ref async_file_event.
+	 */
+	status write(buffer & data);
+
+	/** \brief Flushes all queued data.
+	 *
+	 * Repeat the call after each \ref async_file_event until it no longer returns
+	 * \c status::wait. If \c sync is true, the data is also flushed to disk,
+	 * see \ref file::fsync.
+	 */
+	status finalize(bool sync = false);
+
+	/// The error code of the first failed request, an errno value or Windows error code.
+	int error() const;
+
+	/// \private
+	struct request;
+
+private:
+	class engine;
+	class pool_engine;
+	class uring_engine;
+
+	void complete(request & r, scoped_lock & l);
+	bool ready() const;
+	void fill_read_ahead(scoped_lock & l);
+	void submit_stage(scoped_lock & l);
+	void submit(std::unique_ptr<request> && r, scoped_lock & l);
+
+	thread_pool & pool_;
+	event_handler & handler_;
+	options const opts_;
+
+	file file_;
+	file::mode mode_{file::reading};
+
+	mutable mutex mtx_{false};
+	condition idle_cond_;
+
+	std::unique_ptr<engine> engine_;
+
+	// Requests in order of submission, completed reads are kept until consumed
+	std::deque<std::unique_ptr<request>> requests_;
+
+	// Number of requests not yet completed
+	size_t pending_{};
+
+	// The offset of the next request to submit
+	int64_t offset_{};
+
+	// Data passed to write that has not yet been submitted
+	buffer stage_;
+
+	int error_{};
+	bool eof_{};
+	bool synced_{};
+
+	// Whether an event needs to be sent, and if so, whether all writes need to be done first
+	bool waiting_{};
+	bool flushing_{};
+
+	bool idle_waiting_{};
+};
+
+/// \private
+struct async_file_event_type;
+
+/// Sent by \ref async_file once an operation that returned \c status::wait should be retried
+typedef simple_event<async_file_event_type, async_file*> async_file_event;
+
+}
+
+#endif
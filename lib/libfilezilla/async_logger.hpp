@@ -0,0 +1,157 @@
+#ifndef LIBFILEZILLA_ASYNC_LOGGER_HEADER
+#define LIBFILEZILLA_ASYNC_LOGGER_HEADER
+
+/** \file
+ * \brief A \ref fz::logger_interface "logger" writing messages from a background thread.
+ */
+
+#include "buffer.hpp"
+#include "file.hpp"
+#include "logger.hpp"
+#include "mutex.hpp"
+#include "thread.hpp"
+#include "time.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace fz {
+
+/**
+ * \brief Receives the log messages of an \ref async_logger.
+ *
+ * All functions are only called from the logger's writer thread.
+ */
+class FZ_PUBLIC_SYMBOL log_sink
+{
+public:
+	virtual ~log_sink() = default;
+
+	/// Called for each message, messages from different threads are ordered by their time.
+	virtual void write(logmsg::type t, datetime const& time, std::wstring_view const& msg) = 0;
+
+	/// Called instead of \ref write for messages with deferred formatting. By default formats the message and calls \ref write.
+	virtual void write_deferred(logmsg::type t, datetime const& time, deferred_message const& msg) {
+		write(t, time, msg.format());
+	}
+
+	/// Called at the logger's flush interval if messages have been written since the last flush, and on shutdown.
+	virtual void flush() {}
+};
+
+/**
+ * \brief Batching log sink appending messages to a file.
+ *
+ * Each message is written as a line consisting of the UTC timestamp and the message
+ * converted to UTF-8. Lines are collected in memory and only written to the file
+ * once the batch size is exceeded or the logger flushes the sink.
+ */
+class FZ_PUBLIC_SYMBOL file_log_sink final : public log_sink
+{
+public:
+	explicit file_log_sink(native_string const& path, size_t batch_size = 64 * 1024);
+	virtual ~file_log_sink();
+
+	/// Whether the file could be opened
+	bool opened() const { return file_.opened(); }
+
+	virtual void write(logmsg::type t, datetime const& time, std::wstring_view const& msg) override;
+	virtual void flush() override;
+
+private:
+	file file_;
+	buffer buffer_;
+	size_t const batch_size_;
+
+	timestamp_formatter formatter_;
+};
+
+/**
+ * \brief Logger moving the output of messages off the logging threads.
+ *
+ * Each thread logging through an async_logger gets its own bounded single-producer
+ * queue, pushing a message onto it does not need any locks. A single writer thread
+ * drains the queues and passes the messages to the \ref log_sink.
+ *
+ * By default, the formatting of messages is deferred to the writer thread as well.
+ *
+ * If a queue is full, the message is either dropped, or the logging thread waits
+ * until there is room again, depending on the configured \ref overflow_policy.
+ * Dropped messages are counted and reported through the sink.
+ *
+ * The sink must outlive the logger. Destroying the logger writes all pending
+ * messages and flushes the sink.
+ */
+class FZ_PUBLIC_SYMBOL async_logger final : public logger_interface
+{
+public:
+	enum class overflow_policy {
+		/// Discard messages if the queue is full
+		drop,
+
+		/// Wait until the writer thread has made room in the queue
+		block
+	};
+
+	struct options final {
+		/// Maximum number of pending messages per logging thread, rounded up to a power of two
+		size_t queue_capacity{1024};
+
+		overflow_policy overflow{overflow_policy::drop};
+
+		/// Maximum time between writing a message and flushing the sink
+		duration flush_interval{duration::from_seconds(1)};
+
+		/**
+		 * Format messages logged through \ref log and \ref log_u on the writer
+		 * thread instead of the logging thread.
+		 *
+		 * \sa logger_interface::defer_formatting_
+		 */
+		bool defer_formatting{true};
+	};
+
+	explicit async_logger(log_sink & sink);
+	async_logger(log_sink & sink, options const& opts);
+	virtual ~async_logger();
+
+	virtual void do_log(logmsg::type t, std::wstring && msg) override;
+	virtual void do_log_deferred(logmsg::type t, deferred_message && msg) override;
+
+	/// Blocks until all messages logged prior to this call have been passed to the sink and the sink has been flushed.
+	void flush();
+
+	/// Total number of messages that have been dropped due to full queues
+	uint64_t dropped() const;
+
+	class queue;
+
+private:
+	struct entry;
+
+	queue& local_queue();
+	void push(entry && e);
+	void wakeup_writer(bool force);
+	void run();
+
+	log_sink & sink_;
+	options const options_;
+	uint64_t const id_;
+
+	mutable mutex mtx_{false};
+	condition cond_;
+	condition flushed_cond_;
+	std::vector<std::shared_ptr<queue>> queues_;
+
+	uint64_t flush_requested_{};
+	uint64_t flushed_{};
+	uint64_t dropped_{};
+	bool quit_{};
+	std::atomic<bool> idle_{};
+
+	thread thread_;
+};
+
+}
+
+#endif
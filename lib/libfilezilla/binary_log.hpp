@@ -0,0 +1,104 @@
+#ifndef LIBFILEZILLA_BINARY_LOG_HEADER
+#define LIBFILEZILLA_BINARY_LOG_HEADER
+
+/** \file
+ * \brief Compact binary log files: A \ref fz::log_sink writing them and a reader rendering them back to text.
+ */
+
+#include "async_logger.hpp"
+
+#include <map>
+#include <unordered_map>
+
+namespace fz {
+
+/**
+ * \brief Log sink writing a compact binary representation of messages.
+ *
+ * Each distinct format string is written to the file only once, the first time it is
+ * used. Messages with deferred formatting are then stored as a record consisting of
+ * a timestamp relative to the previous message, the message type, the id of the format
+ * string and the raw arguments. Messages whose arguments cannot be stored in raw form,
+ * such as types with a custom toString conversion, and messages that have already been
+ * formatted are stored as text.
+ *
+ * If the file already exists, new messages are appended to it. Each sink starts its
+ * part of the file with a fresh header and writes its own format strings.
+ *
+ * Use \ref binary_log_reader to turn the file back into text. Narrow strings in the
+ * locale's encoding are stored as-is and get converted using the locale of the reader.
+ *
+ * \sa async_logger
+ */
+class FZ_PUBLIC_SYMBOL binary_log_sink final : public log_sink
+{
+public:
+	explicit binary_log_sink(native_string const& path, size_t batch_size = 64 * 1024);
+	virtual ~binary_log_sink();
+
+	/// Whether the file could be opened
+	bool opened() const { return file_.opened(); }
+
+	virtual void write(logmsg::type t, datetime const& time, std::wstring_view const& msg) override;
+	virtual void write_deferred(logmsg::type t, datetime const& time, deferred_message const& msg) override;
+	virtual void flush() override;
+
+	class encoder;
+
+private:
+	void write_header(logmsg::type t, datetime const& time);
+	uint64_t format_id(encoder const& e);
+
+	file file_;
+	buffer buffer_;
+	size_t const batch_size_;
+
+	int64_t last_time_{};
+	std::map<std::pair<void const*, size_t>, uint64_t> literal_formats_;
+	std::unordered_map<std::string, uint64_t> copied_formats_;
+	uint64_t next_format_id_{};
+
+	std::unique_ptr<encoder> encoder_;
+};
+
+/**
+ * \brief Reads log files written by \ref binary_log_sink.
+ *
+ * Messages are rendered using the same formatting rules as \ref fz::sprintf.
+ * Files holding the output of several sinks one after another are read in full.
+ */
+class FZ_PUBLIC_SYMBOL binary_log_reader final
+{
+public:
+	explicit binary_log_reader(native_string const& path);
+
+	/// Whether the file could be opened and has a valid header
+	bool opened() const { return file_.opened() && !error_; }
+
+	/** \brief Reads the next message.
+	 *
+	 * \return false at the end of the file or on error.
+	 *
+	 * A truncated record at the end of the file, as left behind by a process that
+	 * has not yet flushed its log, is treated as end of file.
+	 */
+	bool read(logmsg::type & t, datetime & time, std::wstring & msg);
+
+	/// Whether reading stopped due to malformed data
+	bool error() const { return error_; }
+
+private:
+	bool fill();
+
+	file file_;
+	buffer buffer_;
+	bool eof_{};
+	bool error_{};
+
+	int64_t last_time_{};
+	std::vector<std::wstring> formats_;
+};
+
+}
+
+#endif
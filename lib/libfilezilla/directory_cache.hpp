@@ -0,0 +1,107 @@
+#ifndef LIBFILEZILLA_DIRECTORY_CACHE_HEADER
+#define LIBFILEZILLA_DIRECTORY_CACHE_HEADER
+
+#include "local_filesys.hpp"
+#include "time.hpp"
+
+#include <memory>
+
+/** \file
+ * \brief Declares \ref fz::directory_cache "directory_cache" to avoid repeatedly enumerating the same directories
+ */
+
+namespace fz {
+
+/**
+ * \brief Caches directory listings, keyed by path.
+ *
+ * Repeated listings of the same directory are served from memory instead of
+ * enumerating the directory and querying the metadata of every file again.
+ *
+ * On Linux, every cached directory is monitored using inotify. Any change to the
+ * directory or the metadata of its entries removes its listing from the cache, as
+ * does a change of the contents of a cached subdirectory, which alters that
+ * subdirectory's modification time. Pending change notifications are processed by
+ * every call to \ref get before it looks at the cache, so changes that have completed
+ * before the call are always reflected.
+ *
+ * Where changes cannot be monitored, either because the platform lacks inotify or
+ * because the system's limit of watches has been reached, listings are kept for
+ * at most \ref options::max_age instead.
+ *
+ * Changes to the targets of symbolic links are not detected.
+ *
+ * If the limits in \ref options are exceeded, the least recently used listings are evicted.
+ *
+ * All member functions are thread-safe.
+ */
+class FZ_PUBLIC_SYMBOL directory_cache final
+{
+public:
+	struct options final {
+		/// Upper bound for the memory used by the cached listings, larger listings are not cached at all
+		size_t max_memory{64 * 1024 * 1024};
+
+		/// Maximum number of cached directories. On Linux each needs an inotify watch.
+		size_t max_directories{1024};
+
+		/// How long listings of directories that cannot be monitored are kept
+		duration max_age{duration::from_seconds(5)};
+
+		/// \see local_filesys::begin_find_files
+		bool query_symlink_targets{true};
+	};
+
+	/// A snapshot of a directory, remains valid even after being removed from the cache
+	typedef std::shared_ptr<local_filesys::entries const> listing;
+
+	struct stats final {
+		uint64_t hits{};
+		uint64_t misses{};
+
+		/// Number of listings removed due to changes
+		uint64_t invalidations{};
+
+		/// Number of listings removed to stay within the limits
+		uint64_t evictions{};
+
+		size_t directories{};
+		size_t memory{};
+	};
+
+	directory_cache();
+	explicit directory_cache(options const& opts);
+	~directory_cache();
+
+	directory_cache(directory_cache const&) = delete;
+	directory_cache& operator=(directory_cache const&) = delete;
+
+	/**
+	 * \brief Gets the listing of a directory, enumerating it if not cached.
+	 *
+	 * The listing includes the metadata of all entries. Directories are enumerated outside
+	 * of any lock, concurrent calls for different directories do not block each other.
+	 *
+	 * \param path Trailing path separators are ignored.
+	 */
+	result get(native_string const& path, listing & out);
+
+	/// Removes the listing of the given directory from the cache, if any
+	void invalidate(native_string const& path);
+
+	/// Removes all listings from the cache
+	void clear();
+
+	stats get_stats() const;
+
+	/// Whether changes to cached directories are monitored on this system, see class description
+	bool monitors_changes() const;
+
+private:
+	class impl;
+	std::unique_ptr<impl> impl_;
+};
+
+}
+
+#endif
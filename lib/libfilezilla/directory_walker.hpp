@@ -0,0 +1,129 @@
+#ifndef LIBFILEZILLA_DIRECTORY_WALKER_HEADER
+#define LIBFILEZILLA_DIRECTORY_WALKER_HEADER
+
+#include "local_filesys.hpp"
+
+#include <functional>
+
+/** \file
+ * \brief Declares \ref fz::directory_walker "directory_walker" to traverse directory trees in parallel
+ */
+
+namespace fz {
+
+class thread_pool;
+
+/**
+ * \brief Traverses a directory tree, enumerating multiple directories concurrently.
+ *
+ * Directories are opened relative to the descriptor of their parent directory and the
+ * metadata of entries is queried relative to the descriptor of their directory, so full
+ * paths never need to be assembled or resolved by the system.
+ *
+ * Enumerating directories in parallel hides the latency of network filesystems, where
+ * each directory listing and metadata query may involve a round trip to the server.
+ */
+class FZ_PUBLIC_SYMBOL directory_walker final
+{
+public:
+	/// How to treat symbolic links
+	enum class symlink_policy {
+		/// Symbolic links are not reported
+		skip,
+
+		/// Symbolic links are reported as \c local_filesys::link, links to directories are not descended into
+		report,
+
+		/**
+		 * Symbolic links are reported with the type and metadata of their target and
+		 * links to directories are descended into, unless they would form a loop.
+		 *
+		 * On Windows, reparse points are reported with their target's metadata but
+		 * not descended into.
+		 */
+		follow
+	};
+
+	struct options final {
+		/// Maximum number of directories enumerated concurrently, including the thread calling \ref walk
+		size_t threads{4};
+
+		/// Entries deeper than this are not reported, the entries of the root directory have depth 0
+		size_t max_depth{static_cast<size_t>(-1)};
+
+		symlink_policy symlinks{symlink_policy::report};
+
+		/// If false, only the name, type and is_link members of the entries are filled in
+		bool metadata{true};
+	};
+
+	/// \private
+	struct node;
+
+	/// \private
+	class state;
+
+	/// A file, directory or link found during the walk
+	struct entry final {
+		/// Name of the entry within its directory
+		native_string_view name;
+
+		/// The entries of the root directory have depth 0
+		size_t depth{};
+
+		local_filesys::type t{local_filesys::unknown};
+		bool is_link{};
+
+		/// -1 for directories or if not known
+		int64_t size{-1};
+		datetime modification_time;
+		int mode{};
+
+		/// Path of the entry relative to the root, assembled on demand
+		native_string path() const;
+
+	private:
+		friend class state;
+		node const* parent_{};
+	};
+
+	/**
+	 * \brief Called for every entry found.
+	 *
+	 * Calls are serialized, but happen on different threads. Return false to end the walk.
+	 * The entry is only valid for the duration of the call.
+	 */
+	typedef std::function<bool(entry const&)> callback;
+
+	explicit directory_walker(thread_pool & pool);
+	directory_walker(thread_pool & pool, options const& opts);
+
+	/**
+	 * \brief Optional filter, called before the callback.
+	 *
+	 * Entries for which it returns false are not passed to the callback. If the entry
+	 * is a directory, it is not descended into either. Calls are serialized with the callback.
+	 */
+	void set_filter(callback const& filter) { filter_ = filter; }
+
+	/**
+	 * \brief Walks the tree below the given directory, blocks until done.
+	 *
+	 * The order in which entries are reported is unspecified, except that a directory is
+	 * always reported before its contents.
+	 *
+	 * Directories that cannot be enumerated are skipped.
+	 *
+	 * \return The first error encountered, \c result::other if the callback ended the walk.
+	 */
+	result walk(native_string const& root, callback const& on_entry);
+
+private:
+	thread_pool & pool_;
+	options const opts_;
+	callback filter_;
+};
+
+}
+
+#endif
@@ -4,12 +4,15 @@
 #include "libfilezilla.hpp"
 
 #include <string>
+#include <type_traits>
 #include <vector>
 
 /** \file
  * \brief Functions to encode/decode strings
  *
  * Defines functions to deal with hex, base64 and percent encoding.
+ *
+ * Where the CPU supports it, hex and base64 are encoded and decoded using SIMD instructions.
  */
 
 namespace fz {
@@ -36,12 +39,40 @@ int hex_char_to_int(Char c)
 	return -1;
 }
 
+/// \private
+template<typename T, typename = void>
+struct has_contiguous_data : std::false_type {};
+
+/// \private
+template<typename T>
+struct has_contiguous_data<T, std::void_t<decltype(std::declval<T&>().data())>> : std::is_pointer<decltype(std::declval<T&>().data())> {};
+
+/** \private
+ * \brief Hex-encodes len octets into 2 * len characters at out.
+ */
+void FZ_PUBLIC_SYMBOL hex_encode_raw(char* out, unsigned char const* in, size_t len, bool lowercase);
+
+/** \private
+ * \brief Decodes len hex characters, len must be even.
+ *
+ * Writes len / 2 octets to out, returns false on invalid input.
+ */
+bool FZ_PUBLIC_SYMBOL hex_decode_raw(unsigned char* out, char const* in, size_t len);
+
 /// \private
 template<typename OutString, typename String>
 OutString hex_decode_impl(String const& in)
 {
 	OutString ret;
-	if (!(in.size() % 2)) {
+	if constexpr (sizeof(typename String::value_type) == 1 && sizeof(typename OutString::value_type) == 1 && has_contiguous_data<OutString>::value) {
+		if (!(in.size() % 2)) {
+			ret.resize(in.size() / 2);
+			if (!hex_decode_raw(reinterpret_cast<unsigned char*>(ret.data()), reinterpret_cast<char const*>(in.data()), in.size())) {
+				return OutString();
+			}
+		}
+	}
+	else if (!(in.size() % 2)) {
 		ret.reserve(in.size() / 2);
 		for (size_t i = 0; i < in.size(); i += 2) {
 			int high = hex_char_to_int(in[i]);
@@ -90,10 +121,16 @@ String hex_encode(InString const& data)
 {
 	static_assert(sizeof(typename InString::value_type) == 1, "Input must be a container of 8 bit values");
 	String ret;
-	ret.reserve(data.size() * 2);
-	for (auto const& c : data) {
-		ret.push_back(int_to_hex_char<typename String::value_type, Lowercase>(static_cast<unsigned char>(c) >> 4));
-		ret.push_back(int_to_hex_char<typename String::value_type, Lowercase>(static_cast<unsigned char>(c) & 0xf));
+	if constexpr (sizeof(typename String::value_type) == 1 && has_contiguous_data<String>::value && has_contiguous_data<InString const>::value) {
+		ret.resize(data.size() * 2);
+		hex_encode_raw(reinterpret_cast<char*>(ret.data()), reinterpret_cast<unsigned char const*>(data.data()), data.size(), Lowercase);
+	}
+	else {
+		ret.reserve(data.size() * 2);
+		for (auto const& c : data) {
+			ret.push_back(int_to_hex_char<typename String::value_type, Lowercase>(static_cast<unsigned char>(c) >> 4));
+			ret.push_back(int_to_hex_char<typename String::value_type, Lowercase>(static_cast<unsigned char>(c) & 0xf));
+		}
 	}
 
 	return ret;
@@ -135,6 +172,60 @@ std::string FZ_PUBLIC_SYMBOL base64_decode_s(std::string_view const& in);
 std::string FZ_PUBLIC_SYMBOL base64_decode_s(std::wstring_view const& in);
 std::string FZ_PUBLIC_SYMBOL base64_decode_s(fz::buffer const& in);
 
+/**
+ * \brief Incremental base64 encoder
+ *
+ * Encodes input passed in chunks of arbitrary size, appending the output to a \ref fz::buffer.
+ * Feeding data through encode() followed by a call to finalize() yields the same output as
+ * \ref base64_encode on the concatenated input, without ever holding all of it in memory.
+ */
+class FZ_PUBLIC_SYMBOL base64_encoder final
+{
+public:
+	explicit base64_encoder(base64_type type = base64_type::standard, bool pad = true);
+
+	/// Encodes all complete groups of 3 octets, up to 2 trailing octets are held back until the next call.
+	void encode(unsigned char const* data, size_t len, fz::buffer& out);
+	void encode(std::string_view const& data, fz::buffer& out);
+	void encode(fz::buffer const& data, fz::buffer& out);
+
+	/// Flushes any held back octets including padding. Afterwards the encoder can be reused.
+	void finalize(fz::buffer& out);
+
+private:
+	base64_type type_;
+	bool pad_;
+	unsigned char pending_[2]{};
+	size_t pending_size_{};
+};
+
+/**
+ * \brief Incremental base64 decoder
+ *
+ * Counterpart to \ref base64_encoder, with the same rules as \ref base64_decode: Whitespace is ignored,
+ * padding is optional and the alphabet is auto-detected.
+ *
+ * Once invalid input has been detected, all further calls fail until reset() is called.
+ */
+class FZ_PUBLIC_SYMBOL base64_decoder final
+{
+public:
+	/// Decodes all complete groups of 4 characters. Returns false on invalid input.
+	bool decode(std::string_view const& data, fz::buffer& out);
+	bool decode(fz::buffer const& data, fz::buffer& out);
+
+	/// Decodes a trailing unpadded group. Returns false if the input was invalid or truncated. Resets the decoder.
+	bool finalize(fz::buffer& out);
+
+	void reset();
+
+private:
+	unsigned char quantum_[4]{};
+	size_t quantum_size_{};
+	bool done_{};
+	bool failed_{};
+};
+
 
 /**
  * \brief Alphabet variations for base32
@@ -100,8 +100,13 @@ public:
 	 *
 	 * One-shot timers are deleted automatically
 	 *
-	 * For periodic timers, the next event is scheduled right before the callback is called. If multiple
-	 * intervals expire before the timer fires, e.g. under heavy load, only one event is sent.
+	 * For periodic timers, the next event is scheduled right before the callback is called, one interval
+	 * after the previous deadline so that the period does not drift. If multiple intervals expire before
+	 * the timer fires, e.g. under heavy load, only one event is sent and the next one is scheduled one
+	 * interval from then.
+	 *
+	 * Intervals below a millisecond are supported, but for them to be accurate, high-resolution
+	 * timers need to be enabled on the event loop, see \ref event_loop::set_high_resolution_timers
 	 *
 	 * If multiple different timers have expired, the order in which the callbacks are executed is unspecified,
 	 * there is no fairness guarantee.
@@ -77,6 +77,24 @@ public:
 	 /// Starts the loop in the caller's thread.
 	void run();
 
+	/** \brief Enables or disables high-resolution timers.
+	 *
+	 * By default, the loop waits for the next timer deadline using a condition
+	 * variable, whose wakeups the kernel may defer by its default timer slack
+	 * and which is subject to scheduling delays of the woken thread.
+	 *
+	 * With high-resolution timers, the loop instead polls a timerfd armed with the
+	 * next deadline, and the timer slack of the loop's thread is set to the given
+	 * value. This allows timers with microsecond accuracy, e.g. for pacing traffic,
+	 * at the cost of a few more system calls per event.
+	 *
+	 * The setting takes effect the next time the loop waits. Disabling restores the
+	 * thread's original timer slack.
+	 *
+	 * \return false if not supported on this platform, only available on Linux.
+	 */
+	bool set_high_resolution_timers(bool enable, duration const& slack = duration::from_microseconds(1));
+
 private:
 	friend class event_handler;
 
@@ -91,10 +109,14 @@ private:
 	bool FZ_PRIVATE_SYMBOL process_event(scoped_lock & l);
 
 	// Process timers. Returns true if a timer has been triggered
+	// If now is empty, it is set to the current time unless no timer can have expired yet.
 	bool FZ_PRIVATE_SYMBOL process_timers(scoped_lock & l, monotonic_clock& now);
 
 	void FZ_PRIVATE_SYMBOL entry();
 
+	// Wakes up the loop if waiting, must be called locked
+	void FZ_PRIVATE_SYMBOL wakeup(scoped_lock & l);
+
 	struct FZ_PRIVATE_SYMBOL timer_data final
 	{
 		event_handler* handler_{};
@@ -122,6 +144,9 @@ private:
 	std::unique_ptr<thread> thread_;
 	std::unique_ptr<async_task> task_;
 
+	class hires_timer;
+	std::unique_ptr<hires_timer> hires_;
+
 	bool quit_{};
 };
 
@@ -12,8 +12,12 @@
  * \brief File handling
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <utility>
+#include <vector>
+
 namespace fz {
 
 /** \brief Lean class for file access
@@ -69,7 +73,21 @@ public:
 		 *
 		 * Does not modify permissions if the file already exists.
 		 */
-		 current_user_and_admins_only = 0x8
+		 current_user_and_admins_only = 0x8,
+
+		/**
+		 * Bypass the page cache, transferring data directly between the passed
+		 * memory and the device. Avoids polluting the cache and copying the data
+		 * for large sequential transfers of data not going to be read again soon.
+		 *
+		 * Unlike the other flags, also applies when opening files for reading.
+		 *
+		 * If the system or filesystem does not support direct I/O, the file is
+		 * silently opened for ordinary buffered I/O, see \ref uses_direct_io. Not
+		 * supported on Windows, whose unbuffered I/O cannot transfer unaligned
+		 * tails.
+		 */
+		direct = 0x10
 	};
 
 	file() = default;
@@ -172,6 +190,59 @@ public:
 	 */
 	int64_t write(void const* buf, int64_t count);
 
+	/** \brief Read data from the given offset in the file
+	 *
+	 * Neither uses nor advances the file pointer, so multiple threads can read from the
+	 * same file concurrently. On Windows the file pointer is modified though, do not mix
+	 * with \ref read and \ref write.
+	 *
+	 * \return Same as \ref read
+	 */
+	int64_t read_at(int64_t offset, void *buf, int64_t count);
+
+	/** \brief Write data at the given offset in the file
+	 *
+	 * Neither uses nor advances the file pointer, so multiple threads can write to
+	 * different parts of the same file concurrently. On Windows the file pointer is
+	 * modified though, do not mix with \ref read and \ref write.
+	 *
+	 * \return Same as \ref write
+	 */
+	int64_t write_at(int64_t offset, void const* buf, int64_t count);
+
+	/// A segment of memory for \ref read_at
+	struct segment final {
+		void* data{};
+		size_t size{};
+	};
+
+	/// A segment of memory for \ref write_at
+	struct const_segment final {
+		void const* data{};
+		size_t size{};
+	};
+
+	/** \brief Scatter read into multiple segments
+	 *
+	 * Fills the segments in order with the data starting at the given offset, using a
+	 * single system call where supported.
+	 *
+	 * \return >0 The number of octets read. It may be less than the total size of the segments.
+	 * \return 0 at EOF
+	 * \return -1 on error
+	 */
+	int64_t read_at(int64_t offset, segment const* segments, size_t count);
+
+	/** \brief Gather write of multiple segments
+	 *
+	 * Writes the segments in order to consecutive locations starting at the given offset,
+	 * using a single system call where supported.
+	 *
+	 * \return >=0 The number of octets written. It may be less than the total size of the segments.
+	 * \return -1 on error
+	 */
+	int64_t write_at(int64_t offset, const_segment const* segments, size_t count);
+
 	/** \brief Ensure data is flushed to disk
 	 *
 	 * \return true Data has been flushed to disk.
@@ -179,12 +250,103 @@ public:
 	 */
 	bool fsync();
 
+	/** \brief Reserves disk space for the file
+	 *
+	 * Allocating the space of a large file up front avoids fragmentation and
+	 * running out of space halfway through writing it.
+	 *
+	 * \param size The number of octets from the start of the file to allocate
+	 * \param extend If false, the size of the file does not change. Otherwise,
+	 * if the file is smaller than \c size, it is extended with zeroes.
+	 *
+	 * \return false if not supported by the filesystem or on error. Never falls back
+	 * to writing zeroes to reserve the space.
+	 */
+	bool allocate(int64_t size, bool extend = false);
+
+	/** \brief Deallocates a range of the file
+	 *
+	 * The range reads back as zeroes afterwards, the size of the file does not change.
+	 * On Windows, the file is marked sparse first.
+	 */
+	bool punch_hole(int64_t offset, int64_t length);
+
+	/** \brief Returns the ranges of a sparse file that contain data
+	 *
+	 * Ranges between are holes that read back as zeroes. If the system cannot tell,
+	 * the whole file is returned as data. Does not change the file pointer.
+	 *
+	 * \return A list of offset and length pairs, empty on error or for empty files.
+	 */
+	std::vector<std::pair<int64_t, int64_t>> data_ranges();
+
+	/// Used by \ref advise
+	enum class advice {
+		normal,
+		sequential,
+		random,
+		willneed,
+		dontneed,
+		noreuse
+	};
+
+	/** \brief Announces the intended access pattern to the system, see posix_fadvise.
+	 *
+	 * A length of 0 means until the end of the file.
+	 *
+	 * \return false if not supported by the system.
+	 */
+	bool advise(int64_t offset, int64_t length, advice a);
+
+	/** \brief Removes data written using \ref write from the page cache once it has been written to disk.
+	 *
+	 * For large files written only once, this prevents evicting data that is going
+	 * to be used again from the cache. It also limits the amount of dirty pages, which
+	 * avoids stalls when the system flushes them in bulk.
+	 *
+	 * \return false if not supported by the system.
+	 */
+	bool set_drop_behind(bool enable);
+
+	/// Whether the file has been opened using the \ref direct flag and the system supports it.
+	bool uses_direct_io() const { return alignment_ != 0; }
+
+	/** \brief Alignment required for direct I/O.
+	 *
+	 * Transfers bypass the page cache if the memory address, the offset in the file
+	 * and the length are multiples of the alignment. Use \ref aligned_buffer for the memory.
+	 *
+	 * If only the length is unaligned, as is usually the case for the tail of a file,
+	 * the aligned part is transferred directly and the remainder through the page cache.
+	 * Any other unaligned transfer goes entirely through the page cache.
+	 *
+	 * On Linux, the unaligned parts are transferred using a second descriptor for the
+	 * same file, opened without direct I/O. Concurrent transfers of other threads
+	 * are not affected.
+	 *
+	 * \return The alignment, 1 if there are no restrictions, 0 if not using direct I/O.
+	 */
+	size_t alignment() const { return alignment_; }
+
 private:
+	void drop_behind();
+	void enable_direct(native_string const& f, mode m);
+
 #ifdef FZ_WINDOWS
 	HANDLE fd_{INVALID_HANDLE_VALUE};
 #else
 	int fd_{-1};
 #endif
+
+	// Start of the data that has not yet been dropped from the cache, -1 if disabled
+	int64_t drop_behind_{-1};
+
+	size_t alignment_{};
+
+#ifndef FZ_WINDOWS
+	// Opened without direct I/O for the unaligned parts of transfers, -1 if unused
+	int buffered_fd_{-1};
+#endif
 };
 
 /** \brief remove the specified file.
@@ -0,0 +1,131 @@
+#ifndef LIBFILEZILLA_FILE_WATCHER_HEADER
+#define LIBFILEZILLA_FILE_WATCHER_HEADER
+
+#include "event.hpp"
+#include "fsresult.hpp"
+#include "time.hpp"
+
+#include <memory>
+#include <type_traits>
+
+/** \file
+ * \brief Declares \ref fz::file_watcher "file_watcher" to get notified about changes to files and directories
+ */
+
+namespace fz {
+
+class event_handler;
+class thread_pool;
+
+/** \brief The changes reported by a \ref file_watcher_event
+ *
+ * Multiple changes to the same path are coalesced into a single event with multiple bits set.
+ */
+enum class file_change
+{
+	/// The path has been created
+	created = 0x1,
+
+	/// The contents or metadata of the path have changed
+	modified = 0x2,
+
+	/// The path has been deleted
+	deleted = 0x4,
+
+	/// The path has been renamed to something else
+	moved_from = 0x8,
+
+	/// Something has been renamed to the path
+	moved_to = 0x10,
+
+	/// Notifications have been lost, anything below the watched path may have changed
+	overflow = 0x20
+};
+
+inline bool operator&(file_change lhs, file_change rhs) {
+	return (static_cast<std::underlying_type_t<file_change>>(lhs) & static_cast<std::underlying_type_t<file_change>>(rhs)) != 0;
+}
+inline file_change operator|(file_change lhs, file_change rhs)
+{
+	return static_cast<file_change>(static_cast<std::underlying_type_t<file_change>>(lhs) | static_cast<std::underlying_type_t<file_change>>(rhs));
+}
+inline file_change& operator|=(file_change& lhs, file_change rhs)
+{
+	lhs = lhs | rhs;
+	return lhs;
+}
+
+/// \private
+struct file_watcher_event_type;
+
+class file_watcher;
+
+/**
+ * \brief Sent by \ref file_watcher for every changed path.
+ *
+ * The path is the watched path, or the path of an entry below it, joined by the path separator.
+ */
+typedef simple_event<file_watcher_event_type, file_watcher*, native_string, file_change> file_watcher_event;
+
+/**
+ * \brief Watches files and directories for changes.
+ *
+ * On Linux, changes are monitored using inotify and reported as soon as the coalescing
+ * delay has passed. Elsewhere, or if inotify cannot be used, the watched paths get
+ * scanned periodically instead. Scanning cannot tell renames apart from deletions
+ * and creations and is limited by the resolution of the modification times.
+ *
+ * For directories, changes to the directory itself and to its entries are reported.
+ * A file replaced by renaming another file over it is no longer watched, watch its
+ * directory instead.
+ *
+ * Events are sent from a worker thread obtained from the passed \ref thread_pool.
+ * All member functions are thread-safe.
+ */
+class FZ_PUBLIC_SYMBOL file_watcher final
+{
+public:
+	struct options final {
+		/// Changes to the same path within this time are reported as a single event
+		duration coalesce{duration::from_milliseconds(50)};
+
+		/// How often the watched paths are scanned if changes cannot be monitored
+		duration poll_interval{duration::from_seconds(2)};
+
+		/// If false, paths are scanned periodically even where inotify is available
+		bool use_inotify{true};
+	};
+
+	file_watcher(thread_pool & pool, event_handler & handler);
+	file_watcher(thread_pool & pool, event_handler & handler, options const& opts);
+
+	/// Stops watching, pending events are removed from the handler's event loop
+	~file_watcher();
+
+	file_watcher(file_watcher const&) = delete;
+	file_watcher& operator=(file_watcher const&) = delete;
+
+	/**
+	 * \brief Starts watching a file or directory.
+	 *
+	 * \param path Trailing path separators are ignored.
+	 * \param recursive If set, subdirectories of a watched directory are watched as well,
+	 * including directories created later. Entries of directories created or moved into
+	 * the tree are reported as created.
+	 */
+	result add(native_string const& path, bool recursive = false);
+
+	/// Stops watching a path passed to \ref add
+	void remove(native_string const& path);
+
+	/// Whether changes are monitored using inotify instead of scanning periodically
+	bool uses_inotify() const;
+
+private:
+	class impl;
+	std::unique_ptr<impl> impl_;
+};
+
+}
+
+#endif
@@ -1,10 +1,12 @@
 #ifndef LIBFILEZILLA_FORMAT_HEADER
 #define LIBFILEZILLA_FORMAT_HEADER
 
+#include "buffer.hpp"
 #include "encode.hpp"
 #include "string.hpp"
 
 #include <cstdlib>
+#include <tuple>
 #include <type_traits>
 
 #ifdef LFZ_FORMAT_DEBUG
@@ -18,6 +20,23 @@
 * \brief Header for the \ref fz::sprintf "sprintf" string formatting function
 */
 
+/** \brief Marks a string literal as format string to be parsed at compile-time
+ *
+ * Use as fz::sprintf(fzF("%s: %d"), name, value). Works with both narrow and
+ * wide string literals. The resulting object implicitly converts to a
+ * std::string_view or std::wstring_view respectively, so it can also be passed
+ * to functions expecting a runtime format string.
+ */
+#define fzF(s) [] { \
+	struct fz_format_string final : ::fz::detail::format_string_base { \
+		using char_type = std::remove_cv_t<std::remove_reference_t<decltype(*(s))>>; \
+		constexpr operator std::basic_string_view<char_type>() const { \
+			return std::basic_string_view<char_type>((s), sizeof(s) / sizeof(char_type) - 1); \
+		} \
+	}; \
+	return fz_format_string{}; \
+}()
+
 namespace fz {
 
 /// \cond
@@ -37,7 +56,7 @@ struct field final {
 	char flags{};
 	char type{};
 
-	explicit operator bool() const { return type != 0; }
+	constexpr explicit operator bool() const { return type != 0; }
 };
 
 template<typename Arg>
@@ -51,93 +70,154 @@ bool is_negative([[maybe_unused]] Arg && v)
 	}
 }
 
-// Converts integral type to desired string type...
-// ... basic case: simple unsigned value
-template<typename String, bool Unsigned, typename Arg>
-typename std::enable_if_t<std::is_integral_v<std::decay_t<Arg>> && !std::is_enum_v<std::decay_t<Arg>>, String> integral_to_string(field const& f, Arg && arg)
+// Character type written into a formatting destination
+template<typename Dest>
+struct dest_char;
+
+template<typename Char>
+struct dest_char<std::basic_string<Char>> {
+	using type = Char;
+};
+
+template<>
+struct dest_char<buffer> {
+	using type = char;
+};
+
+template<typename Dest>
+using dest_char_t = typename dest_char<Dest>::type;
+
+template<typename Char>
+void append_chars(std::basic_string<Char>& out, Char const* p, size_t n)
+{
+	out.append(p, n);
+}
+
+template<typename Char>
+void append_fill(std::basic_string<Char>& out, size_t n, Char c)
 {
-	std::decay_t<Arg> v = arg;
+	out.append(n, c);
+}
 
-	char lead{};
+inline void append_chars(buffer& out, char const* p, size_t n)
+{
+	out.append(reinterpret_cast<unsigned char const*>(p), n);
+}
 
-	format_assert(!Unsigned || !std::is_signed_v<std::decay_t<Arg>> || arg >= 0);
+inline void append_fill(buffer& out, size_t n, char c)
+{
+	out.append(n, static_cast<unsigned char>(c));
+}
 
-	if (is_negative(arg)) {
-		lead = '-';
-	}
-	else if (f.flags & always_sign) {
-		lead = '+';
+// Appends the characters, padded according to the field width
+template<typename Dest, typename Char>
+void append_padded(Dest& out, field const& f, Char const* p, size_t n)
+{
+	if (f.flags & with_width && n < f.width) {
+		if (f.flags & left_align) {
+			append_chars(out, p, n);
+			append_fill(out, f.width - n, Char(' '));
+		}
+		else {
+			append_fill(out, f.width - n, (f.flags & pad_0) ? Char('0') : Char(' '));
+			append_chars(out, p, n);
+		}
 	}
-	else if (f.flags & pad_blank) {
-		lead = ' ';
+	else {
+		append_chars(out, p, n);
 	}
+}
 
-	// max decimal digits in b-bit integer is floor((b-1) * log_10(2)) + 1 < b * 0.5 + 1
-	typename String::value_type buf[sizeof(v) * 4 + 1];
-	auto *const end = buf + sizeof(v) * 4 + 1;
-	auto *p = end;
+// max decimal digits in b-bit integer is floor((b-1) * log_10(2)) + 1 < b * 0.5 + 1
+template<typename T>
+constexpr size_t max_decimal_chars = sizeof(T) * 4 + 1;
 
+// Writes the decimal digits of the value backwards, ending at end. Returns the first written character.
+template<typename Char, typename T>
+Char* decimal_to_chars(Char* end, T v)
+{
+	auto* p = end;
 	do {
 		int const mod = std::abs(static_cast<int>(v % 10));
 		*(--p) = '0' + mod;
 		v /= 10;
 	} while (v);
+	return p;
+}
+
+// Converts integral type to decimal...
+template<bool Unsigned, typename Dest, typename Arg>
+void append_integral(Dest& out, field const& f, Arg && arg)
+{
+	using Char = dest_char_t<Dest>;
+
+	if constexpr (std::is_enum_v<std::decay_t<Arg>>) {
+		// ... for strongly typed enums
+		append_integral<Unsigned>(out, f, static_cast<std::underlying_type_t<std::decay_t<Arg>>>(arg));
+	}
+	else if constexpr (std::is_integral_v<std::decay_t<Arg>>) {
+		std::decay_t<Arg> v = arg;
+
+		char lead{};
 
-	auto width = f.width;
-	if (f.flags & with_width) {
-		if (lead && width > 0) {
-			--width;
+		format_assert(!Unsigned || !std::is_signed_v<std::decay_t<Arg>> || arg >= 0);
+
+		if (is_negative(arg)) {
+			lead = '-';
+		}
+		else if (f.flags & always_sign) {
+			lead = '+';
+		}
+		else if (f.flags & pad_blank) {
+			lead = ' ';
 		}
 
-		String ret;
+		Char buf[max_decimal_chars<decltype(v)> + 1];
+		auto *const end = buf + sizeof(buf) / sizeof(Char);
+		auto *p = decimal_to_chars(end, v);
+		size_t const digits = static_cast<size_t>(end - p);
 
-		if (f.flags & pad_0) {
-			if (lead) {
-				ret += lead;
+		auto width = f.width;
+		if (f.flags & with_width) {
+			if (lead && width > 0) {
+				--width;
+			}
+
+			if (f.flags & pad_0) {
+				if (lead) {
+					append_fill(out, 1, Char(lead));
+				}
+				if (digits < width) {
+					append_fill(out, width - digits, Char('0'));
+				}
+				append_chars(out, p, digits);
 			}
-			if (static_cast<size_t>(end - p) < width) {
-				ret.append(width - (end - p), '0');
+			else {
+				if (digits < width && !(f.flags & left_align)) {
+					append_fill(out, width - digits, Char(' '));
+				}
+				if (lead) {
+					append_fill(out, 1, Char(lead));
+				}
+				append_chars(out, p, digits);
+				if (digits < width && f.flags & left_align) {
+					append_fill(out, width - digits, Char(' '));
+				}
 			}
-			ret.append(p, end);
 		}
 		else {
-			if (static_cast<size_t>(end - p) < width && !(f.flags & left_align)) {
-				ret.append(width - (end - p), ' ');
-			}
 			if (lead) {
-				ret += lead;
-			}
-			ret.append(p, end);
-			if (static_cast<size_t>(end - p) < width && f.flags & left_align) {
-				ret.append(width - (end - p), ' ');
+				*(--p) = lead;
 			}
+			append_chars(out, p, static_cast<size_t>(end - p));
 		}
-
-		return ret;
 	}
 	else {
-		if (lead) {
-			*(--p) = lead;
-		}
-		return String(p, end);
+		// ... assert otherwise
+		format_assert(0);
 	}
 }
 
-// ... for strongly typed enums
-template<typename String, bool Unsigned, typename Arg>
-typename std::enable_if_t<std::is_enum_v<std::decay_t<Arg>>, String> integral_to_string(field const& f, Arg && arg)
-{
-	return integral_to_string<String, Unsigned>(f, static_cast<std::underlying_type_t<std::decay_t<Arg>>>(arg));
-}
-
-// ... assert otherwise
-template<typename String, bool Unsigned, typename Arg>
-typename std::enable_if_t<!std::is_integral_v<std::decay_t<Arg>> && !std::is_enum_v<std::decay_t<Arg>>, String> integral_to_string(field const&, Arg &&)
-{
-	format_assert(0);
-	return String();
-}
-
 template<typename String, class Arg, typename = void>
 struct has_toString : std::false_type {};
 
@@ -161,147 +241,158 @@ struct argument
 	};
 };
 
-// Converts integral type to hex string with desired string type
-template<typename String, bool Lowercase, typename Arg>
-String integral_to_hex_string(Arg && arg) noexcept
+// Writes the hexadecimal digits of the value backwards, ending at end. Returns the first written character.
+template<bool Lowercase, typename Char, typename T>
+Char* hex_to_chars(Char* end, T v)
+{
+	auto* p = end;
+	do {
+		*(--p) = fz::int_to_hex_char<Char, Lowercase>(v & 0xf);
+		v >>= 4;
+	} while (v);
+	return p;
+}
+
+// Converts integral type to hex
+template<bool Lowercase, typename Dest, typename Arg>
+void append_hex(Dest& out, field const& f, Arg && arg)
 {
+	using Char = dest_char_t<Dest>;
+
 	if constexpr (std::is_enum_v<std::decay_t<Arg>>) {
 		// Special handling for enum, cast to underlying type
-		return integral_to_hex_string<String, Lowercase>(static_cast<std::underlying_type_t<std::decay_t<Arg>>>(arg));
+		append_hex<Lowercase>(out, f, static_cast<std::underlying_type_t<std::decay_t<Arg>>>(arg));
 	}
-	else if constexpr (std::is_signed_v<std::decay_t<Arg>>) {
-		return integral_to_hex_string<String, Lowercase>(static_cast<std::make_unsigned_t<std::decay_t<Arg>>>(arg));
+	else if constexpr (std::is_integral_v<std::decay_t<Arg>> && std::is_signed_v<std::decay_t<Arg>>) {
+		append_hex<Lowercase>(out, f, static_cast<std::make_unsigned_t<std::decay_t<Arg>>>(arg));
 	}
 	else if constexpr (std::is_integral_v<std::decay_t<Arg>>) {
-		std::decay_t<Arg> v = arg;
-		typename String::value_type buf[sizeof(v) * 2];
+		std::decay_t<Arg> const v = arg;
+		Char buf[sizeof(v) * 2];
 		auto* const end = buf + sizeof(v) * 2;
-		auto* p = end;
-
-		do {
-			*(--p) = fz::int_to_hex_char<typename String::value_type, Lowercase>(v & 0xf);
-			v >>= 4;
-		} while (v);
-
-		return String(p, end);
+		auto* p = hex_to_chars<Lowercase>(end, v);
+		append_padded(out, f, p, static_cast<size_t>(end - p));
 	}
 	else {
 		format_assert(0);
-		return String();
 	}
 }
 
-// Converts pointer to hex string
-template<typename String, typename Arg>
-String pointer_to_string(Arg&& arg) noexcept
+// Converts pointer to hex
+template<typename Dest, typename Arg>
+void append_pointer(Dest& out, field const& f, Arg&& arg)
 {
+	using Char = dest_char_t<Dest>;
+
 	if constexpr (std::is_pointer_v<std::decay_t<Arg>>) {
-		return String({'0', 'x'}) + integral_to_hex_string<String, true>(reinterpret_cast<uintptr_t>(arg));
+		Char buf[sizeof(uintptr_t) * 2 + 2];
+		auto* const end = buf + sizeof(uintptr_t) * 2 + 2;
+		auto* p = hex_to_chars<true>(end, reinterpret_cast<uintptr_t>(arg));
+		*(--p) = 'x';
+		*(--p) = '0';
+		append_padded(out, f, p, static_cast<size_t>(end - p));
 	}
 	else {
 		format_assert(0);
-		return String();
 	}
 }
 
-template<typename String, typename Arg>
-String char_to_string(Arg&& arg)
+template<typename Dest, typename Arg>
+void append_char(Dest& out, Arg&& arg)
 {
 	if constexpr (std::is_integral_v<std::decay_t<Arg>>) {
-		return String({static_cast<typename String::value_type>(static_cast<unsigned char>(arg))});
+		append_fill(out, 1, static_cast<dest_char_t<Dest>>(static_cast<unsigned char>(arg)));
 	}
 	else {
 		format_assert(0);
-		return String();
 	}
 }
 
-
-template<typename String>
-void pad_arg(String& s, field const& f)
+template<typename Dest, typename Arg>
+void append_string(Dest& out, field const& f, Arg&& arg)
 {
-	if (f.flags & with_width && s.size() < f.width) {
-		if (f.flags & left_align) {
-			s += String(f.width - s.size(), ' ');
-		}
-		else {
-			s = String(f.width - s.size(), (f.flags & pad_0) ? '0' : ' ') + s;
+	using Char = dest_char_t<Dest>;
+	using String = std::basic_string<Char>;
+	using View = std::basic_string_view<Char>;
+
+	if constexpr (std::is_convertible_v<Arg, View>) {
+		// Same character type, copy directly
+		View const v = arg;
+		append_padded(out, f, v.data(), v.size());
+	}
+	else if constexpr (std::is_integral_v<std::decay_t<Arg>>) {
+		std::decay_t<Arg> const v = arg;
+		Char buf[max_decimal_chars<decltype(v)> + 1];
+		auto* const end = buf + sizeof(buf) / sizeof(Char);
+		auto* p = decimal_to_chars(end, v);
+		if (is_negative(v)) {
+			*(--p) = '-';
 		}
+		append_padded(out, f, p, static_cast<size_t>(end - p));
+	}
+	else if constexpr (has_toString<String, Arg>::value) {
+		// Converts argument to string
+		// if toString(arg) is valid expression
+		String const s = toString<String>(std::forward<Arg>(arg));
+		append_padded(out, f, s.data(), s.size());
+	}
+	else {
+		// Otherwise assert
+		format_assert(0);
 	}
 }
 
-template<typename String, typename Arg>
-String format_arg(field const& f, Arg&& arg)
+template<typename Dest, typename Arg>
+void format_arg(Dest& out, field const& f, Arg&& arg)
 {
-	String ret;
 	if (f.type == 's') {
-		if constexpr (std::is_same_v<String, std::decay_t<Arg>>) {
-			ret = arg;
-		}
-		else if constexpr (has_toString<String, Arg>::value) {
-			// Converts argument to string
-			// if toString(arg) is valid expression
-			ret = toString<String>(std::forward<Arg>(arg));
-		}
-		else {
-			// Otherwise assert
-			format_assert(0);
-		}
-		pad_arg(ret, f);
+		append_string(out, f, std::forward<Arg>(arg));
 	}
 	else if (f.type == 'd' || f.type == 'i') {
-		ret = integral_to_string<String, false>(f, std::forward<Arg>(arg));
+		append_integral<false>(out, f, std::forward<Arg>(arg));
 	}
 	else if (f.type == 'u') {
-		ret = integral_to_string<String, true>(f, std::forward<Arg>(arg));
+		append_integral<true>(out, f, std::forward<Arg>(arg));
 	}
 	else if (f.type == 'x') {
-		ret = integral_to_hex_string<String, true>(std::forward<Arg>(arg));
-		pad_arg(ret, f);
+		append_hex<true>(out, f, std::forward<Arg>(arg));
 	}
 	else if (f.type == 'X') {
-		ret = integral_to_hex_string<String, false>(std::forward<Arg>(arg));
-		pad_arg(ret, f);
+		append_hex<false>(out, f, std::forward<Arg>(arg));
 	}
 	else if (f.type == 'p') {
-		ret = pointer_to_string<String>(std::forward<Arg>(arg));
-		pad_arg(ret, f);
+		append_pointer(out, f, std::forward<Arg>(arg));
 	}
 	else if (f.type == 'c') {
-		ret = char_to_string<String>(std::forward<Arg>(arg));
+		append_char(out, std::forward<Arg>(arg));
 	}
 	else {
 		format_assert(0);
 	}
-	return ret;
 }
 
-template<typename String, typename... Args>
-String extract_arg(field const&, size_t)
+template<typename Dest>
+void extract_arg(Dest&, field const&, size_t)
 {
-	return String();
 }
 
-
-template<typename String, typename Arg, typename... Args>
-String extract_arg(field const& f, size_t arg_n, Arg&& arg, Args&&...args)
+template<typename Dest, typename Arg, typename... Args>
+void extract_arg(Dest& out, field const& f, size_t arg_n, Arg&& arg, Args&&...args)
 {
-	String ret;
-
 	if (!arg_n) {
-		ret = format_arg<String>(f, std::forward<Arg>(arg));
+		format_arg(out, f, std::forward<Arg>(arg));
 	}
 	else {
-		ret = extract_arg<String>(f, arg_n - 1, std::forward<Args>(args)...);
+		extract_arg(out, f, arg_n - 1, std::forward<Args>(args)...);
 	}
-
-	return ret;
 }
 
-template<typename InString, typename OutString>
-field get_field(InString const& fmt, typename InString::size_type & pos, size_t& arg_n, OutString & ret)
+// Parses the field starting at the % character at fmt[pos].
+// A literal percent is returned as field of type '%'.
+template<typename View>
+constexpr field parse_field(View const& fmt, size_t & pos, size_t& arg_n)
 {
-	field f;
+	field f{};
 	if (++pos >= fmt.size()) {
 		format_assert(0);
 		return f;
@@ -309,59 +400,62 @@ field get_field(InString const& fmt, typename InString::size_type & pos, size_t&
 
 	// Get literal percent out of the way
 	if (fmt[pos] == '%') {
-		ret += '%';
+		f.type = '%';
 		++pos;
 		return f;
 	}
 
-parse_start:
 	while (true) {
-		if (fmt[pos] == '0') {
-			f.flags |= pad_0;
-		}
-		else if (fmt[pos] == ' ') {
-			f.flags |= pad_blank;
-		}
-		else if (fmt[pos] == '-') {
-			f.flags &= ~pad_0;
-			f.flags |= left_align;
-		}
-		else if (fmt[pos] == '+') {
-			f.flags &= ~pad_blank;
-			f.flags |= always_sign;
+		while (true) {
+			if (fmt[pos] == '0') {
+				f.flags |= pad_0;
+			}
+			else if (fmt[pos] == ' ') {
+				f.flags |= pad_blank;
+			}
+			else if (fmt[pos] == '-') {
+				f.flags &= ~pad_0;
+				f.flags |= left_align;
+			}
+			else if (fmt[pos] == '+') {
+				f.flags &= ~pad_blank;
+				f.flags |= always_sign;
+			}
+			else {
+				break;
+			}
+			if (++pos >= fmt.size()) {
+				format_assert(0);
+				return f;
+			}
 		}
-		else {
-			break;
+
+		// Field width
+		while (fmt[pos] >= '0' && fmt[pos] <= '9') {
+			f.flags |= with_width;
+			f.width *= 10;
+			f.width += fmt[pos] - '0';
+			if (++pos >= fmt.size()) {
+				format_assert(0);
+				return f;
+			}
 		}
-		if (++pos >= fmt.size()) {
+		if (f.width > 10000) {
 			format_assert(0);
-			return f;
+			f.width = 10000;
 		}
-	}
 
-	// Field width
-	while (fmt[pos] >= '0' && fmt[pos] <= '9') {
-		f.flags |= with_width;
-		f.width *= 10;
-		f.width += fmt[pos] - '0';
-		if (++pos >= fmt.size()) {
-			format_assert(0);
-			return f;
+		if (fmt[pos] != '$') {
+			break;
 		}
-	}
-	if (f.width > 10000) {
-		format_assert(0);
-		f.width = 10000;
-	}
 
-	if (fmt[pos] == '$') {
 		// Positional argument, start over
 		arg_n = f.width - 1;
+		f = field{};
 		if (++pos >= fmt.size()) {
 			format_assert(0);
 			return f;
 		}
-		goto parse_start;
 	}
 
 	// Ignore length modifier
@@ -399,34 +493,165 @@ constexpr bool check_arguments(std::index_sequence<Is...>)
 	return (check_argument<String, Args, Is>() && ...);
 }
 
-template<typename InString, typename CharType = typename InString::value_type, typename OutString = std::basic_string<CharType>, typename... Args>
-OutString do_sprintf(InString const& fmt, Args&&... args)
+template<typename Dest, typename View, typename... Args>
+void do_sprintf(Dest& out, View const& fmt, Args&&... args)
 {
-	OutString ret;
-
 	// Find % characters
-	typename InString::size_type start = 0, pos;
+	size_t start = 0, pos;
 
 	size_t arg_n{};
-	while ((pos = fmt.find('%', start)) != InString::npos) {
+	while ((pos = fmt.find('%', start)) != View::npos) {
 
 		// Copy segment preceding the %
-		ret += fmt.substr(start, pos - start);
+		append_chars(out, fmt.data() + start, pos - start);
 
-		field f = detail::get_field(fmt, pos, arg_n, ret);
-		if (f) {
+		field f = parse_field(fmt, pos, arg_n);
+		if (f.type == '%') {
+			append_fill(out, 1, dest_char_t<Dest>('%'));
+		}
+		else if (f) {
 			format_assert(arg_n < sizeof...(args));
-			ret += detail::extract_arg<OutString>(f, arg_n++, std::forward<Args>(args)...);
+			extract_arg(out, f, arg_n++, std::forward<Args>(args)...);
 		}
 
 		start = pos;
 	}
 
 	// Copy remainder of string
-	ret += fmt.substr(start);
+	append_chars(out, fmt.data() + start, fmt.size() - start);
+}
+
+struct format_string_base {};
+
+// A piece of a format string parsed at compile time: Either a literal range
+// of the format string or a field referencing an argument.
+struct format_segment final {
+	size_t start{};
+	size_t length{};
+	size_t arg{};
+	field f{};
+};
+
+template<size_t N>
+struct parsed_format final {
+	format_segment segments[N ? N : 1]{};
+	size_t size{};
+	size_t literal_size{};
+
+	// One past the highest argument index referenced by the format string
+	size_t arg_count{};
+};
+
+// Splits the format string into segments. With count_only set, segments are only counted.
+template<typename View, size_t N>
+constexpr void parse_format_segments(View const& fmt, parsed_format<N>& out, bool count_only)
+{
+	constexpr size_t npos = size_t(-1);
+
+	size_t literal_end = npos;
+	size_t arg_n{};
+	size_t pos{};
+
+	auto add_literal = [&](size_t start, size_t length) {
+		if (literal_end == start) {
+			if (!count_only) {
+				out.segments[out.size - 1].length += length;
+			}
+		}
+		else {
+			if (!count_only) {
+				out.segments[out.size].start = start;
+				out.segments[out.size].length = length;
+			}
+			++out.size;
+		}
+		literal_end = start + length;
+		out.literal_size += length;
+	};
+
+	while (pos < fmt.size()) {
+		size_t const start = pos;
+		if (fmt[pos] != '%') {
+			while (pos < fmt.size() && fmt[pos] != '%') {
+				++pos;
+			}
+			add_literal(start, pos - start);
+			continue;
+		}
+
+		field f = parse_field(fmt, pos, arg_n);
+		if (f.type == '%') {
+			// Second percent sign is the literal one
+			add_literal(start + 1, 1);
+		}
+		else if (f) {
+			if (!count_only) {
+				out.segments[out.size].f = f;
+				out.segments[out.size].arg = arg_n;
+			}
+			++out.size;
+			literal_end = npos;
+			if (arg_n + 1 > out.arg_count) {
+				out.arg_count = arg_n + 1;
+			}
+			++arg_n;
+		}
+	}
+}
+
+template<typename View>
+constexpr size_t count_format_segments(View const& fmt)
+{
+	parsed_format<0> counter{};
+	parse_format_segments(fmt, counter, true);
+	return counter.size;
+}
 
+template<size_t N, typename View>
+constexpr parsed_format<N> parse_format(View const& fmt)
+{
+	parsed_format<N> ret{};
+	parse_format_segments(fmt, ret, false);
 	return ret;
 }
+
+template<typename Format>
+struct compiled_format final {
+	using char_type = typename Format::char_type;
+
+	static constexpr std::basic_string_view<char_type> view = Format{};
+	static constexpr size_t size = count_format_segments(view);
+	static constexpr parsed_format<size> parsed = parse_format<size>(view);
+};
+
+template<typename Format, size_t I, typename Dest, typename Tuple>
+void append_segment(Dest& out, Tuple&& args)
+{
+	using cf = compiled_format<Format>;
+	constexpr format_segment s = cf::parsed.segments[I];
+	if constexpr (static_cast<bool>(s.f)) {
+		format_arg(out, s.f, std::get<s.arg>(std::forward<Tuple>(args)));
+	}
+	else {
+		append_chars(out, cf::view.data() + s.start, s.length);
+	}
+}
+
+template<typename Format, typename Dest, typename Tuple, size_t... Is>
+void do_sprintf_compiled(Dest& out, Tuple&& args, std::index_sequence<Is...>)
+{
+	(append_segment<Format, Is>(out, std::forward<Tuple>(args)), ...);
+}
+
+template<typename Format, typename Dest, typename... Args>
+void do_sprintf_compiled(Dest& out, Args&&... args)
+{
+	using cf = compiled_format<Format>;
+	static_assert(std::is_same_v<typename Format::char_type, dest_char_t<Dest>>, "Character type of format string does not match the destination");
+	static_assert(cf::parsed.arg_count <= sizeof...(Args), "Format string references more arguments than were passed to fz::sprintf()");
+
+	do_sprintf_compiled<Format>(out, std::forward_as_tuple(std::forward<Args>(args)...), std::make_index_sequence<cf::parsed.size>());
+}
 }
 /// \endcond
 
@@ -457,7 +682,9 @@ std::string sprintf(std::string_view const& fmt, Args&&... args)
 {
 	detail::check_arguments<std::string, Args...>(std::index_sequence_for<Args...>());
 
-	return detail::do_sprintf(fmt, std::forward<Args>(args)...);
+	std::string ret;
+	detail::do_sprintf(ret, fmt, std::forward<Args>(args)...);
+	return ret;
 }
 
 template<typename... Args>
@@ -465,7 +692,70 @@ std::wstring sprintf(std::wstring_view const& fmt, Args&&... args)
 {
 	detail::check_arguments<std::wstring, Args...>(std::index_sequence_for<Args...>());
 
-	return detail::do_sprintf(fmt, std::forward<Args>(args)...);
+	std::wstring ret;
+	detail::do_sprintf(ret, fmt, std::forward<Args>(args)...);
+	return ret;
+}
+
+/** \brief Overload of \ref fz::sprintf taking a format string created by \ref fzF
+ *
+ * The format string gets parsed at compile-time, at runtime only the arguments
+ * need to be formatted and copied into the result along with the literal parts
+ * of the format string.
+ *
+ * Fails to compile if the format string references more arguments than are passed.
+ */
+template<typename Format, typename... Args, std::enable_if_t<std::is_base_of_v<detail::format_string_base, Format>, int> = 0>
+std::basic_string<typename Format::char_type> sprintf(Format const&, Args&&... args)
+{
+	using OutString = std::basic_string<typename Format::char_type>;
+	detail::check_arguments<OutString, Args...>(std::index_sequence_for<Args...>());
+
+	OutString ret;
+	ret.reserve(detail::compiled_format<Format>::parsed.literal_size);
+	detail::do_sprintf_compiled<Format>(ret, std::forward<Args>(args)...);
+	return ret;
+}
+
+/** \brief Like \ref fz::sprintf, but appends the formatted string to an existing string.
+ *
+ * Arguments are formatted directly into the destination without creating
+ * temporary strings, except where a string argument needs to be converted
+ * between narrow and wide characters. This allows reusing the destination's
+ * allocated memory across many calls.
+ */
+template<typename... Args>
+void sprintf_to(std::string& out, std::string_view const& fmt, Args&&... args)
+{
+	detail::check_arguments<std::string, Args...>(std::index_sequence_for<Args...>());
+
+	detail::do_sprintf(out, fmt, std::forward<Args>(args)...);
+}
+
+template<typename... Args>
+void sprintf_to(std::wstring& out, std::wstring_view const& fmt, Args&&... args)
+{
+	detail::check_arguments<std::wstring, Args...>(std::index_sequence_for<Args...>());
+
+	detail::do_sprintf(out, fmt, std::forward<Args>(args)...);
+}
+
+/// \brief Appends the formatted string to the buffer, narrow strings are written as-is.
+template<typename... Args>
+void sprintf_to(buffer& out, std::string_view const& fmt, Args&&... args)
+{
+	detail::check_arguments<std::string, Args...>(std::index_sequence_for<Args...>());
+
+	detail::do_sprintf(out, fmt, std::forward<Args>(args)...);
+}
+
+/// \brief Appends the formatted string to the destination using a format string created by \ref fzF
+template<typename Dest, typename Format, typename... Args, std::enable_if_t<std::is_base_of_v<detail::format_string_base, Format>, int> = 0>
+void sprintf_to(Dest& out, Format const&, Args&&... args)
+{
+	detail::check_arguments<std::basic_string<typename Format::char_type>, Args...>(std::index_sequence_for<Args...>());
+
+	detail::do_sprintf_compiled<Format>(out, std::forward<Args>(args)...);
 }
 
 }
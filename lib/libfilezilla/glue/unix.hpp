@@ -30,7 +30,7 @@ bool FZ_PUBLIC_SYMBOL create_pipe(int fds[2]);
 
 /** \brief Disables SIGPIPE
  *
- * \note This is implicitly called by create_pipe and when a socket is created.
+ * \note This is implicitly called by create_pipe, when a socket is created and when a splice_pump is created.
  */
 void FZ_PUBLIC_SYMBOL disable_sigpipe();
 
@@ -11,6 +11,9 @@
 #include <dirent.h>
 #endif
 
+#include <functional>
+#include <vector>
+
 /** \file
  * \brief Declares local_filesys class to enumerate local files and query their metadata such as type, size and modification time.
  */
@@ -109,6 +112,86 @@ public:
 	 */
 	bool get_next_file(native_string& name, bool &is_link, type & t, int64_t* size, datetime* modification_time, int* mode);
 
+	/// Metadata of a directory entry returned by \ref get_next_files
+	struct entry final {
+		/// Position of the name in the arena of \ref entries
+		size_t name_offset{};
+		size_t name_length{};
+
+		/// -1 for directories or if not known
+		int64_t size{-1};
+		datetime modification_time;
+		int mode{};
+		type t{unknown};
+		bool is_link{};
+	};
+
+	/**
+	 * \brief A batch of directory entries.
+	 *
+	 * The names are stored back to back in a single arena, each terminated by a null
+	 * character, the metadata in an array of fixed-size records. Reuse the same object
+	 * for subsequent batches, the memory is kept across calls.
+	 */
+	class entries final
+	{
+	public:
+		size_t size() const { return records_.size(); }
+		bool empty() const { return records_.empty(); }
+
+		entry const& operator[](size_t i) const { return records_[i]; }
+
+		/// Name of the i-th entry. The view is null-terminated and valid until the batch gets modified.
+		native_string_view name(size_t i) const {
+			return native_string_view(names_.data() + records_[i].name_offset, records_[i].name_length);
+		}
+
+		void clear() {
+			names_.clear();
+			records_.clear();
+		}
+
+		/// Appends the entries of another batch, e.g. to collect a whole directory.
+		void append(entries const& other) {
+			size_t const offset = names_.size();
+			names_.append(other.names_);
+			for (auto e : other.records_) {
+				e.name_offset += offset;
+				records_.push_back(e);
+			}
+		}
+
+	private:
+		friend class local_filesys;
+
+		void add(native_string_view name, entry e) {
+			e.name_offset = names_.size();
+			e.name_length = name.size();
+			names_.append(name);
+			names_.push_back(0);
+			records_.push_back(e);
+		}
+
+		native_string names_;
+		std::vector<entry> records_;
+	};
+
+	/**
+	 * \brief Gets the next batch of files in the directory. Call until it returns false.
+	 *
+	 * Much faster than calling \ref get_next_file in a loop for large directories:
+	 * On Linux, a single getdents64 system call reads a large batch of entries and the metadata
+	 * is queried using statx with only the required fields. Under Windows, every batch is the
+	 * result of one directory query, which already includes the metadata.
+	 *
+	 * \param out Replaced with the next batch, empty once the end of the directory is reached.
+	 * \param metadata If false, only name, type and is_link are filled in. The type is taken
+	 * from the directory entry itself where possible, avoiding the need to query each file.
+	 *
+	 * Do not mix with calls to \ref get_next_file during the same enumeration.
+	 */
+	bool get_next_files(entries& out, bool metadata = true);
+
 	/// Ends enumerating files. Automatically called in the destructor.
 	void end_find_files();
 
@@ -121,12 +204,12 @@ public:
 private:
 #ifdef FZ_WINDOWS
 	bool FZ_PRIVATE_SYMBOL check_buffer();
-	std::vector<unsigned char> buffer_;
 	unsigned char* cur_{};
 	HANDLE dir_{INVALID_HANDLE_VALUE};
 #else
 	DIR* dir_{};
 #endif
+	std::vector<unsigned char> buffer_;
 
 	// State for directory enumeration
 	bool dirs_only_{};
@@ -187,6 +270,28 @@ result FZ_PUBLIC_SYMBOL remove_dir(native_string const& absolute_path);
  */
 result FZ_PUBLIC_SYMBOL rename_file(native_string const& source, native_string const& dest, bool allow_copy = true);
 
+/** \brief Progress callback for \ref copy_file
+ *
+ * Gets passed the number of octets copied so far and the size of the source file.
+ * Return false to abort the copy.
+ */
+typedef std::function<bool(int64_t copied, int64_t total)> copy_progress;
+
+/**
+ * \brief Copies a file, overwriting the target file.
+ *
+ * Uses the fastest method supported by the system and filesystems: On Linux
+ * it first tries to share the data blocks using a reflink, then copying in the
+ * kernel using copy_file_range or sendfile, only then falls back to reading
+ * and writing the data. Under Windows, CopyFileEx is used.
+ *
+ * If the copy fails or is aborted through the progress callback, the target
+ * file is removed.
+ *
+ * The data is not flushed to disk, call \ref file::fsync on the target if needed.
+ */
+result FZ_PUBLIC_SYMBOL copy_file(native_string const& source, native_string const& dest, copy_progress const& progress = copy_progress());
+
 }
 
 #endif
@@ -8,6 +8,9 @@
 #include "format.hpp"
 
 #include <atomic>
+#include <cstddef>
+#include <new>
+#include <tuple>
 
 namespace fz {
 namespace logmsg
@@ -39,6 +42,334 @@ namespace logmsg
 	};
 }
 
+/**
+ * \brief Receives the format string and the arguments of a \ref deferred_message.
+ *
+ * \sa deferred_message::visit
+ */
+class deferred_visitor
+{
+public:
+	virtual ~deferred_visitor() = default;
+
+	/// Narrow format strings are in the locale's encoding. Literal format strings remain valid for the lifetime of the program.
+	virtual void format(std::string_view const& fmt, bool literal) = 0;
+	virtual void format(std::wstring_view const& fmt, bool literal) = 0;
+
+	/// Integral arguments, including enums, with the size of their original type
+	virtual void signed_arg(int64_t v, size_t size) = 0;
+	virtual void unsigned_arg(uint64_t v, size_t size) = 0;
+
+	virtual void floating_arg(double v) = 0;
+	virtual void pointer_arg(void const* v) = 0;
+
+	/// Narrow strings are in UTF-8 if logged through \ref logger_interface::log_u, otherwise in the locale's encoding.
+	virtual void string_arg(std::string_view const& v, bool utf8) = 0;
+	virtual void string_arg(std::wstring_view const& v) = 0;
+};
+
+/// \cond
+namespace detail {
+
+// How arguments of deferred log messages are stored. Pointers to strings
+// and string views are copied into strings, as the referenced data is likely
+// gone by the time the message gets formatted.
+template<typename T>
+struct deferred_arg {
+	using type = std::decay_t<T>;
+};
+
+template<> struct deferred_arg<char*> { using type = std::string; };
+template<> struct deferred_arg<char const*> { using type = std::string; };
+template<> struct deferred_arg<wchar_t*> { using type = std::wstring; };
+template<> struct deferred_arg<wchar_t const*> { using type = std::wstring; };
+template<> struct deferred_arg<std::string_view> { using type = std::string; };
+template<> struct deferred_arg<std::wstring_view> { using type = std::wstring; };
+
+template<typename T>
+using deferred_arg_t = typename deferred_arg<std::decay_t<T>>::type;
+
+// Only format strings created by fzF are known to be string literals and get referenced instead
+// of copied. A character array could just as well be a buffer on the stack.
+template<typename String, typename = void>
+struct deferred_format {
+	using type = deferred_arg_t<String>;
+};
+
+template<typename String>
+struct deferred_format<String, std::enable_if_t<std::is_base_of_v<format_string_base, std::decay_t<String>>>> {
+	using type = std::basic_string_view<typename std::decay_t<String>::char_type>;
+};
+
+template<typename String>
+using deferred_format_t = typename deferred_format<String>::type;
+
+// A narrow string argument of log_u that is not converted from UTF-8. Like when formatting
+// right away, only pointers to constant characters, strings and string views are.
+struct locale_string final {
+	explicit locale_string(char const* s)
+		: str_(s)
+	{}
+
+	std::string str_;
+};
+
+template<bool Utf8, typename T>
+using deferred_log_arg_t = std::conditional_t<Utf8 && std::is_same_v<std::decay_t<T>, char*>, locale_string, deferred_arg_t<T>>;
+
+template<typename String, typename... Args>
+constexpr bool is_deferrable_v = std::conjunction_v<
+	std::is_constructible<deferred_format_t<String>, String>,
+	std::is_constructible<deferred_arg_t<Args>, Args>...
+>;
+
+template<typename T>
+T const& utf8_arg(T const& arg) {
+	return arg;
+}
+
+inline std::wstring utf8_arg(std::string const& arg) {
+	return fz::to_wstring_from_utf8(arg);
+}
+
+inline std::string const& utf8_arg(locale_string const& arg) {
+	return arg.str_;
+}
+
+template<typename T>
+constexpr bool is_visitable_arg_v = std::disjunction_v<
+	std::is_arithmetic<T>,
+	std::is_enum<T>,
+	std::conjunction<std::is_pointer<T>, std::is_object<std::remove_pointer_t<T>>>,
+	std::is_same<T, std::string>,
+	std::is_same<T, std::wstring>,
+	std::is_same<T, locale_string>
+>;
+
+template<bool Utf8, typename Fmt, typename... Args>
+struct deferred_record final {
+	static constexpr bool visitable = (is_visitable_arg_v<Args> && ...);
+
+	template<typename String, typename... A>
+	deferred_record(String&& fmt, A&&... args)
+		: fmt_(std::forward<String>(fmt))
+		, args_(std::forward<A>(args)...)
+	{}
+
+	std::wstring format() const {
+		return std::apply([this](auto const&... args) {
+			if constexpr (std::is_same_v<Fmt, std::wstring_view> || std::is_same_v<Fmt, std::wstring>) {
+				return fz::sprintf(std::wstring_view(fmt_), arg(args)...);
+			}
+			else {
+				return fz::sprintf(fz::to_wstring(fmt_), arg(args)...);
+			}
+		}, args_);
+	}
+
+	void visit(deferred_visitor & v) const {
+		constexpr bool literal = std::is_same_v<Fmt, std::string_view> || std::is_same_v<Fmt, std::wstring_view>;
+		if constexpr (std::is_same_v<Fmt, std::wstring_view> || std::is_same_v<Fmt, std::wstring>) {
+			v.format(std::wstring_view(fmt_), literal);
+		}
+		else {
+			v.format(std::string_view(fmt_), literal);
+		}
+		std::apply([&v](auto const&... args) {
+			(visit_arg(v, args), ...);
+		}, args_);
+	}
+
+private:
+	template<typename T>
+	static void visit_arg(deferred_visitor & v, T const& a) {
+		if constexpr (std::is_enum_v<T>) {
+			visit_arg(v, static_cast<std::underlying_type_t<T>>(a));
+		}
+		else if constexpr (std::is_floating_point_v<T>) {
+			v.floating_arg(static_cast<double>(a));
+		}
+		else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+			v.signed_arg(static_cast<int64_t>(a), sizeof(T));
+		}
+		else if constexpr (std::is_integral_v<T>) {
+			v.unsigned_arg(static_cast<uint64_t>(a), sizeof(T));
+		}
+		else if constexpr (std::is_pointer_v<T>) {
+			v.pointer_arg(static_cast<void const*>(a));
+		}
+		else if constexpr (std::is_same_v<T, std::string>) {
+			v.string_arg(std::string_view(a), Utf8);
+		}
+		else if constexpr (std::is_same_v<T, locale_string>) {
+			v.string_arg(std::string_view(a.str_), false);
+		}
+		else {
+			v.string_arg(std::wstring_view(a));
+		}
+	}
+
+	template<typename T>
+	static decltype(auto) arg(T const& a) {
+		if constexpr (Utf8) {
+			return utf8_arg(a);
+		}
+		else {
+			return (a);
+		}
+	}
+
+	Fmt fmt_;
+	std::tuple<Args...> args_;
+};
+}
+/// \endcond
+
+/**
+ * \brief A log message of which the formatting has been deferred.
+ *
+ * Holds a reference to the format string if it has been created by \ref fzF, a copy otherwise,
+ * as well as copies of the arguments. Small messages are stored inline, without allocation.
+ *
+ * Formatting the message results in the same string \ref logger_interface::log would have passed to
+ * \ref logger_interface::do_log.
+ */
+class deferred_message final
+{
+public:
+	deferred_message() noexcept = default;
+
+	/// Creates a message formatted like \ref logger_interface::log, or \ref logger_interface::log_u if Utf8 is set.
+	template<bool Utf8, typename String, typename... Args>
+	static deferred_message create(String&& fmt, Args&&... args)
+	{
+		using record = detail::deferred_record<Utf8, detail::deferred_format_t<String>, detail::deferred_log_arg_t<Utf8, Args>...>;
+		constexpr bool fits = sizeof(record) <= inline_size && alignof(record) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<record>;
+		static ops const record_ops{
+			[](void const* r) { return static_cast<record const*>(r)->format(); },
+			[](void* dst, void* src) noexcept {
+				new (dst) record(std::move(*static_cast<record*>(src)));
+				static_cast<record*>(src)->~record();
+			},
+			[](void* r) noexcept {
+				static_cast<record*>(r)->~record();
+			},
+			visit_fn<record>(),
+			fits
+		};
+
+		deferred_message ret;
+		if constexpr (fits) {
+			ret.data_ = new (ret.storage_) record(std::forward<String>(fmt), std::forward<Args>(args)...);
+		}
+		else {
+			ret.data_ = new record(std::forward<String>(fmt), std::forward<Args>(args)...);
+		}
+		ret.ops_ = &record_ops;
+		return ret;
+	}
+
+	~deferred_message()
+	{
+		reset();
+	}
+
+	deferred_message(deferred_message const&) = delete;
+	deferred_message& operator=(deferred_message const&) = delete;
+
+	deferred_message(deferred_message && op) noexcept
+	{
+		take(op);
+	}
+
+	deferred_message& operator=(deferred_message && op) noexcept
+	{
+		if (this != &op) {
+			reset();
+			take(op);
+		}
+		return *this;
+	}
+
+	explicit operator bool() const { return ops_ != nullptr; }
+
+	/// Formats the message, returns an empty string on empty messages.
+	std::wstring format() const
+	{
+		return ops_ ? ops_->format_(data_) : std::wstring();
+	}
+
+	/// Whether the format string and all arguments can be passed to a \ref deferred_visitor
+	bool visitable() const { return ops_ && ops_->visit_; }
+
+	/** \brief Passes format string and arguments to the visitor.
+	 *
+	 * \return false if not \ref visitable, the visitor does not get called at all in this case.
+	 */
+	bool visit(deferred_visitor & v) const
+	{
+		if (!visitable()) {
+			return false;
+		}
+		ops_->visit_(data_, v);
+		return true;
+	}
+
+	void reset()
+	{
+		if (ops_) {
+			ops_->destroy_(data_);
+			if (!ops_->inline_) {
+				::operator delete(data_);
+			}
+			ops_ = nullptr;
+			data_ = nullptr;
+		}
+	}
+
+private:
+	struct ops final {
+		std::wstring (*format_)(void const*);
+		void (*move_)(void* dst, void* src) noexcept;
+		void (*destroy_)(void*) noexcept;
+		void (*visit_)(void const*, deferred_visitor&);
+		bool inline_;
+	};
+
+	template<typename Record>
+	static constexpr auto visit_fn() -> void (*)(void const*, deferred_visitor&)
+	{
+		if constexpr (Record::visitable) {
+			return [](void const* r, deferred_visitor & v) { static_cast<Record const*>(r)->visit(v); };
+		}
+		else {
+			return nullptr;
+		}
+	}
+
+	void take(deferred_message & op) noexcept
+	{
+		ops_ = op.ops_;
+		if (ops_) {
+			if (ops_->inline_) {
+				ops_->move_(storage_, op.storage_);
+				data_ = storage_;
+			}
+			else {
+				data_ = op.data_;
+			}
+			op.ops_ = nullptr;
+			op.data_ = nullptr;
+		}
+	}
+
+	static constexpr size_t inline_size = 96;
+
+	ops const* ops_{};
+	void* data_{};
+	alignas(std::max_align_t) unsigned char storage_[inline_size];
+};
+
 /**
  * \brief Abstract interface for logging strings.
  *
@@ -60,6 +391,16 @@ public:
 	/// The one thing you need to override
 	virtual void do_log(logmsg::type t, std::wstring && msg) = 0;
 
+	/**
+	 * \brief Called by \ref log and \ref log_u instead of \ref do_log if deferred formatting is enabled.
+	 *
+	 * Override this to move the formatting of the message off the logging thread.
+	 * The default implementation formats the message right away.
+	 */
+	virtual void do_log_deferred(logmsg::type t, deferred_message && msg) {
+		do_log(t, msg.format());
+	}
+
 	/**
 	 * The \arg fmt argument is a format string suitable for fz::sprintf
 	 *
@@ -69,6 +410,12 @@ public:
 	void log(logmsg::type t, String&& fmt, Args&& ...args)
 	{
 		if (should_log(t)) {
+			if constexpr (detail::is_deferrable_v<String, Args...>) {
+				if (defer_formatting_) {
+					do_log_deferred(t, deferred_message::create<false>(std::forward<String>(fmt), std::forward<Args>(args)...));
+					return;
+				}
+			}
 			std::wstring formatted = fz::sprintf(fz::to_wstring(std::forward<String>(fmt)), args...);
 			do_log(t, std::move(formatted));
 		}
@@ -83,6 +430,12 @@ public:
 	void log_u(logmsg::type t, String&& fmt, Args const& ...args)
 	{
 		if (should_log(t)) {
+			if constexpr (detail::is_deferrable_v<String, Args const&...>) {
+				if (defer_formatting_) {
+					do_log_deferred(t, deferred_message::create<true>(std::forward<String>(fmt), args...));
+					return;
+				}
+			}
 			std::wstring formatted = fz::sprintf(fz::to_wstring(std::forward<String>(fmt)), assume_strings_are_utf8(args)...);
 			do_log(t, std::move(formatted));
 		}
@@ -136,6 +489,14 @@ public:
 protected:
 	std::atomic<uint64_t> level_{logmsg::status | logmsg::error | logmsg::command | logmsg::reply};
 
+	/**
+	 * If set, \ref log and \ref log_u only capture the format string and copies of the
+	 * arguments and pass them to \ref do_log_deferred.
+	 *
+	 * Format strings created by \ref fzF are string literals and do not get copied.
+	 */
+	bool defer_formatting_{};
+
 private:
 	std::wstring assume_strings_are_utf8(std::string_view const& arg) {
 		return fz::to_wstring_from_utf8(arg);
@@ -0,0 +1,133 @@
+#ifndef LIBFILEZILLA_MAPPED_FILE_HEADER
+#define LIBFILEZILLA_MAPPED_FILE_HEADER
+
+/** \file
+ * \brief Declares \ref fz::mapped_file "mapped_file" for read-only access to memory-mapped files
+ */
+
+#include "file.hpp"
+#include "nonowning_buffer.hpp"
+
+#include <string_view>
+
+namespace fz {
+
+/**
+ * \brief Maps a file, or a sliding window of it, read-only into memory.
+ *
+ * Accessing the data does not require copying it out of the page cache,
+ * making this well suited for hashing, parsing or sending whole files.
+ *
+ * If the file is larger than the window size passed to \ref open, only a
+ * part of it is mapped at any time. \ref view moves the window as needed.
+ *
+ * \warning If the file is truncated by someone else while mapped, accessing
+ * the pages past the new end of the file causes SIGBUS or an access violation.
+ */
+class FZ_PUBLIC_SYMBOL mapped_file final
+{
+public:
+	/// Used by \ref advise
+	enum class advice {
+		/// No specific access pattern
+		normal,
+
+		/// Pages are accessed in order, read ahead aggressively and free pages behind
+		sequential,
+
+		/// Pages are accessed in random order, disables read-ahead
+		random,
+
+		/// Starts reading the pages of the current window into memory
+		willneed,
+
+		/// The pages of the current window are not going to be accessed soon
+		dontneed,
+
+		/// Use huge pages if supported for the file's filesystem
+		hugepage
+	};
+
+	mapped_file() = default;
+	~mapped_file();
+
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+
+	mapped_file(mapped_file && op) noexcept;
+	mapped_file& operator=(mapped_file && op) noexcept;
+
+	/** \brief Opens the file and maps its beginning
+	 *
+	 * \param window_size Upper bound of the address space used by the mapping.
+	 * Rounded up to the mapping granularity of the system. If 0, the whole file is
+	 * mapped, except on 32-bit systems where a window of 256 MiB is used.
+	 */
+	result open(native_string const& path, size_t window_size = 0);
+
+	void close();
+
+	bool opened() const;
+	explicit operator bool() const { return opened(); }
+
+	/// Size of the file at the time it was opened
+	int64_t size() const { return size_; }
+
+	/** \brief Returns a view of the given range of the file.
+	 *
+	 * The range gets clipped to the end of the file and to the window size. If it is
+	 * not within the mapped window, the window is moved to start at the offset,
+	 * invalidating all views obtained earlier.
+	 *
+	 * Returns an empty view at the end of the file or on error.
+	 */
+	std::basic_string_view<uint8_t> view(int64_t offset, size_t length);
+
+	/** \brief Same as \ref view, for functions taking a \ref nonowning_buffer.
+	 *
+	 * \warning The memory is read-only, only consume from the returned buffer.
+	 */
+	nonowning_buffer buffer(int64_t offset, size_t length);
+
+	/// The currently mapped window of the file, empty if nothing is mapped.
+	std::basic_string_view<uint8_t> window() const { return {data_, mapped_size_}; }
+
+	/// Offset in the file of the currently mapped window
+	int64_t window_offset() const { return mapped_offset_; }
+
+	/** \brief Passes access pattern hints to the system.
+	 *
+	 * \c normal, \c sequential, \c random and \c hugepage also apply to
+	 * windows mapped later on, \c willneed and \c dontneed only apply to the
+	 * current window.
+	 *
+	 * \return false if the hint is not supported.
+	 */
+	bool advise(advice a);
+
+private:
+	bool map(int64_t offset);
+	void unmap();
+	bool apply(advice a);
+
+#ifdef FZ_WINDOWS
+	HANDLE fd_{INVALID_HANDLE_VALUE};
+	HANDLE mapping_{};
+#else
+	int fd_{-1};
+#endif
+
+	int64_t size_{};
+	size_t window_size_{};
+
+	uint8_t* data_{};
+	size_t mapped_size_{};
+	int64_t mapped_offset_{};
+
+	advice pattern_{advice::normal};
+	bool hugepage_{};
+};
+
+}
+
+#endif
@@ -65,6 +65,10 @@ public:
 	/** \brief Creates instance with non-blocking event-based redirected communication
 	 *
 	 * Event semantic akin to \sa fz::socket
+	 *
+	 * On *nix, the pipes of all running processes created with the same thread pool
+	 * are monitored by a single thread of that pool. On Linux, exited children
+	 * are reaped right away instead of when calling \ref kill.
 	 */
 	process(fz::thread_pool & pool, fz::event_handler & handler);
 
@@ -76,7 +80,8 @@ public:
 	enum class io_redirection {
 		redirect, /// Redirect the child's stdin/out/err to pipes which will be interacted with through fz::process::read and fz::process::write
 		none, /// Parent and child share the same stdin/out/err
-		closeall /// Redirects the child's stdin/out/err to pipes closed in the parent process
+		closeall, /// Redirects the child's stdin/out/err to pipes closed in the parent process
+		redirect_discard_stderr /// Like redirect, but the child's stderr goes to the null device instead of a pipe nobody reads from
 	};
 
 	/** \brief Start the process
@@ -87,8 +92,9 @@ public:
 	 * \param cmd The path of the program to execute
 	 * \param args The command-line arguments for the process.
 	 *
-	 * \note May return \c true even if the process cannot be started. In that case, trying to read from the process
-	 * will fail with an error or EOF.
+	 * \note On Windows and Linux, returns \c false if the program cannot be executed. On other platforms, the program
+	 * is executed after fork() has returned, so spawn may return \c true even if the process cannot be started. In that
+	 * case, trying to read from the process will fail with an error or EOF.
 	 *
 	 * If the communication is non-blocking, a successful spawn doubles as process event with write flag
 	 */
@@ -150,6 +156,12 @@ public:
 	 * Returns the HANDLE of the process
 	 */
 	void* handle() const;
+#else
+	/// Returns the parent's end of the pipe connected to the child's standard input, -1 if not redirected
+	int get_input_descriptor() const;
+
+	/// Returns the parent's end of the pipe connected to the child's standard output, -1 if not redirected
+	int get_output_descriptor() const;
 #endif
 
 private:
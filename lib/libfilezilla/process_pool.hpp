@@ -0,0 +1,113 @@
+#ifndef LIBFILEZILLA_PROCESS_POOL_HEADER
+#define LIBFILEZILLA_PROCESS_POOL_HEADER
+
+#include "libfilezilla.hpp"
+#include "time.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** \file
+ * \brief Declares \ref fz::process_pool "process_pool" to execute jobs using long-running helper processes
+ */
+
+namespace fz {
+
+class impersonation_token;
+
+/**
+ * \brief Executes jobs using a pool of worker processes, avoiding the startup cost of a process per job.
+ *
+ * Workers are started as \ref fz::process "processes" and communicate through their standard
+ * input and output. Each request written to a worker and each response read from it is
+ * prefixed by its length as 32 bit unsigned integer in network byte order. A worker handles
+ * one job at a time and has to send exactly one response for every request. Anything written
+ * to the standard error of a worker is discarded.
+ *
+ * The pool grows with the load: if all workers are busy, another one is started, up to
+ * \ref options::max_workers. Workers exceeding \ref options::min_workers get stopped once
+ * they have been idle for \ref options::idle_timeout, which is checked whenever a job
+ * starts or finishes.
+ *
+ * A worker that exits or sends a malformed response fails its current job and is replaced,
+ * as is any worker that has handled \ref options::max_jobs jobs. Idle workers that have
+ * exited or written unexpected output are replaced before they get a job.
+ *
+ * All member functions are thread-safe.
+ */
+class FZ_PUBLIC_SYMBOL process_pool final
+{
+public:
+	struct options final {
+		/// Path of the worker program followed by its arguments
+		std::vector<native_string> command;
+
+		/// Workers started right away and kept running even if idle
+		size_t min_workers{};
+
+		/// Upper bound for the number of workers, at least one
+		size_t max_workers{4};
+
+		/// Workers get replaced after this many jobs, 0 for no limit
+		size_t max_jobs{};
+
+		/// How long workers exceeding min_workers are kept while idle
+		duration idle_timeout{duration::from_seconds(30)};
+
+		/// Larger responses are treated as failure of the worker
+		size_t max_response_size{64 * 1024 * 1024};
+	};
+
+	struct stats final {
+		uint64_t jobs{};
+
+		/// Jobs that failed due to the worker
+		uint64_t failed{};
+
+		/// Number of workers started so far
+		uint64_t started{};
+
+		/// Workers replaced after reaching options::max_jobs
+		uint64_t recycled{};
+
+		/// Running workers, including busy ones
+		size_t workers{};
+		size_t idle{};
+	};
+
+	explicit process_pool(options const& opts);
+
+#if FZ_WINDOWS || FZ_UNIX
+	/// Workers run under the user represented by the impersonation token, use one pool per user.
+	process_pool(options const& opts, impersonation_token && token);
+#endif
+
+	/// Stops all workers. No jobs must be executing.
+	~process_pool();
+
+	process_pool(process_pool const&) = delete;
+	process_pool& operator=(process_pool const&) = delete;
+
+	/**
+	 * \brief Executes a job, blocking until its response has been received.
+	 *
+	 * If \ref options::max_workers workers are busy, waits until one becomes available.
+	 * There is no timeout, a worker that neither responds nor exits blocks the call.
+	 *
+	 * \return false if no worker could be started, or if the worker failed. Requests
+	 * exceeding 4 GiB always fail.
+	 */
+	bool execute(std::string_view const& request, std::string & response);
+
+	stats get_stats() const;
+
+private:
+	class impl;
+	std::unique_ptr<impl> impl_;
+};
+
+}
+
+#endif
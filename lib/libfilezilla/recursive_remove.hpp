@@ -14,6 +14,8 @@
 
 namespace fz {
 
+class thread_pool;
+
 /** \brief Recursively deletes directories.
  *
  * Behavior varies by platform. On Windows, SHFileOperation is used if shell32.dll is loadable.
@@ -35,6 +37,22 @@ public:
 	/// \brief Removes given directories
 	bool remove(std::list<native_string> dirsToVisit);
 
+	/** \brief Removes given directory, deleting independent subtrees concurrently.
+	 *
+	 * Directories are opened relative to the descriptor of their parent and entries are
+	 * removed relative to the descriptor of their directory, no paths get assembled.
+	 * Symbolic links are removed, never followed, not even if \c path itself is one.
+	 *
+	 * Up to \c threads directories, or chunks of large directories, are processed at the
+	 * same time, using threads from the passed pool. Calls \ref confirm once before starting
+	 * and \ref progress periodically.
+	 *
+	 * On Windows, this is the same as calling \ref remove(native_string const&).
+	 *
+	 * \return false if anything could not be removed or if \ref progress returned false.
+	 */
+	bool remove(native_string const& path, thread_pool & pool, size_t threads = 4);
+
 protected:
 	/// \brief Can be overridden to ask the user for a confirmation.
 	///
@@ -42,6 +60,12 @@ protected:
 	/// See \ref adjust_shfileop
 	virtual bool confirm() const { return true; }
 
+	/// \brief Called by the concurrent \ref remove with the number of files and directories removed so far.
+	///
+	/// Calls are serialized, but happen on different threads. Called once more when done.
+	/// Return false to stop removing.
+	virtual bool progress(uint64_t /*files*/, uint64_t /*dirs*/) { return true; }
+
 #ifdef FZ_WINDOWS
 	/// \brief Windows only: Allows customization of the SHFILEOPSTRUCT passed to SHFileOperation.
 	///
@@ -0,0 +1,134 @@
+#ifndef LIBFILEZILLA_SPLICE_PUMP_HEADER
+#define LIBFILEZILLA_SPLICE_PUMP_HEADER
+
+/** \file
+ * \brief Declares \ref fz::splice_pump "splice_pump" to move data between processes, sockets and files
+ */
+
+#include "event.hpp"
+#include "rate_limiter.hpp"
+
+#include <memory>
+
+#ifndef FZ_WINDOWS
+
+namespace fz {
+
+class event_handler;
+class file;
+class process;
+class socket;
+class thread_pool;
+
+/** \brief The type of a \ref pump_event
+ *
+ * In received events, exactly a single bit is always set.
+ */
+enum class pump_event_flag
+{
+	/// The sink does not accept data as fast as the source provides it, reading has paused
+	stalled = 0x1,
+
+	/// Data is moving again after the pump has stalled
+	resumed = 0x2,
+
+	/// All data up to the end of the source has been written to the sink
+	finished = 0x4,
+
+	/// Reading or writing has failed, the pump has stopped
+	failed = 0x8
+};
+
+/// \private
+struct pump_event_type;
+
+class splice_pump;
+
+/**
+ * \brief Sent by \ref splice_pump.
+ *
+ * Finished and failed are sent at most once, after either no more events are sent.
+ */
+typedef simple_event<pump_event_type, splice_pump*, pump_event_flag> pump_event;
+
+/**
+ * \brief Moves data from a source to a sink in the background.
+ *
+ * On Linux, data is moved using splice(), without copying it to and from user memory.
+ * If neither end is a pipe, data passes through an internal pipe. Elsewhere, data is
+ * read into and written from a buffer.
+ *
+ * Moving starts right away and ends once the end of the source has been reached. The
+ * sink is not closed, e.g. shut down a socket afterwards if needed.
+ *
+ * While the pump exists, the ends must not be used for any other reads or writes, and
+ * their read and write events are to be ignored. The descriptors are non-blocking while
+ * pumping, their previous mode is restored by the destructor.
+ *
+ * Each pump uses a thread obtained from the passed \ref thread_pool.
+ *
+ * Creating a pump calls \ref disable_sigpipe, if the peer of the sink has gone away
+ * the pump fails instead of the process getting terminated by SIGPIPE.
+ */
+class FZ_PUBLIC_SYMBOL splice_pump final
+{
+public:
+	/// An end of a pump
+	class FZ_PUBLIC_SYMBOL endpoint final
+	{
+	public:
+		/**
+		 * \brief Reads the child's standard output as source, writes its standard input as sink.
+		 *
+		 * The process must have been spawned with \ref process::io_redirection::redirect
+		 * or \ref process::io_redirection::redirect_discard_stderr
+		 */
+		endpoint(process & p);
+
+		endpoint(socket & s);
+
+		/// Reads or writes at the current position of the file, which gets advanced.
+		endpoint(file & f);
+
+	private:
+		friend class splice_pump;
+
+		int read_fd_{-1};
+		int write_fd_{-1};
+	};
+
+	struct options final {
+		/// Upper bound for the amount of data moved at once
+		size_t chunk_size{64 * 1024};
+
+		/// If set, the pump is a bucket of this limiter
+		rate_limiter * limiter{};
+
+		/// The direction whose tokens are consumed for the data moved
+		direction::type limit_direction{direction::outbound};
+	};
+
+	splice_pump(thread_pool & pool, event_handler & handler, endpoint const& source, endpoint const& sink);
+	splice_pump(thread_pool & pool, event_handler & handler, endpoint const& source, endpoint const& sink, options const& opts);
+
+	/// Stops pumping, pending events are removed from the handler's event loop
+	~splice_pump();
+
+	splice_pump(splice_pump const&) = delete;
+	splice_pump& operator=(splice_pump const&) = delete;
+
+	/// Amount of data written to the sink so far
+	uint64_t transferred() const;
+
+private:
+	class impl;
+	std::unique_ptr<impl> impl_;
+};
+
+}
+
+#else
+#error splice_pump is not available on Windows
+#endif
+
+#endif
@@ -276,13 +276,24 @@ private:
 	accuracy a_{days};
 };
 
-/** \brief The \c duration class represents a time interval in milliseconds.
+/** \brief The \c duration class represents a time interval in microseconds.
  *
  * Constructing a non-empty duration is only possible using the static setters which
  * have the time unit as part of the function name.
  *
  * In contract to \ref datetime, \c duration does not track accuracy.
- * 
+ *
+ * The microsecond resolution allows expressing pacing intervals below a millisecond.
+ * Interfaces taking a duration that are based on milliseconds, such as timers, round
+ * towards zero.
+ *
+ * \warning Up to libfilezilla 0.37, duration stored milliseconds. The change is an ABI
+ * break: the getters and setters are inline, so code compiled against older headers
+ * disagrees by a factor of 1000 with the library about every duration passed in or
+ * out, e.g. to \ref sleep, \ref condition::wait or timers. Such code needs to be
+ * recompiled. The representable range shrinks accordingly to about 292000 years,
+ * sentinels such as \c from_milliseconds(std::numeric_limits<int64_t>::max()) overflow.
+ *
  * \note Arithmetic operations on duration do not check for integer over/underflow
  */
 class FZ_PUBLIC_SYMBOL duration final
@@ -294,68 +305,72 @@ public:
 	 * All getters return the total time of the duration, rounded down to the requested granularity.
 	 * \{
 	 */
-	int64_t get_days() const { return ms_ / 1000 / 3600 / 24; }
-	int64_t get_hours() const { return ms_ / 1000 / 3600; }
-	int64_t get_minutes() const { return ms_ / 1000 / 60; }
-	int64_t get_seconds() const { return ms_ / 1000; }
-	int64_t get_milliseconds() const { return ms_; }
+	int64_t get_days() const { return us_ / 1000 / 1000 / 3600 / 24; }
+	int64_t get_hours() const { return us_ / 1000 / 1000 / 3600; }
+	int64_t get_minutes() const { return us_ / 1000 / 1000 / 60; }
+	int64_t get_seconds() const { return us_ / 1000 / 1000; }
+	int64_t get_milliseconds() const { return us_ / 1000; }
+	int64_t get_microseconds() const { return us_; }
 	/// \}
 
 	static duration from_days(int64_t m) {
-		return duration(m * 1000 * 60 * 60 * 24);
+		return duration(m * 1000 * 1000 * 60 * 60 * 24);
 	}
 	static duration from_hours(int64_t m) {
-		return duration(m * 1000 * 60 * 60);
+		return duration(m * 1000 * 1000 * 60 * 60);
 	}
 	static duration from_minutes(int64_t m) {
-		return duration(m * 1000 * 60);
+		return duration(m * 1000 * 1000 * 60);
 	}
 	static duration from_seconds(int64_t m) {
-		return duration(m * 1000);
+		return duration(m * 1000 * 1000);
 	}
 	static duration from_milliseconds(int64_t m) {
+		return duration(m * 1000);
+	}
+	static duration from_microseconds(int64_t m) {
 		return duration(m);
 	}
 	/// \}
 
 	duration& operator+=(duration const& op) {
-		ms_ += op.ms_;
+		us_ += op.us_;
 		return *this;
 	}
 
 	duration& operator-=(duration const& op) {
-		ms_ -= op.ms_;
+		us_ -= op.us_;
 		return *this;
 	}
 
 	duration operator-() const {
-		return duration(-ms_);
+		return duration(-us_);
 	}
 
 	explicit operator bool() const {
-		return ms_ != 0;
+		return us_ != 0;
 	}
 
 	duration& operator*=(int64_t op) {
-		ms_ *= op;
+		us_ *= op;
 		return *this;
 	}
 
 	duration absolute() const {
-		return (ms_ < 0) ? duration(-ms_) : *this;
+		return (us_ < 0) ? duration(-us_) : *this;
 	}
 
-	bool operator<(duration const& op) const { return ms_ < op.ms_; }
-	bool operator<=(duration const& op) const { return ms_ <= op.ms_; }
-	bool operator>(duration const& op) const { return ms_ > op.ms_; }
-	bool operator>=(duration const& op) const { return ms_ >= op.ms_; }
+	bool operator<(duration const& op) const { return us_ < op.us_; }
+	bool operator<=(duration const& op) const { return us_ <= op.us_; }
+	bool operator>(duration const& op) const { return us_ > op.us_; }
+	bool operator>=(duration const& op) const { return us_ >= op.us_; }
 
 	friend duration FZ_PUBLIC_SYMBOL operator-(duration const& a, duration const& b);
 	friend duration FZ_PUBLIC_SYMBOL operator+(duration const& a, duration const& b);
 private:
-	explicit FZ_PRIVATE_SYMBOL duration(int64_t ms) : ms_(ms) {}
+	explicit FZ_PRIVATE_SYMBOL duration(int64_t us) : us_(us) {}
 
-	int64_t ms_{};
+	int64_t us_{};
 };
 
 inline duration operator-(duration const& a, duration const& b)
@@ -376,6 +391,105 @@ inline duration operator+(duration const& a, duration const& b)
  */
 duration FZ_PUBLIC_SYMBOL operator-(datetime const& a, datetime const& b);
 
+/**
+ * \brief Fast formatting of timestamps in common fixed formats.
+ *
+ * Unlike \ref datetime::format, formatting does not go through the C library. The
+ * calendar date is calculated directly from the timestamp and the broken-down time
+ * is cached per second, so formatting many timestamps of the same second, as
+ * is typical for logging, only writes a few digits.
+ *
+ * For local time, the offset to UTC is obtained from the C library and cached
+ * together with the time range it is valid for. The range is determined by
+ * probing a week into either direction, assuming that timezone transitions
+ * take place on quarter-hours and at most once a week. Changes to the system's
+ * timezone are picked up only once a timestamp outside that range is formatted.
+ *
+ * As with \ref datetime::get_tm, timestamps having only day accuracy are never
+ * converted to local time.
+ *
+ * Each instance keeps its own cache, instances are not thread-safe.
+ */
+class FZ_PUBLIC_SYMBOL timestamp_formatter final
+{
+public:
+	/// Size of an output buffer that is always sufficient
+	static constexpr size_t max_size = 40;
+
+	/** \brief Formats the timestamp as per ISO 8601 and RFC 3339.
+	 *
+	 * Writes at most \ref max_size characters to out, which do not get null-terminated.
+	 *
+	 * \return number of characters written, 0 if the timestamp is empty
+	 *
+	 * \par Examples:
+	 * \li 2020-01-31T08:49:37.512Z
+	 * \li 2020-01-31T09:49:37+01:00
+	 */
+	size_t iso8601(char* out, datetime const& t, datetime::zone z, bool milliseconds = true);
+
+	/** \brief Formats the timestamp in the format specified in RFC 822, updated by RFC 1123.
+	 *
+	 * Always uses UTC, same output as \ref datetime::get_rfc822
+	 *
+	 * \par Example:
+	 * \li Sun, 06 Nov 1994 08:49:37 GMT
+	 */
+	size_t rfc822(char* out, datetime const& t);
+
+	/** \brief Formats the timestamp like ls does in directory listings.
+	 *
+	 * Timestamps within the six months before now contain the time of day,
+	 * others the year.
+	 *
+	 * \par Examples:
+	 * \li Nov  6 08:49
+	 * \li Nov  6  1994
+	 */
+	size_t listing(char* out, datetime const& t, datetime::zone z, datetime const& now);
+
+	/// \name Convenience overloads returning strings
+	/// \{
+	std::string iso8601(datetime const& t, datetime::zone z, bool milliseconds = true) {
+		char buf[max_size];
+		return std::string(buf, iso8601(buf, t, z, milliseconds));
+	}
+
+	std::string rfc822(datetime const& t) {
+		char buf[max_size];
+		return std::string(buf, rfc822(buf, t));
+	}
+
+	std::string listing(datetime const& t, datetime::zone z, datetime const& now) {
+		char buf[max_size];
+		return std::string(buf, listing(buf, t, z, now));
+	}
+	/// \}
+
+private:
+	struct broken_down final {
+		int64_t seconds{std::numeric_limits<int64_t>::min()};
+		int64_t year{};
+		int month{};
+		int day{};
+		int weekday{};
+		int hour{};
+		int minute{};
+		int second{};
+		int offset{};
+	};
+
+	broken_down const& get(datetime const& t, datetime::zone z, int & milliseconds);
+	int FZ_PRIVATE_SYMBOL local_offset(int64_t seconds);
+
+	broken_down cache_[2];
+
+	// Range in which offset_ is valid
+	int64_t offset_from_{};
+	int64_t offset_to_{};
+	int offset_{};
+};
+
 
 
 
@@ -385,6 +499,10 @@ duration FZ_PUBLIC_SYMBOL operator-(datetime const& a, datetime const& b);
  * the monotonic clock ticks steadily forward at always the same pace.
  *
  * \c monotonic_clock is a convenience wrapper around std::chrono::steady_clock.
+ *
+ * In addition to the standard clock, cheaper but less precise sources for the
+ * current time can be selected through \ref now(source). Points in time obtained
+ * from different sources can be compared with each other.
  */
 class FZ_PUBLIC_SYMBOL monotonic_clock final
 {
@@ -415,19 +533,55 @@ public:
 		return monotonic_clock(clock_type::now());
 	}
 
+	/// \brief Sources for the current time, see \ref now(source)
+	enum class source {
+		/// Same as \ref now()
+		standard,
+
+		/**
+		 * Only advances once per scheduler tick, but is considerably cheaper to
+		 * read. Usually lags behind the standard clock by less than its \ref resolution,
+		 * on tickless systems possibly by more after the CPU has been idle. It is never
+		 * ahead of the standard clock. Suitable for timer bookkeeping.
+		 *
+		 * Uses CLOCK_MONOTONIC_COARSE, not available on all platforms.
+		 */
+		coarse,
+
+		/**
+		 * Reads the processor's invariant timestamp counter, calibrated against the
+		 * standard clock on first use, which takes about 10 milliseconds.
+		 *
+		 * Cheap to read with high resolution, suitable for measuring short intervals.
+		 * Over long periods it may drift slightly from the standard clock.
+		 *
+		 * Only available on x86 CPUs advertising an invariant TSC.
+		 */
+		tsc
+	};
+
+	/// Gets the current point in time from the given source, falls back to the standard clock if the source is not available.
+	static monotonic_clock now(source s);
+
+	/// Whether the source is available on this system
+	static bool available(source s);
+
+	/// The granularity in which the clock source advances
+	static duration resolution(source s);
+
 	explicit operator bool() const {
 		return t_ != clock_type::time_point();
 	}
 
 	monotonic_clock& operator+=(duration const& d)
 	{
-		t_ += std::chrono::milliseconds(d.get_milliseconds());
+		t_ += std::chrono::microseconds(d.get_microseconds());
 		return *this;
 	}
 
 	monotonic_clock& operator-=(duration const& d)
 	{
-		t_ -= std::chrono::milliseconds(d.get_milliseconds());
+		t_ -= std::chrono::microseconds(d.get_microseconds());
 		return *this;
 	}
 
@@ -452,7 +606,7 @@ private:
  */
 inline duration operator-(monotonic_clock const& a, monotonic_clock const& b)
 {
-	return duration::from_milliseconds(std::chrono::duration_cast<std::chrono::milliseconds>(a.t_ - b.t_).count());
+	return duration::from_microseconds(std::chrono::duration_cast<std::chrono::microseconds>(a.t_ - b.t_).count());
 }
 
 /// \relates monotonic_clock
@@ -15,6 +15,16 @@
 #include <unistd.h>
 #include <string.h>
 #include <utime.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if defined(__linux__) && defined(STATX_TYPE) && defined(SYS_getdents64)
+#define FZ_USE_GETDENTS 1
 #endif
 
 namespace fz {
@@ -827,6 +837,144 @@ bool local_filesys::get_next_file(native_string& name, bool &is_link, local_file
 #endif
 }
 
+#if FZ_USE_GETDENTS
+namespace {
+struct linux_dirent64
+{
+	ino64_t d_ino;
+	off64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+void set_unknown(local_filesys::entry & e, unsigned char d_type)
+{
+	e.t = (d_type == DT_DIR) ? local_filesys::dir : local_filesys::file;
+	e.is_link = false;
+	e.size = -1;
+	e.modification_time = datetime();
+	e.mode = 0;
+}
+
+void set_metadata(local_filesys::entry & e, struct statx const& buf)
+{
+	e.modification_time = datetime(static_cast<time_t>(buf.stx_mtime.tv_sec), datetime::seconds);
+	e.mode = buf.stx_mode & 0777;
+	e.size = (e.t == local_filesys::file) ? static_cast<int64_t>(buf.stx_size) : -1;
+}
+
+// Same semantics as get_file_info_impl, but only queries the required fields
+// and avoids querying at all if the type is all that is needed and known.
+void get_entry_info(int fd, char const* name, unsigned char d_type, bool metadata, bool follow, local_filesys::entry & e)
+{
+	unsigned int const mask = metadata ? (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME) : STATX_TYPE;
+
+	struct statx buf;
+	bool have_buf{};
+	if (metadata || d_type == DT_UNKNOWN) {
+		if (statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &buf) != 0) {
+			set_unknown(e, d_type);
+			return;
+		}
+		have_buf = true;
+		e.is_link = S_ISLNK(buf.stx_mode);
+	}
+	else {
+		e.is_link = d_type == DT_LNK;
+	}
+
+	if (e.is_link) {
+		if (!follow) {
+			e.t = local_filesys::link;
+			if (have_buf) {
+				set_metadata(e, buf);
+			}
+			return;
+		}
+		if (statx(fd, name, AT_NO_AUTOMOUNT, mask, &buf) != 0) {
+			set_unknown(e, d_type);
+			return;
+		}
+		have_buf = true;
+	}
+
+	if (have_buf) {
+		e.t = S_ISDIR(buf.stx_mode) ? local_filesys::dir : local_filesys::file;
+		if (metadata) {
+			set_metadata(e, buf);
+		}
+	}
+	else {
+		e.t = (d_type == DT_DIR) ? local_filesys::dir : local_filesys::file;
+	}
+}
+}
+#endif
+
+bool local_filesys::get_next_files(entries& out, bool metadata)
+{
+	out.clear();
+
+#if FZ_USE_GETDENTS
+	if (!dir_) {
+		return false;
+	}
+
+	if (buffer_.size() < 256 * 1024) {
+		buffer_.resize(256 * 1024);
+	}
+
+	int const fd = dirfd(dir_);
+	while (out.empty()) {
+		long const res = syscall(SYS_getdents64, fd, buffer_.data(), buffer_.size());
+		if (res <= 0) {
+			break;
+		}
+
+		for (long pos = 0; pos < res;) {
+			auto const& d = *reinterpret_cast<linux_dirent64 const*>(buffer_.data() + pos);
+			pos += d.d_reclen;
+
+			char const* name = d.d_name;
+			if (!name[0] || (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))) {
+				continue;
+			}
+			if (dirs_only_ && d.d_type != DT_DIR && d.d_type != DT_LNK && d.d_type != DT_UNKNOWN) {
+				continue;
+			}
+
+			entry e;
+			get_entry_info(fd, name, d.d_type, metadata, query_symlink_targets_, e);
+			if (dirs_only_ && e.t != dir) {
+				continue;
+			}
+			out.add(name, e);
+		}
+	}
+#else
+	native_string name;
+	entry e;
+	while (out.size() < 1024) {
+		bool const res = metadata ?
+			get_next_file(name, e.is_link, e.t, &e.size, &e.modification_time, &e.mode) :
+			get_next_file(name, e.is_link, e.t, nullptr, nullptr, nullptr);
+		if (!res) {
+			break;
+		}
+		out.add(name, e);
+#ifdef FZ_WINDOWS
+		if (!cur_) {
+			// End of the results of the current directory query
+			break;
+		}
+#endif
+	}
+#endif
+
+	return !out.empty();
+}
+
 datetime local_filesys::get_modification_time(native_string const& path)
 {
 	datetime mtime;
@@ -1118,54 +1266,220 @@ result remove_dir(native_string const& absolute_path)
 	return {result::ok};
 }
 
-#ifndef FZ_WINDOWS
+#ifdef FZ_WINDOWS
 namespace {
-static result do_copy(native_string const& source, native_string const& dest, bool & dest_opened)
+DWORD CALLBACK copy_progress_routine(LARGE_INTEGER total, LARGE_INTEGER copied, LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID data)
 {
-	fz::file in(source, fz::file::reading, fz::file::existing);
+	auto const& progress = *static_cast<copy_progress const*>(data);
+	return progress(copied.QuadPart, total.QuadPart) ? PROGRESS_CONTINUE : PROGRESS_CANCEL;
+}
+}
 
-	if (!in.opened()) {
-		// TODO error codes
-		return {result::other};
+result copy_file(native_string const& source, native_string const& dest, copy_progress const& progress)
+{
+	BOOL const res = CopyFileExW(source.c_str(), dest.c_str(), progress ? copy_progress_routine : nullptr, progress ? const_cast<copy_progress*>(&progress) : nullptr, nullptr, 0);
+	if (res) {
+		return {result::ok};
 	}
 
-	fz::file out(dest, fz::file::writing, fz::file::empty);
-	if (!out.opened()) {
-		// TODO error codes
-		return {result::other};
+	DWORD const err = GetLastError();
+	switch (err) {
+		case ERROR_FILE_NOT_FOUND:
+			return {result::nofile, err};
+		case ERROR_PATH_NOT_FOUND:
+			return {result::nodir, err};
+		case ERROR_ACCESS_DENIED:
+			return {result::noperm, err};
+		case ERROR_DISK_FULL:
+			return {result::nospace, err};
+		default:
+			return {result::other, err};
+	}
+}
+#else
+namespace {
+result copy_error(int err)
+{
+	switch (err) {
+	case ENOSPC:
+	case EDQUOT:
+		return {result::nospace, err};
+	case EACCES:
+	case EPERM:
+		return {result::noperm, err};
+	default:
+		return {result::other, err};
 	}
+}
 
-	dest_opened = true;
+#ifdef __linux__
+// The error codes with which the kernel rejects a copy method for the given files
+bool unsupported(int err)
+{
+	return err == EXDEV || err == ENOSYS || err == EINVAL || err == EOPNOTSUPP || err == ENOTSUP || err == ENOTTY || err == EBADF;
+}
 
-	fz::buffer buffer;
-	while (true) {
-		if (buffer.empty()) {
-			auto read = in.read(buffer.get(64 * 1024), 64 * 1024);
-			if (read < 0) {
-				return {result::other};
-			}
-			else if (read) {
-				buffer.add(read);
+// Copies using in-kernel methods. Returns true if the method got used, with the outcome in res.
+bool copy_in_kernel(int in, int out, int64_t size, int64_t & copied, copy_progress const& progress, result & res)
+{
+#ifdef FICLONE
+	// Reflink, the copy shares the data blocks
+	if (!ioctl(out, FICLONE, in)) {
+		copied = size;
+		if (progress && !progress(copied, size)) {
+			res = {result::other};
+		}
+		else {
+			res = {result::ok};
+		}
+		return true;
+	}
+#endif
+
+	// Copy in steps so that progress can be reported
+	size_t const chunk = 8 * 1024 * 1024;
+	for (int method = 0; method < 2; ++method) {
+#ifndef __NR_copy_file_range
+		if (!method) {
+			continue;
+		}
+#endif
+		while (true) {
+			ssize_t r;
+			if (!method) {
+#ifdef __NR_copy_file_range
+				// Not using the wrapper, some glibc versions emulate it in userspace
+				r = syscall(__NR_copy_file_range, in, nullptr, out, nullptr, chunk, 0);
+#endif
 			}
 			else {
-				if (buffer.empty()) {
-					return {result::ok};
+				r = sendfile(out, in, nullptr, chunk);
+			}
+
+			if (r < 0) {
+				int const err = errno;
+				if (err == EINTR || err == EAGAIN) {
+					continue;
 				}
+				if (unsupported(err)) {
+					// Both methods advance the file positions, the next method
+					// continues where this one stopped.
+					break;
+				}
+				res = copy_error(err);
+				return true;
+			}
+			if (!r) {
+				if (copied < size) {
+					// Some special filesystems claim support, but do not copy anything
+					break;
+				}
+				res = {result::ok};
+				return true;
+			}
+
+			copied += r;
+			if (progress && !progress(copied, size)) {
+				res = {result::other};
+				return true;
 			}
 		}
-		auto written = out.write(buffer.get(), buffer.size());
-		if (written <= 0) {
-			return {result::other};
-		}
+	}
+
+	return false;
+}
+#endif
+
+result do_copy(native_string const& source, native_string const& dest, copy_progress const& progress, bool sync, bool & dest_opened)
+{
+	fz::file in;
+	result res = in.open(source, fz::file::reading, fz::file::existing);
+	if (!res) {
+		return res;
+	}
 
-		buffer.consume(written);
+	// Not truncating yet, the destination could be the source itself
+	fz::file out;
+	res = out.open(dest, fz::file::writing, fz::file::existing);
+	if (!res) {
+		return res;
+	}
+
+	struct stat in_st, out_st;
+	if (fstat(in.fd(), &in_st) || fstat(out.fd(), &out_st)) {
+		return copy_error(errno);
 	}
-	if (!out.fsync()) {
-		return {result::other};
+	if (in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+		return {result::other, EINVAL};
+	}
+
+	dest_opened = true;
+	if (!out.truncate()) {
+		return copy_error(errno);
+	}
+
+	int64_t const size = in.size();
+	int64_t copied{};
+
+	bool done{};
+#ifdef __linux__
+	done = copy_in_kernel(in.fd(), out.fd(), size, copied, progress, res);
+#endif
+
+	if (!done) {
+		size_t const chunk = 256 * 1024;
+
+		fz::buffer buffer;
+		while (true) {
+			if (buffer.empty()) {
+				auto read = in.read(buffer.get(chunk), chunk);
+				if (read < 0) {
+					return copy_error(errno);
+				}
+				else if (read) {
+					buffer.add(read);
+				}
+				else {
+					break;
+				}
+			}
+			auto written = out.write(buffer.get(), buffer.size());
+			if (written <= 0) {
+				return written < 0 ? copy_error(errno) : result{result::other};
+			}
+
+			buffer.consume(written);
+			copied += written;
+			if (progress && !progress(copied, size)) {
+				return {result::other};
+			}
+		}
+	}
+	else if (!res) {
+		return res;
+	}
+
+	if (sync && !out.fsync()) {
+		return copy_error(errno);
 	}
 
 	return {result::ok};
 }
+
+result copy_file(native_string const& source, native_string const& dest, copy_progress const& progress, bool sync)
+{
+	bool dest_opened{};
+	auto ret = do_copy(source, dest, progress, sync, dest_opened);
+	if (!ret && dest_opened) {
+		unlink(dest.c_str());
+	}
+	return ret;
+}
+}
+
+result copy_file(native_string const& source, native_string const& dest, copy_progress const& progress)
+{
+	return copy_file(source, dest, progress, false);
 }
 #endif
 
@@ -1221,12 +1535,9 @@ result rename_file(native_string const& source, native_string const& dest, bool
 		return {result::other, err};
 	}
 
-	bool dest_opened{};
-	auto ret = do_copy(source, dest, dest_opened);
+	// Make sure the copy is on disk before removing the original
+	auto ret = copy_file(source, dest, copy_progress(), true);
 	if (!ret) {
-		if (dest_opened) {
-			unlink(dest.c_str());
-		}
 		return ret;
 	}
 
@@ -1271,6 +1582,7 @@ local_filesys::local_filesys(local_filesys && op)
 #else
 	dir_ = op.dir_;
 	op.dir_ = nullptr;
+	buffer_ = std::move(op.buffer_);
 #endif
 	dirs_only_ = op.dirs_only_;
 	query_symlink_targets_ = op.query_symlink_targets_;
@@ -1299,6 +1611,7 @@ local_filesys& local_filesys::operator=(local_filesys && op)
 #else
 		dir_ = op.dir_;
 		op.dir_ = nullptr;
+		buffer_ = std::move(op.buffer_);
 #endif
 		dirs_only_ = op.dirs_only_;
 		query_symlink_targets_ = op.query_symlink_targets_;
@@ -0,0 +1,334 @@
+#include "libfilezilla/mapped_file.hpp"
+
+#include <algorithm>
+
+#ifndef FZ_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fz {
+
+namespace {
+size_t granularity()
+{
+	static size_t const value = []() -> size_t {
+#ifdef FZ_WINDOWS
+		SYSTEM_INFO info{};
+		GetSystemInfo(&info);
+		return info.dwAllocationGranularity;
+#else
+		long const page = sysconf(_SC_PAGESIZE);
+		return page > 0 ? static_cast<size_t>(page) : 4096;
+#endif
+	}();
+	return value;
+}
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+mapped_file::mapped_file(mapped_file && op) noexcept
+{
+	*this = std::move(op);
+}
+
+mapped_file& mapped_file::operator=(mapped_file && op) noexcept
+{
+	if (this != &op) {
+		close();
+		std::swap(fd_, op.fd_);
+#ifdef FZ_WINDOWS
+		std::swap(mapping_, op.mapping_);
+#endif
+		size_ = op.size_;
+		window_size_ = op.window_size_;
+		std::swap(data_, op.data_);
+		std::swap(mapped_size_, op.mapped_size_);
+		mapped_offset_ = op.mapped_offset_;
+		pattern_ = op.pattern_;
+		hugepage_ = op.hugepage_;
+	}
+	return *this;
+}
+
+result mapped_file::open(native_string const& path, size_t window_size)
+{
+	close();
+
+	if (path.empty()) {
+		return {result::invalid};
+	}
+
+#ifdef FZ_WINDOWS
+	fd_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fd_ == INVALID_HANDLE_VALUE) {
+		auto const err = GetLastError();
+		close();
+		switch (err) {
+		case ERROR_ACCESS_DENIED:
+			return {result::noperm, err};
+		case ERROR_FILE_NOT_FOUND:
+		case ERROR_PATH_NOT_FOUND:
+			return {result::nofile, err};
+		default:
+			return {result::other, err};
+		}
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(fd_, &size)) {
+		auto const err = GetLastError();
+		close();
+		return {result::other, err};
+	}
+	size_ = static_cast<int64_t>(size.QuadPart);
+
+	// Mapping empty files fails
+	if (size_) {
+		mapping_ = CreateFileMappingW(fd_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping_) {
+			auto const err = GetLastError();
+			close();
+			return {result::other, err};
+		}
+	}
+#else
+	fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd_ == -1) {
+		int const err = errno;
+		close();
+		switch (err) {
+		case EACCES:
+		case EPERM:
+			return {result::noperm, err};
+		case ENOENT:
+		case ENOTDIR:
+			return {result::nofile, err};
+		default:
+			return {result::other, err};
+		}
+	}
+
+	struct stat buf;
+	if (fstat(fd_, &buf) != 0) {
+		int const err = errno;
+		close();
+		return {result::other, err};
+	}
+	if (!S_ISREG(buf.st_mode)) {
+		close();
+		return {result::nofile};
+	}
+	size_ = buf.st_size;
+#endif
+
+	if (!window_size) {
+		if (sizeof(void*) < 8) {
+			window_size = 256 * 1024 * 1024;
+		}
+		else {
+			window_size = static_cast<size_t>(size_);
+		}
+	}
+	size_t const g = granularity();
+	window_size_ = std::max(g, (window_size + g - 1) / g * g);
+
+	if (size_ && !map(0)) {
+#ifdef FZ_WINDOWS
+		auto const err = GetLastError();
+#else
+		int const err = errno;
+#endif
+		close();
+		return {result::other, err};
+	}
+
+	return {result::ok};
+}
+
+void mapped_file::close()
+{
+	unmap();
+#ifdef FZ_WINDOWS
+	if (mapping_) {
+		CloseHandle(mapping_);
+		mapping_ = nullptr;
+	}
+	if (fd_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(fd_);
+		fd_ = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (fd_ != -1) {
+		::close(fd_);
+		fd_ = -1;
+	}
+#endif
+	size_ = 0;
+	window_size_ = 0;
+	pattern_ = advice::normal;
+	hugepage_ = false;
+}
+
+bool mapped_file::opened() const
+{
+#ifdef FZ_WINDOWS
+	return fd_ != INVALID_HANDLE_VALUE;
+#else
+	return fd_ != -1;
+#endif
+}
+
+bool mapped_file::map(int64_t offset)
+{
+	unmap();
+
+	int64_t const start = offset - offset % static_cast<int64_t>(granularity());
+	size_t const len = static_cast<size_t>(std::min(static_cast<int64_t>(window_size_), size_ - start));
+
+#ifdef FZ_WINDOWS
+	void* p = MapViewOfFile(mapping_, FILE_MAP_READ, static_cast<DWORD>(static_cast<uint64_t>(start) >> 32), static_cast<DWORD>(start), len);
+	if (!p) {
+		return false;
+	}
+#else
+	void* p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd_, static_cast<off_t>(start));
+	if (p == MAP_FAILED) {
+		return false;
+	}
+#endif
+
+	data_ = static_cast<uint8_t*>(p);
+	mapped_size_ = len;
+	mapped_offset_ = start;
+
+	if (pattern_ != advice::normal) {
+		apply(pattern_);
+	}
+	if (hugepage_) {
+		apply(advice::hugepage);
+	}
+
+	return true;
+}
+
+void mapped_file::unmap()
+{
+	if (data_) {
+#ifdef FZ_WINDOWS
+		UnmapViewOfFile(data_);
+#else
+		munmap(data_, mapped_size_);
+#endif
+		data_ = nullptr;
+	}
+	mapped_size_ = 0;
+	mapped_offset_ = 0;
+}
+
+std::basic_string_view<uint8_t> mapped_file::view(int64_t offset, size_t length)
+{
+	if (!opened() || offset < 0 || offset >= size_) {
+		return {};
+	}
+
+	length = static_cast<size_t>(std::min(static_cast<int64_t>(length), size_ - offset));
+
+	// Move the window if the range isn't mapped, unless the range merely exceeds
+	// the window and moving it would not map any more of it.
+	int64_t const end = offset + static_cast<int64_t>(length);
+	int64_t const window_end = mapped_offset_ + static_cast<int64_t>(mapped_size_);
+	if (!data_ || offset < mapped_offset_ || offset >= window_end ||
+		(end > window_end && offset - offset % static_cast<int64_t>(granularity()) != mapped_offset_))
+	{
+		if (!map(offset)) {
+			return {};
+		}
+	}
+
+	size_t const start = static_cast<size_t>(offset - mapped_offset_);
+	return {data_ + start, std::min(length, mapped_size_ - start)};
+}
+
+nonowning_buffer mapped_file::buffer(int64_t offset, size_t length)
+{
+	auto const v = view(offset, length);
+	return nonowning_buffer(const_cast<uint8_t*>(v.data()), v.size(), v.size());
+}
+
+bool mapped_file::advise(advice a)
+{
+	switch (a) {
+	case advice::normal:
+	case advice::sequential:
+	case advice::random:
+		pattern_ = a;
+		break;
+	case advice::hugepage:
+		hugepage_ = true;
+		break;
+	default:
+		break;
+	}
+
+	if (!data_) {
+		return opened();
+	}
+	return apply(a);
+}
+
+bool mapped_file::apply(advice a)
+{
+#ifdef FZ_WINDOWS
+	switch (a) {
+	case advice::normal:
+		return true;
+#if _WIN32_WINNT >= 0x0602
+	case advice::willneed: {
+		WIN32_MEMORY_RANGE_ENTRY range{data_, mapped_size_};
+		return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != 0;
+	}
+#endif
+	default:
+		return false;
+	}
+#else
+	int flag;
+	switch (a) {
+	case advice::normal:
+		flag = MADV_NORMAL;
+		break;
+	case advice::sequential:
+		flag = MADV_SEQUENTIAL;
+		break;
+	case advice::random:
+		flag = MADV_RANDOM;
+		break;
+	case advice::willneed:
+		flag = MADV_WILLNEED;
+		break;
+	case advice::dontneed:
+		flag = MADV_DONTNEED;
+		break;
+	case advice::hugepage:
+#ifdef MADV_HUGEPAGE
+		flag = MADV_HUGEPAGE;
+		break;
+#else
+		return false;
+#endif
+	default:
+		return false;
+	}
+	return madvise(data_, mapped_size_, flag) == 0;
+#endif
+}
+
+}
@@ -325,7 +325,8 @@ bool condition::wait(scoped_lock& l, duration const& timeout)
 		return true;
 	}
 #ifdef FZ_WINDOWS
-	auto ms = timeout.get_milliseconds();
+	// Round up, a timeout below a millisecond must not turn into a busy loop
+	auto ms = (timeout.get_microseconds() + 999) / 1000;
 	if (ms < 0) {
 		ms = 0;
 	}
@@ -344,9 +345,9 @@ bool condition::wait(scoped_lock& l, duration const& timeout)
 	ts.tv_nsec = tv.tv_usec * 1000;
 #endif
 
-	ts.tv_sec += timeout.get_milliseconds() / 1000;
-	ts.tv_nsec += (timeout.get_milliseconds() % 1000) * 1000 * 1000;
-	if (ts.tv_nsec > 1000000000ll) {
+	ts.tv_sec += timeout.get_seconds();
+	ts.tv_nsec += (timeout.get_microseconds() % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000ll) {
 		++ts.tv_sec;
 		ts.tv_nsec -= 1000000000ll;
 	}
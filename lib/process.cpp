@@ -83,6 +83,19 @@ public:
 		return valid();
 	}
 
+	// Only has the child's end, which writes to the null device
+	bool create_null()
+	{
+		reset();
+
+		SECURITY_ATTRIBUTES attr{};
+		attr.nLength = sizeof(SECURITY_ATTRIBUTES);
+		attr.bInheritHandle = true;
+		write_ = CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &attr, OPEN_EXISTING, 0, nullptr);
+
+		return write_ != INVALID_HANDLE_VALUE;
+	}
+
 	bool valid() const {
 		return read_ != INVALID_HANDLE_VALUE && write_ != INVALID_HANDLE_VALUE;
 	}
@@ -176,12 +189,12 @@ public:
 	impl(impl const&) = delete;
 	impl& operator=(impl const&) = delete;
 
-	bool create_pipes()
+	bool create_pipes(io_redirection redirect_mode)
 	{
 		return
 			in_.create(false, handler_ != nullptr) &&
 			out_.create(true, handler_ != nullptr) &&
-			err_.create(true, false);
+			(redirect_mode == io_redirection::redirect_discard_stderr ? err_.create_null() : err_.create(true, false));
 	}
 
 	void thread_entry()
@@ -260,7 +273,7 @@ public:
 
 		bool const inherit = redirect_mode != io_redirection::none;
 		if (inherit) {
-			if (!create_pipes()) {
+			if (!create_pipes(redirect_mode)) {
 				return false;
 			}
 		}
@@ -275,7 +288,7 @@ public:
 				return false;
 			}
 
-			if (redirect_mode == io_redirection::redirect) {
+			if (redirect_mode == io_redirection::redirect || redirect_mode == io_redirection::redirect_discard_stderr) {
 				DWORD res = ReadFile(out_.read_, read_buffer_.get(64 * 1024), 64 * 1024, nullptr, &ol_read_);
 				DWORD err = GetLastError();
 				if (!res && err != ERROR_IO_PENDING) {
@@ -594,9 +607,23 @@ private:
 #include <unistd.h>
 
 #include <atomic>
+#include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
+#if defined(__linux__) && __has_include(<sched.h>)
+#include <sched.h>
+#include <sys/syscall.h>
+#if defined(CLONE_VM) && defined(CLONE_VFORK)
+#define FZ_SPAWN_VFORK 1
+#include <sys/mman.h>
+#endif
+#if defined(SYS_pidfd_open)
+#define FZ_USE_PIDFD 1
+#endif
+#endif
+
 #if FZ_MAC
 #include "libfilezilla/local_filesys.hpp"
 
@@ -650,6 +677,16 @@ public:
 		return valid();
 	}
 
+	// Only has the child's end, which writes to the null device
+	bool create_null()
+	{
+		reset();
+
+		write_ = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+		return write_ != -1;
+	}
+
 	bool valid() const {
 		return read_ != -1 && write_ != -1;
 	}
@@ -676,94 +713,374 @@ void get_argv(native_string const& cmd, std::vector<native_string>::const_iterat
 
 std::atomic<unsigned int> forkblocks_{};
 mutex forkblock_mtx_;
+
+#if FZ_SPAWN_VFORK
+#ifdef SYS_setuid32
+#define FZ_SYS_SETGROUPS SYS_setgroups32
+#define FZ_SYS_SETGID SYS_setgid32
+#define FZ_SYS_SETUID SYS_setuid32
+#else
+#define FZ_SYS_SETGROUPS SYS_setgroups
+#define FZ_SYS_SETGID SYS_setgid
+#define FZ_SYS_SETUID SYS_setuid
+#endif
+
+// Everything the child needs is prepared by the parent, the child shares
+// the parent's memory and must not allocate.
+struct spawn_args final
+{
+	char const* cmd_{};
+	char* const* argv_{};
+
+	// -1 if not redirecting
+	int in_{-1};
+	int out_{-1};
+	int err_{-1};
+
+	int const* extra_fds_{};
+	size_t extra_fds_count_{};
+
+	bool impersonate_{};
+	uid_t uid_{};
+	gid_t gid_{};
+	gid_t const* sup_groups_{};
+	size_t sup_groups_count_{};
+
+	// Signal mask of the spawning thread
+	sigset_t mask_{};
+
+	// Set by the child if it could not execute the program
+	int error_{};
+};
+
+int spawn_child(void* p)
+{
+	auto & a = *static_cast<spawn_args*>(p);
+
+	// All signals are blocked. Handlers installed by the parent must not run
+	// in the child, it is operating on the parent's memory.
+	for (int sig = 1; sig < _NSIG; ++sig) {
+		struct sigaction sa{};
+		if (!sigaction(sig, nullptr, &sa) && sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL) {
+			sa = {};
+			sa.sa_handler = SIG_DFL;
+			sigaction(sig, &sa, nullptr);
+		}
+	}
+
+	// Redirect to pipe. The redirected descriptors don't have FD_CLOEXEC set,
+	// all others of the pipes do.
+	if (a.in_ != -1) {
+		if (dup2(a.in_, STDIN_FILENO) == -1 ||
+			dup2(a.out_, STDOUT_FILENO) == -1 ||
+			dup2(a.err_, STDERR_FILENO) == -1)
+		{
+			a.error_ = errno;
+			_exit(127);
+		}
+	}
+
+	// Clear FD_CLOEXEC on extra descriptors
+	for (size_t i = 0; i < a.extra_fds_count_; ++i) {
+		int const flags = fcntl(a.extra_fds_[i], F_GETFD);
+		if (flags == -1 || fcntl(a.extra_fds_[i], F_SETFD, flags & ~FD_CLOEXEC) != 0) {
+			a.error_ = errno;
+			_exit(127);
+		}
+	}
+
+	// The libc wrappers would try to change the credentials of all threads
+	// of the parent, whose memory the child shares. Use the raw system calls,
+	// which only affect the calling thread, i.e. the child.
+	if (a.impersonate_) {
+		if (syscall(FZ_SYS_SETGROUPS, a.sup_groups_count_, a.sup_groups_) != 0 ||
+			syscall(FZ_SYS_SETGID, a.gid_) != 0 ||
+			syscall(FZ_SYS_SETUID, a.uid_) != 0)
+		{
+			a.error_ = errno;
+			_exit(127);
+		}
+	}
+
+	sigprocmask(SIG_SETMASK, &a.mask_, nullptr);
+
+	execv(a.cmd_, a.argv_); // noreturn on success
+
+	a.error_ = errno;
+	_exit(127);
 }
 
-class process::impl
+// Unlike fork, does not copy the page tables of the parent, which takes a
+// long time for processes with a large resident set. The calling thread is
+// suspended until the child has called execv or exited.
+pid_t spawn_vfork(spawn_args & a)
+{
+	size_t const stack_size = 64 * 1024;
+	void* stack = mmap(nullptr, stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (stack == MAP_FAILED) {
+		return -1;
+	}
+
+	sigset_t all;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &a.mask_);
+
+	pid_t const pid = clone(spawn_child, static_cast<char*>(stack) + stack_size, CLONE_VM | CLONE_VFORK | SIGCHLD, &a);
+	int const err = errno;
+
+	pthread_sigmask(SIG_SETMASK, &a.mask_, nullptr);
+	munmap(stack, stack_size);
+
+	errno = err;
+	return pid;
+}
+#endif
+
+// The state of a process shared with the reactor, guarded by the reactor's mutex
+struct reactor_entry final
+{
+	process* process_{};
+	event_handler* handler_{};
+
+	int read_fd_{-1};
+	int write_fd_{-1};
+
+	// Becomes readable once the child has exited, -1 if not available
+	int pid_fd_{-1};
+	int pid_{-1};
+
+	bool waiting_read_{};
+	bool waiting_write_{};
+
+	// Set once the reactor has reaped the child
+	bool exited_{};
+};
+
+// Monitors the pipes of all processes with an event handler spawned using the
+// same thread pool, so that there is a single thread per pool instead of one
+// per process. Where pidfds are available, children get reaped as soon as they
+// exit instead of lingering as zombies until killed.
+class process_reactor final
 {
 public:
-	impl(process & p)
-		: process_(p)
-	{}
+	~process_reactor()
+	{
+		{
+			scoped_lock l(mtx_);
+			quit_ = true;
+			poller_.interrupt(l);
+		}
+		task_.join();
+	}
 
-	impl(process & p, thread_pool & pool, event_handler & handler)
-		: process_(p)
-		, pool_(&pool)
-		, handler_(&handler)
+	// Returns the reactor of the pool, starting it if needed
+	static std::shared_ptr<process_reactor> get(thread_pool & pool)
 	{
+		static mutex mtx{false};
+		static std::map<thread_pool*, std::weak_ptr<process_reactor>> reactors;
+
+		scoped_lock l(mtx);
+		auto ret = reactors[&pool].lock();
+		if (ret) {
+			return ret;
+		}
+
+		for (auto it = reactors.begin(); it != reactors.end(); ) {
+			if (it->second.expired()) {
+				it = reactors.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+
+		ret = std::make_shared<process_reactor>();
+		if (ret->poller_.init() != 0) {
+			return nullptr;
+		}
+		ret->task_ = pool.spawn([r = ret.get()]() { r->run(); });
+		if (!ret->task_) {
+			return nullptr;
+		}
+		reactors[&pool] = ret;
+		return ret;
 	}
 
-	~impl()
+	void add(reactor_entry & e)
 	{
-		kill();
+		scoped_lock l(mtx_);
+		entries_[&e] = ++next_id_;
+		poller_.interrupt(l);
 	}
 
-	impl(impl const&) = delete;
-	impl& operator=(impl const&) = delete;
+	// Once returned, the entry is no longer accessed and no further events get sent for it
+	void remove(reactor_entry & e)
+	{
+		scoped_lock l(mtx_);
+		entries_.erase(&e);
+	}
 
-	bool create_pipes()
+	void wait_read(reactor_entry & e)
 	{
-		return
-			in_.create() &&
-			out_.create() &&
-			err_.create();
+		scoped_lock l(mtx_);
+		e.waiting_read_ = true;
+		poller_.interrupt(l);
 	}
 
-	void thread_entry()
+	void wait_write(reactor_entry & e)
 	{
-		scoped_lock l(mutex_);
+		scoped_lock l(mtx_);
+		e.waiting_write_ = true;
+		poller_.interrupt(l);
+	}
+
+private:
+	enum class source_type {
+		read,
+		write,
+		exit
+	};
+
+	struct source final
+	{
+		reactor_entry* entry_;
+		uint64_t id_;
+		source_type type_;
+	};
+
+	void run()
+	{
+		std::vector<pollfd> fds;
+		std::vector<source> sources;
+
+		scoped_lock l(mtx_);
 		while (!quit_) {
-			if (waiting_read_ || waiting_write_) {
-				struct pollfd fds[3]{};
-				nfds_t n{};
-				if (waiting_read_) {
-					fds[n].fd = out_.read_;
-					fds[n++].events = POLLIN;
+			fds.clear();
+			sources.clear();
+			for (auto const& it : entries_) {
+				auto & e = *it.first;
+				auto const add = [&](int fd, short events, source_type t) {
+					if (fd != -1) {
+						fds.push_back(pollfd{fd, events, 0});
+						sources.push_back(source{&e, it.second, t});
+					}
+				};
+				if (e.waiting_read_) {
+					add(e.read_fd_, POLLIN, source_type::read);
 				}
-				if (waiting_write_) {
-					fds[n].fd = in_.write_;
-					fds[n++].events = POLLOUT;
+				if (e.waiting_write_) {
+					add(e.write_fd_, POLLOUT, source_type::write);
 				}
-				if (!poller_.wait(fds, n, l)) {
-					break;
+				if (!e.exited_) {
+					add(e.pid_fd_, POLLIN, source_type::exit);
 				}
+			}
 
-				if (quit_) {
-					break;
+			nfds_t const n = fds.size();
+			fds.emplace_back(); // For the poller's own descriptor
+			if (!poller_.wait(fds.data(), n, l)) {
+				break;
+			}
+
+			for (nfds_t i = 0; i < n; ++i) {
+				if (!fds[i].revents) {
+					continue;
 				}
 
-				for (size_t i = 0; i < n; ++i) {
-					if (fds[i].fd == out_.read_ && waiting_read_) {
-						if (fds[i].revents & (POLLIN|POLLHUP|POLLERR)) {
-							waiting_read_ = false;
+				// The lock was released while polling, the process may have been removed
+				auto const it = entries_.find(sources[i].entry_);
+				if (it == entries_.end() || it->second != sources[i].id_) {
+					continue;
+				}
+				auto & e = *it->first;
 
-							handler_->send_event<process_event>(&process_, process_event_flag::read);
-						}
+				switch (sources[i].type_) {
+				case source_type::read:
+					if (e.waiting_read_) {
+						e.waiting_read_ = false;
+						e.handler_->send_event<process_event>(e.process_, process_event_flag::read);
 					}
-					else if (fds[i].fd == in_.write_ && waiting_write_) {
-						if (fds[i].revents & (POLLOUT|POLLHUP|POLLERR)) {
-							waiting_write_ = false;
-
-							handler_->send_event<process_event>(&process_, process_event_flag::write);
+					break;
+				case source_type::write:
+					if (e.waiting_write_) {
+						e.waiting_write_ = false;
+						e.handler_->send_event<process_event>(e.process_, process_event_flag::write);
+					}
+					break;
+				case source_type::exit:
+					{
+						pid_t ret;
+						do {
+							ret = waitpid(e.pid_, nullptr, WNOHANG);
+						} while (ret == -1 && errno == EINTR);
+						if (ret) {
+							e.exited_ = true;
+						}
+						else {
+							// Cannot happen, but rather leave it to process::kill than spin
+							reset_fd(e.pid_fd_);
 						}
 					}
-				}
-			}
-			else {
-
-				if (!poller_.wait(l)) {
 					break;
 				}
 			}
 		}
 	}
 
+	mutex mtx_{false};
+	poller poller_;
+	async_task task_;
+	bool quit_{};
+
+	// Each addition gets a new id, a removed entry's memory may be reused by another process
+	std::unordered_map<reactor_entry*, uint64_t> entries_;
+	uint64_t next_id_{};
+};
+}
+
+#if FZ_SPAWN_VFORK && FZ_UNIX
+bool get_impersonation_ids(impersonation_token const& token, uid_t & uid, gid_t & gid, std::vector<gid_t> & sup_groups);
+#endif
+
+class process::impl
+{
+public:
+	impl(process & p)
+		: process_(p)
+	{}
+
+	impl(process & p, thread_pool & pool, event_handler & handler)
+		: process_(p)
+		, pool_(&pool)
+		, handler_(&handler)
+	{
+		entry_.process_ = &process_;
+		entry_.handler_ = handler_;
+	}
+
+	~impl()
+	{
+		kill();
+	}
+
+	impl(impl const&) = delete;
+	impl& operator=(impl const&) = delete;
+
+	bool create_pipes(io_redirection redirect_mode)
+	{
+		return
+			in_.create() &&
+			out_.create() &&
+			(redirect_mode == io_redirection::redirect_discard_stderr ? err_.create_null() : err_.create());
+	}
+
 	bool spawn(native_string const& cmd, std::vector<native_string>::const_iterator const& begin, std::vector<native_string>::const_iterator const& end, io_redirection redirect_mode, std::vector<int> const& extra_fds = std::vector<int>(), impersonation_token const* it = nullptr)
 	{
 		if (pid_ != -1) {
 			return false;
 		}
 
-		if (redirect_mode != io_redirection::none && !create_pipes()) {
+		if (redirect_mode != io_redirection::none && !create_pipes(redirect_mode)) {
 			kill();
 			return false;
 		}
@@ -771,21 +1088,53 @@ public:
 		std::vector<char*> argV;
 		get_argv(cmd, begin, end, argV);
 
-		scoped_lock l(mutex_);
 		if (handler_) {
-			if (poller_.init() != 0) {
+			reactor_ = process_reactor::get(*pool_);
+			if (!reactor_) {
 				kill();
 				return false;
 			}
-			task_ = pool_->spawn([this]() { thread_entry(); });
-			if (!task_) {
+		}
+
+
+		scoped_lock fbl(forkblock_mtx_);
+#if FZ_SPAWN_VFORK
+		spawn_args args;
+		args.cmd_ = cmd.c_str();
+		args.argv_ = argV.data();
+		if (redirect_mode != io_redirection::none) {
+			args.in_ = in_.read_;
+			args.out_ = out_.write_;
+			args.err_ = err_.write_;
+		}
+		args.extra_fds_ = extra_fds.data();
+		args.extra_fds_count_ = extra_fds.size();
+
+		std::vector<gid_t> sup_groups;
+		if (it && *it) {
+#if FZ_UNIX
+			args.impersonate_ = get_impersonation_ids(*it, args.uid_, args.gid_, sup_groups);
+#endif
+			if (!args.impersonate_) {
 				kill();
 				return false;
 			}
+			args.sup_groups_ = sup_groups.data();
+			args.sup_groups_count_ = sup_groups.size();
 		}
 
-
-		scoped_lock fbl(forkblock_mtx_);
+		pid_t const pid = spawn_vfork(args);
+		if (pid < 0 || args.error_) {
+			if (pid > 0) {
+				// The child has already exited
+				while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR) {
+				}
+			}
+			kill();
+			return false;
+		}
+		else {
+#else
 		pid_t pid = fork();
 		if (pid < 0) {
 			kill();
@@ -835,6 +1184,7 @@ public:
 			_exit(-1);
 		}
 		else {
+#endif
 			// We're the parent
 			pid_ = pid;
 
@@ -856,11 +1206,23 @@ public:
 						set_nonblocking(out_.read_);
 						set_nonblocking(err_.read_);
 
-						waiting_read_ = true;
-						waiting_write_ = false;
+						entry_.read_fd_ = out_.read_;
+						entry_.write_fd_ = in_.write_;
+						entry_.waiting_read_ = true;
+						entry_.waiting_write_ = false;
 					}
 				}
 			}
+
+			if (reactor_) {
+				entry_.pid_ = pid_;
+				entry_.exited_ = false;
+#if FZ_USE_PIDFD
+				// Fails on kernels older than 5.3, leaving reaping to kill()
+				entry_.pid_fd_ = static_cast<int>(syscall(SYS_pidfd_open, pid_, 0));
+#endif
+				reactor_->add(entry_);
+			}
 		}
 
 		return true;
@@ -887,29 +1249,35 @@ public:
 
 	bool kill(bool wait = true, bool force = false)
 	{
+		bool exited{};
 		if (handler_) {
-			{
-				scoped_lock l(mutex_);
-				quit_ = true;
-				poller_.interrupt(l);
+			if (reactor_) {
+				reactor_->remove(entry_);
+				reactor_.reset();
+
+				exited = entry_.exited_;
+				reset_fd(entry_.pid_fd_);
+				entry_.read_fd_ = -1;
+				entry_.write_fd_ = -1;
 			}
-			task_.join();
-			quit_ = false;
 
 			remove_pending_events();
 		}
 		in_.reset();
 
 		if (pid_ != -1) {
-			::kill(pid_, force ? SIGKILL : SIGTERM);
+			// If already reaped, the pid may have been reused
+			if (!exited) {
+				::kill(pid_, force ? SIGKILL : SIGTERM);
 
-			pid_t ret;
-			do {
-				ret = waitpid(pid_, nullptr, wait ? 0 : WNOHANG);
-			} while (ret == -1 && errno == EINTR);
+				pid_t ret;
+				do {
+					ret = waitpid(pid_, nullptr, wait ? 0 : WNOHANG);
+				} while (ret == -1 && errno == EINTR);
 
-			if (!ret) {
-				return false;
+				if (!ret) {
+					return false;
+				}
 			}
 
 			pid_ = -1;
@@ -924,7 +1292,7 @@ public:
 	rwresult read(void* buffer, unsigned int len)
 	{
 #if DEBUG_SOCKETEVENTS
-		assert(!waiting_read_);
+		assert(!entry_.waiting_read_);
 #endif
 		while (true) {
 			ssize_t r = ::read(out_.read_, buffer, len);
@@ -940,10 +1308,8 @@ public:
 			}
 			switch (err) {
 			case EAGAIN:
-				{
-					scoped_lock l(mutex_);
-					waiting_read_ = true;
-					poller_.interrupt(l);
+				if (reactor_) {
+					reactor_->wait_read(entry_);
 				}
 				return rwresult{rwresult::wouldblock, err};
 			case EIO:
@@ -957,7 +1323,7 @@ public:
 	rwresult write(void const* buffer, unsigned int len)
 	{
 #if DEBUG_SOCKETEVENTS
-		assert(!waiting_write_);
+		assert(!entry_.waiting_write_);
 #endif
 		while (true) {
 			ssize_t written = ::write(in_.write_, buffer, len);
@@ -973,10 +1339,8 @@ public:
 			int const err = errno;
 			switch (err) {
 			case EAGAIN:
-				{
-					scoped_lock l(mutex_);
-					waiting_read_ = true;
-					poller_.interrupt(l);
+				if (reactor_) {
+					reactor_->wait_write(entry_);
 				}
 				return rwresult{rwresult::wouldblock, err};
 			case EIO:
@@ -993,19 +1357,14 @@ public:
 
 	thread_pool * pool_{};
 	event_handler * handler_{};
-	mutex mutex_;
-	async_task task_;
-	bool quit_{};
 
-	poller poller_;
+	std::shared_ptr<process_reactor> reactor_;
+	reactor_entry entry_;
 
 	pipe in_;
 	pipe out_;
 	pipe err_;
 
-	bool waiting_read_{true};
-	bool waiting_write_{};
-
 	int pid_{-1};
 };
 
@@ -1088,6 +1447,16 @@ HANDLE process::handle() const
 {
 	return impl_ ? impl_->handle() : INVALID_HANDLE_VALUE;
 }
+#else
+int process::get_input_descriptor() const
+{
+	return impl_ ? impl_->in_.write_ : -1;
+}
+
+int process::get_output_descriptor() const
+{
+	return impl_ ? impl_->out_.read_ : -1;
+}
 #endif
 
 #if FZ_MAC
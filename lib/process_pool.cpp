@@ -0,0 +1,337 @@
+#include "libfilezilla/process_pool.hpp"
+#include "libfilezilla/impersonation.hpp"
+#include "libfilezilla/mutex.hpp"
+#include "libfilezilla/process.hpp"
+
+#include <algorithm>
+
+#ifdef FZ_WINDOWS
+#include "libfilezilla/glue/windows.hpp"
+#else
+#include <errno.h>
+#include <poll.h>
+#endif
+
+namespace fz {
+
+namespace {
+struct worker final
+{
+	process process_;
+	size_t jobs_{};
+	monotonic_clock idle_since_;
+};
+
+// An idle worker has no reason to write or exit. If it did either, e.g. because
+// it crashed or has been killed, it cannot take a job.
+bool usable(worker & w)
+{
+#ifdef FZ_WINDOWS
+	return WaitForSingleObject(w.process_.handle(), 0) == WAIT_TIMEOUT;
+#else
+	pollfd fd{};
+	fd.fd = w.process_.get_output_descriptor();
+	fd.events = POLLIN;
+	int res;
+	do {
+		res = poll(&fd, 1, 0);
+	} while (res == -1 && errno == EINTR);
+	return !res;
+#endif
+}
+
+bool write_all(process & p, void const* data, size_t len)
+{
+	auto const* d = static_cast<unsigned char const*>(data);
+	while (len) {
+		auto const r = p.write(d, len);
+		if (!r || !r.value_) {
+			return false;
+		}
+		d += r.value_;
+		len -= r.value_;
+	}
+	return true;
+}
+
+bool read_all(process & p, void* data, size_t len)
+{
+	auto* d = static_cast<unsigned char*>(data);
+	while (len) {
+		auto const r = p.read(d, len);
+		if (!r || !r.value_) {
+			return false;
+		}
+		d += r.value_;
+		len -= r.value_;
+	}
+	return true;
+}
+}
+
+class process_pool::impl final
+{
+public:
+	explicit impl(options const& opts)
+		: opts_(opts)
+	{
+		opts_.max_workers = std::max(opts_.max_workers, size_t(1));
+		opts_.min_workers = std::min(opts_.min_workers, opts_.max_workers);
+	}
+
+	~impl()
+	{
+		// Stopped outside the lock, kill() waits for the process to exit
+		std::vector<std::unique_ptr<worker>> idle;
+		{
+			scoped_lock l(mtx_);
+			idle.swap(idle_);
+		}
+	}
+
+	void prestart();
+	bool execute(std::string_view const& request, std::string & response);
+	stats get_stats() const;
+
+#if FZ_WINDOWS || FZ_UNIX
+	impersonation_token token_;
+#endif
+
+private:
+	std::unique_ptr<worker> start();
+	bool run(worker & w, std::string_view const& request, std::string & response);
+	void trim(std::vector<std::unique_ptr<worker>> & stopped);
+
+	options opts_;
+
+	mutable mutex mtx_{false};
+	condition cond_;
+
+	// Most recently used last
+	std::vector<std::unique_ptr<worker>> idle_;
+
+	// Includes busy workers and workers being started
+	size_t workers_{};
+
+	stats stats_;
+};
+
+std::unique_ptr<worker> process_pool::impl::start()
+{
+	if (opts_.command.empty()) {
+		return nullptr;
+	}
+
+	auto w = std::make_unique<worker>();
+	std::vector<native_string> const args(opts_.command.begin() + 1, opts_.command.end());
+	bool spawned;
+#if FZ_WINDOWS || FZ_UNIX
+	if (token_) {
+		spawned = w->process_.spawn(token_, opts_.command.front(), args, process::io_redirection::redirect_discard_stderr);
+	}
+	else
+#endif
+	{
+		spawned = w->process_.spawn(opts_.command.front(), args, process::io_redirection::redirect_discard_stderr);
+	}
+	if (!spawned) {
+		return nullptr;
+	}
+
+	scoped_lock l(mtx_);
+	++stats_.started;
+	return w;
+}
+
+void process_pool::impl::prestart()
+{
+	while (true) {
+		{
+			scoped_lock l(mtx_);
+			if (workers_ >= opts_.min_workers) {
+				return;
+			}
+			++workers_;
+		}
+
+		auto w = start();
+
+		scoped_lock l(mtx_);
+		if (!w) {
+			--workers_;
+			cond_.signal(l);
+			return;
+		}
+		w->idle_since_ = monotonic_clock::now();
+		idle_.push_back(std::move(w));
+		cond_.signal(l);
+	}
+}
+
+void process_pool::impl::trim(std::vector<std::unique_ptr<worker>> & stopped)
+{
+	auto const now = monotonic_clock::now();
+
+	// The least recently used workers come first
+	size_t n{};
+	while (n < idle_.size() && workers_ - n > opts_.min_workers && (now - idle_[n]->idle_since_) >= opts_.idle_timeout) {
+		++n;
+	}
+	if (n) {
+		for (size_t i = 0; i < n; ++i) {
+			stopped.push_back(std::move(idle_[i]));
+		}
+		idle_.erase(idle_.begin(), idle_.begin() + n);
+		workers_ -= n;
+	}
+}
+
+bool process_pool::impl::execute(std::string_view const& request, std::string & response)
+{
+	response.clear();
+	if (request.size() > 0xffffffffu) {
+		return false;
+	}
+
+	std::unique_ptr<worker> w;
+	std::vector<std::unique_ptr<worker>> stopped;
+	{
+		scoped_lock l(mtx_);
+		while (true) {
+			trim(stopped);
+			if (!idle_.empty()) {
+				w = std::move(idle_.back());
+				idle_.pop_back();
+				if (usable(*w)) {
+					break;
+				}
+				stopped.push_back(std::move(w));
+				--workers_;
+				continue;
+			}
+			if (workers_ < opts_.max_workers) {
+				++workers_;
+				break;
+			}
+			cond_.wait(l);
+		}
+	}
+	stopped.clear();
+
+	if (!w) {
+		w = start();
+		if (!w) {
+			scoped_lock l(mtx_);
+			--workers_;
+			++stats_.jobs;
+			++stats_.failed;
+			cond_.signal(l);
+			return false;
+		}
+	}
+
+	bool const ok = run(*w, request, response);
+	++w->jobs_;
+
+	bool const recycle = ok && opts_.max_jobs && w->jobs_ >= opts_.max_jobs;
+	if (!ok || recycle) {
+		w.reset();
+	}
+
+	{
+		scoped_lock l(mtx_);
+		++stats_.jobs;
+		if (!ok) {
+			++stats_.failed;
+		}
+		if (recycle) {
+			++stats_.recycled;
+		}
+		if (w) {
+			w->idle_since_ = monotonic_clock::now();
+			idle_.push_back(std::move(w));
+		}
+		else {
+			--workers_;
+		}
+		trim(stopped);
+		cond_.signal(l);
+	}
+	stopped.clear();
+
+	// Replace stopped workers
+	prestart();
+
+	return ok;
+}
+
+bool process_pool::impl::run(worker & w, std::string_view const& request, std::string & response)
+{
+	auto const encode = [](unsigned char* out, uint32_t v) {
+		out[0] = static_cast<unsigned char>(v >> 24);
+		out[1] = static_cast<unsigned char>(v >> 16);
+		out[2] = static_cast<unsigned char>(v >> 8);
+		out[3] = static_cast<unsigned char>(v);
+	};
+
+	unsigned char header[4];
+	encode(header, static_cast<uint32_t>(request.size()));
+	if (!write_all(w.process_, header, 4) || !write_all(w.process_, request.data(), request.size())) {
+		return false;
+	}
+
+	if (!read_all(w.process_, header, 4)) {
+		return false;
+	}
+	size_t const len = (size_t(header[0]) << 24) | (size_t(header[1]) << 16) | (size_t(header[2]) << 8) | size_t(header[3]);
+	if (len > opts_.max_response_size) {
+		return false;
+	}
+
+	response.resize(len);
+	if (!read_all(w.process_, response.data(), len)) {
+		response.clear();
+		return false;
+	}
+	return true;
+}
+
+process_pool::stats process_pool::impl::get_stats() const
+{
+	scoped_lock l(mtx_);
+	stats ret = stats_;
+	ret.workers = workers_;
+	ret.idle = idle_.size();
+	return ret;
+}
+
+process_pool::process_pool(options const& opts)
+	: impl_(std::make_unique<impl>(opts))
+{
+	impl_->prestart();
+}
+
+#if FZ_WINDOWS || FZ_UNIX
+process_pool::process_pool(options const& opts, impersonation_token && token)
+	: impl_(std::make_unique<impl>(opts))
+{
+	impl_->token_ = std::move(token);
+	impl_->prestart();
+}
+#endif
+
+process_pool::~process_pool()
+{
+}
+
+bool process_pool::execute(std::string_view const& request, std::string & response)
+{
+	return impl_->execute(request, response);
+}
+
+process_pool::stats process_pool::get_stats() const
+{
+	return impl_->get_stats();
+}
+
+}
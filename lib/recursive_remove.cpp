@@ -1,10 +1,20 @@
 #include "libfilezilla/file.hpp"
 #include "libfilezilla/local_filesys.hpp"
 #include "libfilezilla/recursive_remove.hpp"
+#include "libfilezilla/thread_pool.hpp"
+#include "libfilezilla/time.hpp"
+#include "work_stack.hpp"
 
 #if FZ_WINDOWS
 #include "windows/dll.hpp"
 #else
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
@@ -157,6 +167,221 @@ bool recursive_remove::remove(std::list<native_string> dirsToVisit)
 	return success;
 }
 
+#ifndef FZ_WINDOWS
+namespace {
+class parallel_remover;
+
+// A directory being emptied. It gets removed once the last reference is
+// gone, that is after all of its contents have been dealt with.
+struct remove_node final
+{
+	remove_node(parallel_remover & remover, std::shared_ptr<remove_node> const& parent, std::string && name)
+		: remover_(remover)
+		, parent_(parent)
+		, name_(std::move(name))
+	{}
+
+	~remove_node();
+
+	parallel_remover & remover_;
+	std::shared_ptr<remove_node> const parent_;
+	std::string const name_;
+	int fd_{-1};
+};
+
+// Either a directory to empty or, if files_ is not empty, a chunk of its files to remove
+struct remove_task final
+{
+	std::shared_ptr<remove_node> parent_;
+	std::string name_;
+	std::vector<std::string> files_;
+};
+
+class parallel_remover final
+{
+public:
+	parallel_remover(thread_pool & pool, size_t threads, std::function<bool(uint64_t, uint64_t)> const& progress)
+		: progress_(progress)
+		, stack_(pool, threads, [this](remove_task & t, std::vector<remove_task> & tasks) { process(t, tasks); })
+	{}
+
+	bool run(std::string const& path)
+	{
+		// Tasks left over after stopping get discarded, their directories are not removed
+		stack_.run({nullptr, path, {}});
+
+		if (!stack_.stopped()) {
+			scoped_lock l(progress_mtx_);
+			if (!progress_(files_, dirs_)) {
+				stack_.stop();
+			}
+		}
+
+		return !failed_ && !stack_.stopped();
+	}
+
+	void removed_dir(bool success)
+	{
+		if (success) {
+			++dirs_;
+		}
+		else {
+			failed_ = true;
+		}
+	}
+
+	bool stopped() const { return stack_.stopped(); }
+
+private:
+	void process(remove_task & t, std::vector<remove_task> & tasks)
+	{
+		if (t.files_.empty()) {
+			empty_dir(t, tasks);
+		}
+		else {
+			remove_files(t);
+		}
+		// Releasing the reference may remove the parent directory
+		t.parent_.reset();
+		report_progress();
+	}
+
+	void empty_dir(remove_task & t, std::vector<remove_task> & tasks)
+	{
+		int const dirfd = t.parent_ ? t.parent_->fd_ : AT_FDCWD;
+		int fd = openat(dirfd, t.name_.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd == -1) {
+			if (errno == ENOTDIR || errno == ELOOP) {
+				// Not a directory after all, or a symbolic link
+				unlink_entry(dirfd, t.name_);
+			}
+			else if (errno != ENOENT || !t.parent_) {
+				// Entries vanishing in the meantime are fine, a missing root is not
+				failed_ = true;
+			}
+			return;
+		}
+
+		auto n = std::make_shared<remove_node>(*this, t.parent_, std::move(t.name_));
+		n->fd_ = fd;
+
+		fd = fcntl(n->fd_, F_DUPFD_CLOEXEC, 0);
+		local_filesys fs;
+		if (fd == -1 || !fs.begin_find_files(fd, false, false)) {
+			failed_ = true;
+			return;
+		}
+
+		// Enumerate everything before removing anything, removing entries while
+		// enumerating a directory can cause other entries to be skipped.
+		remove_task files{n, {}, {}};
+		local_filesys::entries entries;
+		while (fs.get_next_files(entries, false)) {
+			for (size_t i = 0; i < entries.size(); ++i) {
+				if (entries[i].t == local_filesys::dir && !entries[i].is_link) {
+					tasks.push_back({n, std::string(entries.name(i)), {}});
+				}
+				else {
+					files.files_.emplace_back(entries.name(i));
+					if (files.files_.size() >= chunk_size) {
+						tasks.push_back(std::move(files));
+						files = remove_task{n, {}, {}};
+					}
+				}
+			}
+		}
+		if (!files.files_.empty()) {
+			tasks.push_back(std::move(files));
+		}
+	}
+
+	void remove_files(remove_task const& t)
+	{
+		for (auto const& name : t.files_) {
+			if (stack_.stopped()) {
+				break;
+			}
+			unlink_entry(t.parent_->fd_, name);
+		}
+	}
+
+	void unlink_entry(int dirfd, std::string const& name)
+	{
+		if (!unlinkat(dirfd, name.c_str(), 0)) {
+			++files_;
+		}
+		else if (errno != ENOENT) {
+			failed_ = true;
+		}
+	}
+
+	void report_progress()
+	{
+		scoped_lock l(progress_mtx_);
+		auto const now = monotonic_clock::now();
+		if (!last_progress_ || (now - last_progress_) >= duration::from_milliseconds(100)) {
+			last_progress_ = now;
+			if (!progress_(files_, dirs_)) {
+				stack_.stop();
+			}
+		}
+	}
+
+	// Number of entries removed by a single task
+	static size_t const chunk_size = 1024;
+
+	std::function<bool(uint64_t, uint64_t)> const& progress_;
+
+	std::atomic<bool> failed_{};
+	std::atomic<uint64_t> files_{};
+	std::atomic<uint64_t> dirs_{};
+
+	mutex progress_mtx_{false};
+	monotonic_clock last_progress_;
+
+	work_stack<remove_task> stack_;
+};
+
+remove_node::~remove_node()
+{
+	if (fd_ != -1) {
+		close(fd_);
+	}
+	if (!remover_.stopped()) {
+		int const dirfd = parent_ ? parent_->fd_ : AT_FDCWD;
+		remover_.removed_dir(!unlinkat(dirfd, name_.c_str(), AT_REMOVEDIR));
+	}
+}
+}
+#endif
+
+bool recursive_remove::remove(native_string const& path, thread_pool & pool, size_t threads)
+{
+#ifdef FZ_WINDOWS
+	(void)pool;
+	(void)threads;
+	return remove(path);
+#else
+	if (!confirm()) {
+		return false;
+	}
+
+	native_string p = path;
+	while (p.size() > 1 && p.back() == '/') {
+		p.pop_back();
+	}
+	if (p.empty()) {
+		return true;
+	}
+
+	std::function<bool(uint64_t, uint64_t)> const progress_cb = [this](uint64_t files, uint64_t dirs) {
+		return progress(files, dirs);
+	};
+	parallel_remover remover(pool, threads, progress_cb);
+	return remover.run(p);
+#endif
+}
+
 #ifdef FZ_WINDOWS
 void recursive_remove::adjust_shfileop(SHFILEOPSTRUCT & op)
 {
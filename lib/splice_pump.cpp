@@ -0,0 +1,393 @@
+#include "libfilezilla/splice_pump.hpp"
+#include "libfilezilla/event_handler.hpp"
+#include "libfilezilla/file.hpp"
+#include "libfilezilla/glue/unix.hpp"
+#include "libfilezilla/process.hpp"
+#include "libfilezilla/socket.hpp"
+#include "libfilezilla/thread_pool.hpp"
+#include "unix/poller.hpp"
+
+#include <atomic>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(SPLICE_F_NONBLOCK)
+#define FZ_USE_SPLICE 1
+#endif
+
+namespace fz {
+
+#if FZ_USE_SPLICE
+namespace {
+bool is_pipe(int fd)
+{
+	struct stat st;
+	return !fstat(fd, &st) && S_ISFIFO(st.st_mode);
+}
+}
+#endif
+
+splice_pump::endpoint::endpoint(process & p)
+	: read_fd_(p.get_output_descriptor())
+	, write_fd_(p.get_input_descriptor())
+{
+}
+
+splice_pump::endpoint::endpoint(socket & s)
+	: read_fd_(s.get_descriptor())
+	, write_fd_(read_fd_)
+{
+}
+
+splice_pump::endpoint::endpoint(file & f)
+	: read_fd_(f.fd())
+	, write_fd_(read_fd_)
+{
+}
+
+class splice_pump::impl final : private bucket
+{
+public:
+	impl(splice_pump & pump, thread_pool & pool, event_handler & handler, int in, int out, options const& opts);
+	virtual ~impl();
+
+	std::atomic<uint64_t> transferred_{};
+
+private:
+	enum class state {
+		done,
+		error,
+		quit,
+
+		// Waiting for the source to become readable
+		wait_read,
+
+		// Waiting for the sink to become writable
+		wait_write,
+
+		// Moving directly, the operation would block on either end
+		wait_both,
+
+		// Waiting for the rate limiter
+		wait_tokens
+	};
+
+	bool init(thread_pool & pool);
+	void run();
+
+	// Moves data until done or the next operation would block, runs without holding the mutex
+	state step();
+
+	// Read from the source into the stage, or written from the stage into the sink
+	ssize_t fill(size_t len);
+	ssize_t drain();
+
+	void moved(size_t len);
+
+	virtual void wakeup(direction::type) override;
+
+	splice_pump & pump_;
+	event_handler & handler_;
+	int const in_;
+	int const out_;
+	options const opts_;
+
+	mutex mutex_{false};
+	poller poller_;
+	async_task task_;
+	std::atomic<bool> quit_{};
+
+	// Only accessed by the pumping thread
+	bool stalled_{};
+	bool direct_{};
+	size_t staged_{};
+#if FZ_USE_SPLICE
+	int pipe_[2]{-1, -1};
+#else
+	std::vector<unsigned char> buffer_;
+	size_t filled_{};
+#endif
+
+	int in_flags_{-1};
+	int out_flags_{-1};
+};
+
+splice_pump::impl::impl(splice_pump & pump, thread_pool & pool, event_handler & handler, int in, int out, options const& opts)
+	: pump_(pump)
+	, handler_(handler)
+	, in_(in)
+	, out_(out)
+	, opts_(opts)
+{
+	if (!init(pool)) {
+		handler_.send_event<pump_event>(&pump_, pump_event_flag::failed);
+	}
+}
+
+bool splice_pump::impl::init(thread_pool & pool)
+{
+	if (in_ == -1 || out_ == -1 || !opts_.chunk_size) {
+		return false;
+	}
+
+	// Writing into a pipe or socket whose peer has gone away must fail with EPIPE instead of raising SIGPIPE
+	disable_sigpipe();
+
+	in_flags_ = fcntl(in_, F_GETFL);
+	out_flags_ = fcntl(out_, F_GETFL);
+	if (in_flags_ == -1 || out_flags_ == -1) {
+		return false;
+	}
+	fcntl(in_, F_SETFL, in_flags_ | O_NONBLOCK);
+	fcntl(out_, F_SETFL, out_flags_ | O_NONBLOCK);
+
+#if FZ_USE_SPLICE
+	// splice() needs a pipe on one end
+	direct_ = is_pipe(in_) || is_pipe(out_);
+	if (!direct_ && !create_pipe(pipe_)) {
+		return false;
+	}
+#else
+	buffer_.resize(opts_.chunk_size);
+#endif
+
+	if (poller_.init() != 0) {
+		return false;
+	}
+
+	if (opts_.limiter) {
+		opts_.limiter->add(this);
+	}
+
+	task_ = pool.spawn([this]() { run(); });
+	return static_cast<bool>(task_);
+}
+
+splice_pump::impl::~impl()
+{
+	{
+		scoped_lock l(mutex_);
+		quit_ = true;
+		poller_.interrupt(l);
+	}
+	task_.join();
+	remove_bucket();
+
+	handler_.event_loop_.filter_events([&](event_loop::Events::value_type const& ev) {
+		if (ev.first != &handler_ || ev.second->derived_type() != pump_event::type()) {
+			return false;
+		}
+		return std::get<0>(static_cast<pump_event const&>(*ev.second).v_) == &pump_;
+	});
+
+#if FZ_USE_SPLICE
+	for (int & fd : pipe_) {
+		if (fd != -1) {
+			close(fd);
+		}
+	}
+#endif
+
+	if (out_flags_ != -1) {
+		fcntl(out_, F_SETFL, out_flags_);
+	}
+	if (in_flags_ != -1) {
+		fcntl(in_, F_SETFL, in_flags_);
+	}
+}
+
+void splice_pump::impl::wakeup(direction::type)
+{
+	// Called with the bucket's mutex held. The pumping thread never holds
+	// mutex_ while calling into the bucket.
+	scoped_lock l(mutex_);
+	poller_.interrupt(l);
+}
+
+void splice_pump::impl::moved(size_t len)
+{
+	transferred_ += len;
+	if (stalled_) {
+		stalled_ = false;
+		handler_.send_event<pump_event>(&pump_, pump_event_flag::resumed);
+	}
+}
+
+ssize_t splice_pump::impl::fill(size_t len)
+{
+#if FZ_USE_SPLICE
+	return splice(in_, nullptr, pipe_[1], nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	ssize_t const r = read(in_, buffer_.data(), len);
+	if (r > 0) {
+		filled_ = static_cast<size_t>(r);
+	}
+	return r;
+#endif
+}
+
+ssize_t splice_pump::impl::drain()
+{
+#if FZ_USE_SPLICE
+	return splice(pipe_[0], nullptr, out_, nullptr, staged_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	return write(out_, buffer_.data() + filled_ - staged_, staged_);
+#endif
+}
+
+splice_pump::impl::state splice_pump::impl::step()
+{
+	while (!quit_) {
+		if (staged_) {
+			ssize_t const r = drain();
+			if (r > 0) {
+				staged_ -= static_cast<size_t>(r);
+				moved(static_cast<size_t>(r));
+				continue;
+			}
+			if (r == -1 && errno == EINTR) {
+				continue;
+			}
+			return (r == -1 && errno == EAGAIN) ? state::wait_write : state::error;
+		}
+
+		size_t len = opts_.chunk_size;
+		rate::type max = rate::unlimited;
+		if (opts_.limiter) {
+			max = available(opts_.limit_direction);
+			if (!max) {
+				return state::wait_tokens;
+			}
+			if (max < len) {
+				len = static_cast<size_t>(max);
+			}
+		}
+
+		ssize_t r;
+#if FZ_USE_SPLICE
+		if (direct_) {
+			r = splice(in_, nullptr, out_, nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		}
+		else
+#endif
+		{
+			r = fill(len);
+		}
+
+		if (r > 0) {
+			if (max != rate::unlimited) {
+				consume(opts_.limit_direction, static_cast<rate::type>(r));
+			}
+			if (direct_) {
+				moved(static_cast<size_t>(r));
+			}
+			else {
+				staged_ = static_cast<size_t>(r);
+			}
+			continue;
+		}
+		if (!r) {
+			return state::done;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno != EAGAIN) {
+			return state::error;
+		}
+		return direct_ ? state::wait_both : state::wait_read;
+	}
+	return state::quit;
+}
+
+void splice_pump::impl::run()
+{
+	scoped_lock l(mutex_);
+	while (!quit_) {
+		l.unlock();
+		state const s = step();
+		l.lock();
+
+		if (s == state::quit || quit_) {
+			break;
+		}
+		if (s == state::done || s == state::error) {
+			handler_.send_event<pump_event>(&pump_, s == state::done ? pump_event_flag::finished : pump_event_flag::failed);
+			break;
+		}
+		if (s == state::wait_tokens) {
+			// Interrupted by wakeup
+			if (!poller_.wait(l)) {
+				handler_.send_event<pump_event>(&pump_, pump_event_flag::failed);
+				break;
+			}
+			continue;
+		}
+
+		bool need_read = s != state::wait_write;
+		bool need_write = s != state::wait_read;
+		while (need_read || need_write) {
+			// Data is available but cannot be written
+			if (!need_read && !stalled_) {
+				stalled_ = true;
+				handler_.send_event<pump_event>(&pump_, pump_event_flag::stalled);
+			}
+
+			pollfd fds[3]{};
+			nfds_t n{};
+			nfds_t read_idx{3};
+			if (need_read) {
+				read_idx = n;
+				fds[n].fd = in_;
+				fds[n++].events = POLLIN;
+			}
+			if (need_write) {
+				fds[n].fd = out_;
+				fds[n++].events = POLLOUT;
+			}
+			if (!poller_.wait(fds, n, l)) {
+				quit_ = true;
+				handler_.send_event<pump_event>(&pump_, pump_event_flag::failed);
+				break;
+			}
+			if (quit_) {
+				break;
+			}
+			for (nfds_t i = 0; i < n; ++i) {
+				if (fds[i].revents) {
+					if (i == read_idx) {
+						need_read = false;
+					}
+					else {
+						need_write = false;
+					}
+				}
+			}
+		}
+	}
+}
+
+splice_pump::splice_pump(thread_pool & pool, event_handler & handler, endpoint const& source, endpoint const& sink)
+	: splice_pump(pool, handler, source, sink, options())
+{
+}
+
+splice_pump::splice_pump(thread_pool & pool, event_handler & handler, endpoint const& source, endpoint const& sink, options const& opts)
+	: impl_(std::make_unique<impl>(*this, pool, handler, source.read_fd_, sink.write_fd_, opts))
+{
+}
+
+splice_pump::~splice_pump()
+{
+}
+
+uint64_t splice_pump::transferred() const
+{
+	return impl_->transferred_;
+}
+
+}
@@ -7,12 +7,20 @@
 #include "libfilezilla/glue/windows.hpp"
 #else
 #include <iconv.h>
+#include <langinfo.h>
 #include <strings.h>
 
 #include <memory>
 #include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #endif
 
+#include <cstdint>
 #include <cstdlib>
 
 static_assert('a' + 25 == 'z', "We only support systems running with an ASCII-based character set. Sorry, no EBCDIC.");
@@ -143,66 +151,6 @@ std::wstring str_toupper_ascii(std::wstring_view const& s)
 	return str_case_ascii_impl<std::wstring, false>(s);
 }
 
-std::wstring to_wstring(std::string_view const& in)
-{
-	std::wstring ret;
-
-	if (!in.empty()) {
-#if FZ_WINDOWS
-		char const* const in_p = in.data();
-		size_t const len = in.size();
-		int const out_len = MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, in_p, static_cast<int>(len), nullptr, 0);
-		if (out_len > 0) {
-			ret.resize(out_len);
-			wchar_t* out_p = ret.data();
-			MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, in_p, static_cast<int>(len), out_p, out_len);
-		}
-#else
-		size_t start = 0;
-		while (start < in.size()) {
-			// Run in a loop to handle embedded null chars
-			size_t pos = in.find(char{}, start);
-			size_t inlen;
-			if (pos == std::string::npos) {
-				inlen = in.size() - start;
-			}
-			else {
-				inlen = pos - start;
-			}
-
-			std::mbstate_t ps{};
-			char const* in_p = in.data() + start;
-			size_t len = mbsnrtowcs(nullptr, &in_p, inlen, 0, &ps);
-			if (len != static_cast<size_t>(-1)) {
-				size_t old = ret.size();
-				if (start) {
-					++old;
-				}
-				ret.resize(old + len);
-				wchar_t* out_p = &ret[old];
-
-				in_p = in.data() + start; // Some implementations of wcsrtombs change src even on null dst
-				mbsnrtowcs(out_p, &in_p, inlen, len, &ps);
-			}
-			else {
-				ret.clear();
-				break;
-			}
-
-			start += inlen + 1;
-			if (start >= in.size()) {
-				if (pos != std::string::npos) {
-					ret += wchar_t{};
-				}
-				break;
-			}
-		}
-#endif
-	}
-
-	return ret;
-}
-
 #ifndef FZ_WINDOWS
 // On some platforms, e.g. NetBSD, the second argument to iconv is const.
 // Depending which one is used, declare iconv_second_arg_type as either char* or char const*
@@ -281,8 +229,321 @@ public:
 
 	iconv_t cd{reinterpret_cast<iconv_t>(-1)};
 };
+
+// Native transcoders between UTF-8 and UTF-32 wchar_t, bypassing iconv and the locale.
+//
+// Runs of ASCII characters are converted 16 at a time, anything else is decoded
+// one code point at a time with full validation: Overlong forms, surrogates and
+// code points beyond U+10FFFF are rejected, just like iconv does.
+constexpr bool native_utf32 = sizeof(wchar_t) == 4;
+
+bool locale_is_utf8()
+{
+	char const* cs = nl_langinfo(CODESET);
+	if (!cs) {
+		return false;
+	}
+	std::string_view const codeset(cs);
+	return equal_insensitive_ascii(codeset, "UTF-8") || equal_insensitive_ascii(codeset, "UTF8");
 }
+
+// Widens the leading ASCII characters of the input, returns their number.
+size_t widen_ascii(unsigned char const* in, size_t len, wchar_t* out)
+{
+	size_t i{};
+#if defined(__SSE2__)
+	__m128i const zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+		if (_mm_movemask_epi8(v)) {
+			break;
+		}
+		__m128i const lo = _mm_unpacklo_epi8(v, zero);
+		__m128i const hi = _mm_unpackhi_epi8(v, zero);
+		__m128i* o = reinterpret_cast<__m128i*>(out + i);
+		_mm_storeu_si128(o, _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128(o + 1, _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128(o + 2, _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128(o + 3, _mm_unpackhi_epi16(hi, zero));
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t const v = vld1q_u8(in + i);
+		if (vmaxvq_u8(v) >= 0x80) {
+			break;
+		}
+		uint16x8_t const lo = vmovl_u8(vget_low_u8(v));
+		uint16x8_t const hi = vmovl_u8(vget_high_u8(v));
+		uint32_t* o = reinterpret_cast<uint32_t*>(out + i);
+		vst1q_u32(o, vmovl_u16(vget_low_u16(lo)));
+		vst1q_u32(o + 4, vmovl_u16(vget_high_u16(lo)));
+		vst1q_u32(o + 8, vmovl_u16(vget_low_u16(hi)));
+		vst1q_u32(o + 12, vmovl_u16(vget_high_u16(hi)));
+	}
 #endif
+	for (; i < len && in[i] < 0x80; ++i) {
+		out[i] = static_cast<wchar_t>(in[i]);
+	}
+	return i;
+}
+
+// Narrows the leading ASCII characters of the input, returns their number.
+size_t narrow_ascii(wchar_t const* in, size_t len, char* out)
+{
+	size_t i{};
+#if defined(__SSE2__)
+	__m128i const zero = _mm_setzero_si128();
+	__m128i const non_ascii = _mm_set1_epi32(~0x7f);
+	for (; i + 16 <= len; i += 16) {
+		__m128i const* p = reinterpret_cast<__m128i const*>(in + i);
+		__m128i const a = _mm_loadu_si128(p);
+		__m128i const b = _mm_loadu_si128(p + 1);
+		__m128i const c = _mm_loadu_si128(p + 2);
+		__m128i const d = _mm_loadu_si128(p + 3);
+		__m128i const all = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(all, non_ascii), zero)) != 0xffff) {
+			break;
+		}
+		__m128i const packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 16 <= len; i += 16) {
+		uint32_t const* p = reinterpret_cast<uint32_t const*>(in + i);
+		uint32x4_t const a = vld1q_u32(p);
+		uint32x4_t const b = vld1q_u32(p + 4);
+		uint32x4_t const c = vld1q_u32(p + 8);
+		uint32x4_t const d = vld1q_u32(p + 12);
+		if (vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d))) >= 0x80) {
+			break;
+		}
+		uint16x8_t const lo = vcombine_u16(vmovn_u32(a), vmovn_u32(b));
+		uint16x8_t const hi = vcombine_u16(vmovn_u32(c), vmovn_u32(d));
+		vst1q_u8(reinterpret_cast<uint8_t*>(out + i), vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+	}
+#endif
+	for (; i < len && static_cast<uint32_t>(in[i]) < 0x80; ++i) {
+		out[i] = static_cast<char>(in[i]);
+	}
+	return i;
+}
+
+// Decodes a single non-ASCII code point, advancing p past it. Returns -1 on invalid input.
+uint32_t decode_utf8_sequence(unsigned char const*& p, unsigned char const* end)
+{
+	unsigned char const c = *p;
+	size_t n;
+	uint32_t cp;
+	unsigned char lower = 0x80;
+	unsigned char upper = 0xbf;
+	if (c >= 0xc2 && c <= 0xdf) {
+		n = 1;
+		cp = c & 0x1fu;
+	}
+	else if (c >= 0xe0 && c <= 0xef) {
+		n = 2;
+		cp = c & 0x0fu;
+		if (c == 0xe0) {
+			lower = 0xa0; // Overlong
+		}
+		else if (c == 0xed) {
+			upper = 0x9f; // Surrogates
+		}
+	}
+	else if (c >= 0xf0 && c <= 0xf4) {
+		n = 3;
+		cp = c & 0x07u;
+		if (c == 0xf0) {
+			lower = 0x90; // Overlong
+		}
+		else if (c == 0xf4) {
+			upper = 0x8f; // Beyond U+10FFFF
+		}
+	}
+	else {
+		return static_cast<uint32_t>(-1);
+	}
+
+	if (static_cast<size_t>(end - p) <= n) {
+		return static_cast<uint32_t>(-1);
+	}
+	if (p[1] < lower || p[1] > upper) {
+		return static_cast<uint32_t>(-1);
+	}
+	for (size_t i = 1; i <= n; ++i) {
+		unsigned char const t = p[i];
+		if ((t & 0xc0u) != 0x80u) {
+			return static_cast<uint32_t>(-1);
+		}
+		cp = (cp << 6) | (t & 0x3fu);
+	}
+	p += n + 1;
+	return cp;
+}
+
+// Output is sized for the worst case of one character per input octet, then truncated.
+bool utf8_to_utf32(char const* s, size_t len, std::wstring& ret)
+{
+	ret.resize(len);
+	wchar_t* const out = ret.data();
+	size_t o{};
+
+	auto p = reinterpret_cast<unsigned char const*>(s);
+	auto const end = p + len;
+	while (p != end) {
+		size_t const ascii = widen_ascii(p, static_cast<size_t>(end - p), out + o);
+		p += ascii;
+		o += ascii;
+		if (p == end) {
+			break;
+		}
+
+		uint32_t const cp = decode_utf8_sequence(p, end);
+		if (cp == static_cast<uint32_t>(-1)) {
+			return false;
+		}
+		out[o++] = static_cast<wchar_t>(cp);
+	}
+	ret.resize(o);
+	return true;
+}
+
+// Starts out assuming pure ASCII, only grows to the worst case once the first non-ASCII character is seen.
+bool utf32_to_utf8(wchar_t const* in, size_t len, std::string& ret)
+{
+	ret.resize(len);
+	size_t o{};
+
+	size_t i{};
+	while (i < len) {
+		size_t const ascii = narrow_ascii(in + i, len - i, ret.data() + o);
+		i += ascii;
+		o += ascii;
+		if (i == len) {
+			break;
+		}
+
+		size_t const needed = o + (len - i) * 4;
+		if (ret.size() < needed) {
+			ret.resize(needed);
+		}
+		char* out = ret.data() + o;
+
+		uint32_t const cp = static_cast<uint32_t>(in[i++]);
+		if (cp < 0x800) {
+			*out++ = static_cast<char>(0xc0u | (cp >> 6));
+			*out++ = static_cast<char>(0x80u | (cp & 0x3fu));
+			o += 2;
+		}
+		else if (cp < 0x10000) {
+			if (cp >= 0xd800 && cp <= 0xdfff) {
+				return false;
+			}
+			*out++ = static_cast<char>(0xe0u | (cp >> 12));
+			*out++ = static_cast<char>(0x80u | ((cp >> 6) & 0x3fu));
+			*out++ = static_cast<char>(0x80u | (cp & 0x3fu));
+			o += 3;
+		}
+		else if (cp <= 0x10ffff) {
+			*out++ = static_cast<char>(0xf0u | (cp >> 18));
+			*out++ = static_cast<char>(0x80u | ((cp >> 12) & 0x3fu));
+			*out++ = static_cast<char>(0x80u | ((cp >> 6) & 0x3fu));
+			*out++ = static_cast<char>(0x80u | (cp & 0x3fu));
+			o += 4;
+		}
+		else {
+			return false;
+		}
+	}
+	ret.resize(o);
+	return true;
+}
+
+bool is_valid_utf8(std::string_view const& in)
+{
+	auto p = reinterpret_cast<unsigned char const*>(in.data());
+	auto const end = p + in.size();
+	while (p != end) {
+		if (*p < 0x80) {
+			++p;
+		}
+		else if (decode_utf8_sequence(p, end) == static_cast<uint32_t>(-1)) {
+			return false;
+		}
+	}
+	return true;
+}
+}
+#endif
+
+std::wstring to_wstring(std::string_view const& in)
+{
+	std::wstring ret;
+
+	if (!in.empty()) {
+#if FZ_WINDOWS
+		char const* const in_p = in.data();
+		size_t const len = in.size();
+		int const out_len = MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, in_p, static_cast<int>(len), nullptr, 0);
+		if (out_len > 0) {
+			ret.resize(out_len);
+			wchar_t* out_p = ret.data();
+			MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, in_p, static_cast<int>(len), out_p, out_len);
+		}
+#else
+		if constexpr (native_utf32) {
+			if (locale_is_utf8()) {
+				if (!utf8_to_utf32(in.data(), in.size(), ret)) {
+					ret.clear();
+				}
+				return ret;
+			}
+		}
+
+		size_t start = 0;
+		while (start < in.size()) {
+			// Run in a loop to handle embedded null chars
+			size_t pos = in.find(char{}, start);
+			size_t inlen;
+			if (pos == std::string::npos) {
+				inlen = in.size() - start;
+			}
+			else {
+				inlen = pos - start;
+			}
+
+			std::mbstate_t ps{};
+			char const* in_p = in.data() + start;
+			size_t len = mbsnrtowcs(nullptr, &in_p, inlen, 0, &ps);
+			if (len != static_cast<size_t>(-1)) {
+				size_t old = ret.size();
+				if (start) {
+					++old;
+				}
+				ret.resize(old + len);
+				wchar_t* out_p = &ret[old];
+
+				in_p = in.data() + start; // Some implementations of wcsrtombs change src even on null dst
+				mbsnrtowcs(out_p, &in_p, inlen, len, &ps);
+			}
+			else {
+				ret.clear();
+				break;
+			}
+
+			start += inlen + 1;
+			if (start >= in.size()) {
+				if (pos != std::string::npos) {
+					ret += wchar_t{};
+				}
+				break;
+			}
+		}
+#endif
+	}
+
+	return ret;
+}
 
 std::wstring to_wstring_from_utf8(std::string_view const& in)
 {
@@ -308,6 +569,13 @@ std::wstring to_wstring_from_utf8(char const* s, size_t len)
 			MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, in_p, static_cast<int>(len), out_p, out_len);
 		}
 #else
+		if constexpr (native_utf32) {
+			if (!utf8_to_utf32(s, len, ret)) {
+				ret.clear();
+			}
+			return ret;
+		}
+
 		static thread_local iconv_t_holder holder(wchar_t_encoding(), "UTF-8");
 
 		if (holder && iconv(holder.cd, nullptr, nullptr, nullptr, nullptr) != static_cast<size_t>(-1)) {
@@ -345,6 +613,15 @@ std::string to_string(std::wstring_view const& in)
 			WideCharToMultiByte(CP_ACP, 0, in_p, static_cast<int>(in.size()), out_p, len, nullptr, nullptr);
 		}
 #else
+		if constexpr (native_utf32) {
+			if (locale_is_utf8()) {
+				if (!utf32_to_utf8(in.data(), in.size(), ret)) {
+					ret.clear();
+				}
+				return ret;
+			}
+		}
+
 		size_t start = 0;
 		while (true) {
 			// Run in a loop to handle embedded null chars
@@ -392,6 +669,14 @@ std::string to_string(std::wstring_view const& in)
 
 std::string FZ_PUBLIC_SYMBOL to_utf8(std::string_view const& in)
 {
+#ifndef FZ_WINDOWS
+	if (locale_is_utf8()) {
+		if (is_valid_utf8(in)) {
+			return std::string(in);
+		}
+		return {};
+	}
+#endif
 	return to_utf8(to_wstring(in));
 }
 
@@ -409,6 +694,13 @@ std::string FZ_PUBLIC_SYMBOL to_utf8(std::wstring_view const& in)
 			WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, in_p, static_cast<int>(in.size()), out_p, len, nullptr, nullptr);
 		}
 #else
+		if constexpr (native_utf32) {
+			if (!utf32_to_utf8(in.data(), in.size(), ret)) {
+				ret.clear();
+			}
+			return ret;
+		}
+
 		static thread_local iconv_t_holder holder("UTF-8", wchar_t_encoding());
 
 		if (holder && iconv(holder.cd, nullptr, nullptr, nullptr, nullptr) != static_cast<size_t>(-1)) {
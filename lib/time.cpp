@@ -5,8 +5,20 @@
 #ifndef FZ_WINDOWS
 #include <errno.h>
 #include <sys/time.h>
+#include <time.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FZ_HAVE_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+#include <string.h>
 #include <wchar.h>
 
 //#include <cassert>
@@ -778,19 +790,7 @@ FILETIME datetime::get_filetime() const
 
 std::string datetime::get_rfc822() const
 {
-	if (empty()) {
-		return std::string();
-	}
-	tm const t = get_tm(datetime::zone::utc);
-	if (t.tm_wday < 0 || t.tm_wday > 6 || t.tm_mon < 0 || t.tm_mon > 11) {
-		return std::string();
-	}
-
-	static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
-	static const char* wdays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
-
-	return sprintf("%s, %02d %s %d %02d:%02d:%02d GMT", wdays[t.tm_wday], t.tm_mday, months[t.tm_mon], t.tm_year + 1900,
-		t.tm_hour, t.tm_min, t.tm_sec);
+	return timestamp_formatter().rfc822(*this);
 }
 
 using namespace std::literals;
@@ -973,4 +973,450 @@ bool datetime::set_rfc3339(std::wstring_view const& str)
 	return do_set_rfc3339(*this, str);
 }
 
+
+namespace {
+// Conversions between days since 1970-01-01 and the proleptic Gregorian calendar,
+// see http://howardhinnant.github.io/date_algorithms.html
+void civil_from_days(int64_t days, int64_t & year, int & month, int & day)
+{
+	days += 719468;
+	int64_t const era = (days >= 0 ? days : days - 146096) / 146097;
+	int64_t const doe = days - era * 146097;
+	int64_t const yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int64_t const doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int64_t const mp = (5 * doy + 2) / 153;
+	day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+	month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+	year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+}
+
+int64_t days_from_civil(int64_t year, int month, int day)
+{
+	year -= month <= 2 ? 1 : 0;
+	int64_t const era = (year >= 0 ? year : year - 399) / 400;
+	int64_t const yoe = year - era * 400;
+	int64_t const doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int64_t const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+int64_t floor_div(int64_t a, int64_t b)
+{
+	int64_t const q = a / b;
+	return (a % b < 0) ? q - 1 : q;
+}
+
+char const month_names[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+char const weekday_names[] = "SunMonTueWedThuFriSat";
+
+void put2(char*& p, int v)
+{
+	*p++ = static_cast<char>('0' + v / 10);
+	*p++ = static_cast<char>('0' + v % 10);
+}
+
+void put3(char*& p, int v)
+{
+	*p++ = static_cast<char>('0' + v / 100);
+	put2(p, v % 100);
+}
+
+void put_name(char*& p, char const* names, int index)
+{
+	memcpy(p, names + index * 3, 3);
+	p += 3;
+}
+
+// Years outside of 0-9999 are written with as many digits as needed
+void put_year(char*& p, int64_t year, size_t min_width)
+{
+	if (year >= 0 && year <= 9999 && min_width == 4) {
+		put2(p, static_cast<int>(year / 100));
+		put2(p, static_cast<int>(year % 100));
+	}
+	else {
+		char buf[24];
+		char* const end = buf + sizeof(buf);
+		char* q = detail::decimal_to_chars(end, static_cast<uint64_t>(year < 0 ? -year : year));
+		if (year < 0) {
+			*--q = '-';
+		}
+		for (size_t len = static_cast<size_t>(end - q); len < min_width; ++len) {
+			*p++ = '0';
+		}
+		memcpy(p, q, static_cast<size_t>(end - q));
+		p += end - q;
+	}
+}
+}
+
+timestamp_formatter::broken_down const& timestamp_formatter::get(datetime const& t, datetime::zone z, int & milliseconds)
+{
+	int64_t seconds = t.get_time_t();
+	milliseconds = t.get_milliseconds();
+	if (milliseconds < 0) {
+		milliseconds += 1000;
+		--seconds;
+	}
+
+	// As in get_tm, do not convert if only having days
+	if (t.get_accuracy() == datetime::days) {
+		z = datetime::utc;
+	}
+
+	broken_down & bd = cache_[z == datetime::utc ? 0 : 1];
+	if (bd.seconds == seconds) {
+		return bd;
+	}
+
+	int const offset = (z == datetime::utc) ? 0 : local_offset(seconds);
+	int64_t const local = seconds + offset;
+	int64_t const days = floor_div(local, 86400);
+	int const of_day = static_cast<int>(local - days * 86400);
+
+	if (bd.seconds == std::numeric_limits<int64_t>::min() || floor_div(bd.seconds + bd.offset, 86400) != days) {
+		civil_from_days(days, bd.year, bd.month, bd.day);
+		// 1970-01-01 was a Thursday
+		bd.weekday = static_cast<int>(days + 4 - floor_div(days + 4, 7) * 7);
+	}
+	bd.hour = of_day / 3600;
+	bd.minute = of_day / 60 % 60;
+	bd.second = of_day % 60;
+	bd.offset = offset;
+	bd.seconds = seconds;
+
+	return bd;
+}
+
+int timestamp_formatter::local_offset(int64_t seconds)
+{
+	if (seconds >= offset_from_ && seconds < offset_to_) {
+		return offset_;
+	}
+
+	auto const calc = [](int64_t s) {
+		tm const t = datetime(static_cast<time_t>(s), datetime::seconds).get_tm(datetime::local);
+		int64_t const local = days_from_civil(int64_t(t.tm_year) + 1900, t.tm_mon + 1, t.tm_mday) * 86400 + t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec;
+		return static_cast<int>(local - s);
+	};
+
+	int64_t const quarter = 900;
+	int64_t const week = 7 * 86400;
+
+	int64_t const block = floor_div(seconds, quarter) * quarter;
+	offset_ = calc(block);
+
+	// Find the nearest transitions within a week in either direction
+	int64_t same = block;
+	int64_t other = block + week;
+	if (calc(other) == offset_) {
+		same = other;
+		other += quarter;
+	}
+	else {
+		while (other - same > quarter) {
+			int64_t const mid = same + (other - same) / 2 / quarter * quarter;
+			(calc(mid) == offset_ ? same : other) = mid;
+		}
+	}
+	offset_to_ = other;
+
+	same = block;
+	other = block - week;
+	if (calc(other) == offset_) {
+		same = other;
+	}
+	else {
+		while (same - other > quarter) {
+			int64_t const mid = other + (same - other) / 2 / quarter * quarter;
+			(calc(mid) == offset_ ? same : other) = mid;
+		}
+	}
+	offset_from_ = same;
+
+	return offset_;
+}
+
+size_t timestamp_formatter::iso8601(char* out, datetime const& t, datetime::zone z, bool milliseconds)
+{
+	if (t.empty()) {
+		return 0;
+	}
+
+	int ms;
+	broken_down const& bd = get(t, z, ms);
+
+	char* p = out;
+	put_year(p, bd.year, 4);
+	*p++ = '-';
+	put2(p, bd.month);
+	*p++ = '-';
+	put2(p, bd.day);
+	*p++ = 'T';
+	put2(p, bd.hour);
+	*p++ = ':';
+	put2(p, bd.minute);
+	*p++ = ':';
+	put2(p, bd.second);
+	if (milliseconds) {
+		*p++ = '.';
+		put3(p, ms);
+	}
+	if (z == datetime::utc || t.get_accuracy() == datetime::days) {
+		*p++ = 'Z';
+	}
+	else {
+		int offset = bd.offset / 60;
+		if (offset < 0) {
+			*p++ = '-';
+			offset = -offset;
+		}
+		else {
+			*p++ = '+';
+		}
+		put2(p, offset / 60);
+		*p++ = ':';
+		put2(p, offset % 60);
+	}
+
+	return static_cast<size_t>(p - out);
+}
+
+size_t timestamp_formatter::rfc822(char* out, datetime const& t)
+{
+	if (t.empty()) {
+		return 0;
+	}
+
+	int ms;
+	broken_down const& bd = get(t, datetime::utc, ms);
+
+	char* p = out;
+	put_name(p, weekday_names, bd.weekday);
+	*p++ = ',';
+	*p++ = ' ';
+	put2(p, bd.day);
+	*p++ = ' ';
+	put_name(p, month_names, bd.month - 1);
+	*p++ = ' ';
+	put_year(p, bd.year, 1);
+	*p++ = ' ';
+	put2(p, bd.hour);
+	*p++ = ':';
+	put2(p, bd.minute);
+	*p++ = ':';
+	put2(p, bd.second);
+	memcpy(p, " GMT", 4);
+	p += 4;
+
+	return static_cast<size_t>(p - out);
+}
+
+size_t timestamp_formatter::listing(char* out, datetime const& t, datetime::zone z, datetime const& now)
+{
+	if (t.empty()) {
+		return 0;
+	}
+
+	// Same thresholds as used by ls: Half a Gregorian year into the past
+	int64_t const age = (now - t).get_seconds();
+	bool const recent = !now.empty() && age >= 0 && age < 31556952 / 2;
+
+	int ms;
+	broken_down const& bd = get(t, z, ms);
+
+	char* p = out;
+	put_name(p, month_names, bd.month - 1);
+	*p++ = ' ';
+	if (bd.day < 10) {
+		*p++ = ' ';
+		*p++ = static_cast<char>('0' + bd.day);
+	}
+	else {
+		put2(p, bd.day);
+	}
+	*p++ = ' ';
+	if (recent) {
+		put2(p, bd.hour);
+		*p++ = ':';
+		put2(p, bd.minute);
+	}
+	else {
+		if (bd.year >= 0 && bd.year <= 9999) {
+			*p++ = ' ';
+		}
+		put_year(p, bd.year, 4);
+	}
+
+	return static_cast<size_t>(p - out);
+}
+
+
+namespace {
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC_COARSE)
+// steady_clock is based on CLOCK_MONOTONIC, which shares its epoch with the coarse variant
+std::chrono::steady_clock::time_point coarse_now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+}
+
+duration const& coarse_resolution()
+{
+	static duration const res = [] {
+		timespec ts{};
+		if (clock_getres(CLOCK_MONOTONIC_COARSE, &ts) != 0) {
+			return duration();
+		}
+		// Round up, it is used as upper bound
+		return duration::from_microseconds(static_cast<int64_t>(ts.tv_sec) * 1000000 + (ts.tv_nsec + 999) / 1000);
+	}();
+	return res;
+}
+#endif
+
+#if FZ_HAVE_TSC
+bool has_invariant_tsc()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0x80000000);
+	if (static_cast<unsigned int>(regs[0]) < 0x80000007) {
+		return false;
+	}
+	__cpuid(regs, 0x80000007);
+	return (regs[3] & (1 << 8)) != 0;
+#else
+	unsigned int eax{}, ebx{}, ecx{}, edx{};
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+	return (edx & (1u << 8)) != 0;
+#endif
+}
+
+struct tsc_calibration final
+{
+	bool usable_{};
+	uint64_t tsc_{};
+	std::chrono::steady_clock::time_point time_;
+	double ns_per_tick_{};
+};
+
+// Reads the standard clock between two reads of the TSC, taking the tightest of a few attempts
+void sample(uint64_t & tsc, std::chrono::steady_clock::time_point & time)
+{
+	uint64_t best = uint64_t(-1);
+	for (int i = 0; i < 5; ++i) {
+		uint64_t const before = __rdtsc();
+		auto const now = std::chrono::steady_clock::now();
+		uint64_t const after = __rdtsc();
+		if (after - before < best) {
+			best = after - before;
+			tsc = before + (after - before) / 2;
+			time = now;
+		}
+	}
+}
+
+tsc_calibration calibrate_tsc()
+{
+	tsc_calibration c;
+	if (!has_invariant_tsc()) {
+		return c;
+	}
+
+	sample(c.tsc_, c.time_);
+
+	uint64_t ticks{};
+	std::chrono::steady_clock::time_point time;
+	do {
+		sample(ticks, time);
+	} while (time - c.time_ < std::chrono::milliseconds(10));
+
+	if (ticks > c.tsc_) {
+		c.ns_per_tick_ = std::chrono::duration<double, std::nano>(time - c.time_).count() / static_cast<double>(ticks - c.tsc_);
+		c.usable_ = true;
+	}
+	return c;
+}
+
+tsc_calibration const& tsc()
+{
+	static tsc_calibration const c = calibrate_tsc();
+	return c;
+}
+#endif
+}
+
+monotonic_clock monotonic_clock::now(source s)
+{
+	switch (s) {
+	case source::coarse:
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC_COARSE)
+		if (coarse_resolution()) {
+			return monotonic_clock(coarse_now());
+		}
+#endif
+		break;
+	case source::tsc:
+#if FZ_HAVE_TSC
+		{
+			auto const& c = tsc();
+			if (c.usable_) {
+				// Signed, the counter may have been read before calibration on another thread
+				double const ticks = static_cast<double>(static_cast<int64_t>(__rdtsc() - c.tsc_));
+				return monotonic_clock(c.time_ + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::nano>(ticks * c.ns_per_tick_)));
+			}
+		}
+#endif
+		break;
+	default:
+		break;
+	}
+	return now();
+}
+
+bool monotonic_clock::available(source s)
+{
+	switch (s) {
+	case source::standard:
+		return true;
+	case source::coarse:
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC_COARSE)
+		return static_cast<bool>(coarse_resolution());
+#else
+		return false;
+#endif
+	case source::tsc:
+#if FZ_HAVE_TSC
+		return tsc().usable_;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+duration monotonic_clock::resolution(source s)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC_COARSE)
+	if (s == source::coarse && coarse_resolution()) {
+		return coarse_resolution();
+	}
+#endif
+#if FZ_HAVE_TSC
+	if (s == source::tsc && tsc().usable_) {
+		return duration::from_microseconds(1);
+	}
+#endif
+	(void)s;
+
+	// Smallest representable unit, rounded up to whole microseconds
+	using period = clock_type::period;
+	int64_t const us = (period::num * 1000000 + period::den - 1) / period::den;
+	return duration::from_microseconds(us > 0 ? us : 1);
+}
+
 }
@@ -61,7 +61,7 @@ bool poller::wait(scoped_lock & l)
 }
 
 // fds must be large enough to hold n+1 entries, but fds[n] must not be filled by caller
-bool poller::wait(struct pollfd *fds, nfds_t n, scoped_lock & l)
+bool poller::wait(struct pollfd *fds, nfds_t n, scoped_lock & l, int timeout)
 {
 #ifdef HAVE_EVENTFD
 	fds[n].fd = event_fd_;
@@ -74,7 +74,7 @@ bool poller::wait(struct pollfd *fds, nfds_t n, scoped_lock & l)
 
 	int res{};
 	do {
-		res = poll(fds, n + 1, -1);
+		res = poll(fds, n + 1, timeout);
 	} while (res == -1 && errno == EINTR);
 
 	l.lock();
@@ -89,7 +89,7 @@ bool poller::wait(struct pollfd *fds, nfds_t n, scoped_lock & l)
 #endif
 		(void)damn_spurious_warning; // We do not care about return value and this is definitely correct!
 	}
-	return res > 0;
+	return res >= 0;
 }
 
 void poller::interrupt(scoped_lock & l)
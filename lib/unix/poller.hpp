@@ -26,7 +26,8 @@ public:
 	bool wait(scoped_lock & l);
 
 	// fds must be large enough to hold n+1 entries, but fds[n] must not be filled by caller
-	bool wait(struct pollfd *fds, nfds_t n, scoped_lock & l);
+	// Returns true as well if the timeout in milliseconds has expired, without any revents set
+	bool wait(struct pollfd *fds, nfds_t n, scoped_lock & l, int timeout = -1);
 
 	void interrupt(scoped_lock & l);
 
@@ -37,7 +37,7 @@ void sleep(duration const& d)
 #else
 	timespec ts{};
 	ts.tv_sec = d.get_seconds();
-	ts.tv_nsec = (d.get_milliseconds() % 1000) * 1000000;
+	ts.tv_nsec = (d.get_microseconds() % 1000000) * 1000;
 	nanosleep(&ts, nullptr);
 #endif
 }
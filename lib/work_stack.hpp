@@ -0,0 +1,118 @@
+#ifndef LIBFILEZILLA_WORK_STACK_HEADER
+#define LIBFILEZILLA_WORK_STACK_HEADER
+
+#include "libfilezilla/mutex.hpp"
+#include "libfilezilla/thread_pool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace fz {
+
+/*
+ * A stack of pending tasks, processed by the thread calling run() and up to
+ * threads - 1 additional workers from a thread pool. Processing a task can add
+ * further tasks, the last one added is processed next.
+ *
+ * If the pool cannot provide a worker, the tasks get processed by the
+ * workers there already are.
+ */
+template<typename Task>
+class work_stack final
+{
+public:
+	// Called without holding the lock. Appends new tasks to the vector.
+	using processor = std::function<void(Task &, std::vector<Task> &)>;
+
+	work_stack(thread_pool & pool, size_t threads, processor const& p)
+		: pool_(pool)
+		, threads_(threads ? threads : 1)
+		, process_(p)
+	{}
+
+	work_stack(work_stack const&) = delete;
+	work_stack& operator=(work_stack const&) = delete;
+
+	// Returns once all tasks have been processed or, after stopping, once all
+	// workers are done. Tasks that have not been started get discarded.
+	void run(Task && root)
+	{
+		{
+			scoped_lock l(mtx_);
+			pending_.push_back(std::move(root));
+			running_ = 1;
+		}
+
+		work();
+
+		std::vector<async_task> workers;
+		std::vector<Task> discarded;
+		{
+			scoped_lock l(mtx_);
+			while (running_) {
+				cond_.wait(l);
+			}
+			workers.swap(workers_);
+			discarded.swap(pending_);
+		}
+	}
+
+	// No further tasks get started
+	void stop() { stop_ = true; }
+	bool stopped() const { return stop_; }
+
+private:
+	void work()
+	{
+		scoped_lock l(mtx_);
+		while (!pending_.empty() && !stop_) {
+			Task t = std::move(pending_.back());
+			pending_.pop_back();
+
+			l.unlock();
+			std::vector<Task> added;
+			process_(t, added);
+			// Whatever the task holds is released outside the lock
+			{
+				Task released = std::move(t);
+			}
+			l.lock();
+
+			for (auto & a : added) {
+				pending_.push_back(std::move(a));
+			}
+
+			while (running_ < threads_ && pending_.size() > 1 && !stop_ && !pool_exhausted_) {
+				// The new worker cannot finish before running_ has been incremented, it needs the lock first
+				async_task worker = pool_.spawn([this]() { work(); });
+				if (!worker) {
+					pool_exhausted_ = true;
+					break;
+				}
+				++running_;
+				workers_.push_back(std::move(worker));
+			}
+		}
+
+		if (!--running_) {
+			cond_.signal(l);
+		}
+	}
+
+	thread_pool & pool_;
+	size_t const threads_;
+	processor const process_;
+
+	mutex mtx_{false};
+	condition cond_;
+	std::vector<Task> pending_;
+	std::vector<async_task> workers_;
+	size_t running_{};
+	bool pool_exhausted_{};
+
+	std::atomic<bool> stop_{};
+};
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include "../lib/libfilezilla/async_file.hpp"
+#include "../lib/libfilezilla/event_loop.hpp"
+
+#include "test_utils.hpp"
+
+#include <functional>
+
+class async_file_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(async_file_test);
+	CPPUNIT_TEST(test_roundtrip);
+	CPPUNIT_TEST(test_seek);
+	CPPUNIT_TEST(test_errors);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() { dir_.create("async_file_test"); }
+	void tearDown() { dir_.remove(); }
+
+	void test_roundtrip();
+	void test_seek();
+	void test_errors();
+
+private:
+	temp_dir dir_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(async_file_test);
+
+namespace {
+struct step_event_type;
+typedef fz::simple_event<step_event_type> step_event;
+
+// Runs steps in the event loop thread, each step is repeated on every async_file_event
+// until it returns true.
+class driver final : public fz::event_handler
+{
+public:
+	driver(fz::event_loop & loop, fz::thread_pool & pool, fz::async_file::options const& opts)
+		: fz::event_handler(loop)
+		, file_(pool, *this, opts)
+	{}
+
+	virtual ~driver()
+	{
+		remove_handler();
+	}
+
+	void run(std::function<bool()> const& step)
+	{
+		fz::scoped_lock l(mtx_);
+		step_ = step;
+		done_ = false;
+		send_event<step_event>();
+		while (!done_) {
+			cond_.wait(l);
+		}
+	}
+
+	fz::async_file::status write(std::string const& data, size_t chunk)
+	{
+		fz::async_file::status result{};
+		size_t pos{};
+		fz::buffer pending;
+		run([&]() {
+			while (true) {
+				if (pending.empty() && pos < data.size()) {
+					size_t const n = std::min(chunk, data.size() - pos);
+					pending.append(data.substr(pos, n));
+					pos += n;
+				}
+				if (!pending.empty()) {
+					result = file_.write(pending);
+					if (result == fz::async_file::status::wait) {
+						return false;
+					}
+					if (result != fz::async_file::status::ok) {
+						return true;
+					}
+					continue;
+				}
+				result = file_.finalize(true);
+				return result != fz::async_file::status::wait;
+			}
+		});
+		return result;
+	}
+
+	// Reads up to limit octets, or until the end of the file
+	fz::async_file::status read(std::string & out, size_t limit = std::string::npos)
+	{
+		fz::async_file::status result{};
+		run([&]() {
+			fz::buffer buf;
+			while (out.size() < limit) {
+				result = file_.read(buf);
+				if (result == fz::async_file::status::wait) {
+					return false;
+				}
+				if (result != fz::async_file::status::ok) {
+					break;
+				}
+				out += buf.to_view();
+				buf.clear();
+			}
+			return true;
+		});
+		return result;
+	}
+
+	fz::async_file file_;
+
+private:
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		if (ev.derived_type() == step_event::type() || ev.derived_type() == fz::async_file_event::type()) {
+			fz::scoped_lock l(mtx_);
+			if (!done_ && step_()) {
+				done_ = true;
+				cond_.signal(l);
+			}
+		}
+	}
+
+	fz::mutex mtx_;
+	fz::condition cond_;
+	std::function<bool()> step_;
+	bool done_{};
+};
+}
+
+void async_file_test::test_roundtrip()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+
+	std::string const data = pattern(100000);
+	auto const name = dir_.path("file");
+
+	for (bool uring : {false, true}) {
+		for (size_t depth : {1, 4}) {
+			for (size_t block : {size_t(4096), size_t(1000), size_t(1000000)}) {
+				fz::async_file::options opts;
+				opts.queue_depth = depth;
+				opts.block_size = block;
+				opts.use_io_uring = uring;
+
+				driver d(loop, pool, opts);
+				CPPUNIT_ASSERT(d.file_.open(name, fz::file::writing, fz::file::empty));
+				ASSERT_EQUAL(fz::async_file::status::ok, d.write(data, 3333));
+				d.file_.close();
+
+				CPPUNIT_ASSERT(d.file_.open(name, fz::file::reading));
+				ASSERT_EQUAL(int64_t(data.size()), d.file_.size());
+				std::string read;
+				ASSERT_EQUAL(fz::async_file::status::eof, d.read(read));
+				CPPUNIT_ASSERT(read == data);
+
+				// Reading past the end keeps reporting the end
+				ASSERT_EQUAL(fz::async_file::status::eof, d.read(read));
+				d.file_.close();
+			}
+		}
+	}
+}
+
+void async_file_test::test_seek()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+
+	std::string const data = pattern(50000);
+	auto const name = dir_.path("file");
+
+	for (bool uring : {false, true}) {
+		fz::async_file::options opts;
+		opts.queue_depth = 3;
+		opts.block_size = 4096;
+		opts.use_io_uring = uring;
+
+		driver d(loop, pool, opts);
+		CPPUNIT_ASSERT(d.file_.open(name, fz::file::writing, fz::file::empty));
+		CPPUNIT_ASSERT(d.file_.seek(10000));
+		ASSERT_EQUAL(fz::async_file::status::ok, d.write(data.substr(10000), 1000));
+
+		CPPUNIT_ASSERT(d.file_.seek(0));
+		ASSERT_EQUAL(fz::async_file::status::ok, d.write(data.substr(0, 10000), 5000));
+		d.file_.close();
+
+		CPPUNIT_ASSERT(d.file_.open(name, fz::file::reading));
+		std::string read;
+		ASSERT_EQUAL(fz::async_file::status::ok, d.read(read, 5000));
+		CPPUNIT_ASSERT(read.size() >= 5000);
+		CPPUNIT_ASSERT(read == data.substr(0, read.size()));
+
+		// Discards the read-ahead
+		CPPUNIT_ASSERT(d.file_.seek(12345));
+		read.clear();
+		ASSERT_EQUAL(fz::async_file::status::eof, d.read(read));
+		CPPUNIT_ASSERT(read == data.substr(12345));
+
+		CPPUNIT_ASSERT(d.file_.seek(0));
+		read.clear();
+		ASSERT_EQUAL(fz::async_file::status::eof, d.read(read));
+		CPPUNIT_ASSERT(read == data);
+		d.file_.close();
+	}
+}
+
+void async_file_test::test_errors()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+
+	driver d(loop, pool, fz::async_file::options());
+	CPPUNIT_ASSERT(!d.file_.open(dir_.path("nonexisting"), fz::file::reading));
+
+	fz::buffer buf;
+	ASSERT_EQUAL(fz::async_file::status::error, d.file_.read(buf));
+
+	buf.append("data");
+	ASSERT_EQUAL(fz::async_file::status::error, d.file_.write(buf));
+	ASSERT_EQUAL(size_t(4), buf.size());
+}
@@ -0,0 +1,310 @@
+#include "../lib/libfilezilla/async_logger.hpp"
+
+#include "test_utils.hpp"
+
+#include <map>
+
+class async_logger_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(async_logger_test);
+	CPPUNIT_TEST(test_threads);
+	CPPUNIT_TEST(test_drop);
+	CPPUNIT_TEST(test_block);
+	CPPUNIT_TEST(test_file_sink);
+	CPPUNIT_TEST(test_deferred);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() { dir_.create("async_logger_test"); }
+	void tearDown() { dir_.remove(); }
+
+	void test_threads();
+	void test_drop();
+	void test_block();
+	void test_file_sink();
+	void test_deferred();
+
+private:
+	temp_dir dir_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(async_logger_test);
+
+namespace {
+class memory_sink final : public fz::log_sink
+{
+public:
+	virtual void write(fz::logmsg::type t, fz::datetime const&, std::wstring_view const& msg) override
+	{
+		fz::scoped_lock l(mtx_);
+		while (blocked_) {
+			cond_.wait(l);
+		}
+		messages_.emplace_back(t, std::wstring(msg));
+	}
+
+	virtual void flush() override
+	{
+		fz::scoped_lock l(mtx_);
+		++flushes_;
+	}
+
+	void block(bool b)
+	{
+		fz::scoped_lock l(mtx_);
+		blocked_ = b;
+		if (!b) {
+			cond_.signal(l);
+		}
+	}
+
+	fz::mutex mtx_;
+	fz::condition cond_;
+	bool blocked_{};
+	std::vector<std::pair<fz::logmsg::type, std::wstring>> messages_;
+	size_t flushes_{};
+};
+}
+
+void async_logger_test::test_threads()
+{
+	memory_sink sink;
+
+	fz::async_logger::options opts;
+	opts.overflow = fz::async_logger::overflow_policy::block;
+	{
+		fz::async_logger logger(sink, opts);
+
+		size_t const thread_count = 4;
+		int const per_thread = 2000;
+
+		std::vector<fz::thread> threads(thread_count);
+		for (size_t i = 0; i < thread_count; ++i) {
+			threads[i].run([&logger, i, per_thread] {
+				for (int j = 0; j < per_thread; ++j) {
+					logger.log(fz::logmsg::status, L"%d %d", i, j);
+				}
+			});
+		}
+		for (auto & t : threads) {
+			t.join();
+		}
+
+		logger.flush();
+
+		fz::scoped_lock l(sink.mtx_);
+		ASSERT_EQUAL(size_t(0), static_cast<size_t>(logger.dropped()));
+		ASSERT_EQUAL(thread_count * per_thread, sink.messages_.size());
+		CPPUNIT_ASSERT(sink.flushes_ > 0);
+
+		// Messages of each thread need to arrive in order
+		std::map<size_t, int> next;
+		for (auto const& m : sink.messages_) {
+			auto const tokens = fz::strtok_view(m.second, L" ");
+			ASSERT_EQUAL(size_t(2), tokens.size());
+			size_t const t = fz::to_integral<size_t>(tokens[0]);
+			int const j = fz::to_integral<int>(tokens[1]);
+			ASSERT_EQUAL(next[t], j);
+			next[t] = j + 1;
+		}
+
+		// Not enabled
+		logger.log(fz::logmsg::debug_debug, L"foo");
+	}
+
+	ASSERT_EQUAL(size_t(8000), sink.messages_.size());
+}
+
+void async_logger_test::test_drop()
+{
+	memory_sink sink;
+	sink.block(true);
+
+	fz::async_logger::options opts;
+	opts.queue_capacity = 4;
+	opts.overflow = fz::async_logger::overflow_policy::drop;
+	{
+		fz::async_logger logger(sink, opts);
+		for (int i = 0; i < 100; ++i) {
+			logger.log(fz::logmsg::error, L"%d", i);
+		}
+		CPPUNIT_ASSERT(logger.dropped() > 0);
+		CPPUNIT_ASSERT(logger.dropped() <= 96);
+
+		sink.block(false);
+		logger.flush();
+
+		fz::scoped_lock l(sink.mtx_);
+		size_t warnings{};
+		for (auto const& m : sink.messages_) {
+			if (m.first == fz::logmsg::debug_warning) {
+				++warnings;
+			}
+		}
+		CPPUNIT_ASSERT(warnings > 0);
+		ASSERT_EQUAL(size_t(100 - logger.dropped()), sink.messages_.size() - warnings);
+	}
+}
+
+void async_logger_test::test_block()
+{
+	memory_sink sink;
+
+	fz::async_logger::options opts;
+	opts.queue_capacity = 2;
+	opts.overflow = fz::async_logger::overflow_policy::block;
+	{
+		fz::async_logger logger(sink, opts);
+
+		fz::thread t;
+		t.run([&logger] {
+			for (int i = 0; i < 1000; ++i) {
+				logger.log(fz::logmsg::status, L"%d", i);
+			}
+		});
+		for (int i = 0; i < 1000; ++i) {
+			logger.log(fz::logmsg::status, L"%d", i);
+		}
+		t.join();
+
+		ASSERT_EQUAL(uint64_t(0), logger.dropped());
+	}
+	ASSERT_EQUAL(size_t(2000), sink.messages_.size());
+}
+
+void async_logger_test::test_file_sink()
+{
+	fz::native_string const name = dir_.path("log");
+	{
+		fz::file_log_sink sink(name, 16);
+		CPPUNIT_ASSERT(sink.opened());
+
+		fz::async_logger logger(sink);
+		logger.log(fz::logmsg::status, "Hello %s", "world");
+		logger.log_raw(fz::logmsg::error, L"\u00e4\u00f6\u00fc");
+	}
+
+	fz::file f(name, fz::file::reading);
+	CPPUNIT_ASSERT(f.opened());
+	char buf[200];
+	int64_t read = f.read(buf, sizeof(buf));
+	f.close();
+
+	CPPUNIT_ASSERT(read > 0);
+	std::string_view const content(buf, static_cast<size_t>(read));
+	auto const lines = fz::strtok_view(content, "\n");
+	ASSERT_EQUAL(size_t(2), lines.size());
+
+	// 2020-01-01T00:00:00.000Z message
+	ASSERT_EQUAL(size_t(24), lines[0].find(' '));
+	ASSERT_EQUAL(std::string("Hello world"), std::string(lines[0].substr(25)));
+	ASSERT_EQUAL(std::string("\xc3\xa4\xc3\xb6\xc3\xbc"), std::string(lines[1].substr(25)));
+}
+
+namespace {
+class deferring_logger final : public fz::logger_interface
+{
+public:
+	deferring_logger()
+	{
+		defer_formatting_ = true;
+	}
+
+	virtual void do_log(fz::logmsg::type, std::wstring && msg) override
+	{
+		immediate_.push_back(std::move(msg));
+	}
+
+	virtual void do_log_deferred(fz::logmsg::type, fz::deferred_message && msg) override
+	{
+		deferred_.push_back(std::move(msg));
+	}
+
+	std::vector<std::wstring> immediate_;
+	std::vector<fz::deferred_message> deferred_;
+};
+
+// Records whether narrow string arguments are in UTF-8
+class utf8_visitor final : public fz::deferred_visitor
+{
+public:
+	virtual void format(std::string_view const&, bool) override {}
+	virtual void format(std::wstring_view const&, bool) override {}
+	virtual void signed_arg(int64_t, size_t) override {}
+	virtual void unsigned_arg(uint64_t, size_t) override {}
+	virtual void floating_arg(double) override {}
+	virtual void pointer_arg(void const*) override {}
+	virtual void string_arg(std::string_view const&, bool utf8) override
+	{
+		utf8_.push_back(utf8);
+	}
+	virtual void string_arg(std::wstring_view const&) override {}
+
+	std::vector<bool> utf8_;
+};
+}
+
+void async_logger_test::test_deferred()
+{
+	deferring_logger logger;
+
+	std::string s = "foo";
+	std::wstring ws = L"bar";
+	std::string const long_string(200, 'x');
+	logger.log(fz::logmsg::status, "%s %s %d %s", s.c_str(), std::wstring_view(ws), 42, std::string_view(s));
+	logger.log(fz::logmsg::status, L"%s|%s", long_string, "baz");
+	logger.log_u(fz::logmsg::status, "%s", "\xc3\xa4");
+	logger.log(fz::logmsg::status, std::string("%d%%"), 5);
+	logger.log_raw(fz::logmsg::status, "raw");
+
+	// The captured arguments must not refer to the originals
+	s = "changed";
+	ws = L"changed";
+
+	ASSERT_EQUAL(size_t(1), logger.immediate_.size());
+	ASSERT_EQUAL(std::wstring(L"raw"), logger.immediate_[0]);
+
+	ASSERT_EQUAL(size_t(4), logger.deferred_.size());
+	auto moved = std::move(logger.deferred_[0]);
+	CPPUNIT_ASSERT(!logger.deferred_[0]);
+	ASSERT_EQUAL(std::wstring(L"foo bar 42 foo"), moved.format());
+	ASSERT_EQUAL(std::wstring(200, 'x') + L"|baz", logger.deferred_[1].format());
+	ASSERT_EQUAL(std::wstring(L"\u00e4"), logger.deferred_[2].format());
+	ASSERT_EQUAL(std::wstring(L"5%"), logger.deferred_[3].format());
+
+	// Only format strings created by fzF are referenced, character arrays can be buffers going out of scope
+	static_assert(std::is_same_v<fz::detail::deferred_format_t<char const(&)[4]>, std::string>);
+	auto const literal = fzF("%d");
+	static_assert(std::is_same_v<fz::detail::deferred_format_t<decltype(literal) const&>, std::string_view>);
+	logger.deferred_.clear();
+	{
+		char fmt[] = "%d apples";
+		logger.log(fz::logmsg::status, fmt, 3);
+		fmt[0] = 'x';
+	}
+	logger.log(fz::logmsg::status, fzF(L"%d pears"), 4);
+	ASSERT_EQUAL(size_t(2), logger.deferred_.size());
+	ASSERT_EQUAL(std::wstring(L"3 apples"), logger.deferred_[0].format());
+	ASSERT_EQUAL(std::wstring(L"4 pears"), logger.deferred_[1].format());
+
+	// Like when formatting right away, log_u does not assume UTF-8 for pointers to mutable characters
+	logger.deferred_.clear();
+	char mutable_arg[] = "mutable";
+	logger.log_u(fz::logmsg::status, "%s %s", static_cast<char*>(mutable_arg), static_cast<char const*>(mutable_arg));
+	ASSERT_EQUAL(size_t(1), logger.deferred_.size());
+	ASSERT_EQUAL(std::wstring(L"mutable mutable"), logger.deferred_[0].format());
+	utf8_visitor visitor;
+	CPPUNIT_ASSERT(logger.deferred_[0].visit(visitor));
+	CPPUNIT_ASSERT(visitor.utf8_ == std::vector<bool>({false, true}));
+
+	// Through the async logger
+	memory_sink sink;
+	{
+		fz::async_logger async(sink);
+		std::string arg = "value";
+		async.log(fz::logmsg::status, "%s=%d", arg, 1);
+		arg.clear();
+	}
+	ASSERT_EQUAL(size_t(1), sink.messages_.size());
+	ASSERT_EQUAL(std::wstring(L"value=1"), sink.messages_[0].second);
+}
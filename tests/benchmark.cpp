@@ -0,0 +1,82 @@
+#include "benchmark.hpp"
+
+#include "../lib/libfilezilla/format.hpp"
+#include "../lib/libfilezilla/time.hpp"
+
+#include <iostream>
+#include <vector>
+
+/*
+ * Runs the registered micro-benchmarks.
+ *
+ * Usage: benchmark [name-prefix]...
+ */
+
+namespace benchmark {
+
+namespace {
+struct entry {
+	std::string name;
+	function f;
+};
+
+std::vector<entry>& entries()
+{
+	static std::vector<entry> e;
+	return e;
+}
+
+volatile size_t sink{};
+
+fz::duration run(function const& f, size_t iterations)
+{
+	auto const start = fz::monotonic_clock::now();
+	f(iterations);
+	return fz::monotonic_clock::now() - start;
+}
+}
+
+registrar::registrar(std::string const& name, function const& f)
+{
+	entries().push_back({name, f});
+}
+
+void consume(size_t v)
+{
+	sink = sink + v;
+}
+}
+
+int main(int argc, char *argv[])
+{
+	auto const selected = [&](std::string const& name) {
+		if (argc < 2) {
+			return true;
+		}
+		for (int i = 1; i < argc; ++i) {
+			if (fz::starts_with(name, std::string(argv[i]))) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	for (auto const& e : benchmark::entries()) {
+		if (!selected(e.name)) {
+			continue;
+		}
+
+		// Scale up the iteration count until a run takes long enough to be meaningful
+		size_t iterations = 1;
+		fz::duration d = benchmark::run(e.f, iterations);
+		while (d < fz::duration::from_milliseconds(200) && iterations < (size_t(1) << 40)) {
+			iterations *= (d < fz::duration::from_milliseconds(20)) ? 10 : 2;
+			d = benchmark::run(e.f, iterations);
+		}
+
+		int64_t const tenth_ns = d.get_milliseconds() * 10000000 / static_cast<int64_t>(iterations);
+		std::cout << fz::sprintf("%-40s %12d iterations %10d.%d ns/iteration", e.name, iterations, tenth_ns / 10, tenth_ns % 10) << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef LIBFILEZILLA_TEST_BENCHMARK_HEADER
+#define LIBFILEZILLA_TEST_BENCHMARK_HEADER
+
+#include <functional>
+#include <string>
+
+/*
+ * Minimal micro-benchmark harness. Benchmarks register themselves using
+ * static registrars and are run by the benchmark program, optionally
+ * filtered by name prefixes given on the command line.
+ */
+
+namespace benchmark {
+
+// The function gets passed the number of iterations it should run.
+using function = std::function<void(size_t)>;
+
+struct registrar final
+{
+	registrar(std::string const& name, function const& f);
+};
+
+// Prevents the compiler from optimizing away results
+void consume(size_t v);
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "benchmark.hpp"
+
+#include "../lib/libfilezilla/event_handler.hpp"
+#include "../lib/libfilezilla/event_loop.hpp"
+
+/*
+ * Measures how long a 200 microsecond one-shot timer takes to fire, waiting
+ * on the condition variable against high-resolution timers. Each timer is
+ * re-armed from the handler. The closer to 200000 ns per iteration, the more
+ * accurate.
+ */
+
+namespace {
+
+class oneshot_handler final : public fz::event_handler
+{
+public:
+	explicit oneshot_handler(fz::event_loop & l)
+	: fz::event_handler(l)
+	{}
+
+	virtual ~oneshot_handler()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const&) override
+	{
+		if (--remaining_) {
+			add_timer(fz::duration::from_microseconds(200), true);
+		}
+		else {
+			fz::scoped_lock l(m_);
+			done_ = true;
+			cond_.signal(l);
+		}
+	}
+
+	void run(size_t n)
+	{
+		fz::scoped_lock l(m_);
+		remaining_ = n;
+		add_timer(fz::duration::from_microseconds(200), true);
+		while (!done_) {
+			cond_.wait(l);
+		}
+	}
+
+	fz::mutex m_;
+	fz::condition cond_;
+	size_t remaining_{};
+	bool done_{};
+};
+
+void run_timers(size_t n, bool hires)
+{
+	fz::event_loop loop;
+	loop.set_high_resolution_timers(hires);
+	oneshot_handler h(loop);
+	h.run(n);
+}
+
+benchmark::registrar timer_condition("eventloop/timer_200us/condition", [](size_t n) {
+	run_timers(n, false);
+});
+
+benchmark::registrar timer_hires("eventloop/timer_200us/high_resolution", [](size_t n) {
+	run_timers(n, true);
+});
+
+}
@@ -0,0 +1,532 @@
+#include "benchmark.hpp"
+
+#include "../lib/libfilezilla/aligned_buffer.hpp"
+#include "../lib/libfilezilla/async_file.hpp"
+#include "../lib/libfilezilla/directory_cache.hpp"
+#include "../lib/libfilezilla/directory_walker.hpp"
+#include "../lib/libfilezilla/event_loop.hpp"
+#include "../lib/libfilezilla/format.hpp"
+#include "../lib/libfilezilla/local_filesys.hpp"
+#include "../lib/libfilezilla/mapped_file.hpp"
+#include "../lib/libfilezilla/util.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Reads and writes 64 KiB blocks, blocking with fz::file against async_file
+ * driven by an event handler, using the thread pool and io_uring with
+ * different queue depths. Each iteration is one block. The file is small
+ * enough to stay in the page cache, so this mostly measures the overhead of
+ * submitting requests and of delivering completions.
+ *
+ * Also compares writing 16 scattered 4 KiB chunks using one call to
+ * file::write_at each against a single vectored write_at.
+ *
+ * Compares checksumming a file read into a buffer against checksumming a
+ * mapped_file view, one block per iteration.
+ *
+ * Compares copying the 16 MiB file through a userspace buffer against
+ * fz::copy_file, one file per iteration.
+ *
+ * Finally, compares buffered against direct I/O writing and reading 1 MiB
+ * blocks of a 64 MiB file, one block per iteration. Writes are flushed to
+ * disk at the end so that buffered writes are not merely copied into the
+ * page cache. Buffered reads are served from the cache.
+ *
+ * Lists a directory with 20000 files, entry by entry against batched, each
+ * with metadata and with names and types only. One listing per iteration,
+ * the directory is created once and shared by these benchmarks. Also lists
+ * it through a directory_cache, which only the first iteration misses.
+ *
+ * Walks a tree of 100 directories with 100 files each using directory_walker
+ * with one and with eight threads, one walk per iteration.
+ */
+
+namespace {
+
+size_t const block_size = 64 * 1024;
+size_t const file_blocks = 256;
+
+fz::native_string temp_name()
+{
+	return fz::to_native(fz::sprintf("benchmark_file_%d.tmp", fz::random_number(0, 1000000000)));
+}
+
+class test_file final
+{
+public:
+	test_file()
+		: name_(temp_name())
+	{
+		fz::file f(name_, fz::file::writing, fz::file::empty);
+		std::string const block(block_size, 'x');
+		for (size_t i = 0; i < file_blocks; ++i) {
+			f.write(block.c_str(), static_cast<int64_t>(block.size()));
+		}
+	}
+
+	~test_file()
+	{
+		fz::remove_file(name_);
+	}
+
+	fz::native_string const name_;
+};
+
+class async_driver final : public fz::event_handler
+{
+public:
+	async_driver(fz::event_loop & loop, fz::thread_pool & pool, size_t depth, bool uring)
+		: fz::event_handler(loop)
+		, file_(pool, *this, options(depth, uring))
+	{}
+
+	virtual ~async_driver()
+	{
+		remove_handler();
+	}
+
+	void run(size_t n, fz::file::mode m)
+	{
+		fz::scoped_lock l(mtx_);
+		remaining_ = n;
+		mode_ = m;
+		data_.clear();
+		send_event<fz::async_file_event>(&file_);
+		while (remaining_) {
+			cond_.wait(l);
+		}
+	}
+
+	fz::async_file file_;
+
+private:
+	static fz::async_file::options options(size_t depth, bool uring)
+	{
+		fz::async_file::options opts;
+		opts.queue_depth = depth;
+		opts.block_size = block_size;
+		opts.use_io_uring = uring;
+		return opts;
+	}
+
+	virtual void operator()(fz::event_base const&) override
+	{
+		fz::scoped_lock l(mtx_);
+		while (remaining_) {
+			fz::async_file::status s;
+			if (mode_ == fz::file::reading) {
+				s = file_.read(data_);
+				if (s == fz::async_file::status::eof) {
+					file_.seek(0);
+					continue;
+				}
+				benchmark::consume(data_.size());
+				data_.clear();
+			}
+			else {
+				if (data_.empty()) {
+					data_.append(block_size, 'x');
+				}
+				s = file_.write(data_);
+				if (s == fz::async_file::status::ok && !(remaining_ % file_blocks)) {
+					file_.seek(0);
+				}
+			}
+			if (s == fz::async_file::status::wait) {
+				return;
+			}
+			if (s != fz::async_file::status::ok) {
+				abort();
+			}
+			--remaining_;
+		}
+		cond_.signal(l);
+	}
+
+	fz::mutex mtx_;
+	fz::condition cond_;
+	size_t remaining_{};
+	fz::file::mode mode_{};
+	fz::buffer data_;
+};
+
+void run_sync(size_t n, fz::file::mode m)
+{
+	test_file t;
+	fz::file f(t.name_, m);
+	std::string block(block_size, 'x');
+	for (size_t i = 0; i < n; ++i) {
+		int64_t res;
+		if (m == fz::file::reading) {
+			res = f.read(block.data(), static_cast<int64_t>(block.size()));
+		}
+		else {
+			res = f.write(block.c_str(), static_cast<int64_t>(block.size()));
+		}
+		benchmark::consume(static_cast<size_t>(res));
+		if (!((i + 1) % file_blocks)) {
+			f.seek(0, fz::file::begin);
+		}
+	}
+}
+
+void run_async(size_t n, fz::file::mode m, size_t depth, bool uring)
+{
+	test_file t;
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	async_driver d(loop, pool, depth, uring);
+	d.file_.open(t.name_, m);
+	d.run(n, m);
+	d.file_.close();
+}
+
+benchmark::registrar read_sync("file/read_sync", [](size_t n) {
+	run_sync(n, fz::file::reading);
+});
+
+benchmark::registrar read_pool1("file/read_async_pool_qd1", [](size_t n) {
+	run_async(n, fz::file::reading, 1, false);
+});
+
+benchmark::registrar read_pool4("file/read_async_pool_qd4", [](size_t n) {
+	run_async(n, fz::file::reading, 4, false);
+});
+
+benchmark::registrar read_uring4("file/read_async_uring_qd4", [](size_t n) {
+	run_async(n, fz::file::reading, 4, true);
+});
+
+benchmark::registrar write_sync("file/write_sync", [](size_t n) {
+	run_sync(n, fz::file::writing);
+});
+
+benchmark::registrar write_pool4("file/write_async_pool_qd4", [](size_t n) {
+	run_async(n, fz::file::writing, 4, false);
+});
+
+benchmark::registrar write_uring4("file/write_async_uring_qd4", [](size_t n) {
+	run_async(n, fz::file::writing, 4, true);
+});
+
+size_t const segment_count = 16;
+size_t const segment_size = 4096;
+
+void run_segments(size_t n, bool vectored)
+{
+	test_file t;
+	fz::file f(t.name_, fz::file::writing);
+
+	std::vector<std::string> chunks(segment_count, std::string(segment_size, 'y'));
+	std::vector<fz::file::const_segment> segments;
+	for (auto const& c : chunks) {
+		segments.push_back({c.c_str(), c.size()});
+	}
+
+	int64_t const span = static_cast<int64_t>(segment_count * segment_size);
+	for (size_t i = 0; i < n; ++i) {
+		int64_t const offset = static_cast<int64_t>(i % (file_blocks * block_size / span)) * span;
+		if (vectored) {
+			benchmark::consume(static_cast<size_t>(f.write_at(offset, segments.data(), segments.size())));
+		}
+		else {
+			for (size_t j = 0; j < segment_count; ++j) {
+				benchmark::consume(static_cast<size_t>(f.write_at(offset + static_cast<int64_t>(j * segment_size), chunks[j].c_str(), static_cast<int64_t>(segment_size))));
+			}
+		}
+	}
+}
+
+benchmark::registrar write_at_loop("file/write_at_loop16", [](size_t n) {
+	run_segments(n, false);
+});
+
+benchmark::registrar write_at_vectored("file/write_at_vectored16", [](size_t n) {
+	run_segments(n, true);
+});
+
+size_t checksum(uint8_t const* p, size_t size)
+{
+	size_t sum{};
+	for (size_t i = 0; i < size; ++i) {
+		sum += p[i];
+	}
+	return sum;
+}
+
+benchmark::registrar checksum_read("file/checksum_read", [](size_t n) {
+	test_file t;
+	fz::file f(t.name_, fz::file::reading);
+	std::vector<uint8_t> block(block_size);
+	for (size_t i = 0; i < n; ++i) {
+		int64_t const offset = static_cast<int64_t>((i % file_blocks) * block_size);
+		int64_t const res = f.read_at(offset, block.data(), static_cast<int64_t>(block.size()));
+		benchmark::consume(checksum(block.data(), static_cast<size_t>(res)));
+	}
+});
+
+benchmark::registrar checksum_mapped("file/checksum_mapped", [](size_t n) {
+	test_file t;
+	fz::mapped_file f;
+	f.open(t.name_);
+	f.advise(fz::mapped_file::advice::sequential);
+	for (size_t i = 0; i < n; ++i) {
+		int64_t const offset = static_cast<int64_t>((i % file_blocks) * block_size);
+		auto const v = f.view(offset, block_size);
+		benchmark::consume(checksum(v.data(), v.size()));
+	}
+});
+
+benchmark::registrar copy_buffered("file/copy_buffered", [](size_t n) {
+	test_file t;
+	auto const dest = temp_name();
+	for (size_t i = 0; i < n; ++i) {
+		fz::file in(t.name_, fz::file::reading);
+		fz::file out(dest, fz::file::writing, fz::file::empty);
+		std::vector<uint8_t> buf(64 * 1024);
+		int64_t r;
+		while ((r = in.read(buf.data(), static_cast<int64_t>(buf.size()))) > 0) {
+			out.write(buf.data(), r);
+		}
+	}
+	fz::remove_file(dest);
+});
+
+benchmark::registrar copy_file("file/copy_file", [](size_t n) {
+	test_file t;
+	auto const dest = temp_name();
+	for (size_t i = 0; i < n; ++i) {
+		fz::copy_file(t.name_, dest);
+	}
+	fz::remove_file(dest);
+});
+
+size_t const direct_block_size = 1024 * 1024;
+size_t const direct_blocks = 64;
+
+void run_direct(size_t n, fz::file::mode m, bool direct)
+{
+	auto const name = temp_name();
+	fz::aligned_buffer buf(direct_block_size);
+	memset(buf.data(), 'd', buf.capacity());
+
+	fz::file::creation_flags flags = fz::file::empty;
+	if (direct) {
+		flags = flags | fz::file::direct;
+	}
+	fz::file f(name, fz::file::writing, flags);
+	if (m == fz::file::reading) {
+		for (size_t i = 0; i < direct_blocks; ++i) {
+			f.write(buf.data(), static_cast<int64_t>(buf.capacity()));
+		}
+		f.fsync();
+		f.open(name, fz::file::reading, direct ? fz::file::direct : fz::file::existing);
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		int64_t const offset = static_cast<int64_t>((i % direct_blocks) * direct_block_size);
+		if (m == fz::file::reading) {
+			benchmark::consume(static_cast<size_t>(f.read_at(offset, buf.data(), static_cast<int64_t>(buf.capacity()))));
+		}
+		else {
+			benchmark::consume(static_cast<size_t>(f.write_at(offset, buf.data(), static_cast<int64_t>(buf.capacity()))));
+		}
+	}
+	if (m == fz::file::writing) {
+		f.fsync();
+	}
+
+	f.close();
+	fz::remove_file(name);
+}
+
+benchmark::registrar write_buffered("file/write_buffered_1m", [](size_t n) {
+	run_direct(n, fz::file::writing, false);
+});
+
+benchmark::registrar write_direct("file/write_direct_1m", [](size_t n) {
+	run_direct(n, fz::file::writing, true);
+});
+
+benchmark::registrar read_buffered("file/read_buffered_1m", [](size_t n) {
+	run_direct(n, fz::file::reading, false);
+});
+
+benchmark::registrar read_direct("file/read_direct_1m", [](size_t n) {
+	run_direct(n, fz::file::reading, true);
+});
+
+#ifndef FZ_WINDOWS
+size_t const listing_files = 20000;
+
+class test_dir final
+{
+public:
+	test_dir()
+		: name_(temp_name())
+	{
+		::mkdir(name_.c_str(), 0700);
+		for (size_t i = 0; i < listing_files; ++i) {
+			fz::file f(name_ + fz::sprintf("/%d", i), fz::file::writing);
+		}
+	}
+
+	~test_dir()
+	{
+		for (size_t i = 0; i < listing_files; ++i) {
+			fz::remove_file(name_ + fz::sprintf("/%d", i));
+		}
+		::rmdir(name_.c_str());
+	}
+
+	fz::native_string const name_;
+};
+
+// Creating the files takes far longer than listing them, share them between runs
+test_dir const& shared_dir()
+{
+	static test_dir d;
+	return d;
+}
+
+void run_listing(size_t n, bool batched, bool metadata)
+{
+	auto const& d = shared_dir();
+	fz::local_filesys fs;
+	fz::local_filesys::entries entries;
+	fz::native_string name;
+	bool is_link{};
+	fz::local_filesys::type t{};
+	int64_t size{};
+	fz::datetime mtime;
+	int mode{};
+	for (size_t i = 0; i < n; ++i) {
+		size_t count{};
+		fs.begin_find_files(d.name_, false, true);
+		if (batched) {
+			while (fs.get_next_files(entries, metadata)) {
+				count += entries.size();
+			}
+		}
+		else if (metadata) {
+			while (fs.get_next_file(name, is_link, t, &size, &mtime, &mode)) {
+				++count;
+			}
+		}
+		else {
+			while (fs.get_next_file(name)) {
+				++count;
+			}
+		}
+		benchmark::consume(count);
+	}
+}
+
+// Not a real benchmark, creates the shared directory ahead of the timed listings
+benchmark::registrar list_prepare("file/list_prepare", [](size_t n) {
+	run_listing(0, false, false);
+	benchmark::consume(n);
+});
+
+benchmark::registrar list_single("file/list_single", [](size_t n) {
+	run_listing(n, false, true);
+});
+
+benchmark::registrar list_batched("file/list_batched", [](size_t n) {
+	run_listing(n, true, true);
+});
+
+benchmark::registrar list_single_names("file/list_single_names", [](size_t n) {
+	run_listing(n, false, false);
+});
+
+benchmark::registrar list_batched_names("file/list_batched_names", [](size_t n) {
+	run_listing(n, true, false);
+});
+
+benchmark::registrar list_cached("file/list_cached", [](size_t n) {
+	auto const& d = shared_dir();
+	fz::directory_cache cache;
+	fz::directory_cache::listing l;
+	for (size_t i = 0; i < n; ++i) {
+		cache.get(d.name_, l);
+		benchmark::consume(l->size());
+	}
+});
+
+size_t const tree_dirs = 100;
+size_t const tree_files = 100;
+
+class test_tree final
+{
+public:
+	test_tree()
+		: name_(temp_name())
+	{
+		::mkdir(name_.c_str(), 0700);
+		for (size_t i = 0; i < tree_dirs; ++i) {
+			auto const dir = name_ + fz::sprintf("/%d", i);
+			::mkdir(dir.c_str(), 0700);
+			for (size_t j = 0; j < tree_files; ++j) {
+				fz::file f(dir + fz::sprintf("/%d", j), fz::file::writing);
+			}
+		}
+	}
+
+	~test_tree()
+	{
+		for (size_t i = 0; i < tree_dirs; ++i) {
+			auto const dir = name_ + fz::sprintf("/%d", i);
+			for (size_t j = 0; j < tree_files; ++j) {
+				fz::remove_file(dir + fz::sprintf("/%d", j));
+			}
+			::rmdir(dir.c_str());
+		}
+		::rmdir(name_.c_str());
+	}
+
+	fz::native_string const name_;
+};
+
+void run_walk(size_t n, size_t threads)
+{
+	static test_tree t;
+
+	fz::thread_pool pool;
+	fz::directory_walker::options opts;
+	opts.threads = threads;
+	fz::directory_walker w(pool, opts);
+	for (size_t i = 0; i < n; ++i) {
+		size_t count{};
+		w.walk(t.name_, [&count](fz::directory_walker::entry const&) {
+			++count;
+			return true;
+		});
+		benchmark::consume(count);
+	}
+}
+
+// Not a real benchmark, creates the shared tree ahead of the timed walks
+benchmark::registrar walk_prepare("file/walk_prepare", [](size_t n) {
+	run_walk(0, 1);
+	benchmark::consume(n);
+});
+
+benchmark::registrar walk1("file/walk_threads1", [](size_t n) {
+	run_walk(n, 1);
+});
+
+benchmark::registrar walk8("file/walk_threads8", [](size_t n) {
+	run_walk(n, 8);
+});
+#endif
+
+}
@@ -0,0 +1,91 @@
+#include "benchmark.hpp"
+
+#include "../lib/libfilezilla/format.hpp"
+
+/*
+ * Compares runtime-parsed format strings against format strings parsed
+ * at compile-time.
+ */
+
+namespace {
+
+benchmark::registrar literal_runtime("format/literal/runtime", [](size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf("No arguments at all, just a literal string").size());
+	}
+});
+
+benchmark::registrar literal_compiled("format/literal/compiled", [](size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf(fzF("No arguments at all, just a literal string")).size());
+	}
+});
+
+benchmark::registrar mixed_runtime("format/mixed/runtime", [](size_t n) {
+	std::string const name = "example.txt";
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf("Transferred %d bytes of \"%s\" in %d ms (%d%%)", i * 1000, name, i % 1000, i % 100).size());
+	}
+});
+
+benchmark::registrar mixed_compiled("format/mixed/compiled", [](size_t n) {
+	std::string const name = "example.txt";
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf(fzF("Transferred %d bytes of \"%s\" in %d ms (%d%%)"), i * 1000, name, i % 1000, i % 100).size());
+	}
+});
+
+benchmark::registrar positional_runtime("format/positional/runtime", [](size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf("%3$08x %2$s %1$-6d|", int(i), "foo", i).size());
+	}
+});
+
+benchmark::registrar positional_compiled("format/positional/compiled", [](size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf(fzF("%3$08x %2$s %1$-6d|"), int(i), "foo", i).size());
+	}
+});
+
+benchmark::registrar wide_runtime("format/wide/runtime", [](size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf(L"Item %d of %d: %s", i, n, L"value").size());
+	}
+});
+
+benchmark::registrar wide_compiled("format/wide/compiled", [](size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(fz::sprintf(fzF(L"Item %d of %d: %s"), i, n, L"value").size());
+	}
+});
+
+benchmark::registrar reply_sprintf("format/reply/sprintf", [](size_t n) {
+	std::string reply;
+	for (size_t i = 0; i < n; ++i) {
+		reply = fz::sprintf("213 %d\r\n", i * 4096);
+		reply += fz::sprintf("226 Transfer of %s complete (%d bytes)\r\n", "example.txt", i);
+		benchmark::consume(reply.size());
+	}
+});
+
+benchmark::registrar reply_sprintf_to("format/reply/sprintf_to", [](size_t n) {
+	std::string reply;
+	for (size_t i = 0; i < n; ++i) {
+		reply.clear();
+		fz::sprintf_to(reply, "213 %d\r\n", i * 4096);
+		fz::sprintf_to(reply, "226 Transfer of %s complete (%d bytes)\r\n", "example.txt", i);
+		benchmark::consume(reply.size());
+	}
+});
+
+benchmark::registrar reply_sprintf_to_compiled("format/reply/sprintf_to_compiled", [](size_t n) {
+	fz::buffer reply;
+	for (size_t i = 0; i < n; ++i) {
+		reply.clear();
+		fz::sprintf_to(reply, fzF("213 %d\r\n"), i * 4096);
+		fz::sprintf_to(reply, fzF("226 Transfer of %s complete (%d bytes)\r\n"), "example.txt", i);
+		benchmark::consume(reply.size());
+	}
+});
+
+}
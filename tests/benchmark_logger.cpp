@@ -0,0 +1,80 @@
+#include "benchmark.hpp"
+
+#include "../lib/libfilezilla/async_logger.hpp"
+#include "../lib/libfilezilla/binary_log.hpp"
+#include "../lib/libfilezilla/util.hpp"
+
+/*
+ * Compares the cost on the logging thread of a synchronous logger writing
+ * each message to a file under a mutex against the async_logger, with and
+ * without deferred formatting, and the text sink against the binary sink.
+ */
+
+namespace {
+
+fz::native_string temp_name()
+{
+	return fz::to_native(fz::sprintf("benchmark_logger_%d.log", fz::random_number(0, 1000000000)));
+}
+
+class sync_file_logger final : public fz::logger_interface
+{
+public:
+	explicit sync_file_logger(fz::native_string const& name)
+		: file_(name, fz::file::writing, fz::file::empty)
+	{}
+
+	virtual void do_log(fz::logmsg::type, std::wstring && msg) override
+	{
+		std::string line = fz::to_utf8(msg);
+		line += '\n';
+		fz::scoped_lock l(mtx_);
+		file_.write(line.c_str(), static_cast<int64_t>(line.size()));
+	}
+
+private:
+	fz::mutex mtx_;
+	fz::file file_;
+};
+
+benchmark::registrar sync_logger("logger/sync_file", [](size_t n) {
+	auto const name = temp_name();
+	{
+		sync_file_logger logger(name);
+		for (size_t i = 0; i < n; ++i) {
+			logger.log(fz::logmsg::status, L"Message %d with some payload: %s", i, "example.txt");
+		}
+	}
+	fz::remove_file(name);
+});
+
+template<typename Sink = fz::file_log_sink>
+void run_async(size_t n, bool defer)
+{
+	auto const name = temp_name();
+	{
+		Sink sink(name);
+		fz::async_logger::options opts;
+		opts.overflow = fz::async_logger::overflow_policy::block;
+		opts.defer_formatting = defer;
+		fz::async_logger logger(sink, opts);
+		for (size_t i = 0; i < n; ++i) {
+			logger.log(fz::logmsg::status, L"Message %d with some payload: %s", i, "example.txt");
+		}
+	}
+	fz::remove_file(name);
+}
+
+benchmark::registrar async_logger("logger/async_file", [](size_t n) {
+	run_async(n, false);
+});
+
+benchmark::registrar async_logger_deferred("logger/async_file_deferred", [](size_t n) {
+	run_async(n, true);
+});
+
+benchmark::registrar async_logger_binary("logger/async_binary", [](size_t n) {
+	run_async<fz::binary_log_sink>(n, true);
+});
+
+}
@@ -0,0 +1,64 @@
+#include "benchmark.hpp"
+
+#include "../lib/libfilezilla/process.hpp"
+
+#include <vector>
+
+/*
+ * Measures the latency of spawning a short-lived process and waiting for it
+ * to exit, with the resident set of the benchmark process grown to 0, 256 MiB
+ * and 1 GiB. Creating the child must not copy the page tables of the parent,
+ * or spawning becomes slower the more memory the parent uses.
+ *
+ * One process per iteration, which is waited for until it has closed its
+ * standard output.
+ */
+
+#ifndef FZ_WINDOWS
+namespace {
+
+std::vector<char> ballast;
+
+// Not a real benchmark, grows the resident set ahead of the timed spawns
+void grow(size_t mib, size_t n)
+{
+	// Every page gets touched
+	ballast.resize(mib * 1024 * 1024, 1);
+	benchmark::consume(n);
+}
+
+void run_spawn(size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		fz::process p;
+		if (p.spawn(fz::native_string("/bin/true"))) {
+			// Wait for the child to exit, its end of the pipe gets closed
+			char c;
+			benchmark::consume(p.read(&c, 1).value_);
+		}
+		p.kill();
+	}
+}
+
+benchmark::registrar spawn_rss0("process/spawn_rss_0", [](size_t n) {
+	run_spawn(n);
+});
+
+benchmark::registrar grow256("process/grow_256m", [](size_t n) {
+	grow(256, n);
+});
+
+benchmark::registrar spawn_rss256("process/spawn_rss_256m", [](size_t n) {
+	run_spawn(n);
+});
+
+benchmark::registrar grow1024("process/grow_1g", [](size_t n) {
+	grow(1024, n);
+});
+
+benchmark::registrar spawn_rss1024("process/spawn_rss_1g", [](size_t n) {
+	run_spawn(n);
+});
+
+}
+#endif
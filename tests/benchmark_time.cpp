@@ -0,0 +1,101 @@
+#include "benchmark.hpp"
+
+#include "../lib/libfilezilla/time.hpp"
+
+/*
+ * Compares strftime-based datetime::format against timestamp_formatter,
+ * with timestamps advancing by a millisecond per iteration like log
+ * messages do, and the cost of reading the different clock sources.
+ */
+
+namespace {
+
+fz::datetime const start(fz::datetime::utc, 2020, 3, 2, 12, 35, 0, 0);
+
+benchmark::registrar iso_strftime("time/iso8601/strftime", [](size_t n) {
+	fz::datetime t = start;
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(t.format("%Y-%m-%dT%H:%M:%S", fz::datetime::utc).size());
+		t += fz::duration::from_milliseconds(1);
+	}
+});
+
+benchmark::registrar iso_formatter("time/iso8601/formatter", [](size_t n) {
+	fz::timestamp_formatter f;
+	char buf[fz::timestamp_formatter::max_size];
+	fz::datetime t = start;
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(f.iso8601(buf, t, fz::datetime::utc));
+		t += fz::duration::from_milliseconds(1);
+	}
+});
+
+benchmark::registrar iso_local_strftime("time/iso8601_local/strftime", [](size_t n) {
+	fz::datetime t = start;
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(t.format("%Y-%m-%dT%H:%M:%S%z", fz::datetime::local).size());
+		t += fz::duration::from_milliseconds(1);
+	}
+});
+
+benchmark::registrar iso_local_formatter("time/iso8601_local/formatter", [](size_t n) {
+	fz::timestamp_formatter f;
+	char buf[fz::timestamp_formatter::max_size];
+	fz::datetime t = start;
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(f.iso8601(buf, t, fz::datetime::local));
+		t += fz::duration::from_milliseconds(1);
+	}
+});
+
+// Directory listings have mostly distinct timestamps, no cache hits
+benchmark::registrar listing_strftime("time/listing/strftime", [](size_t n) {
+	fz::datetime const now = start;
+	fz::datetime t = start;
+	for (size_t i = 0; i < n; ++i) {
+		bool const recent = (now - t).get_days() < 182;
+		benchmark::consume(t.format(recent ? "%b %e %H:%M" : "%b %e  %Y", fz::datetime::local).size());
+		t -= fz::duration::from_seconds(7919);
+	}
+});
+
+benchmark::registrar listing_formatter("time/listing/formatter", [](size_t n) {
+	fz::timestamp_formatter f;
+	char buf[fz::timestamp_formatter::max_size];
+	fz::datetime const now = start;
+	fz::datetime t = start;
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(f.listing(buf, t, fz::datetime::local, now));
+		t -= fz::duration::from_seconds(7919);
+	}
+});
+
+benchmark::registrar rfc822("time/rfc822", [](size_t n) {
+	fz::datetime t = start;
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(t.get_rfc822().size());
+		t += fz::duration::from_seconds(1);
+	}
+});
+
+void read_clock(size_t n, fz::monotonic_clock::source s)
+{
+	auto const start = fz::monotonic_clock::now(s);
+	for (size_t i = 0; i < n; ++i) {
+		benchmark::consume(static_cast<size_t>((fz::monotonic_clock::now(s) - start).get_microseconds()));
+	}
+}
+
+benchmark::registrar clock_standard("time/clock/standard", [](size_t n) {
+	read_clock(n, fz::monotonic_clock::source::standard);
+});
+
+benchmark::registrar clock_coarse("time/clock/coarse", [](size_t n) {
+	read_clock(n, fz::monotonic_clock::source::coarse);
+});
+
+benchmark::registrar clock_tsc("time/clock/tsc", [](size_t n) {
+	read_clock(n, fz::monotonic_clock::source::tsc);
+});
+
+}
@@ -0,0 +1,196 @@
+#include "../lib/libfilezilla/binary_log.hpp"
+#include "../lib/libfilezilla/local_filesys.hpp"
+
+#include "test_utils.hpp"
+
+#include <string.h>
+
+class binary_log_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(binary_log_test);
+	CPPUNIT_TEST(test_roundtrip);
+	CPPUNIT_TEST(test_truncated);
+	CPPUNIT_TEST(test_append);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() { dir_.create("binary_log_test"); }
+	void tearDown() { dir_.remove(); }
+
+	void test_roundtrip();
+	void test_truncated();
+	void test_append();
+
+private:
+	temp_dir dir_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(binary_log_test);
+
+namespace {
+void log_messages(fz::logger_interface & logger)
+{
+	std::string s = "foo";
+	std::string const fmt = "%s-%d";
+	for (int i = 0; i < 3; ++i) {
+		logger.log(fz::logmsg::status, "%d %u %s", i, 42u, s);
+	}
+	logger.log(fz::logmsg::error, L"%s|%s|%x|%X|%c", L"wide", "narrow", -1, uint8_t(255), 'c');
+	logger.log(fz::logmsg::command, "%5d|%-5d|%05d|%+d|%%", int64_t(-3), int16_t(-4), uint64_t(7), 8);
+	logger.log(fz::logmsg::reply, "%p %p", static_cast<void*>(nullptr), reinterpret_cast<void*>(0x1234));
+	logger.log(fz::logmsg::debug_info, fmt, "bar", 5);
+	logger.log(fz::logmsg::debug_info, fmt, "baz", 6);
+	logger.log_u(fz::logmsg::status, "%s", "\xc3\xa4\xc3\xb6\xc3\xbc");
+	logger.log(fz::logmsg::status, "%2$s %1$s %s", "a", std::wstring(L"b"));
+	logger.log(fz::logmsg::status, "%s", 1.5);
+
+	// Constant arrays at the same address with different content
+	for (char const* f : {"first %d", "second %d"}) {
+		char buf[16]{};
+		strcpy(buf, f);
+		char const (&cbuf)[16] = buf;
+		logger.log(fz::logmsg::status, cbuf, 7);
+	}
+	for (int i = 0; i < 2; ++i) {
+		logger.log(fz::logmsg::status, fzF("literal %d"), i);
+	}
+	logger.log_raw(fz::logmsg::debug_warning, L"raw ä");
+}
+}
+
+void binary_log_test::test_roundtrip()
+{
+	fz::native_string const name = dir_.path("log");
+
+	// Reference output without deferred formatting
+	std::vector<std::pair<fz::logmsg::type, std::wstring>> expected;
+	{
+		class recorder final : public fz::logger_interface
+		{
+		public:
+			recorder(decltype(expected) & out) : out_(out) {}
+
+			virtual void do_log(fz::logmsg::type t, std::wstring && msg) override
+			{
+				out_.emplace_back(t, std::move(msg));
+			}
+
+			decltype(expected) & out_;
+		} r(expected);
+		log_messages(r);
+	}
+
+	{
+		fz::binary_log_sink sink(name, 16);
+		CPPUNIT_ASSERT(sink.opened());
+
+		fz::async_logger logger(sink);
+		log_messages(logger);
+	}
+
+	{
+		fz::binary_log_reader reader(name);
+		CPPUNIT_ASSERT(reader.opened());
+
+		fz::datetime const now = fz::datetime::now();
+
+		fz::logmsg::type t;
+		fz::datetime time;
+		std::wstring msg;
+		size_t i{};
+		while (reader.read(t, time, msg)) {
+			CPPUNIT_ASSERT(i < expected.size());
+			ASSERT_EQUAL(expected[i].first, t);
+			ASSERT_EQUAL(expected[i].second, msg);
+			CPPUNIT_ASSERT(time <= now);
+			CPPUNIT_ASSERT(time + fz::duration::from_minutes(1) > now);
+			++i;
+		}
+		CPPUNIT_ASSERT(!reader.error());
+		ASSERT_EQUAL(expected.size(), i);
+	}
+
+	// Compared to a text log, format strings and arguments are stored compactly
+	CPPUNIT_ASSERT(fz::local_filesys::get_size(name) < 400);
+}
+
+void binary_log_test::test_truncated()
+{
+	fz::native_string const name = dir_.path("log");
+	{
+		fz::binary_log_sink sink(name);
+		fz::async_logger logger(sink);
+		logger.log(fz::logmsg::status, "first %d", 1);
+		logger.log(fz::logmsg::status, "second %s", std::string(100, 'x'));
+	}
+
+	int64_t const size = fz::local_filesys::get_size(name);
+	CPPUNIT_ASSERT(size > 0);
+	{
+		fz::file f(name, fz::file::writing, fz::file::existing);
+		CPPUNIT_ASSERT(f.opened());
+		CPPUNIT_ASSERT(f.seek(size - 10, fz::file::begin) == size - 10);
+		CPPUNIT_ASSERT(f.truncate());
+	}
+
+	{
+		fz::binary_log_reader reader(name);
+		CPPUNIT_ASSERT(reader.opened());
+
+		fz::logmsg::type t;
+		fz::datetime time;
+		std::wstring msg;
+		CPPUNIT_ASSERT(reader.read(t, time, msg));
+		ASSERT_EQUAL(std::wstring(L"first 1"), msg);
+		CPPUNIT_ASSERT(!reader.read(t, time, msg));
+		CPPUNIT_ASSERT(!reader.error());
+	}
+
+	fz::binary_log_reader missing(dir_.path("nonexisting"));
+	CPPUNIT_ASSERT(!missing.opened());
+}
+
+void binary_log_test::test_append()
+{
+	fz::native_string const name = dir_.path("log");
+	{
+		fz::binary_log_sink sink(name);
+		fz::async_logger logger(sink);
+		logger.log(fz::logmsg::status, "first %d", 1);
+		logger.log(fz::logmsg::error, "second %s", "a");
+	}
+	int64_t const size = fz::local_filesys::get_size(name);
+	{
+		// Different order of format strings, ids must not carry over
+		fz::binary_log_sink sink(name);
+		CPPUNIT_ASSERT(sink.opened());
+		fz::async_logger logger(sink);
+		logger.log(fz::logmsg::error, "second %s", "b");
+		logger.log(fz::logmsg::status, "first %d", 2);
+	}
+	CPPUNIT_ASSERT(fz::local_filesys::get_size(name) > size);
+
+	fz::binary_log_reader reader(name);
+	CPPUNIT_ASSERT(reader.opened());
+
+	fz::datetime const now = fz::datetime::now();
+
+	std::vector<std::pair<fz::logmsg::type, std::wstring>> const expected{
+		{fz::logmsg::status, L"first 1"},
+		{fz::logmsg::error, L"second a"},
+		{fz::logmsg::error, L"second b"},
+		{fz::logmsg::status, L"first 2"}
+	};
+	fz::logmsg::type t;
+	fz::datetime time;
+	std::wstring msg;
+	for (auto const& e : expected) {
+		CPPUNIT_ASSERT(reader.read(t, time, msg));
+		ASSERT_EQUAL(e.first, t);
+		ASSERT_EQUAL(e.second, msg);
+		CPPUNIT_ASSERT(time <= now);
+		CPPUNIT_ASSERT(time + fz::duration::from_minutes(1) > now);
+	}
+	CPPUNIT_ASSERT(!reader.read(t, time, msg));
+	CPPUNIT_ASSERT(!reader.error());
+}
@@ -0,0 +1,182 @@
+#include "../lib/libfilezilla/directory_cache.hpp"
+#include "../lib/libfilezilla/file.hpp"
+
+#include "test_utils.hpp"
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#include <unistd.h>
+
+class directory_cache_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(directory_cache_test);
+	CPPUNIT_TEST(test_cache);
+	CPPUNIT_TEST(test_changes);
+	CPPUNIT_TEST(test_limits);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void test_cache();
+	void test_changes();
+	void test_limits();
+
+private:
+	temp_dir dir_;
+	fz::native_string root_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(directory_cache_test);
+
+namespace {
+std::vector<std::string> const dirs{"a", "b", "c"};
+std::vector<std::string> const files{"f1", "f2", "a/f3", "b/f4", "c/f5"};
+
+void create(fz::native_string const& name, int64_t size = 0)
+{
+	fz::file f(name, fz::file::writing, fz::file::empty);
+	f.write("0123456789", size);
+}
+
+int64_t size_of(fz::directory_cache::listing const& l, fz::native_string_view name)
+{
+	for (size_t i = 0; i < l->size(); ++i) {
+		if (l->name(i) == name) {
+			return (*l)[i].size;
+		}
+	}
+	return -2;
+}
+}
+
+void directory_cache_test::setUp()
+{
+	dir_.create("directory_cache_test");
+	root_ = dir_.path();
+	for (auto const& d : dirs) {
+		::mkdir((root_ + "/" + d).c_str(), 0700);
+	}
+	for (auto const& f : files) {
+		create(root_ + "/" + f);
+	}
+}
+
+void directory_cache_test::tearDown()
+{
+	dir_.remove();
+}
+
+void directory_cache_test::test_cache()
+{
+	fz::directory_cache cache;
+
+	fz::directory_cache::listing first;
+	CPPUNIT_ASSERT(cache.get(root_ + "/", first));
+	CPPUNIT_ASSERT(first);
+	ASSERT_EQUAL(size_t(5), first->size());
+	ASSERT_EQUAL(int64_t(0), size_of(first, "f1"));
+	ASSERT_EQUAL(int64_t(-1), size_of(first, "a"));
+
+	fz::directory_cache::listing second;
+	CPPUNIT_ASSERT(cache.get(root_, second));
+	CPPUNIT_ASSERT(first == second);
+
+	auto stats = cache.get_stats();
+	ASSERT_EQUAL(uint64_t(1), stats.misses);
+	ASSERT_EQUAL(uint64_t(1), stats.hits);
+	ASSERT_EQUAL(size_t(1), stats.directories);
+	CPPUNIT_ASSERT(stats.memory > 0);
+
+	cache.invalidate(root_);
+	CPPUNIT_ASSERT(cache.get(root_, second));
+	CPPUNIT_ASSERT(first != second);
+	ASSERT_EQUAL(uint64_t(2), cache.get_stats().misses);
+
+	fz::directory_cache::listing none;
+	CPPUNIT_ASSERT(!cache.get(root_ + "/nonexisting", none));
+	CPPUNIT_ASSERT(!none);
+	ASSERT_EQUAL(size_t(1), cache.get_stats().directories);
+
+	cache.clear();
+	stats = cache.get_stats();
+	ASSERT_EQUAL(size_t(0), stats.directories);
+	ASSERT_EQUAL(size_t(0), stats.memory);
+}
+
+void directory_cache_test::test_changes()
+{
+	fz::directory_cache cache;
+	if (!cache.monitors_changes()) {
+		return;
+	}
+
+	fz::directory_cache::listing l;
+	CPPUNIT_ASSERT(cache.get(root_, l));
+
+	// New file
+	create(root_ + "/new", 3);
+	CPPUNIT_ASSERT(cache.get(root_, l));
+	ASSERT_EQUAL(size_t(6), l->size());
+	ASSERT_EQUAL(int64_t(3), size_of(l, "new"));
+
+	// Changed size
+	create(root_ + "/f1", 7);
+	CPPUNIT_ASSERT(cache.get(root_, l));
+	ASSERT_EQUAL(int64_t(7), size_of(l, "f1"));
+
+	// Removed file
+	fz::remove_file(root_ + "/new");
+	CPPUNIT_ASSERT(cache.get(root_, l));
+	ASSERT_EQUAL(size_t(5), l->size());
+
+	// Unrelated directory
+	fz::directory_cache::listing sub;
+	CPPUNIT_ASSERT(cache.get(root_ + "/a", sub));
+	create(root_ + "/b/f4", 1);
+	auto stats = cache.get_stats();
+	CPPUNIT_ASSERT(cache.get(root_, l));
+	CPPUNIT_ASSERT(cache.get(root_ + "/a", sub));
+	ASSERT_EQUAL(stats.hits + 2, cache.get_stats().hits);
+
+	// New file in a subdirectory changes the subdirectory's modification time
+	create(root_ + "/a/new");
+	stats = cache.get_stats();
+	CPPUNIT_ASSERT(cache.get(root_ + "/a", sub));
+	ASSERT_EQUAL(size_t(2), sub->size());
+	CPPUNIT_ASSERT(cache.get(root_, l));
+	ASSERT_EQUAL(stats.misses + 2, cache.get_stats().misses);
+}
+
+void directory_cache_test::test_limits()
+{
+	fz::directory_cache::options opts;
+	opts.max_directories = 2;
+	fz::directory_cache cache(opts);
+
+	fz::directory_cache::listing l;
+	for (auto const& d : dirs) {
+		CPPUNIT_ASSERT(cache.get(root_ + "/" + d, l));
+	}
+	auto stats = cache.get_stats();
+	ASSERT_EQUAL(size_t(2), stats.directories);
+	ASSERT_EQUAL(uint64_t(1), stats.evictions);
+
+	// Least recently used got evicted
+	CPPUNIT_ASSERT(cache.get(root_ + "/c", l));
+	CPPUNIT_ASSERT(cache.get(root_ + "/a", l));
+	stats = cache.get_stats();
+	ASSERT_EQUAL(uint64_t(1), stats.hits);
+	ASSERT_EQUAL(uint64_t(2), stats.evictions);
+
+	// Too large to be cached
+	opts.max_memory = 100;
+	fz::directory_cache small(opts);
+	CPPUNIT_ASSERT(small.get(root_, l));
+	ASSERT_EQUAL(size_t(5), l->size());
+	stats = small.get_stats();
+	ASSERT_EQUAL(size_t(0), stats.directories);
+	ASSERT_EQUAL(size_t(0), stats.memory);
+}
+#endif
@@ -0,0 +1,200 @@
+#include "../lib/libfilezilla/directory_walker.hpp"
+#include "../lib/libfilezilla/file.hpp"
+#include "../lib/libfilezilla/string.hpp"
+#include "../lib/libfilezilla/thread_pool.hpp"
+
+#include "test_utils.hpp"
+
+#include <map>
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#include <unistd.h>
+
+class directory_walker_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(directory_walker_test);
+	CPPUNIT_TEST(test_walk);
+	CPPUNIT_TEST(test_symlinks);
+	CPPUNIT_TEST(test_limits);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void test_walk();
+	void test_symlinks();
+	void test_limits();
+
+private:
+	temp_dir dir_;
+	fz::native_string root_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(directory_walker_test);
+
+namespace {
+std::vector<std::string> const dirs{"a", "a/b", "a/b/c", "d"};
+std::vector<std::string> const files{"f1", "a/f2", "a/f3", "a/b/f4", "a/b/c/f5", "d/f6"};
+
+struct found
+{
+	fz::local_filesys::type t{};
+	bool is_link{};
+	int64_t size{};
+	size_t depth{};
+};
+
+std::map<std::string, found> walk(fz::native_string const& root, fz::directory_walker::options const& opts, fz::result & res, fz::directory_walker::callback const& filter = fz::directory_walker::callback())
+{
+	fz::thread_pool pool;
+	fz::directory_walker w(pool, opts);
+	w.set_filter(filter);
+
+	// The callback runs on worker threads, cannot assert there
+	bool consistent = true;
+	std::map<std::string, found> ret;
+	res = w.walk(root, [&](fz::directory_walker::entry const& e) {
+		auto const path = e.path();
+		consistent &= fz::ends_with(path, fz::native_string(e.name));
+
+		// Parents are reported before their contents
+		auto const pos = path.rfind('/');
+		consistent &= pos == std::string::npos || ret.count(path.substr(0, pos)) != 0;
+
+		consistent &= !ret.count(path);
+		ret[path] = found{e.t, e.is_link, e.size, e.depth};
+		return true;
+	});
+	CPPUNIT_ASSERT(consistent);
+	return ret;
+}
+}
+
+void directory_walker_test::setUp()
+{
+	dir_.create("directory_walker_test");
+	root_ = dir_.path();
+	for (auto const& d : dirs) {
+		::mkdir((root_ + "/" + d).c_str(), 0700);
+	}
+	size_t size{};
+	for (auto const& f : files) {
+		fz::file file(root_ + "/" + f, fz::file::writing, fz::file::empty);
+		file.write("0123456789", static_cast<int64_t>(++size));
+	}
+}
+
+void directory_walker_test::tearDown()
+{
+	dir_.remove();
+}
+
+void directory_walker_test::test_walk()
+{
+	for (size_t threads : {1, 2, 8}) {
+		fz::directory_walker::options opts;
+		opts.threads = threads;
+
+		fz::result res;
+		auto const all = walk(root_ + "/", opts, res);
+		CPPUNIT_ASSERT(res);
+		ASSERT_EQUAL(dirs.size() + files.size(), all.size());
+
+		for (auto const& d : dirs) {
+			auto const it = all.find(d);
+			CPPUNIT_ASSERT(it != all.end());
+			ASSERT_EQUAL(fz::local_filesys::dir, it->second.t);
+			ASSERT_EQUAL(int64_t(-1), it->second.size);
+		}
+		for (size_t i = 0; i < files.size(); ++i) {
+			auto const it = all.find(files[i]);
+			CPPUNIT_ASSERT(it != all.end());
+			ASSERT_EQUAL(fz::local_filesys::file, it->second.t);
+			ASSERT_EQUAL(int64_t(i + 1), it->second.size);
+		}
+		ASSERT_EQUAL(size_t(0), all.at("f1").depth);
+		ASSERT_EQUAL(size_t(3), all.at("a/b/c/f5").depth);
+	}
+
+	fz::result res;
+	auto const none = walk(root_ + "/nonexisting", fz::directory_walker::options(), res);
+	CPPUNIT_ASSERT(none.empty());
+	ASSERT_EQUAL(fz::result::nodir, res.error_);
+}
+
+void directory_walker_test::test_symlinks()
+{
+	CPPUNIT_ASSERT(!::symlink("a/b", (root_ + "/dirlink").c_str()));
+	CPPUNIT_ASSERT(!::symlink("f1", (root_ + "/filelink").c_str()));
+	CPPUNIT_ASSERT(!::symlink("../..", (root_ + "/a/b/up").c_str()));
+
+	fz::directory_walker::options opts;
+	fz::result res;
+
+	opts.symlinks = fz::directory_walker::symlink_policy::skip;
+	auto found = walk(root_, opts, res);
+	CPPUNIT_ASSERT(res);
+	ASSERT_EQUAL(dirs.size() + files.size(), found.size());
+
+	opts.symlinks = fz::directory_walker::symlink_policy::report;
+	found = walk(root_, opts, res);
+	CPPUNIT_ASSERT(res);
+	ASSERT_EQUAL(dirs.size() + files.size() + 3, found.size());
+	ASSERT_EQUAL(fz::local_filesys::link, found.at("dirlink").t);
+	ASSERT_EQUAL(fz::local_filesys::link, found.at("a/b/up").t);
+	CPPUNIT_ASSERT(found.at("filelink").is_link);
+
+	// dirlink gets descended into, the up link would form a loop
+	opts.symlinks = fz::directory_walker::symlink_policy::follow;
+	found = walk(root_, opts, res);
+	CPPUNIT_ASSERT(res);
+	ASSERT_EQUAL(fz::local_filesys::dir, found.at("dirlink").t);
+	CPPUNIT_ASSERT(found.at("dirlink").is_link);
+	ASSERT_EQUAL(fz::local_filesys::file, found.at("filelink").t);
+	ASSERT_EQUAL(int64_t(1), found.at("filelink").size);
+	ASSERT_EQUAL(int64_t(4), found.at("dirlink/f4").size);
+	CPPUNIT_ASSERT(found.count("dirlink/c/f5"));
+	CPPUNIT_ASSERT(found.count("a/b/up"));
+	CPPUNIT_ASSERT(!found.count("a/b/up/f1"));
+
+	// Through dirlink, up leads back to the root as well
+	CPPUNIT_ASSERT(found.count("dirlink/up"));
+	CPPUNIT_ASSERT(!found.count("dirlink/up/f1"));
+}
+
+void directory_walker_test::test_limits()
+{
+	fz::directory_walker::options opts;
+	fz::result res;
+
+	opts.max_depth = 0;
+	auto found = walk(root_, opts, res);
+	CPPUNIT_ASSERT(res);
+	ASSERT_EQUAL(size_t(3), found.size());
+
+	opts.max_depth = 1;
+	found = walk(root_, opts, res);
+	ASSERT_EQUAL(size_t(7), found.size());
+
+	// Filtered directories are not descended into
+	opts.max_depth = static_cast<size_t>(-1);
+	found = walk(root_, opts, res, [](fz::directory_walker::entry const& e) {
+		return e.name != "b";
+	});
+	CPPUNIT_ASSERT(res);
+	ASSERT_EQUAL(size_t(6), found.size());
+	CPPUNIT_ASSERT(!found.count("a/b"));
+
+	// Stopping the walk
+	fz::thread_pool pool;
+	fz::directory_walker w(pool);
+	size_t calls{};
+	res = w.walk(root_, [&](fz::directory_walker::entry const&) {
+		return ++calls < 3;
+	});
+	ASSERT_EQUAL(fz::result::other, res.error_);
+	ASSERT_EQUAL(size_t(3), calls);
+}
+#endif
@@ -10,6 +10,7 @@ class EventloopTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testFilter);
 	CPPUNIT_TEST(testCondition);
 	CPPUNIT_TEST(testTimer);
+	CPPUNIT_TEST(testHighResolutionTimer);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -20,6 +21,7 @@ public:
 	void testFilter();
 	void testCondition();
 	void testTimer();
+	void testHighResolutionTimer();
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(EventloopTest);
@@ -254,3 +256,102 @@ void EventloopTest::testTimer()
 
 	CPPUNIT_ASSERT(handler.cond_.wait(l, fz::duration::from_seconds(1)));
 }
+
+namespace {
+class hires_handler final : public fz::event_handler
+{
+public:
+	hires_handler(fz::event_loop & l)
+	: fz::event_handler(l)
+	{}
+
+	virtual ~hires_handler()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const& ev) override {
+		CPPUNIT_ASSERT((fz::dispatch<fz::timer_event, T1>(ev, this, &hires_handler::on_timer, &hires_handler::on_event)));
+	}
+
+	void on_timer(fz::timer_id const& id)
+	{
+		fz::scoped_lock l(m_);
+		times_.push_back(fz::monotonic_clock::now());
+		if (times_.size() == target_) {
+			stop_timer(id);
+			cond_.signal(l);
+		}
+	}
+
+	void on_event()
+	{
+		fz::scoped_lock l(m_);
+		++events_;
+		cond_.signal(l);
+	}
+
+	fz::mutex m_;
+	fz::condition cond_;
+
+	std::vector<fz::monotonic_clock> times_;
+	size_t target_{};
+	int events_{};
+};
+}
+
+void EventloopTest::testHighResolutionTimer()
+{
+	fz::event_loop loop;
+
+	bool const available = loop.set_high_resolution_timers(true);
+#if defined(__linux__)
+	CPPUNIT_ASSERT(available);
+#endif
+	if (!available) {
+		return;
+	}
+
+	hires_handler handler(loop);
+
+	// Events still get delivered while the loop waits
+	{
+		fz::scoped_lock l(handler.m_);
+		handler.send_event<T1>();
+		CPPUNIT_ASSERT(handler.cond_.wait(l, fz::duration::from_seconds(1)));
+		CPPUNIT_ASSERT_EQUAL(1, handler.events_);
+	}
+
+	// One-shot, below a millisecond
+	{
+		fz::scoped_lock l(handler.m_);
+		handler.target_ = 1;
+		auto const start = fz::monotonic_clock::now();
+		handler.add_timer(fz::duration::from_microseconds(300), true);
+		CPPUNIT_ASSERT(handler.cond_.wait(l, fz::duration::from_seconds(1)));
+		CPPUNIT_ASSERT((handler.times_[0] - start) >= fz::duration::from_microseconds(300));
+	}
+
+	// Periodic timers do not drift
+	{
+		fz::scoped_lock l(handler.m_);
+		handler.times_.clear();
+		handler.target_ = 50;
+		auto const start = fz::monotonic_clock::now();
+		handler.add_timer(fz::duration::from_microseconds(2000), false);
+		while (handler.times_.size() < handler.target_) {
+			CPPUNIT_ASSERT(handler.cond_.wait(l, fz::duration::from_seconds(5)));
+		}
+		auto const elapsed = handler.times_.back() - start;
+		CPPUNIT_ASSERT(elapsed >= fz::duration::from_milliseconds(100));
+		CPPUNIT_ASSERT(elapsed < fz::duration::from_milliseconds(150));
+	}
+
+	CPPUNIT_ASSERT(loop.set_high_resolution_timers(false));
+	{
+		fz::scoped_lock l(handler.m_);
+		handler.send_event<T1>();
+		CPPUNIT_ASSERT(handler.cond_.wait(l, fz::duration::from_seconds(1)));
+		CPPUNIT_ASSERT_EQUAL(2, handler.events_);
+	}
+}
@@ -0,0 +1,342 @@
+#include "../lib/libfilezilla/aligned_buffer.hpp"
+#include "../lib/libfilezilla/file.hpp"
+#include "../lib/libfilezilla/thread_pool.hpp"
+
+#include "test_utils.hpp"
+
+#include <vector>
+
+#include <string.h>
+
+class file_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(file_test);
+	CPPUNIT_TEST(test_positional);
+	CPPUNIT_TEST(test_vectored);
+	CPPUNIT_TEST(test_concurrent);
+	CPPUNIT_TEST(test_allocate);
+	CPPUNIT_TEST(test_sparse);
+	CPPUNIT_TEST(test_drop_behind);
+	CPPUNIT_TEST(test_direct);
+	CPPUNIT_TEST(test_direct_concurrent);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() { dir_.create("file_test"); }
+	void tearDown() { dir_.remove(); }
+
+	void test_positional();
+	void test_vectored();
+	void test_concurrent();
+	void test_allocate();
+	void test_sparse();
+	void test_drop_behind();
+	void test_direct();
+	void test_direct_concurrent();
+
+private:
+	temp_dir dir_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(file_test);
+
+void file_test::test_positional()
+{
+	auto const name = dir_.path("file");
+
+	{
+		fz::file f(name, fz::file::writing, fz::file::empty);
+		CPPUNIT_ASSERT(f.opened());
+
+		ASSERT_EQUAL(int64_t(5), f.write_at(10, "world", 5));
+		ASSERT_EQUAL(int64_t(5), f.write_at(0, "hello", 5));
+
+		// The file pointer has not been advanced
+		ASSERT_EQUAL(int64_t(1), f.write("-", 1));
+	}
+
+	fz::file f(name, fz::file::reading);
+	ASSERT_EQUAL(int64_t(15), f.size());
+
+	char buf[16]{};
+	ASSERT_EQUAL(int64_t(5), f.read_at(10, buf, 16));
+	CPPUNIT_ASSERT(std::string_view(buf, 5) == "world");
+
+	ASSERT_EQUAL(int64_t(5), f.read_at(0, buf, 5));
+	CPPUNIT_ASSERT(std::string_view(buf, 5) == "-ello");
+
+	ASSERT_EQUAL(int64_t(0), f.read_at(15, buf, 16));
+	ASSERT_EQUAL(int64_t(0), f.read_at(1000, buf, 16));
+}
+
+void file_test::test_vectored()
+{
+	auto const name = dir_.path("file");
+
+	{
+		fz::file f(name, fz::file::writing, fz::file::empty);
+		fz::file::const_segment const segments[] = {{"abc", 3}, {"", 0}, {"defgh", 5}, {"ij", 2}};
+		ASSERT_EQUAL(int64_t(10), f.write_at(2, segments, 4));
+		ASSERT_EQUAL(int64_t(2), f.write_at(0, "01", 2));
+
+		// More segments than fit on the stack
+		std::vector<fz::file::const_segment> many;
+		for (size_t i = 0; i < 100; ++i) {
+			many.push_back({"x", 1});
+		}
+		ASSERT_EQUAL(int64_t(100), f.write_at(12, many.data(), many.size()));
+	}
+
+	fz::file f(name, fz::file::reading);
+	ASSERT_EQUAL(int64_t(112), f.size());
+
+	char a[4]{};
+	char b[6]{};
+	char c[200]{};
+	fz::file::segment const segments[] = {{a, 4}, {b, 6}, {c, 200}};
+	ASSERT_EQUAL(int64_t(112), f.read_at(0, segments, 3));
+	CPPUNIT_ASSERT(std::string_view(a, 4) == "01ab");
+	CPPUNIT_ASSERT(std::string_view(b, 6) == "cdefgh");
+	CPPUNIT_ASSERT(std::string_view(c, 102) == "ij" + std::string(100, 'x'));
+
+	ASSERT_EQUAL(int64_t(0), f.read_at(112, segments, 3));
+}
+
+void file_test::test_concurrent()
+{
+	auto const name = dir_.path("file");
+
+	size_t const chunks = 8;
+	size_t const chunk_size = 64 * 1024;
+
+	{
+		fz::file f(name, fz::file::writing, fz::file::empty);
+		CPPUNIT_ASSERT(f.opened());
+
+		// Each task writes its own chunk in small pieces through the shared descriptor
+		fz::thread_pool pool;
+		std::vector<fz::async_task> tasks;
+		std::vector<int64_t> results(chunks);
+		for (size_t i = 0; i < chunks; ++i) {
+			tasks.emplace_back(pool.spawn([&f, &results, i]() {
+				std::string const piece(1024, static_cast<char>('a' + i));
+				for (size_t pos = 0; pos < chunk_size; pos += piece.size()) {
+					int64_t const res = f.write_at(static_cast<int64_t>(i * chunk_size + pos), piece.c_str(), static_cast<int64_t>(piece.size()));
+					if (res > 0) {
+						results[i] += res;
+					}
+				}
+			}));
+		}
+		tasks.clear();
+
+		for (auto const& r : results) {
+			ASSERT_EQUAL(int64_t(chunk_size), r);
+		}
+	}
+
+	fz::file f(name, fz::file::reading);
+	ASSERT_EQUAL(int64_t(chunks * chunk_size), f.size());
+
+	std::string data(chunk_size, '\0');
+	for (size_t i = 0; i < chunks; ++i) {
+		ASSERT_EQUAL(int64_t(chunk_size), f.read_at(static_cast<int64_t>(i * chunk_size), data.data(), static_cast<int64_t>(chunk_size)));
+		CPPUNIT_ASSERT(data == std::string(chunk_size, static_cast<char>('a' + i)));
+	}
+}
+
+void file_test::test_allocate()
+{
+	auto const name = dir_.path("file");
+
+	fz::file f(name, fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+	ASSERT_EQUAL(int64_t(3), f.write("abc", 3));
+
+	if (f.allocate(1024 * 1024)) {
+		// Size does not change, the file pointer neither
+		ASSERT_EQUAL(int64_t(3), f.size());
+		ASSERT_EQUAL(int64_t(3), f.position());
+
+		CPPUNIT_ASSERT(f.allocate(2 * 1024 * 1024, true));
+		ASSERT_EQUAL(int64_t(2 * 1024 * 1024), f.size());
+
+		fz::file r(name, fz::file::reading);
+		char buf[3]{1, 2, 3};
+		ASSERT_EQUAL(int64_t(3), r.read_at(1024 * 1024, buf, 3));
+		CPPUNIT_ASSERT(std::string_view(buf, 3) == std::string_view("\0\0\0", 3));
+	}
+
+#ifdef __linux__
+	CPPUNIT_ASSERT(f.advise(0, 0, fz::file::advice::noreuse));
+	CPPUNIT_ASSERT(f.advise(0, 3, fz::file::advice::dontneed));
+#endif
+}
+
+void file_test::test_sparse()
+{
+	auto const name = dir_.path("file");
+
+	int64_t const mb = 1024 * 1024;
+	fz::file f(name, fz::file::writing, fz::file::empty);
+	std::string const block(mb, 'x');
+	for (int i = 0; i < 3; ++i) {
+		ASSERT_EQUAL(mb, f.write(block.c_str(), mb));
+	}
+
+	auto ranges = f.data_ranges();
+	CPPUNIT_ASSERT(!ranges.empty());
+	ASSERT_EQUAL(int64_t(0), ranges.front().first);
+
+	if (f.punch_hole(mb, mb)) {
+		ASSERT_EQUAL(3 * mb, f.size());
+
+		fz::file r(name, fz::file::reading);
+		std::string data(mb, 'y');
+		ASSERT_EQUAL(mb, r.read_at(mb, data.data(), mb));
+		CPPUNIT_ASSERT(data == std::string(mb, '\0'));
+		ASSERT_EQUAL(mb, r.read_at(2 * mb, data.data(), mb));
+		CPPUNIT_ASSERT(data == block);
+
+		// Ranges are ordered, don't overlap and cover all data
+		ranges = f.data_ranges();
+		CPPUNIT_ASSERT(!ranges.empty());
+		int64_t end{};
+		for (auto const& r : ranges) {
+			CPPUNIT_ASSERT(r.first >= end);
+			CPPUNIT_ASSERT(r.second > 0);
+			end = r.first + r.second;
+		}
+		ASSERT_EQUAL(int64_t(0), ranges.front().first);
+		ASSERT_EQUAL(3 * mb, end);
+#ifdef __linux__
+		// Supported by all common Linux filesystems
+		CPPUNIT_ASSERT(ranges.size() >= 2);
+		CPPUNIT_ASSERT(ranges.front().second <= mb);
+#endif
+	}
+}
+
+void file_test::test_drop_behind()
+{
+	auto const name = dir_.path("file");
+
+	int64_t const mb = 1024 * 1024;
+	{
+		fz::file f(name, fz::file::writing, fz::file::empty);
+		bool const supported = f.set_drop_behind(true);
+#ifdef __linux__
+		CPPUNIT_ASSERT(supported);
+#else
+		(void)supported;
+#endif
+		std::string const block(mb, 'z');
+		for (int i = 0; i < 20; ++i) {
+			ASSERT_EQUAL(mb, f.write(block.c_str(), mb));
+		}
+
+		// Seeking backwards is fine
+		f.seek(0, fz::file::begin);
+		ASSERT_EQUAL(int64_t(1), f.write("a", 1));
+	}
+
+	fz::file f(name, fz::file::reading);
+	ASSERT_EQUAL(20 * mb, f.size());
+	std::string data(mb, '\0');
+	ASSERT_EQUAL(mb, f.read_at(19 * mb, data.data(), mb));
+	CPPUNIT_ASSERT(data == std::string(mb, 'z'));
+	ASSERT_EQUAL(int64_t(2), f.read_at(0, data.data(), 2));
+	CPPUNIT_ASSERT(data.substr(0, 2) == "az");
+}
+
+void file_test::test_direct()
+{
+	fz::aligned_buffer buf(100000, 4096);
+	CPPUNIT_ASSERT(!(reinterpret_cast<uintptr_t>(buf.data()) % 4096));
+	ASSERT_EQUAL(size_t(102400), buf.capacity());
+	for (size_t i = 0; i < buf.capacity(); ++i) {
+		buf.data()[i] = static_cast<unsigned char>('a' + i % 26);
+	}
+	std::string_view const data(reinterpret_cast<char const*>(buf.data()), buf.capacity());
+
+	auto const name = dir_.path("file");
+	{
+		fz::file f(name, fz::file::writing, fz::file::empty | fz::file::direct);
+		CPPUNIT_ASSERT(f.opened());
+		size_t const alignment = f.alignment();
+		CPPUNIT_ASSERT(f.uses_direct_io() == (alignment != 0));
+
+		// Aligned, unaligned tail, entirely unaligned and positional at an unaligned offset
+		ASSERT_EQUAL(int64_t(8192), f.write(buf.data(), 8192));
+		ASSERT_EQUAL(int64_t(10000), f.write(buf.data() + 8192, 10000));
+		ASSERT_EQUAL(int64_t(20000), f.write(buf.data() + 18192, 20000));
+		ASSERT_EQUAL(int64_t(61808), f.write_at(38192, buf.data() + 38192, 61808));
+
+		fz::file::const_segment const segments[] = {{buf.data() + 100000, 1000}, {buf.data() + 101000, 1400}};
+		ASSERT_EQUAL(int64_t(2400), f.write_at(100000, segments, 2));
+	}
+
+	fz::file f(name, fz::file::reading, fz::file::direct);
+	CPPUNIT_ASSERT(f.opened());
+	ASSERT_EQUAL(int64_t(buf.capacity()), f.size());
+
+	fz::aligned_buffer in(buf.capacity() + 8192);
+	int64_t pos{};
+	int64_t r;
+	while ((r = f.read(in.data() + pos, 4096 * 3)) > 0) {
+		pos += r;
+	}
+	ASSERT_EQUAL(int64_t(0), r);
+	ASSERT_EQUAL(int64_t(buf.capacity()), pos);
+	CPPUNIT_ASSERT(std::string_view(reinterpret_cast<char const*>(in.data()), buf.capacity()) == data);
+
+	std::string out(5000, '\0');
+	ASSERT_EQUAL(int64_t(5000), f.read_at(12345, out.data(), 5000));
+	CPPUNIT_ASSERT(out == data.substr(12345, 5000));
+
+	fz::aligned_buffer moved(std::move(in));
+	CPPUNIT_ASSERT(!in && moved);
+}
+
+void file_test::test_direct_concurrent()
+{
+	auto const name = dir_.path("file");
+
+	size_t const tasks_count = 4;
+	size_t const pieces = 64;
+	{
+		fz::file f(name, fz::file::writing, fz::file::empty | fz::file::direct);
+		CPPUNIT_ASSERT(f.opened());
+		size_t const alignment = f.alignment();
+		if (alignment <= 1) {
+			// Nothing to transfer separately
+			return;
+		}
+
+		// Each piece has an aligned part transferred directly and an unaligned tail
+		size_t const piece_size = alignment + 100;
+		size_t const stride = 2 * alignment;
+
+		fz::thread_pool pool;
+		std::vector<fz::async_task> tasks;
+		std::vector<int64_t> results(tasks_count);
+		for (size_t i = 0; i < tasks_count; ++i) {
+			tasks.emplace_back(pool.spawn([&, i]() {
+				fz::aligned_buffer buf(piece_size, alignment);
+				memset(buf.data(), 'a' + static_cast<int>(i), piece_size);
+				for (size_t j = 0; j < pieces; ++j) {
+					int64_t const res = f.write_at(static_cast<int64_t>((i * pieces + j) * stride), buf.data(), static_cast<int64_t>(piece_size));
+					if (res > 0) {
+						results[i] += res;
+					}
+				}
+			}));
+		}
+		tasks.clear();
+
+		for (auto const& r : results) {
+			ASSERT_EQUAL(int64_t(pieces * piece_size), r);
+		}
+		CPPUNIT_ASSERT(f.uses_direct_io());
+	}
+}
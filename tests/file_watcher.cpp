@@ -0,0 +1,206 @@
+#include "../lib/libfilezilla/event_handler.hpp"
+#include "../lib/libfilezilla/event_loop.hpp"
+#include "../lib/libfilezilla/file.hpp"
+#include "../lib/libfilezilla/file_watcher.hpp"
+#include "../lib/libfilezilla/thread_pool.hpp"
+#include "../lib/libfilezilla/util.hpp"
+
+#include "test_utils.hpp"
+
+#include <map>
+
+#ifndef FZ_WINDOWS
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class file_watcher_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(file_watcher_test);
+	CPPUNIT_TEST(test_inotify);
+	CPPUNIT_TEST(test_recursive);
+	CPPUNIT_TEST(test_polling);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void test_inotify();
+	void test_recursive();
+	void test_polling();
+
+private:
+	temp_dir dir_;
+	fz::native_string root_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(file_watcher_test);
+
+namespace {
+class change_handler final : public fz::event_handler
+{
+public:
+	change_handler(fz::event_loop & loop)
+		: fz::event_handler(loop)
+	{}
+
+	virtual ~change_handler()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		fz::dispatch<fz::file_watcher_event>(ev, this, &change_handler::on_change);
+	}
+
+	// Waits until the given change has been reported for the path, consuming all changes seen for the path so far
+	bool wait_for(fz::native_string const& path, fz::file_change c)
+	{
+		auto const deadline = fz::monotonic_clock::now() + fz::duration::from_seconds(10);
+
+		fz::scoped_lock l(mtx_);
+		while (true) {
+			auto it = changes_.find(path);
+			if (it != changes_.end() && (it->second.first & c)) {
+				changes_.erase(it);
+				return true;
+			}
+			auto const remaining = deadline - fz::monotonic_clock::now();
+			if (remaining <= fz::duration()) {
+				return false;
+			}
+			cond_.wait(l, remaining);
+		}
+	}
+
+	// Number of events received for the path, unless consumed by wait_for
+	size_t events(fz::native_string const& path)
+	{
+		fz::scoped_lock l(mtx_);
+		auto it = changes_.find(path);
+		return it == changes_.end() ? 0 : it->second.second;
+	}
+
+private:
+	void on_change(fz::file_watcher*, fz::native_string const& path, fz::file_change c)
+	{
+		fz::scoped_lock l(mtx_);
+		auto & entry = changes_[path];
+		entry.first |= c;
+		++entry.second;
+		cond_.signal(l);
+	}
+
+	fz::mutex mtx_;
+	fz::condition cond_;
+	std::map<fz::native_string, std::pair<fz::file_change, size_t>> changes_;
+};
+
+void write_file(fz::native_string const& name, int64_t size)
+{
+	fz::file f(name, fz::file::writing, fz::file::empty);
+	f.write("0123456789", size);
+}
+}
+
+void file_watcher_test::setUp()
+{
+	dir_.create("file_watcher_test");
+	root_ = dir_.path();
+}
+
+void file_watcher_test::tearDown()
+{
+	dir_.remove();
+}
+
+void file_watcher_test::test_inotify()
+{
+	fz::event_loop loop;
+	change_handler handler(loop);
+	fz::thread_pool pool;
+	fz::file_watcher::options opts;
+	opts.coalesce = fz::duration::from_milliseconds(200);
+	fz::file_watcher watcher(pool, handler, opts);
+	if (!watcher.uses_inotify()) {
+		return;
+	}
+
+	CPPUNIT_ASSERT(watcher.add(root_ + "/"));
+	ASSERT_EQUAL(fz::result::nofile, watcher.add(root_ + "/nonexisting").error_);
+
+	// Creating and repeatedly writing gets coalesced into a single event
+	for (int64_t i = 1; i <= 5; ++i) {
+		write_file(root_ + "/f", i);
+	}
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/f", fz::file_change::created));
+	ASSERT_EQUAL(size_t(0), handler.events(root_ + "/f"));
+
+	CPPUNIT_ASSERT(!::rename((root_ + "/f").c_str(), (root_ + "/g").c_str()));
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/f", fz::file_change::moved_from));
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/g", fz::file_change::moved_to));
+
+	fz::remove_file(root_ + "/g");
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/g", fz::file_change::deleted));
+
+	// No longer watched
+	watcher.remove(root_);
+	write_file(root_ + "/f", 1);
+	fz::sleep(fz::duration::from_milliseconds(400));
+	ASSERT_EQUAL(size_t(0), handler.events(root_ + "/f"));
+}
+
+void file_watcher_test::test_recursive()
+{
+	fz::event_loop loop;
+	change_handler handler(loop);
+	fz::thread_pool pool;
+	fz::file_watcher watcher(pool, handler);
+	if (!watcher.uses_inotify()) {
+		return;
+	}
+
+	::mkdir((root_ + "/sub").c_str(), 0700);
+	CPPUNIT_ASSERT(watcher.add(root_, true));
+
+	write_file(root_ + "/sub/x", 1);
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/sub/x", fz::file_change::created));
+
+	// New directories get watched as well
+	::mkdir((root_ + "/sub/deeper").c_str(), 0700);
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/sub/deeper", fz::file_change::created));
+	write_file(root_ + "/sub/deeper/y", 1);
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/sub/deeper/y", fz::file_change::created));
+	write_file(root_ + "/sub/deeper/y", 2);
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/sub/deeper/y", fz::file_change::modified));
+}
+
+void file_watcher_test::test_polling()
+{
+	fz::event_loop loop;
+	change_handler handler(loop);
+	fz::thread_pool pool;
+	fz::file_watcher::options opts;
+	opts.use_inotify = false;
+	opts.poll_interval = fz::duration::from_milliseconds(50);
+	fz::file_watcher watcher(pool, handler, opts);
+	CPPUNIT_ASSERT(!watcher.uses_inotify());
+
+	::mkdir((root_ + "/sub").c_str(), 0700);
+	CPPUNIT_ASSERT(watcher.add(root_, true));
+	ASSERT_EQUAL(fz::result::nofile, watcher.add(root_ + "/nonexisting").error_);
+
+	write_file(root_ + "/f", 1);
+	write_file(root_ + "/sub/x", 1);
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/f", fz::file_change::created));
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/sub/x", fz::file_change::created));
+
+	write_file(root_ + "/f", 2);
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/f", fz::file_change::modified));
+
+	fz::remove_file(root_ + "/sub/x");
+	CPPUNIT_ASSERT(handler.wait_for(root_ + "/sub/x", fz::file_change::deleted));
+}
+#endif
@@ -1,3 +1,4 @@
+#include "../lib/libfilezilla/buffer.hpp"
 #include "../lib/libfilezilla/format.hpp"
 
 #include "test_utils.hpp"
@@ -10,6 +11,8 @@ class format_test final : public CppUnit::TestFixture
 {
 	CPPUNIT_TEST_SUITE(format_test);
 	CPPUNIT_TEST(test_sprintf);
+	CPPUNIT_TEST(test_sprintf_compiled);
+	CPPUNIT_TEST(test_sprintf_to);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -17,6 +20,8 @@ public:
 	void tearDown() {}
 
 	void test_sprintf();
+	void test_sprintf_compiled();
+	void test_sprintf_to();
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(format_test);
@@ -85,6 +90,7 @@ void format_test::test_sprintf()
 	CPPUNIT_ASSERT_EQUAL(std::string("-042"), fz::sprintf("% 04d", -42));
 
 	CPPUNIT_ASSERT_EQUAL(std::string("foo 7 foo"), fz::sprintf("%2$s %1$d %2$s", 7, "foo"));
+	CPPUNIT_ASSERT_EQUAL(std::string("  foo|007"), fz::sprintf("%2$5s|%1$03d", 7, "foo"));
 
 	CPPUNIT_ASSERT_EQUAL(std::string("0"), fz::sprintf("%x", 0));
 	CPPUNIT_ASSERT_EQUAL(std::string("23bf0a"), fz::sprintf("%x", 2342666));
@@ -133,3 +139,69 @@ void format_test::test_sprintf()
 	int64_t const neg64 = -42;
 	CPPUNIT_ASSERT_EQUAL(std::string("ffffffffffffffd6"), fz::sprintf("%x", neg64));
 }
+
+void format_test::test_sprintf_compiled()
+{
+	CPPUNIT_ASSERT_EQUAL(std::string("foo"), fz::sprintf(fzF("foo")));
+	CPPUNIT_ASSERT_EQUAL(std::string(""), fz::sprintf(fzF("")));
+	CPPUNIT_ASSERT_EQUAL(std::string("foo % bar"), fz::sprintf(fzF("foo %% bar")));
+	CPPUNIT_ASSERT_EQUAL(std::string("%%"), fz::sprintf(fzF("%%%%")));
+	CPPUNIT_ASSERT_EQUAL(std::string("%7%"), fz::sprintf(fzF("%%%d%%"), 7));
+
+	CPPUNIT_ASSERT_EQUAL(std::string("foo bar"), fz::sprintf(fzF("foo %s"), "bar"));
+	CPPUNIT_ASSERT_EQUAL(std::string("foo bar"), fz::sprintf(fzF("foo %s"), L"bar"));
+	CPPUNIT_ASSERT_EQUAL(std::string("foo bar"), fz::sprintf(fzF("foo %s"), std::string("bar")));
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"foo bar"), fz::sprintf(fzF(L"foo %s"), L"bar"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"foo bar"), fz::sprintf(fzF(L"foo %s"), std::wstring(L"bar")));
+
+	CPPUNIT_ASSERT_EQUAL(std::string(" 001"), fz::sprintf(fzF("% 04d"), 1));
+	CPPUNIT_ASSERT_EQUAL(std::string("-77    "), fz::sprintf(fzF("%+-7d"), -77));
+	CPPUNIT_ASSERT_EQUAL(std::string("23BF0A"), fz::sprintf(fzF("%X"), 2342666));
+	CPPUNIT_ASSERT_EQUAL(std::string("ffffffffffffffd6"), fz::sprintf(fzF("%x"), int64_t(-42)));
+	CPPUNIT_ASSERT_EQUAL(std::string("18446744073709551615"), fz::sprintf(fzF("%lu"), uint64_t(-1)));
+
+	CPPUNIT_ASSERT_EQUAL(std::string("foo 7 foo"), fz::sprintf(fzF("%2$s %1$d %2$s"), 7, "foo"));
+	CPPUNIT_ASSERT_EQUAL(std::string("a1b2c"), fz::sprintf(fzF("a%db%dc"), 1, 2));
+
+	// Unused arguments are fine
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), fz::sprintf(fzF("%d"), 1, 2));
+
+	// Incomplete trailing field is dropped like in the runtime-parsed variant
+	CPPUNIT_ASSERT_EQUAL(fz::sprintf("foo %", 1), fz::sprintf(fzF("foo %"), 1));
+	CPPUNIT_ASSERT_EQUAL(fz::sprintf("%5", 1), fz::sprintf(fzF("%5"), 1));
+
+	// Usable as ordinary format string
+	std::string_view const v = fzF("%s-%s");
+	CPPUNIT_ASSERT_EQUAL(std::string("x-y"), fz::sprintf(v, "x", "y"));
+}
+
+void format_test::test_sprintf_to()
+{
+	std::string s = "prefix:";
+	fz::sprintf_to(s, "%d %s %% %x", -5, "foo", 255u);
+	CPPUNIT_ASSERT_EQUAL(std::string("prefix:-5 foo % ff"), s);
+	fz::sprintf_to(s, "|%4s|%-4d|%04X|", L"ab", 7, 171);
+	CPPUNIT_ASSERT_EQUAL(std::string("prefix:-5 foo % ff|  ab|7   |00AB|"), s);
+
+	std::wstring w = L"w:";
+	fz::sprintf_to(w, L"%s %s %+d", "narrow", L"wide", 3);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"w:narrow wide +3"), w);
+
+	fz::buffer b;
+	b.append("250 ");
+	fz::sprintf_to(b, "%s %d%c", std::string_view("OK"), uint64_t(18446744073709551615u), '\n');
+	CPPUNIT_ASSERT_EQUAL(std::string("250 OK 18446744073709551615\n"), std::string(b.to_view()));
+
+	fz::sprintf_to(b, fzF("%2$s=%1$05d;"), 42, "x");
+	CPPUNIT_ASSERT_EQUAL(std::string("250 OK 18446744073709551615\nx=00042;"), std::string(b.to_view()));
+
+	w.clear();
+	fz::sprintf_to(w, fzF(L"%s"), -12);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"-12"), w);
+
+	// Integers formatted as strings
+	CPPUNIT_ASSERT_EQUAL(std::string("-42"), fz::sprintf("%s", -42));
+	CPPUNIT_ASSERT_EQUAL(std::string("   42"), fz::sprintf("%5s", 42u));
+	CPPUNIT_ASSERT_EQUAL(std::string("0x1f"), fz::sprintf("%p", reinterpret_cast<void*>(0x1f)));
+	CPPUNIT_ASSERT_EQUAL(std::string("  0x1f"), fz::sprintf("%6p", reinterpret_cast<void*>(0x1f)));
+}
@@ -0,0 +1,208 @@
+#include "../lib/libfilezilla/file.hpp"
+#include "../lib/libfilezilla/format.hpp"
+#include "../lib/libfilezilla/local_filesys.hpp"
+
+#include "test_utils.hpp"
+
+#include <map>
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class local_filesys_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(local_filesys_test);
+	CPPUNIT_TEST(test_copy);
+	CPPUNIT_TEST(test_copy_abort);
+#ifndef FZ_WINDOWS
+	CPPUNIT_TEST(test_batch);
+#endif
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() { dir_.create("local_filesys_test"); }
+	void tearDown() { dir_.remove(); }
+
+	void test_copy();
+	void test_copy_abort();
+	void test_batch();
+
+private:
+	temp_dir dir_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(local_filesys_test);
+
+namespace {
+std::string read_all(fz::native_string const& name)
+{
+	std::string ret;
+	fz::file f(name, fz::file::reading);
+	char buf[65536];
+	int64_t r;
+	while ((r = f.read(buf, sizeof(buf))) > 0) {
+		ret.append(buf, static_cast<size_t>(r));
+	}
+	return ret;
+}
+
+void write_all(fz::native_string const& name, std::string const& data)
+{
+	fz::file f(name, fz::file::writing, fz::file::empty);
+	f.write(data.c_str(), static_cast<int64_t>(data.size()));
+}
+}
+
+void local_filesys_test::test_copy()
+{
+	auto const source = dir_.path("source");
+	auto const dest = dir_.path("dest");
+
+	std::string data;
+	for (size_t i = 0; i < 3000000; ++i) {
+		data += static_cast<char>('a' + (i * 7 + i / 1013) % 26);
+	}
+	write_all(source, data);
+
+	// Overwrites existing files
+	write_all(dest, "old content that is a bit longer than nothing");
+
+	int64_t last_copied{};
+	int64_t last_total{};
+	auto progress = [&](int64_t copied, int64_t total) {
+		CPPUNIT_ASSERT(copied >= last_copied);
+		last_copied = copied;
+		last_total = total;
+		return true;
+	};
+	CPPUNIT_ASSERT(fz::copy_file(source, dest, progress));
+	ASSERT_EQUAL(int64_t(data.size()), last_copied);
+	ASSERT_EQUAL(int64_t(data.size()), last_total);
+	CPPUNIT_ASSERT(read_all(dest) == data);
+
+	// Empty files
+	write_all(source, std::string());
+	CPPUNIT_ASSERT(fz::copy_file(source, dest));
+	ASSERT_EQUAL(int64_t(0), fz::local_filesys::get_size(dest));
+
+#ifndef FZ_WINDOWS
+	// Copying a file onto itself leaves it alone
+	write_all(source, data);
+	CPPUNIT_ASSERT(!fz::copy_file(source, source));
+	CPPUNIT_ASSERT(read_all(source) == data);
+
+	fz::remove_file(dest);
+	CPPUNIT_ASSERT(!link(source.c_str(), dest.c_str()));
+	CPPUNIT_ASSERT(!fz::copy_file(source, dest));
+	CPPUNIT_ASSERT(read_all(source) == data);
+	ASSERT_EQUAL(fz::local_filesys::file, fz::local_filesys::get_file_type(dest));
+#endif
+
+	fz::remove_file(source);
+	fz::remove_file(dest);
+
+	auto res = fz::copy_file(source, dest);
+	ASSERT_EQUAL(fz::result::nofile, res.error_);
+	ASSERT_EQUAL(fz::local_filesys::unknown, fz::local_filesys::get_file_type(dest));
+}
+
+void local_filesys_test::test_copy_abort()
+{
+	auto const source = dir_.path("source");
+	auto const dest = dir_.path("dest");
+
+	write_all(source, std::string(20 * 1024 * 1024, 'x'));
+
+	size_t calls{};
+	auto progress = [&](int64_t, int64_t) {
+		++calls;
+		return false;
+	};
+	CPPUNIT_ASSERT(!fz::copy_file(source, dest, progress));
+	ASSERT_EQUAL(size_t(1), calls);
+
+	// Aborted copies get removed
+	ASSERT_EQUAL(fz::local_filesys::unknown, fz::local_filesys::get_file_type(dest));
+	ASSERT_EQUAL(fz::local_filesys::file, fz::local_filesys::get_file_type(source));
+}
+
+#ifndef FZ_WINDOWS
+namespace {
+struct info
+{
+	bool is_link{};
+	fz::local_filesys::type t{};
+	int64_t size{};
+	fz::datetime mtime;
+	int mode{};
+
+	bool operator==(info const& op) const {
+		return is_link == op.is_link && t == op.t && size == op.size && mtime == op.mtime && mode == op.mode;
+	}
+};
+
+std::map<fz::native_string, info> list(fz::native_string const& path, bool dirs_only, bool follow)
+{
+	std::map<fz::native_string, info> ret;
+	fz::local_filesys fs;
+	CPPUNIT_ASSERT(fs.begin_find_files(path, dirs_only, follow));
+	fz::native_string name;
+	info i;
+	while (fs.get_next_file(name, i.is_link, i.t, &i.size, &i.mtime, &i.mode)) {
+		ret[name] = i;
+	}
+	return ret;
+}
+
+std::map<fz::native_string, info> list_batched(fz::native_string const& path, bool dirs_only, bool follow, bool metadata)
+{
+	std::map<fz::native_string, info> ret;
+	fz::local_filesys fs;
+	CPPUNIT_ASSERT(fs.begin_find_files(path, dirs_only, follow));
+	fz::local_filesys::entries entries;
+	while (fs.get_next_files(entries, metadata)) {
+		for (size_t i = 0; i < entries.size(); ++i) {
+			auto const& e = entries[i];
+			auto const name = entries.name(i);
+			CPPUNIT_ASSERT(!name.data()[name.size()]);
+			ret[fz::native_string(name)] = info{e.is_link, e.t, e.size, e.modification_time, e.mode};
+		}
+	}
+	CPPUNIT_ASSERT(entries.empty());
+	return ret;
+}
+}
+
+void local_filesys_test::test_batch()
+{
+	auto const& dir = dir_.path();
+	CPPUNIT_ASSERT(!::mkdir((dir + "/sub").c_str(), 0700));
+	for (size_t i = 0; i < 3000; ++i) {
+		write_all(dir + fz::sprintf("/file_%d_with_a_somewhat_longer_name", i), std::string(i % 10, 'x'));
+	}
+	CPPUNIT_ASSERT(!::symlink("sub", (dir + "/dirlink").c_str()));
+	CPPUNIT_ASSERT(!::symlink("file_5_with_a_somewhat_longer_name", (dir + "/filelink").c_str()));
+	CPPUNIT_ASSERT(!::symlink("nonexisting", (dir + "/dangling").c_str()));
+
+	for (bool dirs_only : {false, true}) {
+		for (bool follow : {false, true}) {
+			auto const expected = list(dir, dirs_only, follow);
+			ASSERT_EQUAL(dirs_only ? size_t(follow ? 2 : 1) : size_t(3004), expected.size());
+			CPPUNIT_ASSERT(list_batched(dir, dirs_only, follow, true) == expected);
+
+			// Without metadata, names and types still match
+			auto const batched = list_batched(dir, dirs_only, follow, false);
+			ASSERT_EQUAL(expected.size(), batched.size());
+			for (auto const& [name, i] : batched) {
+				auto const it = expected.find(name);
+				CPPUNIT_ASSERT(it != expected.end());
+				ASSERT_EQUAL(it->second.t, i.t);
+				ASSERT_EQUAL(it->second.is_link, i.is_link);
+				ASSERT_EQUAL(int64_t(-1), i.size);
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,116 @@
+#include "../lib/libfilezilla/mapped_file.hpp"
+
+#include "test_utils.hpp"
+
+class mapped_file_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(mapped_file_test);
+	CPPUNIT_TEST(test_whole);
+	CPPUNIT_TEST(test_window);
+	CPPUNIT_TEST(test_special);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() { dir_.create("mapped_file_test"); }
+	void tearDown() { dir_.remove(); }
+
+	void test_whole();
+	void test_window();
+	void test_special();
+
+private:
+	temp_dir dir_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mapped_file_test);
+
+namespace {
+void create(fz::native_string const& name, std::string const& data)
+{
+	fz::file f(name, fz::file::writing, fz::file::empty);
+	f.write(data.c_str(), static_cast<int64_t>(data.size()));
+}
+
+std::string to_string(std::basic_string_view<uint8_t> const& v)
+{
+	return std::string(reinterpret_cast<char const*>(v.data()), v.size());
+}
+}
+
+void mapped_file_test::test_whole()
+{
+	std::string const data = pattern(100000);
+	auto const name = dir_.path("file");
+	create(name, data);
+
+	fz::mapped_file f;
+	CPPUNIT_ASSERT(f.open(name));
+	ASSERT_EQUAL(int64_t(data.size()), f.size());
+	CPPUNIT_ASSERT(f.advise(fz::mapped_file::advice::sequential));
+	CPPUNIT_ASSERT(f.advise(fz::mapped_file::advice::willneed));
+
+	ASSERT_EQUAL(data.size(), f.window().size());
+	CPPUNIT_ASSERT(to_string(f.view(0, data.size() + 100)) == data);
+	CPPUNIT_ASSERT(to_string(f.view(12345, 100)) == data.substr(12345, 100));
+	CPPUNIT_ASSERT(f.view(int64_t(data.size()), 1).empty());
+
+	fz::nonowning_buffer b = f.buffer(99990, 100);
+	ASSERT_EQUAL(size_t(10), b.size());
+	CPPUNIT_ASSERT(std::string_view(reinterpret_cast<char const*>(b.get()), b.size()) == data.substr(99990));
+
+	fz::mapped_file moved(std::move(f));
+	CPPUNIT_ASSERT(!f.opened());
+	CPPUNIT_ASSERT(to_string(moved.view(50000, 10)) == data.substr(50000, 10));
+}
+
+void mapped_file_test::test_window()
+{
+	std::string const data = pattern(1000000);
+	auto const name = dir_.path("file");
+	create(name, data);
+
+	fz::mapped_file f;
+	CPPUNIT_ASSERT(f.open(name, 100000));
+	size_t const window = f.window().size();
+	CPPUNIT_ASSERT(window >= 100000 && window < data.size());
+
+	// Sequential pass in odd-sized steps, crossing window boundaries
+	std::string out;
+	int64_t pos{};
+	while (true) {
+		auto v = f.view(pos, 77777);
+		if (v.empty()) {
+			break;
+		}
+		CPPUNIT_ASSERT(v.size() <= 77777);
+		out += to_string(v);
+		pos += static_cast<int64_t>(v.size());
+	}
+	CPPUNIT_ASSERT(out == data);
+
+	// Jumping back remaps
+	CPPUNIT_ASSERT(to_string(f.view(10, 20)) == data.substr(10, 20));
+	ASSERT_EQUAL(int64_t(0), f.window_offset());
+
+	auto v = f.view(900001, 1000);
+	CPPUNIT_ASSERT(to_string(v) == data.substr(900001, 1000));
+	CPPUNIT_ASSERT(f.window_offset() <= 900001);
+
+	// Requests larger than the window are clipped
+	v = f.view(1, data.size());
+	CPPUNIT_ASSERT(!v.empty() && v.size() <= window);
+	CPPUNIT_ASSERT(to_string(v) == data.substr(1, v.size()));
+}
+
+void mapped_file_test::test_special()
+{
+	fz::mapped_file f;
+	CPPUNIT_ASSERT(!f.open(dir_.path("nonexisting")));
+	CPPUNIT_ASSERT(f.view(0, 10).empty());
+
+	auto const name = dir_.path("empty");
+	create(name, std::string());
+	CPPUNIT_ASSERT(f.open(name));
+	ASSERT_EQUAL(int64_t(0), f.size());
+	CPPUNIT_ASSERT(f.view(0, 10).empty());
+}
@@ -0,0 +1,224 @@
+#include "../lib/libfilezilla/event_handler.hpp"
+#include "../lib/libfilezilla/event_loop.hpp"
+#include "../lib/libfilezilla/format.hpp"
+#include "../lib/libfilezilla/process.hpp"
+#include "../lib/libfilezilla/thread_pool.hpp"
+
+#include "test_utils.hpp"
+
+#include <map>
+#include <memory>
+
+#ifndef FZ_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+
+class process_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(process_test);
+	CPPUNIT_TEST(test_redirect);
+	CPPUNIT_TEST(test_extra_fds);
+	CPPUNIT_TEST(test_nonexisting);
+	CPPUNIT_TEST(test_events);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void test_redirect();
+	void test_extra_fds();
+	void test_nonexisting();
+	void test_events();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(process_test);
+
+namespace {
+std::string read_all(fz::process & p)
+{
+	std::string ret;
+	char buf[256];
+	while (true) {
+		auto const r = p.read(buf, sizeof(buf));
+		if (!r || !r.value_) {
+			break;
+		}
+		ret.append(buf, r.value_);
+	}
+	return ret;
+}
+
+// Feeds input to the processes and collects their output
+class process_handler final : public fz::event_handler
+{
+public:
+	process_handler(fz::event_loop & loop)
+		: fz::event_handler(loop)
+	{}
+
+	virtual ~process_handler()
+	{
+		remove_handler();
+	}
+
+	void start(fz::process & p, std::string const& input)
+	{
+		fz::scoped_lock l(mtx_);
+		states_[&p].input_ = input;
+
+		// A spawned process is writable
+		send_event<fz::process_event>(&p, fz::process_event_flag::write);
+	}
+
+	bool wait(size_t processes)
+	{
+		auto const deadline = fz::monotonic_clock::now() + fz::duration::from_seconds(30);
+
+		fz::scoped_lock l(mtx_);
+		while (done_ < processes) {
+			auto const remaining = deadline - fz::monotonic_clock::now();
+			if (remaining <= fz::duration()) {
+				return false;
+			}
+			cond_.wait(l, remaining);
+		}
+		return true;
+	}
+
+	std::string output(fz::process & p)
+	{
+		fz::scoped_lock l(mtx_);
+		return states_[&p].output_;
+	}
+
+	bool failed()
+	{
+		fz::scoped_lock l(mtx_);
+		return failed_;
+	}
+
+private:
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		fz::dispatch<fz::process_event>(ev, this, &process_handler::on_process);
+	}
+
+	void on_process(fz::process* p, fz::process_event_flag f)
+	{
+		fz::scoped_lock l(mtx_);
+		auto & state = states_[p];
+		if (f == fz::process_event_flag::write) {
+			while (state.written_ < state.input_.size()) {
+				auto const r = p->write(state.input_.data() + state.written_, state.input_.size() - state.written_);
+				if (!r) {
+					failed_ |= r.error_ != fz::rwresult::wouldblock;
+					return;
+				}
+				state.written_ += r.value_;
+			}
+		}
+		else {
+			char buf[4096];
+			while (true) {
+				auto const r = p->read(buf, sizeof(buf));
+				if (!r) {
+					failed_ |= r.error_ != fz::rwresult::wouldblock;
+					return;
+				}
+				if (!r.value_) {
+					++done_;
+					cond_.signal(l);
+					return;
+				}
+				state.output_.append(buf, r.value_);
+			}
+		}
+	}
+
+	struct state
+	{
+		std::string input_;
+		size_t written_{};
+		std::string output_;
+	};
+
+	fz::mutex mtx_;
+	fz::condition cond_;
+	std::map<fz::process*, state> states_;
+	size_t done_{};
+	bool failed_{};
+};
+}
+
+void process_test::test_redirect()
+{
+	fz::process p;
+	CPPUNIT_ASSERT(p.spawn(fz::native_string("/bin/echo"), {fz::native_string("foo"), fz::native_string("bar")}));
+	ASSERT_EQUAL(std::string("foo bar\n"), read_all(p));
+}
+
+void process_test::test_extra_fds()
+{
+	int fds[2];
+	CPPUNIT_ASSERT(!pipe(fds));
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	// Only the descriptors passed as extra descriptors are inherited
+	fz::process p;
+	std::string const script = "echo extra >&" + std::to_string(fds[1]);
+	CPPUNIT_ASSERT(p.spawn(fz::native_string("/bin/sh"), {fz::native_string("-c"), script}, {fds[1]}, fz::process::io_redirection::none));
+	close(fds[1]);
+
+	char buf[16]{};
+	ASSERT_EQUAL(ssize_t(6), read(fds[0], buf, sizeof(buf)));
+	ASSERT_EQUAL(std::string("extra\n"), std::string(buf, 6));
+	close(fds[0]);
+	p.kill();
+}
+
+void process_test::test_nonexisting()
+{
+	fz::process p;
+#ifdef __linux__
+	// Elsewhere the failure only shows in the exit code of the forked child
+	CPPUNIT_ASSERT(!p.spawn(fz::native_string("/nonexisting/program")));
+#else
+	p.spawn(fz::native_string("/nonexisting/program"));
+	p.kill();
+#endif
+
+	// Can be reused after failing
+	CPPUNIT_ASSERT(p.spawn(fz::native_string("/bin/echo"), {fz::native_string("ok")}));
+	ASSERT_EQUAL(std::string("ok\n"), read_all(p));
+}
+
+void process_test::test_events()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	process_handler handler(loop);
+
+	// Larger than the pipe buffers, both reading and writing have to wait
+	size_t const count = 32;
+	size_t const size = 256 * 1024;
+
+	std::vector<std::unique_ptr<fz::process>> processes;
+	std::vector<std::string> inputs;
+	for (size_t i = 0; i < count; ++i) {
+		processes.push_back(std::make_unique<fz::process>(pool, handler));
+		inputs.push_back(std::string(size, static_cast<char>('a' + i % 26)));
+		auto const script = fz::sprintf("head -c %d", size);
+		CPPUNIT_ASSERT(processes.back()->spawn(fz::native_string("/bin/sh"), {fz::native_string("-c"), script}));
+		handler.start(*processes.back(), inputs.back());
+	}
+
+	CPPUNIT_ASSERT(handler.wait(count));
+	CPPUNIT_ASSERT(!handler.failed());
+	for (size_t i = 0; i < count; ++i) {
+		CPPUNIT_ASSERT(handler.output(*processes[i]) == inputs[i]);
+		CPPUNIT_ASSERT(processes[i]->kill());
+	}
+}
+#endif
@@ -0,0 +1,204 @@
+#include "../lib/libfilezilla/process_pool.hpp"
+#include "../lib/libfilezilla/thread_pool.hpp"
+#include "../lib/libfilezilla/util.hpp"
+
+#include "test_utils.hpp"
+
+#include <set>
+
+#ifndef FZ_WINDOWS
+#include <signal.h>
+
+class process_pool_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(process_pool_test);
+	CPPUNIT_TEST(test_execute);
+	CPPUNIT_TEST(test_recycle);
+	CPPUNIT_TEST(test_crash);
+	CPPUNIT_TEST(test_idle_killed);
+	CPPUNIT_TEST(test_scaling);
+	CPPUNIT_TEST(test_stderr);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void test_execute();
+	void test_recycle();
+	void test_crash();
+	void test_idle_killed();
+	void test_scaling();
+	void test_stderr();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(process_pool_test);
+
+namespace {
+// Responds with the request followed by a colon and its pid, exits on a request of "crash",
+// writes more than a pipe buffer to stderr on a request of "noisy"
+char const worker_script[] = R"(
+while h=$(dd bs=1 count=4 2>/dev/null | od -An -tu1) && [ -n "$h" ]; do
+	set -- $h
+	p=$(dd bs=1 count=$(( ($1 << 24) | ($2 << 16) | ($3 << 8) | $4 )) 2>/dev/null)
+	[ "$p" = crash ] && exit 1
+	[ "$p" = noisy ] && head -c 200000 /dev/zero >&2
+	r="$p:$$"
+	n=${#r}
+	printf "\\$(printf %o $((n >> 24 & 255)))\\$(printf %o $((n >> 16 & 255)))\\$(printf %o $((n >> 8 & 255)))\\$(printf %o $((n & 255)))%s" "$r"
+done
+)";
+
+fz::process_pool::options worker_options()
+{
+	fz::process_pool::options opts;
+	opts.command = {fz::native_string("/bin/sh"), fz::native_string("-c"), fz::native_string(worker_script)};
+	return opts;
+}
+
+// Returns the pid of the worker, or an empty string if the response is not the echoed request
+std::string execute(fz::process_pool & pool, std::string const& request)
+{
+	std::string response;
+	if (!pool.execute(request, response) || !fz::starts_with(response, request + ":")) {
+		return std::string();
+	}
+	return response.substr(request.size() + 1);
+}
+}
+
+void process_pool_test::test_execute()
+{
+	auto opts = worker_options();
+	opts.min_workers = 1;
+	fz::process_pool pool(opts);
+	ASSERT_EQUAL(uint64_t(1), pool.get_stats().started);
+	ASSERT_EQUAL(size_t(1), pool.get_stats().idle);
+
+	// The prestarted worker handles all sequential jobs
+	auto const pid = execute(pool, "hello");
+	CPPUNIT_ASSERT(!pid.empty());
+	ASSERT_EQUAL(pid, execute(pool, "world"));
+	ASSERT_EQUAL(pid, execute(pool, ""));
+	ASSERT_EQUAL(pid, execute(pool, std::string(1000, 'x')));
+
+	auto const s = pool.get_stats();
+	ASSERT_EQUAL(uint64_t(4), s.jobs);
+	ASSERT_EQUAL(uint64_t(0), s.failed);
+	ASSERT_EQUAL(uint64_t(1), s.started);
+	ASSERT_EQUAL(size_t(1), s.workers);
+}
+
+void process_pool_test::test_recycle()
+{
+	auto opts = worker_options();
+	opts.max_jobs = 2;
+	fz::process_pool pool(opts);
+
+	std::set<std::string> pids;
+	for (size_t i = 0; i < 5; ++i) {
+		auto const pid = execute(pool, "job");
+		CPPUNIT_ASSERT(!pid.empty());
+		pids.insert(pid);
+	}
+	ASSERT_EQUAL(size_t(3), pids.size());
+
+	auto const s = pool.get_stats();
+	ASSERT_EQUAL(uint64_t(3), s.started);
+	ASSERT_EQUAL(uint64_t(2), s.recycled);
+}
+
+void process_pool_test::test_crash()
+{
+	auto opts = worker_options();
+	opts.min_workers = 1;
+	fz::process_pool pool(opts);
+
+	auto const pid = execute(pool, "before");
+	CPPUNIT_ASSERT(!pid.empty());
+
+	std::string response;
+	CPPUNIT_ASSERT(!pool.execute("crash", response));
+
+	// Has been replaced
+	auto const pid2 = execute(pool, "after");
+	CPPUNIT_ASSERT(!pid2.empty());
+	CPPUNIT_ASSERT(pid != pid2);
+
+	auto const s = pool.get_stats();
+	ASSERT_EQUAL(uint64_t(1), s.failed);
+	ASSERT_EQUAL(uint64_t(2), s.started);
+
+	opts.command = {fz::native_string("/nonexisting/program")};
+	fz::process_pool broken(opts);
+	CPPUNIT_ASSERT(!broken.execute("job", response));
+}
+
+void process_pool_test::test_idle_killed()
+{
+	auto opts = worker_options();
+	opts.min_workers = 1;
+	fz::process_pool pool(opts);
+
+	auto const pid = execute(pool, "before");
+	CPPUNIT_ASSERT(!pid.empty());
+	CPPUNIT_ASSERT(!kill(fz::to_integral<pid_t>(pid), SIGKILL));
+	fz::sleep(fz::duration::from_milliseconds(100));
+
+	// The dead worker is replaced instead of failing the job
+	auto const pid2 = execute(pool, "after");
+	CPPUNIT_ASSERT(!pid2.empty());
+	CPPUNIT_ASSERT(pid != pid2);
+
+	auto const s = pool.get_stats();
+	ASSERT_EQUAL(uint64_t(0), s.failed);
+	ASSERT_EQUAL(uint64_t(2), s.started);
+	ASSERT_EQUAL(size_t(1), s.workers);
+}
+
+void process_pool_test::test_scaling()
+{
+	auto opts = worker_options();
+	opts.max_workers = 3;
+	opts.idle_timeout = fz::duration::from_milliseconds(100);
+	fz::process_pool pool(opts);
+
+	size_t const count = 12;
+	std::vector<std::string> pids(count);
+	{
+		fz::thread_pool threads;
+		std::vector<fz::async_task> tasks;
+		for (size_t i = 0; i < count; ++i) {
+			tasks.push_back(threads.spawn([&, i]() {
+				pids[i] = execute(pool, fz::to_string(i));
+			}));
+		}
+	}
+	std::set<std::string> distinct;
+	for (auto const& pid : pids) {
+		CPPUNIT_ASSERT(!pid.empty());
+		distinct.insert(pid);
+	}
+	CPPUNIT_ASSERT(distinct.size() <= 3);
+
+	auto s = pool.get_stats();
+	CPPUNIT_ASSERT(s.workers <= 3);
+	ASSERT_EQUAL(s.workers, s.idle);
+	ASSERT_EQUAL(uint64_t(count), s.jobs);
+
+	// Idle workers are stopped once the next job finishes
+	fz::sleep(fz::duration::from_milliseconds(200));
+	CPPUNIT_ASSERT(!execute(pool, "last").empty());
+	s = pool.get_stats();
+	ASSERT_EQUAL(size_t(1), s.workers);
+}
+
+void process_pool_test::test_stderr()
+{
+	fz::process_pool pool(worker_options());
+
+	auto const pid = execute(pool, "noisy");
+	CPPUNIT_ASSERT(!pid.empty());
+	ASSERT_EQUAL(pid, execute(pool, "noisy"));
+}
+#endif
@@ -0,0 +1,148 @@
+#include "../lib/libfilezilla/file.hpp"
+#include "../lib/libfilezilla/format.hpp"
+#include "../lib/libfilezilla/local_filesys.hpp"
+#include "../lib/libfilezilla/recursive_remove.hpp"
+#include "../lib/libfilezilla/thread_pool.hpp"
+
+#include "test_utils.hpp"
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#include <unistd.h>
+
+class recursive_remove_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(recursive_remove_test);
+	CPPUNIT_TEST(test_remove);
+	CPPUNIT_TEST(test_parallel);
+	CPPUNIT_TEST(test_links);
+	CPPUNIT_TEST(test_stop);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void test_remove();
+	void test_parallel();
+	void test_links();
+	void test_stop();
+
+private:
+	temp_dir dir_;
+	fz::native_string root_;
+	fz::native_string outside_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(recursive_remove_test);
+
+namespace {
+// Enough files in one directory to be split into multiple chunks
+size_t const big_files = 3000;
+
+void create_tree(fz::native_string const& root)
+{
+	::mkdir(root.c_str(), 0700);
+	for (auto const& d : {"/a", "/a/b", "/a/b/c", "/d", "/big"}) {
+		::mkdir((root + d).c_str(), 0700);
+	}
+	for (auto const& f : {"/f1", "/a/f2", "/a/b/f3", "/a/b/c/f4", "/d/f5"}) {
+		fz::file file(root + f, fz::file::writing);
+	}
+	for (size_t i = 0; i < big_files; ++i) {
+		fz::file file(root + fz::sprintf("/big/%d", i), fz::file::writing);
+	}
+}
+
+class counting_remove final : public fz::recursive_remove
+{
+public:
+	virtual bool progress(uint64_t files, uint64_t dirs) override
+	{
+		// Never decreasing
+		consistent_ &= files >= files_ && dirs >= dirs_;
+		files_ = files;
+		dirs_ = dirs;
+		++calls_;
+		return calls_ <= stop_after_;
+	}
+
+	uint64_t files_{};
+	uint64_t dirs_{};
+	size_t calls_{};
+	size_t stop_after_{static_cast<size_t>(-1)};
+	bool consistent_{true};
+};
+}
+
+void recursive_remove_test::setUp()
+{
+	dir_.create("recursive_remove_test");
+	root_ = dir_.path("root");
+	outside_ = dir_.path("outside");
+	create_tree(root_);
+	::mkdir(outside_.c_str(), 0700);
+	fz::file file(outside_ + "/kept", fz::file::writing);
+}
+
+void recursive_remove_test::tearDown()
+{
+	dir_.remove();
+}
+
+void recursive_remove_test::test_remove()
+{
+	CPPUNIT_ASSERT(fz::recursive_remove().remove(root_ + "/"));
+	ASSERT_EQUAL(fz::local_filesys::unknown, fz::local_filesys::get_file_type(root_));
+}
+
+void recursive_remove_test::test_parallel()
+{
+	for (size_t threads : {1, 8}) {
+		fz::thread_pool pool;
+		counting_remove r;
+		CPPUNIT_ASSERT(r.remove(root_ + "/", pool, threads));
+		ASSERT_EQUAL(fz::local_filesys::unknown, fz::local_filesys::get_file_type(root_));
+		CPPUNIT_ASSERT(r.consistent_);
+		CPPUNIT_ASSERT(r.calls_ > 0);
+		ASSERT_EQUAL(uint64_t(5 + big_files), r.files_);
+		ASSERT_EQUAL(uint64_t(6), r.dirs_);
+
+		create_tree(root_);
+	}
+
+	// A missing root is an error, a plain file is simply removed
+	fz::thread_pool pool;
+	CPPUNIT_ASSERT(!fz::recursive_remove().remove(root_ + "/nonexisting", pool));
+	CPPUNIT_ASSERT(fz::recursive_remove().remove(root_ + "/f1", pool));
+	ASSERT_EQUAL(fz::local_filesys::unknown, fz::local_filesys::get_file_type(root_ + "/f1"));
+}
+
+void recursive_remove_test::test_links()
+{
+	// Links are removed, their targets are left alone
+	CPPUNIT_ASSERT(!::symlink("../../outside", (root_ + "/a/outside").c_str()));
+	CPPUNIT_ASSERT(!::symlink("../outside/kept", (root_ + "/kept").c_str()));
+
+	fz::native_string const link = dir_.path("link");
+	CPPUNIT_ASSERT(!::symlink("outside", link.c_str()));
+
+	fz::thread_pool pool;
+	CPPUNIT_ASSERT(fz::recursive_remove().remove(link, pool));
+	ASSERT_EQUAL(fz::local_filesys::unknown, fz::local_filesys::get_file_type(link, false));
+
+	CPPUNIT_ASSERT(fz::recursive_remove().remove(root_, pool));
+	ASSERT_EQUAL(fz::local_filesys::unknown, fz::local_filesys::get_file_type(root_));
+	ASSERT_EQUAL(fz::local_filesys::file, fz::local_filesys::get_file_type(outside_ + "/kept"));
+}
+
+void recursive_remove_test::test_stop()
+{
+	fz::thread_pool pool;
+	counting_remove r;
+	r.stop_after_ = 0;
+	CPPUNIT_ASSERT(!r.remove(root_, pool, 1));
+	ASSERT_EQUAL(size_t(1), r.calls_);
+	ASSERT_EQUAL(fz::local_filesys::dir, fz::local_filesys::get_file_type(root_));
+}
+#endif
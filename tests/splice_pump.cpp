@@ -0,0 +1,279 @@
+#include "../lib/libfilezilla/event_handler.hpp"
+#include "../lib/libfilezilla/event_loop.hpp"
+#include "../lib/libfilezilla/file.hpp"
+#include "../lib/libfilezilla/process.hpp"
+#include "../lib/libfilezilla/socket.hpp"
+#include "../lib/libfilezilla/thread_pool.hpp"
+
+#include "test_utils.hpp"
+
+#ifndef FZ_WINDOWS
+#include "../lib/libfilezilla/glue/unix.hpp"
+#include "../lib/libfilezilla/splice_pump.hpp"
+
+#include <unistd.h>
+
+class splice_pump_test final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(splice_pump_test);
+	CPPUNIT_TEST(test_process_to_file);
+	CPPUNIT_TEST(test_file_to_process);
+	CPPUNIT_TEST(test_file_to_socket);
+	CPPUNIT_TEST(test_socket_closed);
+	CPPUNIT_TEST(test_backpressure);
+	CPPUNIT_TEST(test_rate_limit);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void test_process_to_file();
+	void test_file_to_process();
+	void test_file_to_socket();
+	void test_socket_closed();
+	void test_backpressure();
+	void test_rate_limit();
+
+private:
+	temp_dir dir_;
+	fz::native_string name_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(splice_pump_test);
+
+namespace {
+class pump_handler final : public fz::event_handler
+{
+public:
+	pump_handler(fz::event_loop & loop)
+		: fz::event_handler(loop)
+	{}
+
+	virtual ~pump_handler()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		fz::dispatch<fz::pump_event>(ev, this, &pump_handler::on_pump);
+	}
+
+	// Waits for the pump to finish or fail, returns all flags received
+	std::vector<fz::pump_event_flag> wait()
+	{
+		auto const deadline = fz::monotonic_clock::now() + fz::duration::from_seconds(30);
+
+		fz::scoped_lock l(mtx_);
+		while (!done_) {
+			auto const remaining = deadline - fz::monotonic_clock::now();
+			if (remaining <= fz::duration()) {
+				break;
+			}
+			cond_.wait(l, remaining);
+		}
+		return flags_;
+	}
+
+private:
+	void on_pump(fz::splice_pump*, fz::pump_event_flag f)
+	{
+		fz::scoped_lock l(mtx_);
+		flags_.push_back(f);
+		if (f == fz::pump_event_flag::finished || f == fz::pump_event_flag::failed) {
+			done_ = true;
+			cond_.signal(l);
+		}
+	}
+
+	fz::mutex mtx_;
+	fz::condition cond_;
+	std::vector<fz::pump_event_flag> flags_;
+	bool done_{};
+};
+
+bool finished(std::vector<fz::pump_event_flag> const& flags)
+{
+	return !flags.empty() && flags.back() == fz::pump_event_flag::finished;
+}
+
+void create_file(fz::native_string const& name, size_t size)
+{
+	fz::file f(name, fz::file::writing, fz::file::empty);
+	std::string const data(size, 'x');
+	CPPUNIT_ASSERT(f.write(data.data(), static_cast<int64_t>(data.size())) == static_cast<int64_t>(data.size()));
+}
+}
+
+void splice_pump_test::setUp()
+{
+	dir_.create("splice_pump_test");
+	name_ = dir_.path("file");
+}
+
+void splice_pump_test::tearDown()
+{
+	dir_.remove();
+}
+
+void splice_pump_test::test_process_to_file()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	pump_handler handler(loop);
+
+	fz::process p;
+	CPPUNIT_ASSERT(p.spawn(fz::native_string("/bin/sh"), {fz::native_string("-c"), fz::native_string("yes 0123456789abcde | head -c 1000000")}));
+
+	fz::file f(name_, fz::file::writing, fz::file::empty);
+	{
+		fz::splice_pump pump(pool, handler, p, f);
+		CPPUNIT_ASSERT(finished(handler.wait()));
+		ASSERT_EQUAL(uint64_t(1000000), pump.transferred());
+	}
+	ASSERT_EQUAL(int64_t(1000000), f.size());
+
+	fz::file r(name_, fz::file::reading);
+	r.seek(999984, fz::file::begin);
+	char buf[16];
+	ASSERT_EQUAL(int64_t(16), r.read(buf, 16));
+	ASSERT_EQUAL(std::string("0123456789abcde\n"), std::string(buf, 16));
+}
+
+void splice_pump_test::test_file_to_process()
+{
+	create_file(name_, 300000);
+
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	pump_handler handler(loop);
+
+	fz::process p;
+	CPPUNIT_ASSERT(p.spawn(fz::native_string("/bin/sh"), {fz::native_string("-c"), fz::native_string("head -c 300000 | wc -c")}));
+
+	fz::file f(name_, fz::file::reading);
+	{
+		fz::splice_pump pump(pool, handler, f, p);
+		CPPUNIT_ASSERT(finished(handler.wait()));
+	}
+
+	std::string output;
+	char buf[64];
+	while (true) {
+		auto const r = p.read(buf, sizeof(buf));
+		if (!r || !r.value_) {
+			break;
+		}
+		output.append(buf, r.value_);
+	}
+	ASSERT_EQUAL(std::string("300000"), fz::trimmed(output));
+}
+
+void splice_pump_test::test_file_to_socket()
+{
+	create_file(name_, 500000);
+
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	pump_handler handler(loop);
+
+	int fds[2];
+	CPPUNIT_ASSERT(fz::create_socketpair(fds));
+	int error{};
+	auto s = fz::socket::from_descriptor(fz::socket_descriptor(fds[0]), pool, error);
+	CPPUNIT_ASSERT(s);
+
+	// Neither end is a pipe
+	fz::file f(name_, fz::file::reading);
+	fz::splice_pump pump(pool, handler, f, *s);
+
+	size_t received{};
+	char buf[65536];
+	while (received < 500000) {
+		ssize_t const r = read(fds[1], buf, sizeof(buf));
+		if (r <= 0) {
+			break;
+		}
+		received += static_cast<size_t>(r);
+	}
+	close(fds[1]);
+	ASSERT_EQUAL(size_t(500000), received);
+	CPPUNIT_ASSERT(finished(handler.wait()));
+	ASSERT_EQUAL(uint64_t(500000), pump.transferred());
+}
+
+void splice_pump_test::test_socket_closed()
+{
+	create_file(name_, 500000);
+
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	pump_handler handler(loop);
+
+	int fds[2];
+	CPPUNIT_ASSERT(fz::create_socketpair(fds));
+	int error{};
+	auto s = fz::socket::from_descriptor(fz::socket_descriptor(fds[0]), pool, error);
+	CPPUNIT_ASSERT(s);
+	close(fds[1]);
+
+	fz::file f(name_, fz::file::reading);
+	fz::splice_pump pump(pool, handler, f, *s);
+
+	auto const flags = handler.wait();
+	CPPUNIT_ASSERT(!flags.empty());
+	ASSERT_EQUAL(fz::pump_event_flag::failed, flags.back());
+}
+
+void splice_pump_test::test_backpressure()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	pump_handler handler(loop);
+
+	fz::process producer;
+	CPPUNIT_ASSERT(producer.spawn(fz::native_string("/bin/sh"), {fz::native_string("-c"), fz::native_string("head -c 1000000 /dev/zero")}));
+
+	// Does not read for a while, so the pipe to it fills up
+	fz::process consumer;
+	CPPUNIT_ASSERT(consumer.spawn(fz::native_string("/bin/sh"), {fz::native_string("-c"), fz::native_string("sleep 0.3; cat > /dev/null")}));
+
+	fz::splice_pump pump(pool, handler, producer, consumer);
+	auto const flags = handler.wait();
+	CPPUNIT_ASSERT(finished(flags));
+	ASSERT_EQUAL(uint64_t(1000000), pump.transferred());
+
+	CPPUNIT_ASSERT(flags.size() >= 3);
+	ASSERT_EQUAL(fz::pump_event_flag::stalled, flags[0]);
+	ASSERT_EQUAL(fz::pump_event_flag::resumed, flags[1]);
+}
+
+void splice_pump_test::test_rate_limit()
+{
+	create_file(name_, 0);
+
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	pump_handler handler(loop);
+
+	fz::rate_limit_manager mgr(loop);
+	fz::rate_limiter limiter(&mgr);
+	limiter.set_limits(fz::rate::unlimited, 1000000);
+
+	fz::process p;
+	CPPUNIT_ASSERT(p.spawn(fz::native_string("/bin/sh"), {fz::native_string("-c"), fz::native_string("head -c 1500000 /dev/zero")}));
+
+	fz::file f(name_, fz::file::writing, fz::file::empty);
+	fz::splice_pump::options opts;
+	opts.limiter = &limiter;
+
+	auto const start = fz::monotonic_clock::now();
+	fz::splice_pump pump(pool, handler, p, f, opts);
+	CPPUNIT_ASSERT(finished(handler.wait()));
+	auto const elapsed = fz::monotonic_clock::now() - start;
+
+	ASSERT_EQUAL(uint64_t(1500000), pump.transferred());
+	CPPUNIT_ASSERT(elapsed >= fz::duration::from_milliseconds(400));
+}
+#endif
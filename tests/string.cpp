@@ -1,3 +1,4 @@
+#include "../lib/libfilezilla/buffer.hpp"
 #include "../lib/libfilezilla/encode.hpp"
 #include "../lib/libfilezilla/string.hpp"
 
@@ -14,7 +15,13 @@ class string_test final : public CppUnit::TestFixture
 	CPPUNIT_TEST(test_conversion2);
 	CPPUNIT_TEST(test_conversion_utf8);
 	CPPUNIT_TEST(test_conversion_null);
+	CPPUNIT_TEST(test_conversion_utf8_long);
+	CPPUNIT_TEST(test_conversion_utf8_invalid);
 	CPPUNIT_TEST(test_base64);
+	CPPUNIT_TEST(test_base64_long);
+	CPPUNIT_TEST(test_base64_streaming);
+	CPPUNIT_TEST(test_base32);
+	CPPUNIT_TEST(test_hex);
 	CPPUNIT_TEST(test_trim);
 	CPPUNIT_TEST(test_strtok);
 	CPPUNIT_TEST(test_startsendswith);
@@ -29,7 +36,13 @@ public:
 	void test_conversion2();
 	void test_conversion_utf8();
 	void test_conversion_null();
+	void test_conversion_utf8_long();
+	void test_conversion_utf8_invalid();
 	void test_base64();
+	void test_base64_long();
+	void test_base64_streaming();
+	void test_base32();
+	void test_hex();
 	void test_trim();
 	void test_strtok();
 	void test_startsendswith();
@@ -119,6 +132,59 @@ void string_test::test_conversion_null()
 	}
 }
 
+void string_test::test_conversion_utf8_long()
+{
+	// Long enough to exercise the vectorized ASCII path, with multi-byte characters at various block offsets
+	std::wstring w;
+	std::string u;
+	for (size_t i = 0; i < 200; ++i) {
+		w += L"abcdefghijklmnopq";
+		u += "abcdefghijklmnopq";
+		if (i % 3 == 0) {
+			w += wchar_t(0xf6);
+			u += "\xc3\xb6";
+		}
+		if (i % 5 == 0) {
+			w += wchar_t(0x20ac);
+			u += "\xe2\x82\xac";
+		}
+		if (i % 7 == 0) {
+			w += wchar_t(0x1f600);
+			u += "\xf0\x9f\x98\x80";
+		}
+	}
+
+	ASSERT_EQUAL(u, fz::to_utf8(w));
+	ASSERT_EQUAL(w, fz::to_wstring_from_utf8(u));
+}
+
+void string_test::test_conversion_utf8_invalid()
+{
+	// Truncated sequences
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("abc\xc3"));
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("abc\xe2\x82"));
+	// Stray continuation octet
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("abc\x80"));
+	// Overlong forms
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("\xc0\xaf"));
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("\xe0\x80\xaf"));
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("\xf0\x80\x80\xaf"));
+	// Surrogates
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("\xed\xa0\x80"));
+	// Beyond U+10FFFF
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("\xf4\x90\x80\x80"));
+	ASSERT_EQUAL(std::wstring(), fz::to_wstring_from_utf8("\xf5\x80\x80\x80"));
+
+	// Boundaries
+	ASSERT_EQUAL(std::wstring(1, wchar_t(0xd7ff)), fz::to_wstring_from_utf8("\xed\x9f\xbf"));
+	ASSERT_EQUAL(std::wstring(1, wchar_t(0xe000)), fz::to_wstring_from_utf8("\xee\x80\x80"));
+	if constexpr (sizeof(wchar_t) == 4) {
+		ASSERT_EQUAL(std::wstring(1, wchar_t(0x10ffff)), fz::to_wstring_from_utf8("\xf4\x8f\xbf\xbf"));
+		ASSERT_EQUAL(std::string(), fz::to_utf8(std::wstring(1, wchar_t(0x110000))));
+		ASSERT_EQUAL(std::string(), fz::to_utf8(std::wstring(L"abc") + wchar_t(0xd800)));
+	}
+}
+
 void string_test::test_base64()
 {
 	CPPUNIT_ASSERT_EQUAL(std::string(""),         fz::base64_encode(""));
@@ -163,6 +229,127 @@ void string_test::test_base64()
 	CPPUNIT_ASSERT_EQUAL(std::string(""), fz::base64_decode_s("Zm9vbHM=Zg=="));
 }
 
+namespace {
+std::string make_octets(size_t n)
+{
+	std::string ret;
+	for (size_t i = 0; i < n; ++i) {
+		ret += static_cast<char>((i * 7 + i / 256) & 0xff);
+	}
+	return ret;
+}
+}
+
+void string_test::test_base64_long()
+{
+	// Long enough for the vectorized code paths, with all possible tail lengths
+	for (size_t n = 90; n < 96; ++n) {
+		std::string const data = make_octets(n);
+
+		std::string const encoded = fz::base64_encode(data);
+		CPPUNIT_ASSERT_EQUAL(((n + 2) / 3) * 4, encoded.size());
+		CPPUNIT_ASSERT_EQUAL(data, fz::base64_decode_s(encoded));
+
+		std::string const url = fz::base64_encode(data, fz::base64_type::url, false);
+		CPPUNIT_ASSERT_EQUAL(data, fz::base64_decode_s(url));
+
+		// Whitespace inside the vectorized blocks
+		std::string wrapped = encoded;
+		wrapped.insert(40, "\r\n");
+		wrapped.insert(17, " ");
+		CPPUNIT_ASSERT_EQUAL(data, fz::base64_decode_s(wrapped));
+
+		// Invalid character inside a vectorized block
+		std::string bad = encoded;
+		bad[21] = '*';
+		CPPUNIT_ASSERT_EQUAL(std::string(), fz::base64_decode_s(bad));
+	}
+}
+
+void string_test::test_base64_streaming()
+{
+	std::string const data = make_octets(1000);
+	std::string const encoded = fz::base64_encode(data);
+
+	for (size_t chunk : {1, 2, 5, 64, 999}) {
+		fz::base64_encoder enc;
+		fz::buffer out;
+		for (size_t i = 0; i < data.size(); i += chunk) {
+			enc.encode(std::string_view(data).substr(i, chunk), out);
+		}
+		enc.finalize(out);
+		CPPUNIT_ASSERT_EQUAL(encoded, std::string(out.to_view()));
+
+		fz::base64_decoder dec;
+		fz::buffer decoded;
+		for (size_t i = 0; i < encoded.size(); i += chunk) {
+			CPPUNIT_ASSERT(dec.decode(std::string_view(encoded).substr(i, chunk), decoded));
+		}
+		CPPUNIT_ASSERT(dec.finalize(decoded));
+		CPPUNIT_ASSERT_EQUAL(data, std::string(decoded.to_view()));
+	}
+
+	fz::base64_decoder dec;
+	fz::buffer decoded;
+	CPPUNIT_ASSERT(dec.decode("Zm9v", decoded));
+	CPPUNIT_ASSERT(dec.decode("bA=", decoded));
+	CPPUNIT_ASSERT(dec.decode("=\n", decoded));
+	CPPUNIT_ASSERT(!dec.decode("Zg", decoded));
+	CPPUNIT_ASSERT(!dec.finalize(decoded));
+
+	decoded.clear();
+	CPPUNIT_ASSERT(dec.decode("Zm9vbHM", decoded));
+	CPPUNIT_ASSERT(dec.finalize(decoded));
+	CPPUNIT_ASSERT_EQUAL(std::string("fools"), std::string(decoded.to_view()));
+
+	CPPUNIT_ASSERT(dec.decode("Z", decoded));
+	CPPUNIT_ASSERT(!dec.finalize(decoded));
+}
+
+void string_test::test_base32()
+{
+	// Test vectors from RFC 4648
+	CPPUNIT_ASSERT_EQUAL(std::string(""), fz::base32_encode(""));
+	CPPUNIT_ASSERT_EQUAL(std::string("MY======"), fz::base32_encode("f"));
+	CPPUNIT_ASSERT_EQUAL(std::string("MZXQ===="), fz::base32_encode("fo"));
+	CPPUNIT_ASSERT_EQUAL(std::string("MZXW6==="), fz::base32_encode("foo"));
+	CPPUNIT_ASSERT_EQUAL(std::string("MZXW6YQ="), fz::base32_encode("foob"));
+	CPPUNIT_ASSERT_EQUAL(std::string("MZXW6YTB"), fz::base32_encode("fooba"));
+	CPPUNIT_ASSERT_EQUAL(std::string("MZXW6YTBOI======"), fz::base32_encode("foobar"));
+	CPPUNIT_ASSERT_EQUAL(std::string("CPNMUOJ1E8======"), fz::base32_encode("foobar", fz::base32_type::base32hex));
+
+	CPPUNIT_ASSERT_EQUAL(std::string("foobar"), fz::base32_decode_s("MZXW6YTBOI======"));
+	CPPUNIT_ASSERT_EQUAL(std::string("foobar"), fz::base32_decode_s("MZXW6YTBOI"));
+	CPPUNIT_ASSERT_EQUAL(std::string("foobar"), fz::base32_decode_s("MZXW 6YTB\nOI======"));
+	CPPUNIT_ASSERT_EQUAL(std::string("foobar"), fz::base32_decode_s("CPNMUOJ1E8======", fz::base32_type::base32hex));
+	CPPUNIT_ASSERT_EQUAL(std::string(""), fz::base32_decode_s("MZXW6YT!OI======"));
+
+	for (auto type : {fz::base32_type::standard, fz::base32_type::base32hex, fz::base32_type::locale_safe}) {
+		std::string const data = make_octets(123);
+		CPPUNIT_ASSERT_EQUAL(data, fz::base32_decode_s(fz::base32_encode(data, type), type));
+		CPPUNIT_ASSERT_EQUAL(data, fz::base32_decode_s(fz::base32_encode(data, type, false), type));
+	}
+}
+
+void string_test::test_hex()
+{
+	CPPUNIT_ASSERT_EQUAL(std::string("00017f80ff"), fz::hex_encode<std::string>(std::string({0, 1, 0x7f, '\x80', '\xff'})));
+	CPPUNIT_ASSERT_EQUAL(std::string("00017F80FF"), (fz::hex_encode<std::string, std::string, false>(std::string({0, 1, 0x7f, '\x80', '\xff'}))));
+	ASSERT_EQUAL(std::wstring(L"00017f80ff"), fz::hex_encode<std::wstring>(std::string({0, 1, 0x7f, '\x80', '\xff'})));
+
+	std::string const data = make_octets(100);
+	std::string const encoded = fz::hex_encode<std::string>(data);
+	CPPUNIT_ASSERT_EQUAL(size_t(200), encoded.size());
+	CPPUNIT_ASSERT_EQUAL(data, fz::hex_decode<std::string>(encoded));
+	CPPUNIT_ASSERT_EQUAL(data, fz::hex_decode<std::string>(fz::str_toupper_ascii(encoded)));
+	CPPUNIT_ASSERT_EQUAL(data, fz::hex_decode<std::string>(fz::to_wstring(encoded)));
+
+	std::string bad = encoded;
+	bad[50] = 'g';
+	CPPUNIT_ASSERT(fz::hex_decode(bad).empty());
+	CPPUNIT_ASSERT(fz::hex_decode(encoded.substr(1)).empty());
+}
+
 void string_test::test_trim()
 {
 	CPPUNIT_ASSERT_EQUAL(std::string("foo"), fz::trimmed(std::string("foo")));
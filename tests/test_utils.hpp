@@ -1,11 +1,20 @@
 #ifndef LIBFILEZILLA_TEST_UTILS_HEADER
 #define LIBFILEZILLA_TEST_UTILS_HEADER
 
+#include "../lib/libfilezilla/format.hpp"
+#include "../lib/libfilezilla/recursive_remove.hpp"
 #include "../lib/libfilezilla/string.hpp"
+#include "../lib/libfilezilla/util.hpp"
 
 #include <cppunit/TestAssert.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#ifdef FZ_WINDOWS
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
 template<typename T>
 std::string inline value_to_string(T const& t, typename std::enable_if_t<std::is_enum_v<T>>* = nullptr)
 {
@@ -41,4 +50,70 @@ void inline assert_equal_data(V const& expected, V const& actual, std::string co
 #define ASSERT_EQUAL_DATA(expected, actual, data) assert_equal_data((expected), (actual), #actual, data, CPPUNIT_SOURCELINE())
 #define ASSERT_EQUAL(expected, actual) assert_equal_data((expected), (actual), #actual, std::string(), CPPUNIT_SOURCELINE())
 
+// A random name in the current directory
+fz::native_string inline temp_name(std::string_view const& prefix)
+{
+	return fz::to_native(fz::sprintf("%s_%d.tmp", prefix, fz::random_number(0, 1000000000)));
+}
+
+// Data without short repetitions, to detect misplaced blocks
+std::string inline pattern(size_t size)
+{
+	std::string ret;
+	ret.reserve(size);
+	for (size_t i = 0; i < size; ++i) {
+		ret += static_cast<char>('a' + (i * 7 + i / 251) % 26);
+	}
+	return ret;
+}
+
+/*
+ * A directory holding everything a test creates. Fixtures create it in setUp()
+ * and remove it in tearDown() together with all its contents, so nothing is
+ * left behind even if a test fails halfway.
+ */
+class temp_dir final
+{
+public:
+	temp_dir() = default;
+
+	temp_dir(temp_dir const&) = delete;
+	temp_dir& operator=(temp_dir const&) = delete;
+
+	~temp_dir()
+	{
+		remove();
+	}
+
+	void create(std::string_view const& prefix)
+	{
+		remove();
+		path_ = temp_name(prefix);
+#ifdef FZ_WINDOWS
+		CPPUNIT_ASSERT(!_wmkdir(path_.c_str()));
+#else
+		CPPUNIT_ASSERT(!::mkdir(path_.c_str(), 0700));
+#endif
+	}
+
+	void remove()
+	{
+		if (!path_.empty()) {
+			fz::recursive_remove().remove(path_);
+			path_.clear();
+		}
+	}
+
+	fz::native_string const& path() const { return path_; }
+
+	// Path of an entry in the directory
+	fz::native_string path(std::string_view const& name) const
+	{
+		return path_ + fzT("/") + fz::to_native(name);
+	}
+
+private:
+	fz::native_string path_;
+};
+
 #endif
@@ -3,6 +3,7 @@
 
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <stdlib.h>
 #include <unistd.h>
 
 class TimeTest final : public CppUnit::TestFixture
@@ -13,6 +14,9 @@ class TimeTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testAlternateMidnight);
 	CPPUNIT_TEST(testRFC822);
 	CPPUNIT_TEST(testRFC3339);
+	CPPUNIT_TEST(testFormatter);
+	CPPUNIT_TEST(testMicroseconds);
+	CPPUNIT_TEST(testClockSources);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -26,6 +30,11 @@ public:
 
 	void testRFC822();
 	void testRFC3339();
+
+	void testFormatter();
+
+	void testMicroseconds();
+	void testClockSources();
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TimeTest);
@@ -141,3 +150,117 @@ void TimeTest::testRFC3339()
 	CPPUNIT_ASSERT(t.set_rfc3339(s2));
 	CPPUNIT_ASSERT(t == t2);
 }
+
+void TimeTest::testFormatter()
+{
+	fz::timestamp_formatter f;
+
+	fz::datetime const t1(fz::datetime::utc, 1985, 4, 12, 23, 20, 50, 52);
+	CPPUNIT_ASSERT_EQUAL(std::string("1985-04-12T23:20:50.052Z"), f.iso8601(t1, fz::datetime::utc));
+	CPPUNIT_ASSERT_EQUAL(std::string("1985-04-12T23:20:50Z"), f.iso8601(t1, fz::datetime::utc, false));
+	CPPUNIT_ASSERT_EQUAL(std::string("Fri, 12 Apr 1985 23:20:50 GMT"), f.rfc822(t1));
+	CPPUNIT_ASSERT_EQUAL(std::string(), f.rfc822(fz::datetime()));
+
+	fz::datetime const pre(fz::datetime::utc, 1957, 10, 4, 19, 28, 34, 1);
+	CPPUNIT_ASSERT_EQUAL(std::string("1957-10-04T19:28:34.001Z"), f.iso8601(pre, fz::datetime::utc));
+	CPPUNIT_ASSERT_EQUAL(std::string("1969-12-31T23:59:59.999Z"), f.iso8601(fz::datetime(fz::datetime::utc, 1970, 1, 1, 0, 0, 0, 0) - fz::duration::from_milliseconds(1), fz::datetime::utc));
+
+	fz::datetime const now(fz::datetime::utc, 2020, 3, 2, 12, 35, 0);
+	CPPUNIT_ASSERT_EQUAL(std::string("Feb  9 08:05"), f.listing(fz::datetime(fz::datetime::utc, 2020, 2, 9, 8, 5), fz::datetime::utc, now));
+	CPPUNIT_ASSERT_EQUAL(std::string("Aug 10  2019"), f.listing(fz::datetime(fz::datetime::utc, 2019, 8, 10, 8, 5), fz::datetime::utc, now));
+	CPPUNIT_ASSERT_EQUAL(std::string("Mar  3  2020"), f.listing(fz::datetime(fz::datetime::utc, 2020, 3, 3, 8, 5), fz::datetime::utc, now));
+
+	// Compare against strftime over a wide range, with consecutive seconds hitting the cache
+	char const* old_tz = getenv("TZ");
+	std::string const saved_tz = old_tz ? old_tz : "";
+	setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+	tzset();
+
+	fz::datetime t(fz::datetime::utc, 1900, 1, 1, 0, 0, 0, 0);
+	for (int i = 0; i < 5000; ++i) {
+		t += fz::duration::from_seconds(i % 4 ? 1 : 12345678);
+		for (auto z : {fz::datetime::utc, fz::datetime::local}) {
+			std::string expected = t.format("%Y-%m-%dT%H:%M:%S", z);
+			if (z == fz::datetime::utc) {
+				expected += 'Z';
+			}
+			else {
+				std::string const offset = t.format("%z", z);
+				expected += offset.substr(0, 3) + ":" + offset.substr(3);
+			}
+			CPPUNIT_ASSERT_EQUAL(expected, f.iso8601(t, z, false));
+		}
+		CPPUNIT_ASSERT_EQUAL(t.format("%a, %d %b %Y %H:%M:%S GMT", fz::datetime::utc), f.rfc822(t));
+	}
+
+	// Across a DST transition
+	fz::datetime dst(fz::datetime::utc, 2020, 3, 29, 0, 59, 59);
+	CPPUNIT_ASSERT_EQUAL(std::string("2020-03-29T01:59:59+01:00"), f.iso8601(dst, fz::datetime::local, false));
+	dst += fz::duration::from_seconds(1);
+	CPPUNIT_ASSERT_EQUAL(std::string("2020-03-29T03:00:00+02:00"), f.iso8601(dst, fz::datetime::local, false));
+
+	if (old_tz) {
+		setenv("TZ", saved_tz.c_str(), 1);
+	}
+	else {
+		unsetenv("TZ");
+	}
+	tzset();
+}
+
+void TimeTest::testMicroseconds()
+{
+	auto const d = fz::duration::from_microseconds(1500);
+	CPPUNIT_ASSERT_EQUAL(int64_t(1500), d.get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(1), d.get_milliseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(3000000), fz::duration::from_seconds(3).get_microseconds());
+	CPPUNIT_ASSERT(fz::duration::from_microseconds(999) < fz::duration::from_milliseconds(1));
+	CPPUNIT_ASSERT(fz::duration::from_microseconds(1));
+
+	auto const start = fz::monotonic_clock::now();
+	auto const later = start + fz::duration::from_microseconds(250);
+	CPPUNIT_ASSERT_EQUAL(int64_t(250), (later - start).get_microseconds());
+
+	// Adding sub-millisecond parts to a timestamp with millisecond accuracy truncates them
+	fz::datetime const t(fz::datetime::utc, 2020, 1, 1, 0, 0, 0, 0);
+	CPPUNIT_ASSERT((t + fz::duration::from_microseconds(1999)) == (t + fz::duration::from_milliseconds(1)));
+
+	fz::sleep(fz::duration::from_microseconds(500));
+	CPPUNIT_ASSERT((fz::monotonic_clock::now() - start).get_microseconds() >= 500);
+}
+
+void TimeTest::testClockSources()
+{
+	using source = fz::monotonic_clock::source;
+
+	CPPUNIT_ASSERT(fz::monotonic_clock::available(source::standard));
+
+	for (auto s : {source::standard, source::coarse, source::tsc}) {
+		auto const res = fz::monotonic_clock::resolution(s);
+		CPPUNIT_ASSERT(res.get_microseconds() >= 1);
+
+		auto const before = fz::monotonic_clock::now();
+		auto const t1 = fz::monotonic_clock::now(s);
+		auto const t2 = fz::monotonic_clock::now(s);
+		auto const after = fz::monotonic_clock::now();
+
+		CPPUNIT_ASSERT(t1);
+		CPPUNIT_ASSERT(t1 <= t2);
+
+		// Sources are comparable with each other
+		if (s == source::coarse) {
+			// Lags behind by about its resolution, possibly more on tickless systems
+			CPPUNIT_ASSERT(t1 <= after);
+			CPPUNIT_ASSERT(t1 + res + fz::duration::from_milliseconds(100) >= before);
+		}
+		else {
+			CPPUNIT_ASSERT((t1 - before).absolute() < fz::duration::from_milliseconds(5));
+			CPPUNIT_ASSERT((after - t2).absolute() < fz::duration::from_milliseconds(5));
+		}
+
+		fz::sleep(fz::duration::from_milliseconds(20));
+		auto const elapsed = fz::monotonic_clock::now(s) - t2;
+		CPPUNIT_ASSERT(elapsed + res + fz::duration::from_milliseconds(10) >= fz::duration::from_milliseconds(20));
+		CPPUNIT_ASSERT(elapsed < fz::duration::from_seconds(2));
+	}
+}